@@ -0,0 +1,103 @@
+#!/usr/bin/env python
+'''
+                delay_dump2txt.py
+
+Synopsis:
+    Convert a binary delay dump file, written by sirocco when it is run
+    with -binary_delay_dump, to the text format of the .delay_dump file
+    written by default, so that it can be read by existing tools such as
+    py4py.reverb
+
+Usage:
+    Either import as a module in a python session e.g.
+    from delay_dump2txt import read_delay_dump, delay_dump2txt
+
+    or run from the command line e.g.
+
+    delay_dump2txt.py root
+
+Arguments:
+    root
+        root filename of the run. root.delay_dump.bin is read and
+        root.delay_dump is written. A different output file can be
+        given as a second argument.
+
+Notes:
+    The binary file starts with a header, followed by fixed size records,
+    one per photon. The layout must match delay_dump_header and
+    delay_dump_record in source/reverb.c.
+'''
+
+import sys
+import time
+import numpy as np
+
+C = 2.997925e10
+MAGIC = b"SIRDELAY"
+FORMAT_VERSION = 1
+
+HEADER = np.dtype([("magic", "S8"), ("version", "i4"), ("record_size", "i4"), ("n_doubles", "i4"),
+                   ("n_ints", "i4"), ("rank", "i4"), ("n_ranks", "i4")])
+
+RECORD = np.dtype([("freq", "f8"), ("w", "f8"), ("x", "f8"), ("y", "f8"), ("z", "f8"), ("delay", "f8"),
+                   ("np", "i4"), ("nscat", "i4"), ("nrscat", "i4"), ("spec", "i4"), ("origin", "i4"),
+                   ("nres", "i4"), ("line_res", "i4"), ("padding", "i4")])
+
+COLUMNS = ["Np", "Freq.", "Lambda", "Weight", "LastX", "LastY", "LastZ", "Scat.", "RScat.", "Delay", "Spec.",
+           "Orig.", "Res.", "LineRes."]
+
+
+def read_delay_dump(filename):
+    '''
+    Read a binary delay dump file, returning the header and a structured
+    array with one entry per photon
+    '''
+
+    with open(filename, "rb") as f:
+        header = np.fromfile(f, dtype=HEADER, count=1)
+        if len(header) != 1 or header["magic"][0] != MAGIC:
+            raise ValueError("{} is not a binary delay dump file".format(filename))
+        if header["version"][0] != FORMAT_VERSION or header["record_size"][0] != RECORD.itemsize:
+            raise ValueError("{} has format version {} and records of {} bytes, expected version {} and {} bytes".format(
+                filename, header["version"][0], header["record_size"][0], FORMAT_VERSION, RECORD.itemsize))
+        records = np.fromfile(f, dtype=RECORD)
+
+    return header[0], records
+
+
+def delay_dump2txt(root, outfile=None, chunk=100000):
+    '''
+    Convert root.delay_dump.bin to the text format, writing it to
+    root.delay_dump unless another output file is given
+    '''
+
+    header, records = read_delay_dump("{}.delay_dump.bin".format(root))
+
+    if outfile is None:
+        outfile = "{}.delay_dump".format(root)
+
+    fmt = "%-12d %-12.5g %-12.7g %-12.5g %-12.5g %-12.5g %-12.5g %-12d %-12d %-12.5g %-12d %-12d %-12d %-12d"
+
+    with open(outfile, "w") as f:
+        f.write("# Converted from the binary delay dump {}.delay_dump.bin\n".format(root))
+        f.write("# Date	{}\n#  \n".format(time.asctime()))
+        f.write("#\n# " + " ".join("{:<12s}".format(name) for name in COLUMNS).rstrip() + "\n")
+
+        for i in range(0, len(records), chunk):
+            r = records[i:i + chunk]
+            columns = [r["np"], r["freq"], C * 1e8 / r["freq"], r["w"], r["x"], r["y"], r["z"], r["nscat"],
+                       r["nrscat"], r["delay"], r["spec"], r["origin"], r["nres"], r["line_res"]]
+            table = np.empty(len(r), dtype=[("c{}".format(j), c.dtype) for j, c in enumerate(columns)])
+            for j, c in enumerate(columns):
+                table["c{}".format(j)] = c
+            np.savetxt(f, table, fmt=fmt)
+
+    print("Wrote {} photons to {}".format(len(records), outfile))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print(__doc__)
+        sys.exit(1)
+
+    delay_dump2txt(sys.argv[1], sys.argv[2] if len(sys.argv) > 2 else None)
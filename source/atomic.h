@@ -535,3 +535,7 @@ extern double charge_exchange_ioniz_rates[MAX_CHARGE_EXCHANGE]; //An array to st
 /* a variable which controls whether to save a summary of atomic data
    this is defined in atomic.h, rather than the modes structure */
 extern int write_atomicdata;
+
+/* a variable which controls whether get_atomic_data reads the atomic data from, and
+   saves it to, a binary image of the masterfile (see atomicdata_image.c) */
+extern int use_atomic_image;
@@ -91,3 +91,4 @@ double charge_exchange_recomb_rates[NIONS];     //An array to store the actual r
 double charge_exchange_ioniz_rates[MAX_CHARGE_EXCHANGE];        //An array to store the actual ionization rates for a given temperature
 
 int write_atomicdata;
+int use_atomic_image;
@@ -1,5 +1,6 @@
 /* atomicdata.c */
 int get_atomic_data(char masterfile[]);
+int check_atomic_data(int ierr);
 /* atomicdata_sub.c */
 int atomicdata2file(void);
 int index_lines(void);
@@ -15,3 +16,7 @@ double upsilon(int n_coll, double u0);
 void skiplines(FILE *fptr, int nskip);
 /* atomicdata_init.c */
 int init_atomic_data(void);
+/* atomicdata_image.c */
+int atomic_image_name(char masterfile[], char image[]);
+int write_atomic_image(char masterfile[]);
+int read_atomic_image(char masterfile[]);
@@ -89,6 +89,10 @@
  * one should avoid calling routines like Exit(0) that are very sirocco centric.  It's important
  * that future modifications to get_atomic_data maintain this independence.
  *
+ * If use_atomic_image is set, the data are read from a binary image of the masterfile
+ * made on a previous call, if the image is up to date, and otherwise the image is
+ * made once the text files have been read.  See atomicdata_image.c
+ *
  *
  *
  **********************************************************/
@@ -104,7 +108,7 @@ get_atomic_data (masterfile)
   char file[LINELENGTH];
 
   char word[LINELENGTH];
-  int n, m, i, j;
+  int n, m, j;
   int n1, n2;                   //081115 nsh two new counters for DR - use new pointers to avoid any clashes!
   int nparam;                   //081115 nsh temperary holder for number of DR parameters
   double drp[MAX_DR_PARAMS];    //081115 nsh array to hold DR parameters prior to putting into structure
@@ -144,7 +148,6 @@ get_atomic_data (masterfile)
   int nions_simple, nions_macro;
   int nlevels_simple;
   int ntop_phot_simple, ntop_phot_macro;
-  int bb_max, bf_max;
   int lev_type;
   int nn;
   double gstemp[BAD_GS_RR_PARAMS];      //Temporary storage for badnell resolved GS RR rates
@@ -165,6 +168,10 @@ get_atomic_data (masterfile)
   double dlambda;
 
 
+  /* Use the binary image of the atomic data instead of the text files, if it is up to date */
+  if (use_atomic_image && read_atomic_image (masterfile) == 0)
+    return (0);
+
   /* Initialize the atomic data structures and various counters */
   init_atomic_data ();
 
@@ -2763,6 +2770,61 @@ a total emission oscillator strength for the level....really ought to be radiati
     }
   }
 
+/* Check the data for consistency, and report how close we are to the limits of the structures */
+
+  check_atomic_data (ierr);
+
+
+
+  /* Finally create frequency ordered pointers to the various portions
+   * of the atomic data
+   */
+
+  /* Index the lines */
+  index_lines ();
+
+/* Index the topbase photoionization structure by threshold freqeuncy */
+  if (ntop_phot + nxphot > 0)
+    index_phot_top ();
+/* Index the topbase photoionization structure by threshold freqeuncy */
+  if (n_inner_tot > 0)
+    index_inner_cross ();
+
+
+  check_xsections ();           // debug routine, only prints if verbosity > 4
+
+  /* Save the data so that the text files need not be read again until they change */
+  if (use_atomic_image)
+    write_atomic_image (masterfile);
+
+  return (0);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Check the atomic data for consistency once they have been read
+ *
+ * @param [in] int  ierr   Non-zero if an inconsistency was already found while the data were read
+ * @return     Always returns 0, since the program exits if the data are inconsistent
+ *
+ * @details
+ * This is called by get_atomic_data once the text files have been read, and by
+ * read_atomic_image once a binary image has been read, so that the data are
+ * checked in the same way whichever was used.  It also reports how close the
+ * data are to the limits set in the structures, and writes the data to a file
+ * if this was requested, or if there were inconsistencies.
+ *
+ **********************************************************/
+
+int
+check_atomic_data (ierr)
+     int ierr;
+{
+  int n, i;
+  int bb_max, bf_max;
+
 /* Check that all of the macro_info variables are initialized to 1
 or zero so that simple checks of true and false can be used for them */
 
@@ -2877,24 +2939,5 @@ or zero so that simple checks of true and false can be used for them */
     Exit (0);
   }
 
-
-
-  /* Finally create frequency ordered pointers to the various portions
-   * of the atomic data
-   */
-
-  /* Index the lines */
-  index_lines ();
-
-/* Index the topbase photoionization structure by threshold freqeuncy */
-  if (ntop_phot + nxphot > 0)
-    index_phot_top ();
-/* Index the topbase photoionization structure by threshold freqeuncy */
-  if (n_inner_tot > 0)
-    index_inner_cross ();
-
-
-  check_xsections ();           // debug routine, only prints if verbosity > 4
-
   return (0);
 }
@@ -0,0 +1,641 @@
+
+/***********************************************************/
+/** @file  atomicdata_image.c
+ *
+ * @brief  Save the atomic data as a binary image, and read it back
+ *
+ * Reading the atomic data from the text files listed in a masterfile
+ * means parsing tens of MB of text, and when sirocco is run in parallel
+ * every MPI process does this at the same time.  The routines here
+ * write the structures filled by get_atomic_data to a single binary
+ * file, the image, which is named after the masterfile, and read it back,
+ * so that the text files need only be parsed when they change.
+ *
+ * The image begins with a header which records a format version, the sizes
+ * of the atomic data structures and the limits on the numbers of elements,
+ * ions, levels etc, a checksum of the data, and the size and modification time
+ * of the masterfile and of each of the files it lists.  An image is only used
+ * if all of these match, so it is rebuilt whenever the data files are
+ * changed, or sirocco is compiled with different structures.
+ *
+ * In parallel, only the root process reads the image, which is then
+ * broadcast to the other processes.
+ *
+ ***********************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "atomic.h"
+#include "sirocco.h"
+#include "log.h"
+// If routines are added cproto > atomic_proto.h should be run
+#include "atomic_proto.h"
+
+#define ATOMIC_IMAGE_MAGIC        "SIRATOM"
+#define ATOMIC_IMAGE_VERSION      1
+#define ATOMIC_IMAGE_NSIZES       26
+#define ATOMIC_IMAGE_MAX_SOURCES  500
+#define ATOMIC_IMAGE_MAX_SECTIONS 20
+#define ATOMIC_IMAGE_BCAST_CHUNK  (1 << 30)
+
+/** The header at the start of an image */
+typedef struct atomic_image_header
+{
+  char magic[8];
+  int version;
+  int nsources;                 /**< The number of source files, the masterfile and the files it lists */
+  int sizes[ATOMIC_IMAGE_NSIZES];       /**< The sizes of the structures and arrays when the image was written */
+  long payload_size;            /**< The number of bytes of atomic data which follow the list of source files */
+  unsigned long checksum;       /**< The FNV-1a checksum of the atomic data */
+} atomic_image_header;
+
+/** A record of one of the files from which the image was made */
+typedef struct atomic_image_source
+{
+  char name[LINELENGTH];
+  long size;
+  long mtime;
+} atomic_image_source;
+
+/** The numbers of entries read into each of the atomic data arrays, which
+ * is the first part of the atomic data in an image */
+typedef struct atomic_image_counts
+{
+  int nelements, nions, nlevels, nlte_levels, nlevels_macro;
+  int nlines, nlines_macro, n_inner_tot, nauger, nauger_macro;
+  int n_coll_stren, nxphot, ntop_phot, nphot_total, ndrecomb;
+  int n_total_rr, n_bad_gs_rr, n_dere_di_rate, gaunt_n_gsqrd, n_charge_exchange;
+  double phot_freq_min, inner_freq_min, rho2nh;
+} atomic_image_counts;
+
+/** A contiguous block of atomic data */
+typedef struct atomic_image_section
+{
+  void *ptr;
+  size_t size;
+} atomic_image_section;
+
+
+
+/**********************************************************/
+/**
+ * @brief      Construct the name of the image for a masterfile
+ *
+ * @param [in] char  masterfile[]   The masterfile
+ * @param [out] char  image[]   The name of the image, which must have space for LINELENGTH characters
+ * @return     Always returns 0
+ *
+ **********************************************************/
+
+int
+atomic_image_name (masterfile, image)
+     char masterfile[];
+     char image[];
+{
+  snprintf (image, LINELENGTH, "%s.image", masterfile);
+  return (0);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Record the size and modification time of the masterfile
+ * and of the data files that it lists
+ *
+ * @param [in] char  masterfile[]   The masterfile
+ * @param [out] atomic_image_source  src[]   The records for the files
+ * @return     The number of files, or -1 if one of them cannot be found
+ *
+ * @details
+ * The masterfile is read in the same way as in get_atomic_data, so that the
+ * files recorded are exactly the ones which would be read.
+ *
+ **********************************************************/
+
+static int
+atomic_image_sources (masterfile, src)
+     char masterfile[];
+     atomic_image_source src[];
+{
+  FILE *mptr;
+  char aline[LINELENGTH], file[LINELENGTH];
+  struct stat st;
+  int nsources;
+
+  if ((mptr = fopen (masterfile, "r")) == NULL || stat (masterfile, &st) != 0)
+  {
+    if (mptr != NULL)
+      fclose (mptr);
+    return (-1);
+  }
+
+  memset (&src[0], 0, sizeof (atomic_image_source));
+  strncpy (src[0].name, masterfile, LINELENGTH - 1);
+  src[0].size = st.st_size;
+  src[0].mtime = st.st_mtime;
+  nsources = 1;
+
+  while (fgets (aline, LINELENGTH, mptr) != NULL)
+  {
+    if (sscanf (aline, "%s", file) == 1 && file[0] != '#')
+    {
+      if (nsources == ATOMIC_IMAGE_MAX_SOURCES || stat (file, &st) != 0)
+      {
+        fclose (mptr);
+        return (-1);
+      }
+      memset (&src[nsources], 0, sizeof (atomic_image_source));
+      strcpy (src[nsources].name, file);
+      src[nsources].size = st.st_size;
+      src[nsources].mtime = st.st_mtime;
+      nsources++;
+    }
+  }
+
+  fclose (mptr);
+
+  return (nsources);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Record the sizes of the atomic data structures and the limits on their numbers
+ *
+ **********************************************************/
+
+static void
+atomic_image_sizes (sizes)
+     int sizes[];
+{
+  int n = 0;
+
+  sizes[n++] = sizeof (ele_dummy);
+  sizes[n++] = sizeof (ion_dummy);
+  sizes[n++] = sizeof (config_dummy);
+  sizes[n++] = sizeof (line_dummy);
+  sizes[n++] = sizeof (auger_dummy);
+  sizes[n++] = sizeof (Coll_stren);
+  sizes[n++] = sizeof (Topbase_phot);
+  sizes[n++] = sizeof (Inner_elec_yield);
+  sizes[n++] = sizeof (Inner_fluor_yield);
+  sizes[n++] = sizeof (struct ground_fracs);
+  sizes[n++] = sizeof (Drecomb);
+  sizes[n++] = sizeof (Total_rr);
+  sizes[n++] = sizeof (Bad_gs_rr);
+  sizes[n++] = sizeof (Dere_di_rate);
+  sizes[n++] = sizeof (Gaunt_total);
+  sizes[n++] = sizeof (Charge_exchange);
+  sizes[n++] = sizeof (atomic_image_counts);
+  sizes[n++] = NELEMENTS;
+  sizes[n++] = NIONS;
+  sizes[n++] = NLEVELS;
+  sizes[n++] = NLINES;
+  sizes[n++] = N_INNER;
+  sizes[n++] = NAUGER_MACRO;
+  sizes[n++] = NCROSS;
+  sizes[n++] = MAX_GAUNT_N_GSQRD;
+  sizes[n++] = MAX_CHARGE_EXCHANGE;
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Describe where each block of atomic data lives
+ *
+ * @param [in] atomic_image_counts *  counts   The numbers of entries in each array
+ * @param [out] atomic_image_section  sec[]   The blocks of atomic data
+ * @return     The number of blocks
+ *
+ * @details
+ * Only the entries which were read are stored for the large arrays, while the
+ * small arrays which are indexed by ion are stored in full.  init_atomic_data
+ * must have been called to allocate ele, ion, etc. before this is called.
+ *
+ **********************************************************/
+
+static int
+atomic_image_layout (counts, sec)
+     atomic_image_counts *counts;
+     atomic_image_section sec[];
+{
+  int n = 0;
+  int nphot;
+
+  nphot = counts->nphot_total;
+  if (nphot < counts->ntop_phot + counts->nxphot)
+    nphot = counts->ntop_phot + counts->nxphot;
+
+  sec[n].ptr = counts;
+  sec[n++].size = sizeof (atomic_image_counts);
+  sec[n].ptr = ele;
+  sec[n++].size = counts->nelements * sizeof (ele_dummy);
+  sec[n].ptr = ion;
+  sec[n++].size = counts->nions * sizeof (ion_dummy);
+  sec[n].ptr = xconfig;
+  sec[n++].size = counts->nlevels * sizeof (config_dummy);
+  sec[n].ptr = line;
+  sec[n++].size = counts->nlines * sizeof (line_dummy);
+  sec[n].ptr = auger_macro;
+  sec[n++].size = counts->nauger_macro * sizeof (auger_dummy);
+  sec[n].ptr = coll_stren;
+  sec[n++].size = counts->n_coll_stren * sizeof (Coll_stren);
+  sec[n].ptr = phot_top;
+  sec[n++].size = nphot * sizeof (Topbase_phot);
+  sec[n].ptr = inner_cross;
+  sec[n++].size = counts->n_inner_tot * sizeof (Topbase_phot);
+  sec[n].ptr = inner_elec_yield;
+  sec[n++].size = sizeof (inner_elec_yield);
+  sec[n].ptr = inner_fluor_yield;
+  sec[n++].size = sizeof (inner_fluor_yield);
+  sec[n].ptr = ground_frac;
+  sec[n++].size = sizeof (ground_frac);
+  sec[n].ptr = drecomb;
+  sec[n++].size = sizeof (drecomb);
+  sec[n].ptr = total_rr;
+  sec[n++].size = sizeof (total_rr);
+  sec[n].ptr = bad_gs_rr;
+  sec[n++].size = sizeof (bad_gs_rr);
+  sec[n].ptr = dere_di_rate;
+  sec[n++].size = sizeof (dere_di_rate);
+  sec[n].ptr = gaunt_total;
+  sec[n++].size = sizeof (gaunt_total);
+  sec[n].ptr = charge_exchange;
+  sec[n++].size = sizeof (charge_exchange);
+
+  return (n);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      The 64 bit FNV-1a hash of a block of memory
+ *
+ **********************************************************/
+
+static unsigned long
+atomic_image_checksum (buf, nbytes, hash)
+     unsigned char *buf;
+     size_t nbytes;
+     unsigned long hash;
+{
+  size_t i;
+
+  for (i = 0; i < nbytes; i++)
+  {
+    hash ^= buf[i];
+    hash *= 1099511628211UL;
+  }
+
+  return (hash);
+}
+
+#define ATOMIC_IMAGE_FNV_OFFSET 14695981039346656037UL
+
+
+
+/**********************************************************/
+/**
+ * @brief      Write the atomic data which has just been read by get_atomic_data to
+ * the image for a masterfile
+ *
+ * @param [in] char  masterfile[]   The masterfile from which the data was read
+ * @return     0 if the image was written, 1 otherwise
+ *
+ * @details
+ * The image is written to a temporary file which is then renamed, so that
+ * other runs which are starting at the same time never see a partial image.
+ * Only the root process writes the image.  Failing to write it is not fatal, since
+ * the data can always be read from the text files again.
+ *
+ **********************************************************/
+
+int
+write_atomic_image (masterfile)
+     char masterfile[];
+{
+  FILE *fptr;
+  char image[LINELENGTH], tmpfile[LINELENGTH + 32];
+  atomic_image_header header;
+  atomic_image_source *src;
+  atomic_image_counts counts;
+  atomic_image_section sec[ATOMIC_IMAGE_MAX_SECTIONS];
+  int n, nsec, ierr;
+
+  if (rank_global != 0)
+    return (0);
+
+  atomic_image_name (masterfile, image);
+
+  src = calloc (ATOMIC_IMAGE_MAX_SOURCES, sizeof (atomic_image_source));
+  if (src == NULL)
+  {
+    Error ("write_atomic_image: Could not allocate memory for the list of atomic data files\n");
+    return (1);
+  }
+
+  memset (&header, 0, sizeof (header));
+  strcpy (header.magic, ATOMIC_IMAGE_MAGIC);
+  header.version = ATOMIC_IMAGE_VERSION;
+  atomic_image_sizes (header.sizes);
+
+  if ((header.nsources = atomic_image_sources (masterfile, src)) < 0)
+  {
+    Error ("write_atomic_image: Could not find all of the files listed in %s\n", masterfile);
+    free (src);
+    return (1);
+  }
+
+  memset (&counts, 0, sizeof (counts));
+  counts.nelements = nelements;
+  counts.nions = nions;
+  counts.nlevels = nlevels;
+  counts.nlte_levels = nlte_levels;
+  counts.nlevels_macro = nlevels_macro;
+  counts.nlines = nlines;
+  counts.nlines_macro = nlines_macro;
+  counts.n_inner_tot = n_inner_tot;
+  counts.nauger = nauger;
+  counts.nauger_macro = nauger_macro;
+  counts.n_coll_stren = n_coll_stren;
+  counts.nxphot = nxphot;
+  counts.ntop_phot = ntop_phot;
+  counts.nphot_total = nphot_total;
+  counts.ndrecomb = ndrecomb;
+  counts.n_total_rr = n_total_rr;
+  counts.n_bad_gs_rr = n_bad_gs_rr;
+  counts.n_dere_di_rate = n_dere_di_rate;
+  counts.gaunt_n_gsqrd = gaunt_n_gsqrd;
+  counts.n_charge_exchange = n_charge_exchange;
+  counts.phot_freq_min = phot_freq_min;
+  counts.inner_freq_min = inner_freq_min;
+  counts.rho2nh = rho2nh;
+
+  nsec = atomic_image_layout (&counts, sec);
+
+  header.payload_size = 0;
+  header.checksum = ATOMIC_IMAGE_FNV_OFFSET;
+  for (n = 0; n < nsec; n++)
+  {
+    header.payload_size += sec[n].size;
+    header.checksum = atomic_image_checksum (sec[n].ptr, sec[n].size, header.checksum);
+  }
+
+  snprintf (tmpfile, sizeof (tmpfile), "%s.%d.tmp", image, (int) getpid ());
+
+  if ((fptr = fopen (tmpfile, "w")) == NULL)
+  {
+    Error ("write_atomic_image: Could not open %s, so the atomic data will be read from the text files again next time\n", tmpfile);
+    free (src);
+    return (1);
+  }
+
+  ierr = (fwrite (&header, sizeof (header), 1, fptr) != 1);
+  ierr |= (fwrite (src, sizeof (atomic_image_source), header.nsources, fptr) != (size_t) header.nsources);
+  for (n = 0; n < nsec; n++)
+    if (sec[n].size > 0)
+      ierr |= (fwrite (sec[n].ptr, sec[n].size, 1, fptr) != 1);
+  ierr |= (fclose (fptr) != 0);
+
+  if (ierr || rename (tmpfile, image) != 0)
+  {
+    Error ("write_atomic_image: Could not write %s\n", image);
+    remove (tmpfile);
+    free (src);
+    return (1);
+  }
+
+  Log ("write_atomic_image: Wrote the atomic data from %d files to %s (%.1f MB)\n", header.nsources, image, 1e-6 * header.payload_size);
+
+  free (src);
+  return (0);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Read the payload of the image for a masterfile, if it is
+ * up to date
+ *
+ * @param [in] char  masterfile[]   The masterfile
+ * @param [out] long *  payload_size   The size of the atomic data in the image
+ * @return     The atomic data, or NULL if there is no usable image
+ *
+ **********************************************************/
+
+static char *
+atomic_image_load (masterfile, payload_size)
+     char masterfile[];
+     long *payload_size;
+{
+  FILE *fptr;
+  char image[LINELENGTH];
+  char *payload;
+  atomic_image_header header;
+  atomic_image_source *src, *src_image;
+  int sizes[ATOMIC_IMAGE_NSIZES];
+  int n, nsources;
+
+  atomic_image_name (masterfile, image);
+
+  if ((fptr = fopen (image, "r")) == NULL)
+  {
+    Log ("atomic_image_load: There is no atomic data image %s, so it will be made\n", image);
+    return (NULL);
+  }
+
+  atomic_image_sizes (sizes);
+
+  if (fread (&header, sizeof (header), 1, fptr) != 1 || memcmp (header.magic, ATOMIC_IMAGE_MAGIC, sizeof (header.magic)) != 0
+      || header.version != ATOMIC_IMAGE_VERSION || memcmp (header.sizes, sizes, sizeof (sizes)) != 0
+      || header.nsources < 1 || header.nsources > ATOMIC_IMAGE_MAX_SOURCES || header.payload_size <= 0)
+  {
+    Log ("atomic_image_load: %s was made by a different version of sirocco, so it will be remade\n", image);
+    fclose (fptr);
+    return (NULL);
+  }
+
+  src = calloc (2 * ATOMIC_IMAGE_MAX_SOURCES, sizeof (atomic_image_source));
+  if (src == NULL)
+  {
+    fclose (fptr);
+    return (NULL);
+  }
+  src_image = src + ATOMIC_IMAGE_MAX_SOURCES;
+
+  nsources = atomic_image_sources (masterfile, src);
+
+  if (fread (src_image, sizeof (atomic_image_source), header.nsources, fptr) != (size_t) header.nsources)
+    nsources = -1;
+
+  if (nsources != header.nsources)
+  {
+    Log ("atomic_image_load: The files listed in %s have changed, so %s will be remade\n", masterfile, image);
+    free (src);
+    fclose (fptr);
+    return (NULL);
+  }
+
+  for (n = 0; n < nsources; n++)
+  {
+    if (strcmp (src[n].name, src_image[n].name) != 0 || src[n].size != src_image[n].size || src[n].mtime != src_image[n].mtime)
+    {
+      Log ("atomic_image_load: %s has changed since %s was made, so it will be remade\n", src[n].name, image);
+      free (src);
+      fclose (fptr);
+      return (NULL);
+    }
+  }
+
+  free (src);
+
+  if ((payload = malloc (header.payload_size)) == NULL)
+  {
+    Error ("atomic_image_load: Could not allocate %ld bytes to read %s\n", header.payload_size, image);
+    fclose (fptr);
+    return (NULL);
+  }
+
+  if (fread (payload, header.payload_size, 1, fptr) != 1
+      || atomic_image_checksum ((unsigned char *) payload, header.payload_size, ATOMIC_IMAGE_FNV_OFFSET) != header.checksum)
+  {
+    Error ("atomic_image_load: %s is incomplete or corrupted, so it will be remade\n", image);
+    free (payload);
+    fclose (fptr);
+    return (NULL);
+  }
+
+  fclose (fptr);
+
+  Log ("Get_atomic_data: Reading from atomic data image %s\n", image);
+
+  *payload_size = header.payload_size;
+  return (payload);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Fill the atomic data structures from the image for a masterfile
+ *
+ * @param [in] char  masterfile[]   The masterfile
+ * @return     0 if the atomic data was read from the image, 1 if there is no
+ * usable image and the atomic data must be read from the text files
+ *
+ * @details
+ * The root process checks that the image is up to date, reads it with a single
+ * read, and broadcasts it to the other processes.  Every process then unpacks
+ * it and creates the frequency ordered indices to the lines and cross sections,
+ * as is done at the end of get_atomic_data.  All processes must call this routine.
+ *
+ **********************************************************/
+
+int
+read_atomic_image (masterfile)
+     char masterfile[];
+{
+  char *payload;
+  long payload_size;
+  size_t offset;
+  atomic_image_counts counts;
+  atomic_image_section sec[ATOMIC_IMAGE_MAX_SECTIONS];
+  int n, nsec;
+
+  payload = NULL;
+  payload_size = 0;
+
+  if (rank_global == 0)
+    payload = atomic_image_load (masterfile, &payload_size);
+
+#ifdef MPI_ON
+  if (np_mpi_global > 1)
+  {
+    long nsent, nchunk;
+
+    MPI_Bcast (&payload_size, 1, MPI_LONG, 0, MPI_COMM_WORLD);
+    if (payload_size > 0 && rank_global != 0)
+    {
+      if ((payload = malloc (payload_size)) == NULL)
+      {
+        Error ("read_atomic_image: Could not allocate %ld bytes for the atomic data\n", payload_size);
+        Exit (1);
+      }
+    }
+    for (nsent = 0; nsent < payload_size; nsent += nchunk)
+    {
+      nchunk = payload_size - nsent < ATOMIC_IMAGE_BCAST_CHUNK ? payload_size - nsent : ATOMIC_IMAGE_BCAST_CHUNK;
+      MPI_Bcast (payload + nsent, (int) nchunk, MPI_CHAR, 0, MPI_COMM_WORLD);
+    }
+  }
+#endif
+
+  if (payload == NULL)
+    return (1);
+
+  init_atomic_data ();
+
+  memcpy (&counts, payload, sizeof (counts));
+  nsec = atomic_image_layout (&counts, sec);
+
+  offset = sizeof (counts);
+  for (n = 1; n < nsec; n++)
+  {
+    memcpy (sec[n].ptr, payload + offset, sec[n].size);
+    offset += sec[n].size;
+  }
+  free (payload);
+
+  if (offset != (size_t) payload_size)
+  {
+    Error ("read_atomic_image: The atomic data image for %s has an unexpected size\n", masterfile);
+    Exit (1);
+  }
+
+  nelements = counts.nelements;
+  nions = counts.nions;
+  nlevels = counts.nlevels;
+  nlte_levels = counts.nlte_levels;
+  nlevels_macro = counts.nlevels_macro;
+  nlines = counts.nlines;
+  nlines_macro = counts.nlines_macro;
+  n_inner_tot = counts.n_inner_tot;
+  nauger = counts.nauger;
+  nauger_macro = counts.nauger_macro;
+  n_coll_stren = counts.n_coll_stren;
+  nxphot = counts.nxphot;
+  ntop_phot = counts.ntop_phot;
+  nphot_total = counts.nphot_total;
+  ndrecomb = counts.ndrecomb;
+  n_total_rr = counts.n_total_rr;
+  n_bad_gs_rr = counts.n_bad_gs_rr;
+  n_dere_di_rate = counts.n_dere_di_rate;
+  gaunt_n_gsqrd = counts.gaunt_n_gsqrd;
+  n_charge_exchange = counts.n_charge_exchange;
+  phot_freq_min = counts.phot_freq_min;
+  inner_freq_min = counts.inner_freq_min;
+  rho2nh = counts.rho2nh;
+
+  /* Make the same checks as when the text files are read */
+  check_atomic_data (0);
+
+  index_lines ();
+  if (ntop_phot + nxphot > 0)
+    index_phot_top ();
+  if (n_inner_tot > 0)
+    index_inner_cross ();
+
+  check_xsections ();
+
+  return (0);
+}
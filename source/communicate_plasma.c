@@ -50,10 +50,12 @@ broadcast_plasma_grid (const int n_start, const int n_stop, const int n_cells_ra
 
   d_xsignal (files.root, "%-20s Begin communicating plasma grid\n", "NOK");
   const int n_cells_max = get_max_cells_per_rank (NPLASMA);
-  const int comm_buffer_size = calculate_comm_buffer_size (1 + n_cells_max * (1 + 20 + nphot_total + nions + NXBANDS + 2 * N_PHOT_PROC),
-                                                           n_cells_max * (71 + 11 * nions + nlte_levels + 2 * nphot_total + n_inner_tot +
-                                                                          11 * NXBANDS + NBINS_IN_CELL_SPEC + 6 * NFLUX_ANGLES +
-                                                                          N_DMO_DT_DIRECTIONS + 12 * NFORCE_DIRECTIONS));
+  const int n_spec_blocks_max = get_max_cell_spec_blocks_per_rank (n_start, n_stop);
+  const int comm_buffer_size =
+    calculate_comm_buffer_size (1 + n_cells_max * (1 + 21 + nphot_total + nions + NXBANDS + 2 * N_PHOT_PROC + NCELL_SPEC_BLOCKS),
+                                n_cells_max * (71 + 11 * nions + nlte_levels + 2 * nphot_total + n_inner_tot + 11 * NXBANDS +
+                                               6 * NFLUX_ANGLES + N_DMO_DT_DIRECTIONS + 12 * NFORCE_DIRECTIONS + WU_PHASE_NTYPES) +
+                                n_spec_blocks_max * CELL_SPEC_BLOCK_SIZE);
   char *comm_buffer = malloc (comm_buffer_size);
   if (comm_buffer == NULL)
   {
@@ -147,7 +149,7 @@ broadcast_plasma_grid (const int n_start, const int n_stop, const int n_cells_ra
         MPI_Pack (cell->pl_log_w, NXBANDS, MPI_DOUBLE, comm_buffer, comm_buffer_size, &position, MPI_COMM_WORLD);
         MPI_Pack (cell->exp_temp, NXBANDS, MPI_DOUBLE, comm_buffer, comm_buffer_size, &position, MPI_COMM_WORLD);
         MPI_Pack (cell->exp_w, NXBANDS, MPI_DOUBLE, comm_buffer, comm_buffer_size, &position, MPI_COMM_WORLD);
-        MPI_Pack (cell->cell_spec_flux, NBINS_IN_CELL_SPEC, MPI_DOUBLE, comm_buffer, comm_buffer_size, &position, MPI_COMM_WORLD);
+        pack_cell_spec (cell, comm_buffer, comm_buffer_size, &position);
         MPI_Pack (cell->F_vis, NFORCE_DIRECTIONS, MPI_DOUBLE, comm_buffer, comm_buffer_size, &position, MPI_COMM_WORLD);
         MPI_Pack (cell->F_UV, NFORCE_DIRECTIONS, MPI_DOUBLE, comm_buffer, comm_buffer_size, &position, MPI_COMM_WORLD);
         MPI_Pack (cell->F_Xray, NFORCE_DIRECTIONS, MPI_DOUBLE, comm_buffer, comm_buffer_size, &position, MPI_COMM_WORLD);
@@ -211,6 +213,8 @@ broadcast_plasma_grid (const int n_start, const int n_stop, const int n_cells_ra
         MPI_Pack (&cell->hccheck, 1, MPI_INT, comm_buffer, comm_buffer_size, &position, MPI_COMM_WORLD);
         MPI_Pack (&cell->converge_whole, 1, MPI_INT, comm_buffer, comm_buffer_size, &position, MPI_COMM_WORLD);
         MPI_Pack (&cell->converging, 1, MPI_INT, comm_buffer, comm_buffer_size, &position, MPI_COMM_WORLD);
+        MPI_Pack (&cell->te_nevals, 1, MPI_INT, comm_buffer, comm_buffer_size, &position, MPI_COMM_WORLD);
+        MPI_Pack (cell->wu_time, WU_PHASE_NTYPES, MPI_DOUBLE, comm_buffer, comm_buffer_size, &position, MPI_COMM_WORLD);
         MPI_Pack (&cell->ip, 1, MPI_DOUBLE, comm_buffer, comm_buffer_size, &position, MPI_COMM_WORLD);
         MPI_Pack (&cell->xi, 1, MPI_DOUBLE, comm_buffer, comm_buffer_size, &position, MPI_COMM_WORLD);
       }
@@ -302,7 +306,7 @@ broadcast_plasma_grid (const int n_start, const int n_stop, const int n_cells_ra
         MPI_Unpack (comm_buffer, comm_buffer_size, &position, cell->pl_log_w, NXBANDS, MPI_DOUBLE, MPI_COMM_WORLD);
         MPI_Unpack (comm_buffer, comm_buffer_size, &position, cell->exp_temp, NXBANDS, MPI_DOUBLE, MPI_COMM_WORLD);
         MPI_Unpack (comm_buffer, comm_buffer_size, &position, cell->exp_w, NXBANDS, MPI_DOUBLE, MPI_COMM_WORLD);
-        MPI_Unpack (comm_buffer, comm_buffer_size, &position, cell->cell_spec_flux, NBINS_IN_CELL_SPEC, MPI_DOUBLE, MPI_COMM_WORLD);
+        unpack_cell_spec (cell, comm_buffer, comm_buffer_size, &position);
         MPI_Unpack (comm_buffer, comm_buffer_size, &position, cell->F_vis, NFORCE_DIRECTIONS, MPI_DOUBLE, MPI_COMM_WORLD);
         MPI_Unpack (comm_buffer, comm_buffer_size, &position, cell->F_UV, NFORCE_DIRECTIONS, MPI_DOUBLE, MPI_COMM_WORLD);
         MPI_Unpack (comm_buffer, comm_buffer_size, &position, cell->F_Xray, NFORCE_DIRECTIONS, MPI_DOUBLE, MPI_COMM_WORLD);
@@ -366,6 +370,8 @@ broadcast_plasma_grid (const int n_start, const int n_stop, const int n_cells_ra
         MPI_Unpack (comm_buffer, comm_buffer_size, &position, &cell->hccheck, 1, MPI_INT, MPI_COMM_WORLD);
         MPI_Unpack (comm_buffer, comm_buffer_size, &position, &cell->converge_whole, 1, MPI_INT, MPI_COMM_WORLD);
         MPI_Unpack (comm_buffer, comm_buffer_size, &position, &cell->converging, 1, MPI_INT, MPI_COMM_WORLD);
+        MPI_Unpack (comm_buffer, comm_buffer_size, &position, &cell->te_nevals, 1, MPI_INT, MPI_COMM_WORLD);
+        MPI_Unpack (comm_buffer, comm_buffer_size, &position, cell->wu_time, WU_PHASE_NTYPES, MPI_DOUBLE, MPI_COMM_WORLD);
         MPI_Unpack (comm_buffer, comm_buffer_size, &position, &cell->ip, 1, MPI_DOUBLE, MPI_COMM_WORLD);
         MPI_Unpack (comm_buffer, comm_buffer_size, &position, &cell->xi, 1, MPI_DOUBLE, MPI_COMM_WORLD);
       }
@@ -593,10 +599,11 @@ broadcast_updated_plasma_properties (const int n_start_rank, const int n_stop_ra
 
   d_xsignal (files.root, "%-20s Begin communicating updated plasma properties\n", "NOK");
   const int n_cells_max = get_max_cells_per_rank (NPLASMA);
-  const int num_ints = 1 + n_cells_max * (20 + nphot_total + 2 * NXBANDS + 2 * N_PHOT_PROC + nions);
+  const int n_spec_blocks_max = get_max_cell_spec_blocks_per_rank (n_start_rank, n_stop_rank);
+  const int num_ints = 1 + n_cells_max * (21 + nphot_total + 2 * NXBANDS + 2 * N_PHOT_PROC + nions + NCELL_SPEC_BLOCKS);
   const int num_doubles =
     n_cells_max * (71 + 1 * 3 + 9 * 4 + 6 * NFLUX_ANGLES + 3 * NFORCE_DIRECTIONS + 9 * nions + 1 * nlte_levels + 3 * nphot_total +
-                   1 * n_inner_tot + 9 * NXBANDS + 1 * NBINS_IN_CELL_SPEC);
+                   1 * n_inner_tot + 9 * NXBANDS + WU_PHASE_NTYPES) + n_spec_blocks_max * CELL_SPEC_BLOCK_SIZE;
   const int size_of_comm_buffer = calculate_comm_buffer_size (num_ints, num_doubles);
   char *const comm_buffer = malloc (size_of_comm_buffer);
   if (comm_buffer == NULL)
@@ -688,8 +695,7 @@ broadcast_updated_plasma_properties (const int n_start_rank, const int n_stop_ra
         MPI_Pack (plasmamain[n_plasma].pl_log_w, NXBANDS, MPI_DOUBLE, comm_buffer, size_of_comm_buffer, &position, MPI_COMM_WORLD);
         MPI_Pack (plasmamain[n_plasma].exp_temp, NXBANDS, MPI_DOUBLE, comm_buffer, size_of_comm_buffer, &position, MPI_COMM_WORLD);
         MPI_Pack (plasmamain[n_plasma].exp_w, NXBANDS, MPI_DOUBLE, comm_buffer, size_of_comm_buffer, &position, MPI_COMM_WORLD);
-        MPI_Pack (plasmamain[n_plasma].cell_spec_flux, NBINS_IN_CELL_SPEC, MPI_DOUBLE, comm_buffer, size_of_comm_buffer, &position,
-                  MPI_COMM_WORLD);
+        pack_cell_spec (&plasmamain[n_plasma], comm_buffer, size_of_comm_buffer, &position);
         MPI_Pack (plasmamain[n_plasma].F_vis, NFORCE_DIRECTIONS, MPI_DOUBLE, comm_buffer, size_of_comm_buffer, &position, MPI_COMM_WORLD);
         MPI_Pack (plasmamain[n_plasma].F_UV, NFORCE_DIRECTIONS, MPI_DOUBLE, comm_buffer, size_of_comm_buffer, &position, MPI_COMM_WORLD);
         MPI_Pack (plasmamain[n_plasma].F_Xray, NFORCE_DIRECTIONS, MPI_DOUBLE, comm_buffer, size_of_comm_buffer, &position, MPI_COMM_WORLD);
@@ -767,6 +773,8 @@ broadcast_updated_plasma_properties (const int n_start_rank, const int n_stop_ra
         MPI_Pack (&plasmamain[n_plasma].hccheck, 1, MPI_INT, comm_buffer, size_of_comm_buffer, &position, MPI_COMM_WORLD);
         MPI_Pack (&plasmamain[n_plasma].converge_whole, 1, MPI_INT, comm_buffer, size_of_comm_buffer, &position, MPI_COMM_WORLD);
         MPI_Pack (&plasmamain[n_plasma].converging, 1, MPI_INT, comm_buffer, size_of_comm_buffer, &position, MPI_COMM_WORLD);
+        MPI_Pack (&plasmamain[n_plasma].te_nevals, 1, MPI_INT, comm_buffer, size_of_comm_buffer, &position, MPI_COMM_WORLD);
+        MPI_Pack (plasmamain[n_plasma].wu_time, WU_PHASE_NTYPES, MPI_DOUBLE, comm_buffer, size_of_comm_buffer, &position, MPI_COMM_WORLD);
         MPI_Pack (&plasmamain[n_plasma].ip, 1, MPI_DOUBLE, comm_buffer, size_of_comm_buffer, &position, MPI_COMM_WORLD);
         MPI_Pack (&plasmamain[n_plasma].xi, 1, MPI_DOUBLE, comm_buffer, size_of_comm_buffer, &position, MPI_COMM_WORLD);
 
@@ -856,8 +864,7 @@ broadcast_updated_plasma_properties (const int n_start_rank, const int n_stop_ra
         MPI_Unpack (comm_buffer, size_of_comm_buffer, &position, plasmamain[n_plasma].pl_log_w, NXBANDS, MPI_DOUBLE, MPI_COMM_WORLD);
         MPI_Unpack (comm_buffer, size_of_comm_buffer, &position, plasmamain[n_plasma].exp_temp, NXBANDS, MPI_DOUBLE, MPI_COMM_WORLD);
         MPI_Unpack (comm_buffer, size_of_comm_buffer, &position, plasmamain[n_plasma].exp_w, NXBANDS, MPI_DOUBLE, MPI_COMM_WORLD);
-        MPI_Unpack (comm_buffer, size_of_comm_buffer, &position, plasmamain[n_plasma].cell_spec_flux, NBINS_IN_CELL_SPEC, MPI_DOUBLE,
-                    MPI_COMM_WORLD);
+        unpack_cell_spec (&plasmamain[n_plasma], comm_buffer, size_of_comm_buffer, &position);
         MPI_Unpack (comm_buffer, size_of_comm_buffer, &position, plasmamain[n_plasma].F_vis, NFORCE_DIRECTIONS, MPI_DOUBLE, MPI_COMM_WORLD);
         MPI_Unpack (comm_buffer, size_of_comm_buffer, &position, plasmamain[n_plasma].F_UV, NFORCE_DIRECTIONS, MPI_DOUBLE, MPI_COMM_WORLD);
         MPI_Unpack (comm_buffer, size_of_comm_buffer, &position, plasmamain[n_plasma].F_Xray, NFORCE_DIRECTIONS, MPI_DOUBLE,
@@ -938,6 +945,9 @@ broadcast_updated_plasma_properties (const int n_start_rank, const int n_stop_ra
         MPI_Unpack (comm_buffer, size_of_comm_buffer, &position, &plasmamain[n_plasma].hccheck, 1, MPI_INT, MPI_COMM_WORLD);
         MPI_Unpack (comm_buffer, size_of_comm_buffer, &position, &plasmamain[n_plasma].converge_whole, 1, MPI_INT, MPI_COMM_WORLD);
         MPI_Unpack (comm_buffer, size_of_comm_buffer, &position, &plasmamain[n_plasma].converging, 1, MPI_INT, MPI_COMM_WORLD);
+        MPI_Unpack (comm_buffer, size_of_comm_buffer, &position, &plasmamain[n_plasma].te_nevals, 1, MPI_INT, MPI_COMM_WORLD);
+        MPI_Unpack (comm_buffer, size_of_comm_buffer, &position, plasmamain[n_plasma].wu_time, WU_PHASE_NTYPES, MPI_DOUBLE,
+                    MPI_COMM_WORLD);
         MPI_Unpack (comm_buffer, size_of_comm_buffer, &position, &plasmamain[n_plasma].ip, 1, MPI_DOUBLE, MPI_COMM_WORLD);
         MPI_Unpack (comm_buffer, size_of_comm_buffer, &position, &plasmamain[n_plasma].xi, 1, MPI_DOUBLE, MPI_COMM_WORLD);
       }
@@ -972,7 +982,8 @@ reduce_simple_estimators (void)
 {
 #ifdef MPI_ON                   // these routines should only be called anyway in parallel but we need these to compile
 
-  int mpi_i, mpi_j;
+  int mpi_i, mpi_j, mpi_k;
+  int n_helper;
   double *maxfreqhelper, *maxfreqhelper2;
   /*NSH 131213 the next line introduces new helper arrays for the max and min frequencies in bands */
   double *maxbandfreqhelper, *maxbandfreqhelper2, *minbandfreqhelper, *minbandfreqhelper2;
@@ -1266,34 +1277,75 @@ reduce_simple_estimators (void)
   free (iqdisk_helper2);
 
 
-/* Now during ionization cycles, process the cell spectra */
-
-  /* The size of the commbuffers need to be the number of spectra x the length of each */
+/* Now during ionization cycles, process the cell spectra. Only the blocks which
+ * have been allocated on at least one rank are communicated, so first make sure
+ * every rank has allocated the same blocks */
 
   if (geo.ioniz_or_extract == CYCLE_IONIZ)
   {
-    size_of_commbuffer = NPLASMA * NBINS_IN_CELL_SPEC;
+    size_of_commbuffer = NPLASMA * NCELL_SPEC_BLOCKS;
+
+    iredhelper = calloc (sizeof (int), size_of_commbuffer);
+    iredhelper2 = calloc (sizeof (int), size_of_commbuffer);
+
+    for (mpi_j = 0; mpi_j < NPLASMA; mpi_j++)
+    {
+      for (mpi_i = 0; mpi_i < NCELL_SPEC_BLOCKS; mpi_i++)
+      {
+        iredhelper[mpi_j * NCELL_SPEC_BLOCKS + mpi_i] = (plasmamain[mpi_j].cell_spec_block[mpi_i] != NULL);
+      }
+    }
+
+    MPI_Allreduce (iredhelper, iredhelper2, size_of_commbuffer, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+
+    for (mpi_j = 0; mpi_j < NPLASMA; mpi_j++)
+    {
+      for (mpi_i = 0; mpi_i < NCELL_SPEC_BLOCKS; mpi_i++)
+      {
+        if (iredhelper2[mpi_j * NCELL_SPEC_BLOCKS + mpi_i])
+        {
+          cell_spec_alloc_block (&plasmamain[mpi_j], mpi_i);
+        }
+      }
+    }
+
+    free (iredhelper);
+    free (iredhelper2);
+
+    size_of_commbuffer = cell_spec_count_blocks (0, NPLASMA) * CELL_SPEC_BLOCK_SIZE;
 
     redhelper = calloc (sizeof (double), size_of_commbuffer);
     redhelper2 = calloc (sizeof (double), size_of_commbuffer);
 
-    for (mpi_i = 0; mpi_i < NBINS_IN_CELL_SPEC; mpi_i++)
+    n_helper = 0;
+    for (mpi_j = 0; mpi_j < NPLASMA; mpi_j++)
     {
-      for (mpi_j = 0; mpi_j < NPLASMA; mpi_j++)
+      for (mpi_i = 0; mpi_i < NCELL_SPEC_BLOCKS; mpi_i++)
       {
-        redhelper[mpi_i * NPLASMA + mpi_j] = plasmamain[mpi_j].cell_spec_flux[mpi_i] / np_mpi_global;
-
+        if (plasmamain[mpi_j].cell_spec_block[mpi_i] != NULL)
+        {
+          for (mpi_k = 0; mpi_k < CELL_SPEC_BLOCK_SIZE; mpi_k++)
+          {
+            redhelper[n_helper++] = plasmamain[mpi_j].cell_spec_block[mpi_i][mpi_k] / np_mpi_global;
+          }
+        }
       }
     }
 
     MPI_Allreduce (redhelper, redhelper2, size_of_commbuffer, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
 
-    for (mpi_i = 0; mpi_i < NBINS_IN_CELL_SPEC; mpi_i++)
+    n_helper = 0;
+    for (mpi_j = 0; mpi_j < NPLASMA; mpi_j++)
     {
-      for (mpi_j = 0; mpi_j < NPLASMA; mpi_j++)
+      for (mpi_i = 0; mpi_i < NCELL_SPEC_BLOCKS; mpi_i++)
       {
-        plasmamain[mpi_j].cell_spec_flux[mpi_i] = redhelper2[mpi_i * NPLASMA + mpi_j];
-
+        if (plasmamain[mpi_j].cell_spec_block[mpi_i] != NULL)
+        {
+          for (mpi_k = 0; mpi_k < CELL_SPEC_BLOCK_SIZE; mpi_k++)
+          {
+            plasmamain[mpi_j].cell_spec_block[mpi_i][mpi_k] = redhelper2[n_helper++];
+          }
+        }
       }
     }
 
@@ -1306,3 +1358,122 @@ reduce_simple_estimators (void)
 #endif
   return (0);
 }
+
+/**********************************************************/
+/**
+ * @brief Find the largest number of allocated cell spectrum blocks owned by
+ *        any rank
+ *
+ * @param [in] int n_start  The index of the first cell owned by this rank
+ * @param [in] int n_stop   The index of the last cell owned by this rank
+ *
+ * @return int  The largest number of allocated blocks over all ranks
+ *
+ * @details
+ *
+ * This is used to size the communication buffers which carry the cell
+ * spectra, so that with -sparse_cell_spec the buffers only need to be as
+ * large as the spectra which have actually been accumulated.
+ *
+ **********************************************************/
+
+int
+get_max_cell_spec_blocks_per_rank (const int n_start, const int n_stop)
+{
+  int n_blocks = cell_spec_count_blocks (n_start, n_stop);
+#ifdef MPI_ON
+  int n_blocks_max;
+
+  MPI_Allreduce (&n_blocks, &n_blocks_max, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+
+  return n_blocks_max;
+#else
+  return n_blocks;
+#endif
+}
+
+/**********************************************************/
+/**
+ * @brief Pack the allocated blocks of a cell spectrum into a comm buffer
+ *
+ * @param [in] PlasmaPtr cell           The plasma cell
+ * @param [in] char *comm_buffer        The comm buffer
+ * @param [in] int comm_buffer_size     The size of the comm buffer
+ * @param [in, out] int *position       The current position in the buffer
+ *
+ * @details
+ *
+ * A mask of which blocks are present is packed first, followed by the
+ * contents of those blocks. unpack_cell_spec reverses this.
+ *
+ **********************************************************/
+
+void
+pack_cell_spec (PlasmaPtr cell, char *comm_buffer, const int comm_buffer_size, int *position)
+{
+#ifdef MPI_ON
+  int i;
+  int spec_mask[NCELL_SPEC_BLOCKS];
+
+  for (i = 0; i < NCELL_SPEC_BLOCKS; i++)
+  {
+    spec_mask[i] = (cell->cell_spec_block[i] != NULL);
+  }
+
+  MPI_Pack (spec_mask, NCELL_SPEC_BLOCKS, MPI_INT, comm_buffer, comm_buffer_size, position, MPI_COMM_WORLD);
+  for (i = 0; i < NCELL_SPEC_BLOCKS; i++)
+  {
+    if (spec_mask[i])
+    {
+      MPI_Pack (cell->cell_spec_block[i], CELL_SPEC_BLOCK_SIZE, MPI_DOUBLE, comm_buffer, comm_buffer_size, position, MPI_COMM_WORLD);
+    }
+  }
+#endif
+}
+
+/**********************************************************/
+/**
+ * @brief Unpack a cell spectrum packed by pack_cell_spec
+ *
+ * @param [in] PlasmaPtr cell           The plasma cell
+ * @param [in] char *comm_buffer        The comm buffer
+ * @param [in] int comm_buffer_size     The size of the comm buffer
+ * @param [in, out] int *position       The current position in the buffer
+ *
+ * @details
+ *
+ * Blocks which were not sent hold no flux, so are either released or,
+ * when the cell spectra are not sparse, set to zero.
+ *
+ **********************************************************/
+
+void
+unpack_cell_spec (PlasmaPtr cell, char *comm_buffer, const int comm_buffer_size, int *position)
+{
+#ifdef MPI_ON
+  int i;
+  int spec_mask[NCELL_SPEC_BLOCKS];
+
+  MPI_Unpack (comm_buffer, comm_buffer_size, position, spec_mask, NCELL_SPEC_BLOCKS, MPI_INT, MPI_COMM_WORLD);
+  for (i = 0; i < NCELL_SPEC_BLOCKS; i++)
+  {
+    if (spec_mask[i])
+    {
+      MPI_Unpack (comm_buffer, comm_buffer_size, position, cell_spec_alloc_block (cell, i), CELL_SPEC_BLOCK_SIZE, MPI_DOUBLE,
+                  MPI_COMM_WORLD);
+    }
+    else if (cell->cell_spec_block[i] != NULL)
+    {
+      if (modes.sparse_cell_spec)
+      {
+        free (cell->cell_spec_block[i]);
+        cell->cell_spec_block[i] = NULL;
+      }
+      else
+      {
+        memset (cell->cell_spec_block[i], 0, CELL_SPEC_BLOCK_SIZE * sizeof (double));
+      }
+    }
+  }
+#endif
+}
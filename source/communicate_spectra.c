@@ -25,6 +25,10 @@
  * between MPI ranks using an MPI_Allreduce. Works on both the linear and the
  * log spectra.
  *
+ * Only the bins in use in this cycle are communicated. The bins of
+ * each spectrum are packed contiguously, so that packing and unpacking is a
+ * sequential copy rather than a strided one.
+ *
  **********************************************************/
 
 int
@@ -33,9 +37,9 @@ normalize_spectra_across_ranks (void)
 #ifdef MPI_ON
   int i;
   int j;
-  int nspec;
-  int size_of_commbuffer;;
-  double *spectrum_buffer;
+  int nspec, nwave;
+  int size_of_commbuffer;
+  double *spectrum_buffer, *buf;
 
   d_xsignal (files.root, "%-20s Begin spectrum reduction\n", "NOK");
 
@@ -44,36 +48,40 @@ normalize_spectra_across_ranks (void)
   if (geo.ioniz_or_extract == CYCLE_EXTRACT)
   {
     nspec = MSPEC + geo.nangles;
+    nwave = NWAVE_EXTRACT;
   }
   else
   {
     nspec = MSPEC;
+    nwave = NWAVE_IONIZ;
   }
 
-  size_of_commbuffer = 4 * nspec * NWAVE_MAX;   // We need space for all 4 separate spectra we are normalizing
+  size_of_commbuffer = 4 * nspec * nwave;   // We need space for all 4 separate spectra we are normalizing
   spectrum_buffer = calloc (sizeof (double), size_of_commbuffer);
 
-  for (i = 0; i < NWAVE_MAX; i++)
+  for (j = 0; j < nspec; j++)
   {
-    for (j = 0; j < nspec; j++)
+    buf = &spectrum_buffer[4 * j * nwave];
+    for (i = 0; i < nwave; i++)
     {
-      spectrum_buffer[i * nspec + j] = xxspec[j].f[i] / np_mpi_global;
-      spectrum_buffer[i * nspec + j + (NWAVE_MAX * nspec)] = xxspec[j].lf[i] / np_mpi_global;
-      spectrum_buffer[i * nspec + j + (2 * NWAVE_MAX * nspec)] = xxspec[j].f_wind[i] / np_mpi_global;
-      spectrum_buffer[i * nspec + j + (3 * NWAVE_MAX * nspec)] = xxspec[j].lf_wind[i] / np_mpi_global;
+      buf[i] = xxspec[j].f[i] / np_mpi_global;
+      buf[i + nwave] = xxspec[j].lf[i] / np_mpi_global;
+      buf[i + 2 * nwave] = xxspec[j].f_wind[i] / np_mpi_global;
+      buf[i + 3 * nwave] = xxspec[j].lf_wind[i] / np_mpi_global;
     }
   }
 
   MPI_Allreduce (MPI_IN_PLACE, spectrum_buffer, size_of_commbuffer, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
 
-  for (i = 0; i < NWAVE_MAX; i++)
+  for (j = 0; j < nspec; j++)
   {
-    for (j = 0; j < nspec; j++)
+    buf = &spectrum_buffer[4 * j * nwave];
+    for (i = 0; i < nwave; i++)
     {
-      xxspec[j].f[i] = spectrum_buffer[i * nspec + j];
-      xxspec[j].lf[i] = spectrum_buffer[i * nspec + j + (NWAVE_MAX * nspec)];
-      xxspec[j].f_wind[i] = spectrum_buffer[i * nspec + j + (2 * NWAVE_MAX * nspec)];
-      xxspec[j].lf_wind[i] = spectrum_buffer[i * nspec + j + (3 * NWAVE_MAX * nspec)];
+      xxspec[j].f[i] = buf[i];
+      xxspec[j].lf[i] = buf[i + nwave];
+      xxspec[j].f_wind[i] = buf[i + 2 * nwave];
+      xxspec[j].lf_wind[i] = buf[i + 3 * nwave];
     }
   }
 
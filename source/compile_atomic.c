@@ -0,0 +1,74 @@
+
+/***********************************************************/
+/** @file  compile_atomic.c
+ *
+ * @brief  A standalone routine which compiles the atomic data listed
+ * in a masterfile into a binary image
+ *
+ * This routine is run from the command line, as follows
+ *
+ * compile_atomic  masterfile
+ *
+ * e.g. compile_atomic data/standard80.dat, which reads all of the
+ * files listed in the masterfile and writes data/standard80.dat.image.
+ * It must be run from the directory in which sirocco would be run, since
+ * the files in the masterfile are given relative to it.
+ *
+ * The image is read by sirocco when it is run with the -atomic_image
+ * switch.  Sirocco will also make the image itself if it is missing or out of
+ * date, so this routine is mainly useful for preparing the image before a
+ * large parallel run.
+ *
+ ***********************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "atomic.h"
+#include "sirocco.h"
+#include "atomic_proto.h"
+
+
+/**********************************************************/
+/**
+ * @brief      compile the atomic data in a masterfile into a binary image
+ *
+ * @param [in] int  argc   The number of command line arguments
+ * @param [in] char *  argv[]   The command line arguments
+ * @return     0 if the image was written
+ *
+ **********************************************************/
+
+int
+main (argc, argv)
+     int argc;
+     char *argv[];
+{
+  char masterfile[LINELENGTH], image[LINELENGTH];
+
+  if (argc != 2 || argv[1][0] == '-')
+  {
+    printf ("Usage: compile_atomic masterfile\n");
+    printf ("Reads the atomic data listed in masterfile and writes it to masterfile.image\n");
+    exit (1);
+  }
+
+  strncpy (masterfile, argv[1], LINELENGTH - 1);
+  masterfile[LINELENGTH - 1] = '\0';
+
+  Log_set_verbosity (3);
+
+  /* Always read the text files, since the point is to remake the image */
+  use_atomic_image = FALSE;
+  get_atomic_data (masterfile);
+
+  if (write_atomic_image (masterfile))
+    exit (1);
+
+  atomic_image_name (masterfile, image);
+  printf ("Wrote the atomic data from %s to %s\n", masterfile, image);
+
+  return (0);
+}
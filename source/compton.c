@@ -17,6 +17,17 @@
 
 PlasmaPtr xplasma;              /// Pointer to current plasma cell
 
+/* Parameters of the tables used in Compton scattering, which are described
+ * with compton_table_make at the end of this file */
+
+#define COMPTON_TAB_LXMIN   -4.0        /// log10 of the lowest ratio of photon to electron energy tabulated
+#define COMPTON_TAB_LXMAX   2.0 /// log10 of the highest ratio of photon to electron energy tabulated
+#define COMPTON_TAB_NX      121 /// The number of energy ratios tabulated
+#define COMPTON_TAB_NU      129 /// The number of random deviates tabulated for the scattering direction
+#define COMPTON_THERMAL_NU  1025        /// The number of random deviates tabulated for the thermal speed
+#define COMPTON_THERMAL_VMAX 5.0        /// The largest thermal speed, in units of sqrt(2kT/m)
+#define COMPTON_TAB_TOL     1e-4        /// The largest error allowed when interpolating in a table
+
 
 
 /**********************************************************/
@@ -381,7 +392,8 @@ klein_nishina (nu)
   return (kn);
 }
 
-//External variables to allow zero_find to search for the correct fractional energy change
+//External variables to allow zero_find to search for the correct fractional energy change with compton_func.
+//compton_dir no longer uses these, see compton_kn_invert, but they are kept for compton_func
 
 double sigma_rand;              //The randomised cross section that our photon will see
 double sigma_max;               //The cross section for the maxmimum energy loss
@@ -455,19 +467,19 @@ compton_dir (p)
      PhotPtr p;                 // Pointer to the current photon
 
 {
-  double f_min, f_max, f;       //Fractional energy changes - E_old/E_new - minimum possible, maximum possible, actual as implied by random cross section
+  double f;                     //Fractional energy change - E_old/E_new - as implied by a random cross section
   double n, l, m, phi, len;     //The direction cosines of the new photon direction in the frame of reference with q along the photon path
+  double energy_ratio;          //The ratio of photon energy to electron rest mass energy
   struct basis nbasis;          //The basis function which transforms between the photon frame and the observer frame
   double lmn[3];                /* the individual direction cosines in the rotated frame */
   double x[3];                  /*photon direction in the frame of reference of the original photon */
   double dummy[3], c[3];
-  int ierr = FALSE;
 
-  x1 = PLANCK * p->freq / MELEC / VLIGHT / VLIGHT;      //compute the ratio of photon energy to electron energy. In the electron rest frame this is just the electron rest mass energy
+  energy_ratio = PLANCK * p->freq / MELEC / VLIGHT / VLIGHT;    //compute the ratio of photon energy to electron energy. In the electron rest frame this is just the electron rest mass energy
 
   n = l = m = 0.0;
 
-  if (x1 < 0.0001)              //If the photon energy is low, we use the diple approximation            
+  if (energy_ratio < 0.0001)    //If the photon energy is low, we use the diple approximation
   {
     randvdipole (lmn, p->lmn);
     stuff_v (lmn, p->lmn);
@@ -476,25 +488,23 @@ compton_dir (p)
   {
 
     /* The process is as follows:
-       Generate a random number between 0 and 1 - this represents a randomised cross section (normalised to the maximum which out photon packet sees
-       Calculate the mininumum and max energy change, corresponding to scattering angles of 0 and 180 degrees
-       Calculate sigma_max, a variable that is communicated externally to the zero_find routine.  This is used to scale the K_N function to lie between 
-       0 and 1. This is essentually the chance of a photon scattering through 180 degrees - or the angle giving the maximum energy loss
-       Find the zero that represents our randomised fractional energy loss z_rand.
+       Generate a random number between 0 and 1 - this represents a randomised cross section (normalised to the maximum which out photon packet sees)
+       Find the fractional energy change f, between 1 (no deflection) and 1+2x (scattering through 180 degrees), for which the
+       partial KN cross section is this fraction of the maximum. This is read from a table of the inverse of the cumulative
+       distribution, unless the table has been turned off, or is not accurate enough here, in which case it is found directly.
      */
-    sigma_rand = random_number (0.0, 1.0);
-    f_min = 1.;
-    f_max = 1. + (2. * x1);
-    sigma_max = sigma_compton_partial (f_max, x1);
-    f = zero_find (compton_func, f_min, f_max, 1e-8, &ierr);
-    if (ierr)
+    if (modes.compton_tables)
+    {
+      f = compton_kn_sample (energy_ratio, random_number (0.0, 1.0));
+    }
+    else
     {
-      Error ("compton_dir: zero_find failed\n");
+      f = compton_kn_invert (energy_ratio, random_number (0.0, 1.0));
     }
 /*We now have the fractional energy change f - we use the 'normal' equation for Compton scattering 
   to obtain the angle cosine n=cos(\theta)	for the scattering direction*/
 
-    n = (1. - ((f - 1.) / x1)); //This is the angle cosine of the new direction in the frame of reference of the photon - this gives a 2D scattering angle
+    n = (1. - ((f - 1.) / energy_ratio));       //This is the angle cosine of the new direction in the frame of reference of the photon - this gives a 2D scattering angle
 
     if (isfinite (len = sqrt (1. - (n * n))) == 0)      //Compute the length of the other angle cosines - the isfinite is to take care of the very rare occasion where n=1!
       len = 0.0;                // If n=1, then the photon has either been undeflected or bounced straight back. Both are vanishingly unlikely but need to be treated.
@@ -572,14 +582,21 @@ compton_get_thermal_velocity (t, v)
   double vel;
 
 
-  if (init_cdf_thermal)
+  if (modes.compton_tables)
   {
-    double dummy[2] = { 0, 1 };
-    cdf_gen_from_func (&cdf_thermal, &pdf_thermal, 0, 5, 0, dummy);
-    init_cdf_thermal = FALSE;
+    vel = compton_thermal_sample (random_number (0.0, 1.0));
   }
+  else
+  {
+    if (init_cdf_thermal)
+    {
+      double dummy[2] = { 0, 1 };
+      cdf_gen_from_func (&cdf_thermal, &pdf_thermal, 0, COMPTON_THERMAL_VMAX, 0, dummy);
+      init_cdf_thermal = FALSE;
+    }
 
-  vel = cdf_get_rand (&cdf_thermal);
+    vel = cdf_get_rand (&cdf_thermal);
+  }
 
   vel *= sqrt ((2. * BOLTZMANN / MELEC) * t);
 
@@ -859,7 +876,14 @@ compton_reweight (p_in, p_out)
 
   reweight = xr * xr * (xr + 1. / xr - sin (theta) * sin (theta));
 
-  reweight *= 4. * PI / compton_reweight_norm (p_in->freq);
+  if (modes.compton_tables)
+  {
+    reweight *= 4. * PI / compton_reweight_norm_sample (p_in->freq);
+  }
+  else
+  {
+    reweight *= 4. * PI / compton_reweight_norm (p_in->freq);
+  }
 
 
 
@@ -873,3 +897,443 @@ compton_reweight (p_in, p_out)
 
   return (0);
 }
+
+
+
+/* The tables used in Compton scattering.  Each holds a function of the ratio
+ * x of photon energy to electron rest mass energy and of a uniform random
+ * deviate u, on a grid which is regular in log10(x) and in u, and is
+ * interpolated bilinearly.  Tables of x alone have nu=1, and tables of u
+ * alone have nx=1. */
+
+typedef struct compton_table
+{
+  int nx, nu;                   /* The number of nodes in log10(x) and in u */
+  double lx_min, dlx, du;       /* The lowest log10(x) and the spacing of the nodes */
+  double tol;                   /* The largest error allowed when interpolating */
+  double *value;                /* The values at the nodes, with u varying fastest */
+  char *exact;                  /* For each cell, TRUE if interpolation is not accurate enough */
+  double (*func) (double x, double u);  /* The function which is tabulated */
+} compton_table_dummy, *CompTablePtr;
+
+static compton_table_dummy comp_tab_kn, comp_tab_norm, comp_tab_thermal;
+static int comp_tab_init = FALSE;
+
+
+/**********************************************************/
+/**
+ * @brief      The number of cells along one axis of a Compton table
+ *
+ * @param [in] int  n   The number of nodes along the axis
+ * @return     The number of cells, which is one for an axis with a single node
+ *
+ **********************************************************/
+
+static int
+compton_table_ncell (int n)
+{
+  return (n > 1 ? n - 1 : 1);
+}
+
+
+/**********************************************************/
+/**
+ * @brief      Interpolate bilinearly within one cell of a Compton table
+ *
+ * @param [in] CompTablePtr  tab   The table
+ * @param [in] int  i   The cell in log10(x)
+ * @param [in] int  j   The cell in u
+ * @param [in] double  fx   The fractional position within the cell in log10(x)
+ * @param [in] double  fu   The fractional position within the cell in u
+ * @return     The interpolated value
+ *
+ **********************************************************/
+
+static double
+compton_table_interp (CompTablePtr tab, int i, int j, double fx, double fu)
+{
+  int i1, j1;
+  double *v = tab->value;
+  int nu = tab->nu;
+
+  i1 = (tab->nx > 1) ? i + 1 : i;
+  j1 = (tab->nu > 1) ? j + 1 : j;
+
+  return ((1. - fx) * ((1. - fu) * v[i * nu + j] + fu * v[i * nu + j1]) + fx * ((1. - fu) * v[i1 * nu + j] + fu * v[i1 * nu + j1]));
+}
+
+
+/**********************************************************/
+/**
+ * @brief      Make one of the tables used in Compton scattering
+ *
+ * @param [out] CompTablePtr  tab   The table
+ * @param [in] int  nx   The number of nodes in log10(x), from COMPTON_TAB_LXMIN to COMPTON_TAB_LXMAX
+ * @param [in] int  nu   The number of nodes in u, from 0 to 1
+ * @param [in] double  (*func) (double, double)   The function to tabulate
+ * @param [in] double  tol   The largest error allowed when interpolating
+ * @return     The number of cells where the function must be evaluated exactly
+ *
+ * @details
+ * Once the function has been evaluated at the nodes, the interpolated
+ * value at the centre of each cell is compared with the function itself.
+ * Cells where the error is larger than tol (or than tol times the value,
+ * where the value is larger than one) are flagged, and compton_table_eval
+ * calls the function directly there, as it does outside the range of x
+ * which is tabulated.
+ *
+ **********************************************************/
+
+static int
+compton_table_make (CompTablePtr tab, int nx, int nu, double (*func) (double, double), double tol)
+{
+  int i, j, ncx, ncu, nexact;
+  double exact, interp;
+
+  tab->nx = nx;
+  tab->nu = nu;
+  tab->func = func;
+  tab->tol = tol;
+  tab->lx_min = COMPTON_TAB_LXMIN;
+  tab->dlx = (nx > 1) ? (COMPTON_TAB_LXMAX - COMPTON_TAB_LXMIN) / (nx - 1) : 0.0;
+  tab->du = (nu > 1) ? 1.0 / (nu - 1) : 0.0;
+
+  ncx = compton_table_ncell (nx);
+  ncu = compton_table_ncell (nu);
+
+  if ((tab->value = calloc (sizeof (double), nx * nu)) == NULL || (tab->exact = calloc (sizeof (char), ncx * ncu)) == NULL)
+  {
+    Error ("compton_table_make: Error in allocating memory for a table of %d x %d\n", nx, nu);
+    Exit (EXIT_FAILURE);
+  }
+
+  for (i = 0; i < nx; i++)
+  {
+    for (j = 0; j < nu; j++)
+    {
+      tab->value[i * nu + j] = func (pow (10., tab->lx_min + i * tab->dlx), j * tab->du);
+    }
+  }
+
+  nexact = 0;
+  for (i = 0; i < ncx; i++)
+  {
+    for (j = 0; j < ncu; j++)
+    {
+      exact = func (pow (10., tab->lx_min + (i + 0.5) * tab->dlx), (j + 0.5) * tab->du);
+      interp = compton_table_interp (tab, i, j, 0.5, 0.5);
+      if (fabs (interp - exact) > tol * fmax (1.0, fabs (exact)))
+      {
+        tab->exact[i * ncu + j] = TRUE;
+        nexact++;
+      }
+    }
+  }
+
+  return (nexact);
+}
+
+
+/**********************************************************/
+/**
+ * @brief      Evaluate one of the tables used in Compton scattering
+ *
+ * @param [in] CompTablePtr  tab   The table
+ * @param [in] double  x   The ratio of photon to electron rest mass energy, ignored if nx=1
+ * @param [in] double  u   The random deviate, between 0 and 1, ignored if nu=1
+ * @return     The value of the tabulated function
+ *
+ **********************************************************/
+
+static double
+compton_table_eval (CompTablePtr tab, double x, double u)
+{
+  int i = 0, j = 0;
+  double fx = 0.0, fu = 0.0;
+
+  if (tab->nx > 1)
+  {
+    fx = (log10 (x) - tab->lx_min) / tab->dlx;
+    if (fx < 0.0 || fx >= tab->nx - 1)
+    {
+      return (tab->func (x, u));
+    }
+    i = (int) fx;
+    fx -= i;
+  }
+
+  if (tab->nu > 1)
+  {
+    fu = u / tab->du;
+    j = (int) fu;
+    if (j > tab->nu - 2)
+    {
+      j = tab->nu - 2;
+    }
+    fu -= j;
+  }
+
+  if (tab->exact[i * compton_table_ncell (tab->nu) + j])
+  {
+    return (tab->func (x, u));
+  }
+
+  return (compton_table_interp (tab, i, j, fx, fu));
+}
+
+
+/**********************************************************/
+/**
+ * @brief      The derivative of sigma_compton_partial with respect to the
+ * fractional energy change
+ *
+ * @param [in] double  f   The fractional energy change
+ * @param [in] double  x   The energy of the incoming photon divided by the rest mass energy of an electron
+ * @return     d sigma_compton_partial / df
+ *
+ **********************************************************/
+
+static double
+dsigma_compton_partial_df (double f, double x)
+{
+  double tot;
+
+  tot = ((x * x) - (2 * x) - 2) / (x * x * f) + 1. / (f * f * f) + 1. / (x * x) + 2. / (x * f * f) + 1. / (x * x * f * f);
+
+  return (3 * THOMPSON * tot / (8 * x));
+}
+
+
+/**********************************************************/
+/**
+ * @brief      Find the fractional energy change of a Compton scattered photon
+ * for a given random deviate
+ *
+ * @param [in] double  x   The energy of the incoming photon divided by the rest mass energy of an electron
+ * @param [in] double  u   A random number between 0 and 1, the fraction of the maximum partial cross section
+ * @return     The fractional energy change f, between 1 and 1+2x
+ *
+ * @details
+ * This solves sigma_compton_partial(f, x) = u * sigma_compton_partial(1+2x, x),
+ * which compton_dir used to do with zero_find and compton_func. It uses
+ * Newton-Raphson steps, falling back to bisection whenever a step would leave
+ * the bracket, and no external variables.
+ *
+ **********************************************************/
+
+double
+compton_kn_invert (double x, double u)
+{
+  double f, f_new, f_lo, f_hi;
+  double sigma_tot, g;
+  int n;
+
+  f_lo = 1.;
+  f_hi = 1. + (2. * x);
+  sigma_tot = sigma_compton_partial (f_hi, x);
+  f = 1. + (2. * x * u);
+
+  for (n = 0; n < 100; n++)
+  {
+    g = sigma_compton_partial (f, x) / sigma_tot - u;
+    if (g == 0.0)
+    {
+      return (f);
+    }
+    else if (g < 0.0)
+    {
+      f_lo = f;
+    }
+    else
+    {
+      f_hi = f;
+    }
+
+    f_new = f - g * sigma_tot / dsigma_compton_partial_df (f, x);
+    if (!(f_new > f_lo && f_new < f_hi))
+    {
+      f_new = 0.5 * (f_lo + f_hi);
+    }
+
+    if (fabs (f_new - f) < 1e-8)
+    {
+      return (f_new);
+    }
+    f = f_new;
+  }
+
+  Error ("compton_kn_invert: did not converge for x %e u %e\n", x, u);
+
+  return (f);
+}
+
+
+/**********************************************************/
+/**
+ * @brief      The function of x and u held in the table of scattering directions
+ *
+ * @details
+ * The table holds ln(f)/ln(1+2x), which runs from 0 to 1 for every x and is
+ * more nearly linear than f itself.
+ *
+ **********************************************************/
+
+static double
+compton_kn_table_func (double x, double u)
+{
+  return (log (compton_kn_invert (x, u)) / log (1. + 2. * x));
+}
+
+
+/**********************************************************/
+/**
+ * @brief      The normalisation used in compton_reweight, as a function of x
+ *
+ **********************************************************/
+
+static double
+compton_norm_table_func (double x, double u)
+{
+  return (compton_reweight_norm (x * MELEC * VLIGHT * VLIGHT / PLANCK));
+}
+
+
+/**********************************************************/
+/**
+ * @brief      Find the speed of a thermal electron, for a given random deviate
+ *
+ * @param [in] double  x   Not used
+ * @param [in] double  u   A random number between 0 and 1
+ * @return     The speed in units of sqrt(2kT/m)
+ *
+ * @details
+ * This inverts the cumulative Maxwell-Boltzmann distribution of
+ * pdf_thermal, truncated at COMPTON_THERMAL_VMAX as the cdf used in
+ * compton_get_thermal_velocity has always been, by bisection.
+ *
+ **********************************************************/
+
+static double
+compton_thermal_table_func (double x, double u)
+{
+  double v_lo, v_hi, v, norm, cdf;
+  int n;
+
+  norm = erf (COMPTON_THERMAL_VMAX) - 2. * COMPTON_THERMAL_VMAX * exp (-COMPTON_THERMAL_VMAX * COMPTON_THERMAL_VMAX) / sqrt (PI);
+
+  v_lo = 0.0;
+  v_hi = COMPTON_THERMAL_VMAX;
+  v = 0.5 * (v_lo + v_hi);
+
+  for (n = 0; n < 60 && v_hi - v_lo > 1e-10; n++)
+  {
+    v = 0.5 * (v_lo + v_hi);
+    cdf = (erf (v) - 2. * v * exp (-v * v) / sqrt (PI)) / norm;
+    if (cdf < u)
+    {
+      v_lo = v;
+    }
+    else
+    {
+      v_hi = v;
+    }
+  }
+
+  return (0.5 * (v_lo + v_hi));
+}
+
+
+/**********************************************************/
+/**
+ * @brief      Make the tables used in Compton scattering
+ *
+ * @details
+ * This is called during setup when the tables are turned on with
+ * -compton_tables.  The samplers also make the tables the first time any
+ * of them is needed, if that has not already been done, as happens in the
+ * unit tests.  The tables are not changed afterwards.
+ *
+ **********************************************************/
+
+void
+init_compton_tables (void)
+{
+  int nexact;
+
+  nexact = compton_table_make (&comp_tab_kn, COMPTON_TAB_NX, COMPTON_TAB_NU, compton_kn_table_func, COMPTON_TAB_TOL);
+  Log_silent ("init_compton_tables: %d of %d cells of the scattering direction table are evaluated exactly\n", nexact,
+              (COMPTON_TAB_NX - 1) * (COMPTON_TAB_NU - 1));
+  nexact = compton_table_make (&comp_tab_norm, COMPTON_TAB_NX, 1, compton_norm_table_func, COMPTON_TAB_TOL);
+  Log_silent ("init_compton_tables: %d of %d cells of the reweighting normalisation table are evaluated exactly\n", nexact,
+              COMPTON_TAB_NX - 1);
+  nexact = compton_table_make (&comp_tab_thermal, 1, COMPTON_THERMAL_NU, compton_thermal_table_func, COMPTON_TAB_TOL);
+  Log_silent ("init_compton_tables: %d of %d cells of the thermal speed table are evaluated exactly\n", nexact, COMPTON_THERMAL_NU - 1);
+
+  comp_tab_init = TRUE;
+}
+
+
+/**********************************************************/
+/**
+ * @brief      Find the fractional energy change of a Compton scattered
+ * photon from the tabulated inverse of the KN cumulative distribution
+ *
+ * @param [in] double  x   The energy of the incoming photon divided by the rest mass energy of an electron
+ * @param [in] double  u   A random number between 0 and 1
+ * @return     The fractional energy change f, as compton_kn_invert
+ *
+ **********************************************************/
+
+double
+compton_kn_sample (double x, double u)
+{
+  if (comp_tab_init == FALSE)
+  {
+    init_compton_tables ();
+  }
+
+  return (exp (compton_table_eval (&comp_tab_kn, x, u) * log (1. + 2. * x)));
+}
+
+
+/**********************************************************/
+/**
+ * @brief      The normalisation used in compton_reweight, from a table
+ *
+ * @param [in] double  nu   The frequency of the unscattered photon
+ * @return     compton_reweight_norm(nu)
+ *
+ **********************************************************/
+
+double
+compton_reweight_norm_sample (double nu)
+{
+  if (comp_tab_init == FALSE)
+  {
+    init_compton_tables ();
+  }
+
+  return (compton_table_eval (&comp_tab_norm, PLANCK * nu / (MELEC * VLIGHT * VLIGHT), 0.0));
+}
+
+
+/**********************************************************/
+/**
+ * @brief      The speed of a thermal electron from the tabulated inverse
+ * of the Maxwell-Boltzmann cumulative distribution
+ *
+ * @param [in] double  u   A random number between 0 and 1
+ * @return     The speed in units of sqrt(2kT/m)
+ *
+ **********************************************************/
+
+double
+compton_thermal_sample (double u)
+{
+  if (comp_tab_init == FALSE)
+  {
+    init_compton_tables ();
+  }
+
+  return (compton_table_eval (&comp_tab_thermal, 1.0, u));
+}
@@ -41,6 +41,12 @@ compute_dr_coeffs (temp)
 {
   int n, n1, n2;
   double Adi, Bdi, T0, T1;
+
+  if (te_coeff_cache_lookup (TE_COEFF_DR, temp, dr_coeffs))
+  {
+    return (0);
+  }
+
   for (n = 1; n < nions + 1; n++)
   {
     if (ion[n].drflag == 0)     //There are no dielectronic coefficients relating to this ion
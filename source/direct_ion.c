@@ -53,6 +53,11 @@ compute_di_coeffs (T)
 {
   int n;
 
+  if (te_coeff_cache_lookup (TE_COEFF_DI, T, di_coeffs))
+  {
+    return (0);
+  }
+
   for (n = 0; n < nions; n++)   //Loop over all ions
   {
     if (ion[n].dere_di_flag == 0)       //If there isnt DI data for the ion
@@ -244,6 +249,11 @@ compute_qrecomb_coeffs (T)
 
   xtop = NULL;                  //Avoid compiler warning, though it seem odd we need to do this at all.
 
+  if (te_coeff_cache_lookup (TE_COEFF_QRECOMB, T, qrecomb_coeffs))
+  {
+    return (0);
+  }
+
   for (n = 0; n < nions; n++)   //We need to generate data for the ions doing the recombining.
   {
     if (ion[n].istate > 1)      //We cannot recombine to anything from the neutral iom
@@ -819,9 +819,17 @@ ds_to_disk (p, allow_negative, hit)
    */
 
 
-  stuff_phot (p, &ds_to_disk_photon);
+  ierr = TRUE;
+  if (modes.disk_table)
+  {
+    s = ds_to_disk_surface (p, smin, smax, &ierr);
+  }
 
-  s = zero_find (disk_height, smin, smax, 1, &ierr);
+  if (ierr)
+  {
+    stuff_phot (p, &ds_to_disk_photon);
+    s = zero_find (disk_height, smin, smax, 1, &ierr);
+  }
 
   if (ierr)
   {
@@ -920,6 +928,403 @@ ds_to_disk (p, allow_negative, hit)
 
 
 
+/* A table of the surface of a vertically extended disk, in which the height of the disk
+ * is taken to vary linearly with radius between radii spaced logarithmically out to
+ * the edge of the disk, so each segment of the surface is the frustum of a cone.  The
+ * innermost segment is a cone with its point at the origin.  This is used by
+ * ds_to_disk_surface when modes.disk_table is set.
+ */
+
+#define NDISK_SURFACE 4096
+#define DISK_SURFACE_RMIN 1e-6  /* The radius of the tip of the innermost cone, as a fraction of geo.disk_rad_max */
+
+static struct
+{
+  double z0, z1, rmax;          /* The parameters of the disk the table was made for */
+  double dlogr;                 /* The logarithmic spacing of the radii */
+  double r[NDISK_SURFACE + 1], z[NDISK_SURFACE + 1];
+  double a[NDISK_SURFACE], b[NDISK_SURFACE];    /* The height of segment i is a[i] + b[i] r */
+} disk_surface = { -1 };
+
+
+
+/**********************************************************/
+/**
+ * @brief      Make the table of the surface of a vertically extended disk
+ *
+ * @return     Always returns 0
+ *
+ * @details
+ * The table is remade whenever the parameters of the disk have changed
+ * since it was last made.
+ *
+ **********************************************************/
+
+static int
+disk_surface_init ()
+{
+  int i;
+
+  if (disk_surface.z0 == geo.disk_z0 && disk_surface.z1 == geo.disk_z1 && disk_surface.rmax == geo.disk_rad_max)
+    return (0);
+
+  disk_surface.z0 = geo.disk_z0;
+  disk_surface.z1 = geo.disk_z1;
+  disk_surface.rmax = geo.disk_rad_max;
+  disk_surface.dlogr = -log (DISK_SURFACE_RMIN) / (NDISK_SURFACE - 1);
+
+  disk_surface.r[0] = disk_surface.z[0] = 0;
+  for (i = 1; i <= NDISK_SURFACE; i++)
+  {
+    disk_surface.r[i] = geo.disk_rad_max * exp ((i - NDISK_SURFACE) * disk_surface.dlogr);
+    disk_surface.z[i] = zdisk (disk_surface.r[i]);
+  }
+  disk_surface.r[NDISK_SURFACE] = geo.disk_rad_max;
+
+  for (i = 0; i < NDISK_SURFACE; i++)
+  {
+    disk_surface.b[i] = (disk_surface.z[i + 1] - disk_surface.z[i]) / (disk_surface.r[i + 1] - disk_surface.r[i]);
+    disk_surface.a[i] = disk_surface.z[i] - disk_surface.b[i] * disk_surface.r[i];
+  }
+
+  return (0);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Find the segment of the table of the disk surface which
+ * contains a radius
+ *
+ * @param [in] double  r   The radius
+ * @return     The segment, limited to those in the table
+ *
+ **********************************************************/
+
+static int
+disk_surface_segment (r)
+     double r;
+{
+  int i;
+
+  if (r < disk_surface.r[1])
+    return (0);
+  if (r >= geo.disk_rad_max)
+    return (NDISK_SURFACE - 1);
+
+  i = NDISK_SURFACE + (int) floor (log (r / geo.disk_rad_max) / disk_surface.dlogr);
+  if (i < 1)
+    i = 1;
+  else if (i > NDISK_SURFACE - 1)
+    i = NDISK_SURFACE - 1;
+
+  /* Allow for rounding in the logarithm */
+  if (r < disk_surface.r[i] && i > 1)
+    i--;
+  else if (r >= disk_surface.r[i + 1] && i < NDISK_SURFACE - 1)
+    i++;
+
+  return (i);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Find where a photon path crosses one segment of the table
+ * of the disk surface
+ *
+ * @param [in] double  x[]   The position of the photon
+ * @param [in] double  lmn[]   The direction of the photon
+ * @param [in] int  i   The segment
+ * @param [in] double  s1   The smallest distance to consider
+ * @param [in] double  s2   The largest distance to consider
+ * @param [in] int  backwards   If TRUE, look for the crossing nearest s2,
+ * otherwise the one nearest s1
+ * @param [out] double *  s   The distance to the crossing
+ * @return     TRUE if the path crosses the segment between s1 and s2,
+ * FALSE otherwise
+ *
+ * @details
+ * On the top of the disk, where z = a + b r, squaring
+ * (z0 + s n - a)^2 = b^2 r(s)^2 gives a quadratic in s, and similarly for
+ * the bottom, where z = -(a + b r).  Roots of the squared equation which
+ * are on the wrong side of the disk plane, or outside the segment, are
+ * rejected.
+ *
+ **********************************************************/
+
+static int
+ds_to_disk_segment (x, lmn, i, s1, s2, backwards, s)
+     double x[], lmn[];
+     int i;
+     double s1, s2;
+     int backwards;
+     double *s;
+{
+  double a, b, q, pp, rho2;
+  double u, w, aa, bb, cc, disc, root[2], r, z;
+  int side, n, nroot, found;
+
+  a = disk_surface.a[i];
+  b = disk_surface.b[i];
+  q = lmn[0] * lmn[0] + lmn[1] * lmn[1];
+  pp = x[0] * lmn[0] + x[1] * lmn[1];
+  rho2 = x[0] * x[0] + x[1] * x[1];
+
+  found = FALSE;
+
+  for (side = -1; side <= 1; side += 2)
+  {
+    u = side * x[2] - a;
+    w = side * lmn[2];
+    aa = w * w - b * b * q;
+    bb = 2. * (u * w - b * b * pp);
+    cc = u * u - b * b * rho2;
+
+    nroot = 0;
+    if (fabs (aa) <= 1e-12 * (w * w + b * b * q))
+    {
+      if (bb != 0)
+        root[nroot++] = -cc / bb;
+    }
+    else if ((disc = bb * bb - 4. * aa * cc) >= 0)
+    {
+      /* The numerically stable form of the two roots */
+      disc = -0.5 * (bb + (bb > 0 ? sqrt (disc) : -sqrt (disc)));
+      if (disc != 0)
+      {
+        root[nroot++] = disc / aa;
+        root[nroot++] = cc / disc;
+      }
+      else
+      {
+        root[nroot++] = 0;
+      }
+    }
+
+    for (n = 0; n < nroot; n++)
+    {
+      if (root[n] < s1 || root[n] > s2)
+        continue;
+      if (found && (backwards ? root[n] <= *s : root[n] >= *s))
+        continue;
+      z = side * (x[2] + root[n] * lmn[2]);
+      r = sqrt (fabs (rho2 + root[n] * (2. * pp + root[n] * q)));
+      if (z < 0 || z - a < 0 || r < disk_surface.r[i] * (1. - 1e-9) || r > disk_surface.r[i + 1] * (1. + 1e-9))
+        continue;
+      *s = root[n];
+      found = TRUE;
+    }
+  }
+
+  return (found);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Find the distance along a photon path at which it reaches
+ * a radius
+ *
+ * @param [in] double  rho2   The square of the distance of the photon from the z axis
+ * @param [in] double  pp   x lx + y ly for the photon
+ * @param [in] double  q   lx^2 + ly^2 for the photon
+ * @param [in] double  r   The radius
+ * @param [in] int  outward   TRUE for the part of the path moving away from the z axis,
+ * FALSE for the part moving towards it
+ * @return     The distance, or the distance of closest approach to the z axis if
+ * the path does not reach r
+ *
+ **********************************************************/
+
+static double
+ds_to_radius (rho2, pp, q, r, outward)
+     double rho2, pp, q, r;
+     int outward;
+{
+  double disc;
+
+  disc = pp * pp - q * (rho2 - r * r);
+  if (disc < 0)
+    disc = 0;
+
+  return ((-pp + (outward ? sqrt (disc) : -sqrt (disc))) / q);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Find where a photon first hits the surface of a vertically
+ * extended disk, using a table of the surface
+ *
+ * @param [in] PhotPtr  p   The photon
+ * @param [in] double  smin   The smallest distance to consider
+ * @param [in] double  smax   The largest distance to consider
+ * @param [out] int *  ierr   FALSE if the surface was hit, TRUE otherwise
+ * @return     The distance to the surface
+ *
+ * @details
+ * This replaces the root finding in ds_to_disk, when modes.disk_table
+ * is set.  The crossing nearest the photon is found, which is the one
+ * nearest smin unless the whole range is behind the photon, as it is when
+ * ds_to_disk looks back for where a photon entered the disk.
+ *
+ * The radius along the path of a photon falls to a minimum and then rises,
+ * so between smin and smax the path runs through the radii of the table in
+ * at most two monotonic pieces.  These are followed in order along the
+ * path through blocks of DISK_SURFACE_BLOCK segments.  A block is skipped
+ * if the photon stays on one side of the disk plane and above the highest
+ * point of the disk in the block; otherwise the segments in it are checked
+ * using the analytic intersection with each frustum.
+ *
+ * The distance found is refined with a single Newton step on the true
+ * surface given by zdisk, so that the error from the table is reduced to a
+ * small fraction of a cm.
+ *
+ * If the surface is not hit, ds_to_disk falls back to the root finder.
+ *
+ **********************************************************/
+
+#define DISK_SURFACE_BLOCK 64
+
+double
+ds_to_disk_surface (p, smin, smax, ierr)
+     PhotPtr p;
+     double smin, smax;
+     int *ierr;
+{
+  double q, pp, rho2;
+  double s_piece[3], s1, s2, sa, sb, za, zb, r1, r2;
+  double s, ds, r, dfds, f;
+  int npieces, n, k, i, i1, i2, di, ilo, ihi, outward;
+  int backwards, found;
+
+  *ierr = TRUE;
+  disk_surface_init ();
+
+  q = p->lmn[0] * p->lmn[0] + p->lmn[1] * p->lmn[1];
+  pp = p->x[0] * p->lmn[0] + p->x[1] * p->lmn[1];
+  rho2 = p->x[0] * p->x[0] + p->x[1] * p->x[1];
+  backwards = (smax <= 0 && smin < 0);
+
+  /* Split the path at the point closest to the z axis */
+  npieces = 0;
+  s_piece[npieces++] = smin;
+  if (q > 0 && -pp / q > smin && -pp / q < smax)
+    s_piece[npieces++] = -pp / q;
+  s_piece[npieces] = smax;
+
+  s = 0;
+  found = FALSE;
+
+  for (k = 0; k < npieces && found == FALSE; k++)
+  {
+    n = backwards ? npieces - 1 - k : k;
+    s1 = s_piece[n];
+    s2 = s_piece[n + 1];
+    r1 = sqrt (fabs (rho2 + s1 * (2. * pp + s1 * q)));
+    r2 = sqrt (fabs (rho2 + s2 * (2. * pp + s2 * q)));
+    if (r1 >= geo.disk_rad_max && r2 >= geo.disk_rad_max)
+      continue;
+
+    outward = (r2 > r1);
+    i1 = disk_surface_segment (backwards ? r2 : r1);
+    i2 = disk_surface_segment (backwards ? r1 : r2);
+    di = (i2 >= i1) ? 1 : -1;
+
+    for (i = i1;;)
+    {
+      /* The segments of this block which the piece of the path covers */
+      if (di > 0)
+      {
+        ilo = i;
+        ihi = (i / DISK_SURFACE_BLOCK + 1) * DISK_SURFACE_BLOCK - 1;
+        if (ihi > i2)
+          ihi = i2;
+      }
+      else
+      {
+        ihi = i;
+        ilo = (i / DISK_SURFACE_BLOCK) * DISK_SURFACE_BLOCK;
+        if (ilo < i2)
+          ilo = i2;
+      }
+
+      /* The bounding volume check.  For a disk which flares outwards, the block
+         is not hit if the photon stays on one side of the disk plane, and above
+         the disk surface at the outer edge of the block.  The height of the photon
+         varies linearly along the path, so it is enough to check where the path
+         enters and leaves the block. */
+
+      if (q > 0 && geo.disk_z1 >= 0)
+      {
+        sa = ds_to_radius (rho2, pp, q, disk_surface.r[ilo], outward);
+        sb = ds_to_radius (rho2, pp, q, disk_surface.r[ihi + 1], outward);
+        if (sa < s1)
+          sa = s1;
+        else if (sa > s2)
+          sa = s2;
+        if (sb < s1)
+          sb = s1;
+        else if (sb > s2)
+          sb = s2;
+        za = p->x[2] + sa * p->lmn[2];
+        zb = p->x[2] + sb * p->lmn[2];
+        if (za * zb > 0 && fabs (za) > disk_surface.z[ihi + 1] && fabs (zb) > disk_surface.z[ihi + 1])
+        {
+          if (ilo == i2 || ihi == i2)
+            break;
+          i = (di > 0) ? ihi + 1 : ilo - 1;
+          continue;
+        }
+      }
+
+      for (i = (di > 0 ? ilo : ihi); i >= ilo && i <= ihi; i += di)
+      {
+        if ((found = ds_to_disk_segment (p->x, p->lmn, i, s1, s2, backwards, &s)))
+          break;
+      }
+      if (found || ilo == i2 || ihi == i2)
+        break;
+      i = (di > 0) ? ihi + 1 : ilo - 1;
+    }
+  }
+
+  if (found == FALSE)
+  {
+    return (0);
+  }
+
+  /* Refine the distance on the true surface of the disk */
+
+  r = sqrt (fabs (rho2 + s * (2. * pp + s * q)));
+  if (r > 0)
+  {
+    f = zdisk (r) - fabs (p->x[2] + s * p->lmn[2]);
+    dfds = geo.disk_z1 * zdisk (r) / r * (pp + s * q) / r;
+    dfds -= (p->x[2] + s * p->lmn[2] > 0 ? p->lmn[2] : -p->lmn[2]);
+    if (dfds != 0)
+    {
+      ds = -f / dfds;
+      if (s + ds >= smin && s + ds <= smax)
+      {
+        r = sqrt (fabs (rho2 + (s + ds) * (2. * pp + (s + ds) * q)));
+        if (fabs (zdisk (r) - fabs (p->x[2] + (s + ds) * p->lmn[2])) < fabs (f))
+          s += ds;
+      }
+    }
+  }
+
+  *ierr = FALSE;
+  return (s);
+}
+
+
+
 /**********************************************************/
 /**
  * @brief      Calculate the change in disk height as s function of s
@@ -75,6 +75,8 @@ disk_init (rmin, rmax, m, mdot, freqmin, freqmax, ioniz_or_extract, ftot)
   int spectype;
   double emit;
   double factor, fcol;
+  static double step_emit[STEPS + 2];
+  int istep, nsteps;
 
 
 
@@ -136,6 +138,7 @@ disk_init (rmin, rmax, m, mdot, freqmin, freqmax, ioniz_or_extract, ftot)
   q1 = 2. * PI;
 
   (*ftot) = 0;
+  istep = 0;
 
 
   for (logr = logrmin; logr < logrmax; logr += logdr)
@@ -168,6 +171,8 @@ disk_init (rmin, rmax, m, mdot, freqmin, freqmax, ioniz_or_extract, ftot)
     {
       emit = emittance_bb (freqmin, freqmax, t);
     }
+    if (istep < STEPS + 2)
+      step_emit[istep++] = emit;
     (*ftot) += emit * (2. * r + dr) * dr * factor;
   }
 
@@ -195,6 +200,8 @@ disk_init (rmin, rmax, m, mdot, freqmin, freqmax, ioniz_or_extract, ftot)
   disk.v[0] = sqrt (GRAV * geo.mstar / rmin);
   nrings = 1;
   f = 0;
+  nsteps = istep;
+  istep = 0;
 
   for (logr = logrmin; logr < logrmax; logr += logdr)
   {
@@ -214,7 +221,13 @@ disk_init (rmin, rmax, m, mdot, freqmin, freqmax, ioniz_or_extract, ftot)
       factor = 1.0;
     }
 
-    if (spectype > -1)
+    /* The emittance of each step was found in the loop above, and only needs
+       to be recomputed if there were more steps than could be stored */
+    if (istep < nsteps)
+    {
+      emit = step_emit[istep++];
+    }
+    else if (spectype > -1)
     {
       emit = emittance_continuum (spectype, freqmin, freqmax, t, log_g);
     }
@@ -370,27 +383,54 @@ qdisk_init (rmin, rmax, m, mdot)
  * photons are used to modify the temperatures structure
  * of the disk
  *
- * This routine records information about the 
- * photons which were emitted from the disk 
- * and zeros various arrays that will record information
- * about photons that will hit the disk
+ * This routine zeros various arrays that will record information
+ * about photons that will be emitted by and will hit the disk. The
+ * photons which are emitted from the disk are recorded by
+ * qdisk_record_emission
  * 
  *
  **********************************************************/
 
 int
-qdisk_reinit (p)
-     PhotPtr p;
+qdisk_reinit ()
 {
-  int nphot, i, n;
-  double rho;
-  struct photon pp;
+  int n;
   for (n = 0; n < NRINGS; n++)
   {
     qdisk.emit[n] = qdisk.nhit[n] = qdisk.heat[n] = qdisk.nphot[n] = qdisk.w[n] = qdisk.ave_freq[n] = 0;
   }
 
-  for (nphot = 0; nphot < NPHOT; nphot++)
+  return (0);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Record information about the photons in a flight which
+ *      were emitted from the disk
+ *
+ * @param [in] PhotPtr  p   A flight of photons, before they are transported
+ * @param [in] int  nphot_flight   The number of photons in the flight
+ * @return     Always return zero
+ *
+ * ###Notes###
+ *
+ * This is called for each batch of photons in a cycle, after qdisk_reinit
+ * has been called once at the start of the cycle
+ *
+ **********************************************************/
+
+int
+qdisk_record_emission (p, nphot_flight)
+     PhotPtr p;
+     int nphot_flight;
+{
+  int nphot, i;
+  double rho;
+  struct photon pp;
+
+  for (nphot = 0; nphot < nphot_flight; nphot++)
   {
     stuff_phot (&p[nphot], &pp);
     if (pp.origin_orig == PTYPE_DISK)
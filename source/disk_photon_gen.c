@@ -61,6 +61,8 @@ photo_gen_disk (p, weight, f1, f2, spectype, istart, nphot)
   int nring = 0;
   double north[3];
   double fcol;
+  int ring_count[NRINGS];
+  double ring_expected[NRINGS];
 
   if ((iend = istart + nphot) > NPHOT)
   {
@@ -75,8 +77,24 @@ photo_gen_disk (p, weight, f1, f2, spectype, istart, nphot)
   Log_silent ("photo_gen_disk creates nphot %5d photons from %5d to %5d \n", nphot, istart, iend);
   freqmin = f1;
   freqmax = f2;
+
+  for (i = 0; i < NRINGS; i++)
+  {
+    ring_count[i] = 0;
+    ring_expected[i] = (i < NRINGS - 1) ? (double) nphot / (NRINGS - 1) : 0.0;
+  }
+
+  /* In stratified mode, the ring, the position in it, the hemisphere, the direction
+     and the frequency of the photons are spread evenly over the set of photons */
+
+  if (modes.stratify)
+    stratify_init (nphot, STRATIFY_MAX_DIM);
+
   for (i = istart; i < iend; i++)
   {
+    if (modes.stratify)
+      stratify_sample (i - istart);
+
     p[i].origin = PTYPE_DISK;   // identify this as a disk photon
     p[i].frame = F_LOCAL;
     p[i].w = weight;
@@ -126,6 +144,7 @@ photo_gen_disk (p, weight, f1, f2, spectype, istart, nphot)
       }
 
       disk.nphot[nring]++;
+      ring_count[nring]++;
 
 /* The next line is really valid only if dr is small.  Otherwise one
  * should account for the area.  But haven't fixed this yet ?? 04Dec
@@ -232,6 +251,14 @@ photo_gen_disk (p, weight, f1, f2, spectype, istart, nphot)
 
   }
 
+  stratify_sample (-1);
+
+  if (modes.stratify && !modes.searchlight)
+  {
+    Log ("photo_gen_disk: dispersion of photons amongst rings %8.4f (1 for independent sampling)\n",
+         stratify_dispersion (ring_count, ring_expected, NRINGS));
+  }
+
 
   return (0);
 }
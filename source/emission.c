@@ -284,6 +284,9 @@ photo_gen_wind (p, weight, freqmin, freqmax, photstart, nphot)
   int nplasma = 0;
   int nnscat;
   int ptype[NPLASMA][3];        //Store for the types of photons to be generated in each cell, ff first, fb next, line third
+  int nstart;
+  int *cell_count;
+  double *cell_expected;
   dt_cmf = 0.0;
 
   for (nplasma = 0; nplasma < NPLASMA; nplasma++)
@@ -297,8 +300,17 @@ photo_gen_wind (p, weight, freqmin, freqmax, photstart, nphot)
   photstop = photstart + nphot;
   Log_silent ("photo_gen_wind creates nphot %5d photons from %5d to %5d \n", nphot, photstart, photstop);
 
+  /* In stratified mode, the cells in which photons are generated, and the process
+     which generates them, are spread evenly over the set of photons */
+
+  if (modes.stratify)
+    stratify_init (nphot, 2);
+
   for (kkk = photstart; kkk < photstop; kkk++)
   {
+    if (modes.stratify)
+      stratify_sample (kkk - photstart);
+
     p[kkk].nres = -1;
     p[kkk].nnscat = 1;
 
@@ -355,8 +367,36 @@ photo_gen_wind (p, weight, freqmin, freqmax, photstart, nphot)
 
 
 
-/* Now generate the photons looping over the Plasma cells */
+  stratify_sample (-1);
+
+  /* Record how evenly the photons were spread amongst the cells compared to their luminosity,
+     but only when stratified sampling is in use since that is when this is of interest */
+
+  if (modes.stratify)
+  {
+    cell_count = calloc (NPLASMA, sizeof (int));
+    cell_expected = calloc (NPLASMA, sizeof (double));
+    if (cell_count != NULL && cell_expected != NULL)
+    {
+      for (nplasma = 0; nplasma < NPLASMA; nplasma++)
+      {
+        cell_count[nplasma] = ptype[nplasma][FREE_FREE] + ptype[nplasma][FREE_BOUND] + ptype[nplasma][BOUND_BOUND];
+        cell_expected[nplasma] = nphot * plasmamain[nplasma].lum_tot / plasmamain[nplasma].xgamma / geo.f_wind;
+      }
+      Log ("photo_gen_wind: dispersion of photons amongst cells %8.4f (1 for independent sampling)\n",
+           stratify_dispersion (cell_count, cell_expected, NPLASMA));
+    }
+    free (cell_count);
+    free (cell_expected);
+  }
+
+/* Now generate the photons looping over the Plasma cells, with the frequency, position
+   and direction of each stratified in the same way */
+
+  if (modes.stratify)
+    stratify_init (nphot, STRATIFY_MAX_DIM);
 
+  nstart = photstart;
   photstop = photstart;
 
   icell_old = (-1);
@@ -370,6 +410,8 @@ photo_gen_wind (p, weight, freqmin, freqmax, photstart, nphot)
 
     for (np = photstart; np < photstop; np++)
     {
+      if (modes.stratify)
+        stratify_sample (np - nstart);
 
       if (np < photstart + ptype[nplasma][FREE_FREE])
       {
@@ -457,6 +499,8 @@ photo_gen_wind (p, weight, freqmin, freqmax, photstart, nphot)
     }
   }
 
+  stratify_sample (-1);
+
 
   return (nphot);
 }
@@ -12,6 +12,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "atomic.h"
@@ -157,7 +158,7 @@ update_banded_estimators (xplasma, p, ds, w_ave, ndom)
   {
     i = NBINS_IN_CELL_SPEC - 1;
   }
-  xplasma->cell_spec_flux[i] += w_ave * ds;
+  cell_spec_add (xplasma, i, w_ave * ds);
 
 
 
@@ -672,11 +673,15 @@ normalise_simple_estimators (xplasma)
 
   for (i = 0; i < NBINS_IN_CELL_SPEC; i++)
   {
+    if (xplasma->cell_spec_block[i / CELL_SPEC_BLOCK_SIZE] == NULL)
+    {
+      continue;                 /* No flux was deposited in this block */
+    }
     freq_min = geo.cell_log_freq_min + (i) * geo.cell_delta_lfreq;
     freq_max = freq_min + geo.cell_delta_lfreq;
     dfreq = pow (10., freq_max) - pow (10., freq_min);
 
-    xplasma->cell_spec_flux[i] /= (4 * PI * invariant_volume_time * dfreq);
+    xplasma->cell_spec_block[i / CELL_SPEC_BLOCK_SIZE][i % CELL_SPEC_BLOCK_SIZE] /= (4 * PI * invariant_volume_time * dfreq);
 
   }
 
@@ -793,3 +798,175 @@ update_persistent_directional_flux_estimators (int nplasma, double flux_persist_
   plasmamain[nplasma].rad_force_bf_persist[3] = length (plasmamain[nplasma].rad_force_bf_persist);
 
 }
+
+
+
+/**********************************************************/
+/**
+ * @brief      Return a block of a cell spectrum, allocating it if necessary
+ *
+ * @param [in] PlasmaPtr  xplasma   The plasma cell
+ * @param [in] int  nblock   The block of the cell spectrum wanted
+ * @return     A pointer to the CELL_SPEC_BLOCK_SIZE bins of the block
+ *
+ * @details
+ * Cell spectra are stored as NCELL_SPEC_BLOCKS separately allocated
+ * blocks.  Normally all of the blocks are allocated in calloc_dyn_plasma,
+ * but with -sparse_cell_spec a block is only allocated when a photon
+ * first deposits flux in it, so that cells which see few photons, or
+ * photons in a narrow frequency range, cost little memory, little
+ * space in the windsave file and little MPI communication.
+ *
+ **********************************************************/
+
+double *
+cell_spec_alloc_block (xplasma, nblock)
+     PlasmaPtr xplasma;
+     int nblock;
+{
+  if (xplasma->cell_spec_block[nblock] == NULL)
+  {
+    if ((xplasma->cell_spec_block[nblock] = calloc (sizeof (double), CELL_SPEC_BLOCK_SIZE)) == NULL)
+    {
+      Error ("cell_spec_alloc_block: Error in allocating memory for cell spectrum block %d of cell %d\n", nblock, xplasma->nplasma);
+      Exit (EXIT_FAILURE);
+    }
+  }
+
+  return (xplasma->cell_spec_block[nblock]);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Add flux to one bin of a cell spectrum
+ *
+ * @param [in] PlasmaPtr  xplasma   The plasma cell
+ * @param [in] int  i   The bin of the cell spectrum
+ * @param [in] double  value   The flux to add
+ * @return     Always returns 0
+ *
+ **********************************************************/
+
+int
+cell_spec_add (xplasma, i, value)
+     PlasmaPtr xplasma;
+     int i;
+     double value;
+{
+  double *block;
+
+  if ((block = xplasma->cell_spec_block[i / CELL_SPEC_BLOCK_SIZE]) == NULL)
+  {
+    block = cell_spec_alloc_block (xplasma, i / CELL_SPEC_BLOCK_SIZE);
+  }
+
+  block[i % CELL_SPEC_BLOCK_SIZE] += value;
+
+  return (0);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Return the value of one bin of a cell spectrum
+ *
+ * @param [in] PlasmaPtr  xplasma   The plasma cell
+ * @param [in] int  i   The bin of the cell spectrum
+ * @return     The flux in the bin, which is zero if its block has
+ * not been allocated
+ *
+ **********************************************************/
+
+double
+cell_spec_get (xplasma, i)
+     PlasmaPtr xplasma;
+     int i;
+{
+  double *block;
+
+  if ((block = xplasma->cell_spec_block[i / CELL_SPEC_BLOCK_SIZE]) == NULL)
+  {
+    return (0.0);
+  }
+
+  return (block[i % CELL_SPEC_BLOCK_SIZE]);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Zero a cell spectrum at the start of an ionization cycle
+ *
+ * @param [in] PlasmaPtr  xplasma   The plasma cell
+ * @return     Always returns 0
+ *
+ * @details
+ * With -sparse_cell_spec the blocks are released, so that the memory
+ * used by each cell follows what the photons deposit in the current
+ * cycle. Otherwise every block is (re)allocated and set to zero.
+ *
+ **********************************************************/
+
+int
+cell_spec_zero (xplasma)
+     PlasmaPtr xplasma;
+{
+  int n;
+
+  for (n = 0; n < NCELL_SPEC_BLOCKS; n++)
+  {
+    if (modes.sparse_cell_spec)
+    {
+      free (xplasma->cell_spec_block[n]);
+      xplasma->cell_spec_block[n] = NULL;
+    }
+    else
+    {
+      memset (cell_spec_alloc_block (xplasma, n), 0, CELL_SPEC_BLOCK_SIZE * sizeof (double));
+    }
+  }
+
+  return (0);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Count the allocated blocks of the cell spectra in a
+ * range of plasma cells
+ *
+ * @param [in] int  n_start   The first plasma cell
+ * @param [in] int  n_stop   One more than the last plasma cell
+ * @return     The number of allocated blocks
+ *
+ * @details
+ * This is used to size the windsave records and the MPI buffers
+ * which carry the cell spectra.
+ *
+ **********************************************************/
+
+int
+cell_spec_count_blocks (n_start, n_stop)
+     int n_start, n_stop;
+{
+  int n, m;
+  int nblocks = 0;
+
+  for (n = n_start; n < n_stop; n++)
+  {
+    for (m = 0; m < NCELL_SPEC_BLOCKS; m++)
+    {
+      if (plasmamain[n].cell_spec_block[m] != NULL)
+      {
+        nblocks++;
+      }
+    }
+  }
+
+  return (nblocks);
+}
@@ -455,9 +455,8 @@ extract_one (w, pp, nspec)
   struct photon pdummy, pdummy_orig;
   double weight_min;
   int icell;
-  int k, k1;
+  int k, k1, iwind;
   double tau;
-  double lfreqmin, lfreqmax, ldfreq;
   double normal[3];
 
   /*
@@ -535,56 +534,26 @@ extract_one (w, pp, nspec)
       Error_silent ("Warning: extract_one: ignoring very high tau  %8.2e at %g\n", tau, pp->freq);
     else
     {
-      k = (int) ((pp->freq - xxspec[nspec].freqmin) / xxspec[nspec].dfreq);
-
       /*
-       * Force the frequency to be in range of that
+       * Find the bins, forcing the frequency to be in range of that
        * recorded in the spectrum
        */
 
-      if (k < 0)
-        k = 0;
-      else if (k > NWAVE_EXTRACT - 1)
-        k = NWAVE_EXTRACT - 1;
-
+      k = spectrum_linear_bin (&xxspec[nspec], pp->freq, NWAVE_EXTRACT);
+      k1 = spectrum_log_bin (&xxspec[nspec], pp->freq, NWAVE_EXTRACT);
 
-      lfreqmin = log10 (xxspec[nspec].freqmin);
-      lfreqmax = log10 (xxspec[nspec].freqmax);
-      ldfreq = (lfreqmax - lfreqmin) / NWAVE_EXTRACT;
-
-      k1 = (int) ((log10 (pp->freq) - log10 (xxspec[nspec].freqmin)) / ldfreq);
-      if (k1 < 0)
-      {
-        k1 = 0;
-      }
-      if (k1 > NWAVE_EXTRACT - 1)
-      {
-        k1 = NWAVE_EXTRACT - 1;
-      }
       /*
        * Increment the spectrum.  Note that the photon
        * weight has not been diminished by its passage
        * through th wind, even though it may have
        * encounterd a number of resonance, and so the
-       * weight must be reduced by tau
-       */
-
-      xxspec[nspec].f[k] += pp->w * exp (-(tau));
-      xxspec[nspec].lf[k1] += pp->w * exp (-(tau));
-
-
-
-      /*
-       * If this photon was a wind photon, then also
-       * increment the "reflected" spectrum
+       * weight must be reduced by tau.  If this photon
+       * was a wind photon, then also increment the
+       * "reflected" spectrum
        */
-      if (pp->origin == PTYPE_WIND || pp->origin == PTYPE_WIND_MATOM || pp->nscat > 0)
-      {
 
-        xxspec[nspec].f_wind[k] += pp->w * exp (-(tau));
-        xxspec[nspec].lf_wind[k1] += pp->w * exp (-(tau));
-
-      }
+      iwind = (pp->origin == PTYPE_WIND || pp->origin == PTYPE_WIND_MATOM || pp->nscat > 0);
+      spectrum_add (&xxspec[nspec], k, k1, pp->w * exp (-(tau)), iwind);
       /*
        * Records the total distance travelled by extracted
        * photon if in reverberation mode
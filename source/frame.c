@@ -118,18 +118,12 @@ observer_to_local_frame (p_in, p_out)
   int ierr;
 
 
-  ierr = check_frame (p_in, F_OBSERVER, "Observer_to_local_frame");
-
-  /* Initialize the output photon */
-  stuff_phot (p_in, p_out);
-  p_out->frame = F_LOCAL;
-
   /* Calculate the local velocity of the wind at this position */
   one = &wmain[p_in->grid];
   ndom = one->ndom;
   vwind_xyz (ndom, p_in, v);
 
-  ierr = lorentz_transform (p_in, p_out, v);
+  ierr = observer_to_local_frame_with_v (p_in, p_out, v);
 
 
 
@@ -138,6 +132,45 @@ observer_to_local_frame (p_in, p_out)
 
 
 
+/**********************************************************/
+/**
+ * @brief      carries out the transformation of a photon from the observer
+ *      frame to the local frame, given the velocity of the wind at the
+ *      position of the photon
+ *
+ * @param [in] PhotPtr  p_in   The photon in the observer frame
+ * @param [out] PhotPtr  p_out   The photon in the local frame
+ * @param [in] double  v[]   The velocity of the wind at the position of the photon
+ *
+ * @return    The routine returns 0, unless there was an error
+ *
+ * @details
+ * This is observer_to_local_frame for routines which have already found
+ * the velocity of the wind, and so can avoid interpolating on the wind
+ * grid again.
+ *
+ **********************************************************/
+
+int
+observer_to_local_frame_with_v (p_in, p_out, v)
+     PhotPtr p_in, p_out;
+     double v[];
+{
+  int ierr;
+
+  ierr = check_frame (p_in, F_OBSERVER, "Observer_to_local_frame");
+
+  /* Initialize the output photon */
+  stuff_phot (p_in, p_out);
+  p_out->frame = F_LOCAL;
+
+  ierr = lorentz_transform (p_in, p_out, v);
+
+  return (ierr);
+}
+
+
+
 /**********************************************************/
 /**
  * @brief      carries out the transformation of all the quantities
@@ -346,8 +379,6 @@ observer_to_local_frame_ds (p_obs, ds_obs)
   WindPtr one;
   int ndom;
   double v[3];
-  double gamma;
-  double ds_cmf;
 
   if (rel_mode == REL_MODE_LINEAR)
   {
@@ -359,6 +390,40 @@ observer_to_local_frame_ds (p_obs, ds_obs)
   ndom = one->ndom;
   vwind_xyz (ndom, p_obs, v);
 
+  return (observer_to_local_frame_ds_with_v (p_obs, ds_obs, v));
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      calculate the distance a photon will travel
+ *      in the local frame given a distance in the observer
+ *      frame and the velocity of the wind
+ *
+ * @param [in] PhotPtr  p_obs    The photon in the observer frame
+ * @param [in] double   ds_obs   The distance from a starting point
+                                 for the photon to travel
+ * @param [in] double  v[]   The velocity of the wind at the position of the photon
+ *
+ * @return    The distance in the co-moving or local frame
+ *
+ **********************************************************/
+
+double
+observer_to_local_frame_ds_with_v (p_obs, ds_obs, v)
+     PhotPtr p_obs;
+     double ds_obs;
+     double v[];
+{
+  double gamma;
+  double ds_cmf;
+
+  if (rel_mode == REL_MODE_LINEAR)
+  {
+    return (ds_obs);
+  }
+
   gamma = 1. / sqrt (1 - (dot (v, v) / (VLIGHT * VLIGHT)));
 
   ds_cmf = ds_obs;
@@ -759,3 +824,128 @@ lorentz_transform (p_in, p_out, v)
 
   return (ierr);
 }
+
+
+
+/**********************************************************/
+/**
+ * @brief      fit a quadratic model of the wind velocity along a
+ *      straight segment of the path of a photon
+ *
+ * @param [out] RayVelPtr  ray   The model of the velocity along the segment
+ * @param [in] PhotPtr  p   The photon, in the observer frame, at the start of the segment
+ * @param [in] double  smax   The length of the segment
+ * @param [in] double  v_start[]   The velocity of the wind at the start of the segment
+ * @param [in] double  v_mid[]   The velocity of the wind at the middle of the segment
+ * @param [in] double  v_stop[]   The velocity of the wind at the end of the segment
+ *
+ * @return    Always returns 0
+ *
+ * @details
+ * The velocity is modelled as v(s) = v0 + a s + b s^2, passing through
+ * the three velocities given, so that the velocity, the frequency of the
+ * photon in the local frame and the velocity gradient along the path can
+ * be found anywhere on the segment with a few multiplications, rather
+ * than by interpolating on the wind grid.
+ *
+ * ### Notes ###
+ *
+ * Within a cell the velocity interpolated by vwind_xyz varies smoothly,
+ * so a quadratic is a good approximation over segments short enough that
+ * the linear Doppler approximation in calculate_ds is nearly satisfied.
+ *
+ **********************************************************/
+
+int
+ray_velocity_fit (ray, p, smax, v_start, v_mid, v_stop)
+     RayVelPtr ray;
+     PhotPtr p;
+     double smax;
+     double v_start[], v_mid[], v_stop[];
+{
+  int i;
+
+  for (i = 0; i < 3; i++)
+  {
+    ray->v0[i] = v_start[i];
+    ray->a[i] = (4. * v_mid[i] - 3. * v_start[i] - v_stop[i]) / smax;
+    ray->b[i] = 2. * (v_start[i] + v_stop[i] - 2. * v_mid[i]) / (smax * smax);
+    ray->lmn[i] = p->lmn[i];
+  }
+  ray->freq = p->freq;
+
+  return (0);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      the frequency in the local frame of a photon which has
+ *      travelled a distance s along a segment fitted by ray_velocity_fit
+ *
+ * @param [in] RayVelPtr  ray   The model of the velocity along the segment
+ * @param [in] double  s   The distance along the segment
+ *
+ * @return    The frequency of the photon in the local frame
+ *
+ * @details
+ * The frequency is transformed as in lorentz_transform for a photon
+ * in the observer frame.
+ *
+ **********************************************************/
+
+double
+ray_local_freq (ray, s)
+     RayVelPtr ray;
+     double s;
+{
+  double v[3];
+  double vel, gamma;
+  int i;
+
+  for (i = 0; i < 3; i++)
+    v[i] = ray->v0[i] + s * (ray->a[i] + s * ray->b[i]);
+
+  vel = dot (ray->lmn, v);
+
+  if (rel_mode == REL_MODE_LINEAR)
+  {
+    return (ray->freq / (1. + vel / VLIGHT));
+  }
+
+  gamma = 1. / (sqrt (1 - (dot (v, v) / (VLIGHT * VLIGHT))));
+
+  return (ray->freq * gamma * (1. - vel / VLIGHT));
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      the velocity gradient along the path of a photon which
+ *      has travelled a distance s along a segment fitted by ray_velocity_fit
+ *
+ * @param [in] RayVelPtr  ray   The model of the velocity along the segment
+ * @param [in] double  s   The distance along the segment
+ *
+ * @return    dv/ds along the direction of the photon
+ *
+ * @details
+ * This is the equivalent of dvwind_ds_cmf, and like it can be negative.
+ *
+ **********************************************************/
+
+double
+ray_dvds (ray, s)
+     RayVelPtr ray;
+     double s;
+{
+  double dv_ds[3];
+  int i;
+
+  for (i = 0; i < 3; i++)
+    dv_ds[i] = ray->a[i] + 2. * s * ray->b[i];
+
+  return (dot (ray->lmn, dv_ds));
+}
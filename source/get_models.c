@@ -47,6 +47,10 @@
 #include    <stdlib.h>
 #include	<strings.h>
 #include	<string.h>
+#include	<fcntl.h>
+#include	<unistd.h>
+#include	<sys/mman.h>
+#include	<sys/stat.h>
 #include 	"atomic.h"
 #include	"sirocco.h"      //This needs to come before modlel.h so that what is in models.h is used
 #include    "models.h"
@@ -58,6 +62,12 @@
 /// Needed so can initialize nmods_tot the first time this routine is called
 int get_models_init = 0;
 
+static int read_model_image (char modellist[], int npars, int nstart);
+static int write_model_image (char modellist[], int npars, int nstart, int nstop);
+static void model_order (int spectype);
+static int model_cache_find (int spectype, double par[]);
+static void model_cache_add (int spectype, double par[], double flux[]);
+
 
 /**********************************************************/
 /**
@@ -172,7 +182,7 @@ get_models (modellist, npars, spectype)
   int n, m, mm, nxpar;
   double xpar[NPARS], xmin[NPARS], xmax[NPARS];
   int get_one_model ();
-  int nw, nwaves;
+  int nw, nwaves, nread;
 
   nwaves = 0;
 
@@ -229,52 +239,79 @@ get_models (modellist, npars, spectype)
 
 
   nw = -1;                      // Initiallize nw
-  while (n < NMODS && (fgets (dummy, LINELENGTH, mptr)) != NULL)
+
+  /* If the binary image of this list of models is up to date, read the models from
+     it rather than from the individual files */
+
+  if (modes.model_image && (nread = read_model_image (modellist, npars, n)) > 0)
   {
-    if (dummy[0] == '#' || dummy[0] == '!')
-    {
-    }                           //skip comment lines in models
-    else
+    for (mm = n; mm < n + nread; mm++)
     {
-      nxpar =
-        sscanf (dummy, "%s %lf %lf %lf %lf %lf %lf %lf %lf %lf",
-                mods[n].name, &xpar[0], &xpar[1], &xpar[2], &xpar[3], &xpar[4], &xpar[5], &xpar[6], &xpar[7], &xpar[8]);
-      if (nxpar < npars)
-      {
-        Error ("get_models: nxpar (%d) < npars (%d) in line %s\n", nxpar, npars, dummy);
-        Exit (0);
-      }
       for (m = 0; m < npars; m++)
       {
-        mods[n].par[m] = xpar[m];
-        if (xpar[m] > xmax[m])
-          xmax[m] = xpar[m];
-        if (xpar[m] < xmin[m])
-          xmin[m] = xpar[m];
+        if (mods[mm].par[m] > xmax[m])
+          xmax[m] = mods[mm].par[m];
+        if (mods[mm].par[m] < xmin[m])
+          xmin[m] = mods[mm].par[m];
       }
-      for (mm = m; mm < NPARS; mm++)
-        mods[n].par[mm] = -99;
-
-      nwaves = get_one_model (mods[n].name, &mods[n]);
-      if (nw > 0 && nwaves != nw)
+    }
+    nwaves = mods[n].nwaves;
+    n += nread;
+  }
+  else
+  {
+    while (n < NMODS && (fgets (dummy, LINELENGTH, mptr)) != NULL)
+    {
+      if (dummy[0] == '#' || dummy[0] == '!')
       {
-        Error ("get_models: file %s has %d wavelengths, others have %d\n", mods[n].name, nwaves, nw);
-        Exit (0);
-      }
+      }                         //skip comment lines in models
+      else
+      {
+        nxpar =
+          sscanf (dummy, "%s %lf %lf %lf %lf %lf %lf %lf %lf %lf",
+                  mods[n].name, &xpar[0], &xpar[1], &xpar[2], &xpar[3], &xpar[4], &xpar[5], &xpar[6], &xpar[7], &xpar[8]);
+        if (nxpar < npars)
+        {
+          Error ("get_models: nxpar (%d) < npars (%d) in line %s\n", nxpar, npars, dummy);
+          Exit (0);
+        }
+        for (m = 0; m < npars; m++)
+        {
+          mods[n].par[m] = xpar[m];
+          if (xpar[m] > xmax[m])
+            xmax[m] = xpar[m];
+          if (xpar[m] < xmin[m])
+            xmin[m] = xpar[m];
+        }
+        for (mm = m; mm < NPARS; mm++)
+          mods[n].par[mm] = -99;
 
-      if ((n % 100) == 0)
-        Log ("Model n %d %s\n", n, mods[n].name);
-      n++;
+        nwaves = get_one_model (mods[n].name, &mods[n]);
+        if (nw > 0 && nwaves != nw)
+        {
+          Error ("get_models: file %s has %d wavelengths, others have %d\n", mods[n].name, nwaves, nw);
+          Exit (0);
+        }
+
+        if ((n % 100) == 0)
+          Log ("Model n %d %s\n", n, mods[n].name);
+        n++;
+      }
     }
-  }
 
 
-  if (n == NMODS)
-  {
-    Error ("get_models: Reached maximum number of models %d. Please increase NMODS in .h file \n", n);
-    Exit (0);
+    if (n == NMODS)
+    {
+      Error ("get_models: Reached maximum number of models %d. Please increase NMODS in .h file \n", n);
+      Exit (0);
+    }
+
+    if (modes.model_image && n > nmods_tot)
+      write_model_image (modellist, npars, nmods_tot, n);
   }
 
+  fclose (mptr);
+
 
 
 /* Now complete the initialization of the modsum structure */
@@ -313,6 +350,10 @@ get_models (modellist, npars, spectype)
 
 
 
+  /* Sort the models by their first parameter, and start with an empty cache of interpolated models */
+  model_order (ncomps);
+  comp[ncomps].nkeys = comp[ncomps].ncache = comp[ncomps].ncache_max = 0;
+
   *spectype = ncomps;           // Set the spectype
 
 
@@ -378,6 +419,278 @@ get_one_model (filename, onemod)
   return (n);
 }
 
+
+#define MODEL_IMAGE_MAGIC   "SIRMODS"
+#define MODEL_IMAGE_VERSION 1
+
+/** The header of the binary image of a list of models */
+typedef struct model_image_header
+{
+  char magic[8];
+  int version;
+  int npars;                    /**< The number of parameters read for each model */
+  int nmods;                    /**< The number of models */
+  int nwaves;                   /**< The number of wavelengths, which are the same for all of the models */
+  long list_size, list_mtime;   /**< The size and modification time of the list of models */
+  unsigned long checksum;       /**< The FNV-1a checksum of everything which follows the header */
+} model_image_header;
+
+/** The record for each model in the image, which is followed by the common wavelengths
+ * and then the fluxes of each model in turn */
+typedef struct model_image_record
+{
+  char name[LINELEN];
+  double par[NPARS];
+  long size, mtime;             /**< The size and modification time of the file the model was read from */
+} model_image_record;
+
+
+/**********************************************************/
+/**
+ * @brief      the 64 bit FNV-1a hash of a block of memory, continuing from hash
+ *
+ **********************************************************/
+
+static unsigned long
+model_image_checksum (buf, nbytes, hash)
+     unsigned char *buf;
+     size_t nbytes;
+     unsigned long hash;
+{
+  size_t i;
+
+  for (i = 0; i < nbytes; i++)
+  {
+    hash ^= buf[i];
+    hash *= 1099511628211UL;
+  }
+
+  return (hash);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      read a list of models from its binary image
+ *
+ * @param [in] char  modellist[]   The file containing the list of models
+ * @param [in] int  npars   The number of parameters for each model
+ * @param [in] int  nstart   The position in mods at which to store the first model
+ * @return     The number of models read, or -1 if there is no up to date image
+ *
+ * @details
+ * The image, modellist.image, is mapped into memory and the models are copied
+ * from it into mods.  The image is used only if the list and every model in it
+ * have the same size and modification time as when the image was written, and
+ * if its checksum is correct.  The checksum, and that each model name ends within
+ * its record, are checked before the names are used.
+ *
+ **********************************************************/
+
+static int
+read_model_image (modellist, npars, nstart)
+     char modellist[];
+     int npars, nstart;
+{
+  char image[LINELENGTH];
+  struct stat st;
+  int fd, n, ierr;
+  char *map;
+  size_t map_size, expected;
+  model_image_header *header;
+  model_image_record *rec;
+  double *w, *f;
+
+  snprintf (image, LINELENGTH, "%s.image", modellist);
+
+  if ((fd = open (image, O_RDONLY)) < 0)
+  {
+    Log ("get_models: There is no image %s of the models, so it will be made\n", image);
+    return (-1);
+  }
+  if (fstat (fd, &st) != 0 || st.st_size < (long) sizeof (model_image_header))
+  {
+    close (fd);
+    return (-1);
+  }
+  map_size = st.st_size;
+  map = mmap (NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (map == MAP_FAILED)
+  {
+    Error ("get_models: Could not map %s into memory\n", image);
+    return (-1);
+  }
+
+  header = (model_image_header *) map;
+  expected = 0;
+  if (memcmp (header->magic, MODEL_IMAGE_MAGIC, sizeof (header->magic)) == 0 && header->version == MODEL_IMAGE_VERSION && header->nwaves > 0
+      && header->nwaves <= NWAVES && header->nmods > 0 && header->nmods < NMODS - nstart)
+    expected = sizeof (model_image_header) + header->nmods * sizeof (model_image_record)
+      + (size_t) (header->nmods + 1) * header->nwaves * sizeof (double);
+
+  if (expected != map_size || header->npars != npars || stat (modellist, &st) != 0 || st.st_size != header->list_size
+      || st.st_mtime != header->list_mtime)
+  {
+    Log ("get_models: %s is out of date, so it will be remade\n", image);
+    munmap (map, map_size);
+    return (-1);
+  }
+
+  /* Check the records are intact before the names in them are used */
+
+  rec = (model_image_record *) (map + sizeof (model_image_header));
+  ierr = model_image_checksum ((unsigned char *) rec, map_size - sizeof (model_image_header), 14695981039346656037UL) != header->checksum;
+  for (n = 0; n < header->nmods && !ierr; n++)
+  {
+    if (memchr (rec[n].name, '\0', sizeof (rec[n].name)) == NULL)
+      ierr = TRUE;
+  }
+
+  if (ierr)
+  {
+    Error ("get_models: %s is corrupted, so it will be remade\n", image);
+    munmap (map, map_size);
+    return (-1);
+  }
+
+  for (n = 0; n < header->nmods; n++)
+  {
+    if (stat (rec[n].name, &st) != 0 || st.st_size != rec[n].size || st.st_mtime != rec[n].mtime)
+    {
+      Log ("get_models: %s has changed since %s was made, so it will be remade\n", rec[n].name, image);
+      munmap (map, map_size);
+      return (-1);
+    }
+  }
+
+  w = (double *) (rec + header->nmods);
+  f = w + header->nwaves;
+  for (n = 0; n < header->nmods; n++)
+  {
+    strcpy (mods[nstart + n].name, rec[n].name);
+    memcpy (mods[nstart + n].par, rec[n].par, sizeof (rec[n].par));
+    memcpy (mods[nstart + n].w, w, header->nwaves * sizeof (double));
+    memcpy (mods[nstart + n].f, f + (size_t) n * header->nwaves, header->nwaves * sizeof (double));
+    mods[nstart + n].nwaves = header->nwaves;
+  }
+
+  n = header->nmods;
+  munmap (map, map_size);
+
+  Log ("get_models: Read %d models from %s\n", n, image);
+
+  return (n);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      write a list of models which has just been read to a binary image
+ *
+ * @param [in] char  modellist[]   The file containing the list of models
+ * @param [in] int  npars   The number of parameters for each model
+ * @param [in] int  nstart   The position in mods of the first model
+ * @param [in] int  nstop   The position in mods after the last model
+ * @return     0 if the image was written, 1 otherwise
+ *
+ * @details
+ * The image contains one copy of the wavelengths, so it can only be made if all of the
+ * models have the same wavelengths, which model assumes in any case.  It is written
+ * by the root process only, to a temporary file which is then renamed.
+ *
+ **********************************************************/
+
+static int
+write_model_image (modellist, npars, nstart, nstop)
+     char modellist[];
+     int npars, nstart, nstop;
+{
+  char image[LINELENGTH], tmpfile[LINELENGTH + 32];
+  FILE *fptr;
+  struct stat st;
+  model_image_header header;
+  model_image_record *rec;
+  size_t nbytes;
+  int n, nwaves, ierr;
+
+  if (rank_global != 0)
+    return (0);
+
+  snprintf (image, LINELENGTH, "%s.image", modellist);
+  nwaves = mods[nstart].nwaves;
+
+  for (n = nstart + 1; n < nstop; n++)
+  {
+    if (mods[n].nwaves != nwaves || memcmp (mods[n].w, mods[nstart].w, nwaves * sizeof (double)) != 0)
+    {
+      Error ("get_models: The models in %s do not all have the same wavelengths, so %s cannot be made\n", modellist, image);
+      return (1);
+    }
+  }
+
+  if ((rec = calloc (nstop - nstart, sizeof (model_image_record))) == NULL)
+    return (1);
+
+  memset (&header, 0, sizeof (header));
+  strcpy (header.magic, MODEL_IMAGE_MAGIC);
+  header.version = MODEL_IMAGE_VERSION;
+  header.npars = npars;
+  header.nmods = nstop - nstart;
+  header.nwaves = nwaves;
+  ierr = stat (modellist, &st);
+  header.list_size = st.st_size;
+  header.list_mtime = st.st_mtime;
+
+  for (n = 0; n < header.nmods; n++)
+  {
+    strcpy (rec[n].name, mods[nstart + n].name);
+    memcpy (rec[n].par, mods[nstart + n].par, sizeof (rec[n].par));
+    ierr |= stat (rec[n].name, &st);
+    rec[n].size = st.st_size;
+    rec[n].mtime = st.st_mtime;
+  }
+
+  nbytes = nwaves * sizeof (double);
+  header.checksum = model_image_checksum ((unsigned char *) rec, header.nmods * sizeof (model_image_record), 14695981039346656037UL);
+  header.checksum = model_image_checksum ((unsigned char *) mods[nstart].w, nbytes, header.checksum);
+  for (n = nstart; n < nstop; n++)
+    header.checksum = model_image_checksum ((unsigned char *) mods[n].f, nbytes, header.checksum);
+
+  snprintf (tmpfile, sizeof (tmpfile), "%s.%d.tmp", image, (int) getpid ());
+
+  if (ierr || (fptr = fopen (tmpfile, "w")) == NULL)
+  {
+    Error ("get_models: Could not write %s, so the models will be read from the individual files again next time\n", image);
+    free (rec);
+    return (1);
+  }
+
+  ierr = (fwrite (&header, sizeof (header), 1, fptr) != 1);
+  ierr |= (fwrite (rec, sizeof (model_image_record), header.nmods, fptr) != (size_t) header.nmods);
+  ierr |= (fwrite (mods[nstart].w, nbytes, 1, fptr) != 1);
+  for (n = nstart; n < nstop; n++)
+    ierr |= (fwrite (mods[n].f, nbytes, 1, fptr) != 1);
+  ierr |= (fclose (fptr) != 0);
+
+  free (rec);
+
+  if (ierr || rename (tmpfile, image) != 0)
+  {
+    Error ("get_models: Could not write %s\n", image);
+    remove (tmpfile);
+    return (1);
+  }
+
+  Log ("get_models: Wrote %d models to %s\n", header.nmods, image);
+
+  return (0);
+}
+
+
+
 int nmodel_error = 0;
 int nmodel_terror = 0;
 
@@ -437,11 +750,15 @@ model (spectype, par)
 
 
 {
-  int j, n;
+  int i, j, k, n;
+  int lo, hi, mid, ilo, ihi;
+  int nmods, *order;
+  int cand[NMODS];              // The models which bracket the requested one in the first parameter
+  int ncand;
   int good_models[NMODS];       // Used to establish which models are to be included in creating output model
   double xmin[NPARS], xmax[NPARS];      // The vertices of a completely filled grid
   double weight[NMODS];         // The weights assigned to the models
-  double hi, lo, delta, wtot;
+  double hi_delta, lo_delta, delta, wtot;
   int ngood;
   double f;
   int nwaves;
@@ -465,76 +782,124 @@ exact model previously */
     return (0);                 // This was the model stored in comp already
   }
 
+  nwaves = comp[spectype].nwaves;
 
-  /* First identify the models of interest */
-  n = 0;
-  while (n < comp[spectype].modstart)
+  /* Next determine whether this model was interpolated and cached earlier, as
+     happens for example when photons are generated from each of the rings of a disk
+     in turn */
+
+  if ((k = model_cache_find (spectype, par)) >= 0)
   {
-    weight[n] = good_models[n] = 0;
-    n++;
+    memcpy (comp[spectype].xmod.f, &comp[spectype].cache_f[(size_t) k * nwaves], nwaves * sizeof (double));
+    for (j = 0; j < comp[spectype].npars; j++)
+    {
+      comp[spectype].xmod.par[j] = par[j];
+    }
+    return (nwaves);
   }
-  while (n < comp[spectype].modstop)
+
+
+  /* Identify the models of interest. Only the models whose first parameter is the
+     closest one above par[0], or the closest one at or below par[0], can contribute,
+     and these are found by bisection on the models sorted by the first parameter.
+     If par[0] is outside the grid, these are the models at the nearest edge */
+
+  nmods = comp[spectype].nmods;
+  order = comp[spectype].order;
+
+  lo = 0;
+  hi = nmods;
+  while (lo < hi)
   {
-    weight[n] = good_models[n] = 1;
-    n++;
+    mid = (lo + hi) / 2;
+    if (mods[order[mid]].par[0] > par[0])
+      hi = mid;
+    else
+      lo = mid + 1;
   }
-  while (n < nmods_tot)
+
+  xmax[0] = (lo < nmods) ? mods[order[lo]].par[0] : comp[spectype].max[0];
+  xmin[0] = (lo > 0) ? mods[order[lo - 1]].par[0] : comp[spectype].min[0];
+
+  ilo = ihi = lo;
+  while (ilo > 0 && mods[order[ilo - 1]].par[0] >= xmin[0])
+    ilo--;
+  while (ihi < nmods && mods[order[ihi]].par[0] <= xmax[0])
+    ihi++;
+
+  /* Put the candidates back in the order in which they were read, so that
+     the models are combined in the same order as they are in the full grid */
+
+  ncand = 0;
+  for (i = ilo; i < ihi; i++)
   {
-    weight[n] = good_models[n] = 0;
-    n++;
+    n = ncand++;
+    while (n > 0 && cand[n - 1] > order[i])
+    {
+      cand[n] = cand[n - 1];
+      n--;
+    }
+    cand[n] = order[i];
+  }
+
+  for (i = 0; i < ncand; i++)
+  {
+    weight[i] = good_models[i] = 1;
   }
 
   for (j = 0; j < comp[spectype].npars; j++)
   {
     xmax[j] = comp[spectype].max[j];
     xmin[j] = comp[spectype].min[j];
-    hi = BIG;
-    lo = -BIG;
-    for (n = comp[spectype].modstart; n < comp[spectype].modstop; n++)
+    hi_delta = BIG;
+    lo_delta = -BIG;
+    for (i = 0; i < ncand; i++)
     {
-      if (good_models[n])
+      if (good_models[i])
       {
+        n = cand[i];
         delta = mods[n].par[j] - par[j];
-        if (delta > 0.0 && delta < hi)
+        if (delta > 0.0 && delta < hi_delta)
         {
           xmax[j] = mods[n].par[j];
-          hi = delta;
+          hi_delta = delta;
         }
-        if (delta <= 0.0 && delta >= lo)
+        if (delta <= 0.0 && delta >= lo_delta)
         {
           xmin[j] = mods[n].par[j];
-          lo = delta;
+          lo_delta = delta;
         }
       }
     }
     /*   So at this point we know what xmin[j] and xmax[j] and we
        need to prune good_models
      */
-    for (n = comp[spectype].modstart; n < comp[spectype].modstop; n++)
+    for (i = 0; i < ncand; i++)
     {
+      n = cand[i];
       // Next lines excludes the models which are out of range.
       if (mods[n].par[j] > xmax[j] || mods[n].par[j] < xmin[j])
-        good_models[n] = 0;
+        good_models[i] = 0;
       /* Next line modifies the weight of this model assuming a regular grid
          If xmax==xmin, then par[j] was outside of the range of the models and
          so we need to weight the remaining models fully.
        */
 
-      if (good_models[n] && xmax[j] > xmin[j])
+      if (good_models[i] && xmax[j] > xmin[j])
       {
         f = (par[j] - xmin[j]) / (xmax[j] - xmin[j]);
         if (mods[n].par[j] == xmax[j])
         {
           // Then the model is at the maximum for this parameter
-          weight[n] *= f;
+          weight[i] *= f;
         }
         else
-          weight[n] *= (1. - f);
+          weight[i] *= (1. - f);
 
 /*If the weight given to a model is going to be zero, it needs to be
 excluded from furthur consideration */
-        if (weight[n] == 0.0)
-          good_models[n] = 0;
+        if (weight[i] == 0.0)
+          good_models[i] = 0;
 
       }
     }
@@ -546,11 +911,11 @@ excluded from furthur consideration */
 
   wtot = 0;
   ngood = 0;
-  for (n = comp[spectype].modstart; n < comp[spectype].modstop; n++)
+  for (i = 0; i < ncand; i++)
   {
-    if (good_models[n])
+    if (good_models[i])
     {
-      wtot += weight[n];
+      wtot += weight[i];
       ngood++;
     }
   }
@@ -559,10 +924,10 @@ excluded from furthur consideration */
     Error ("model: Wtot must be greater than 0 or something is badly wrong\n");
     Exit (0);
   }
-  for (n = comp[spectype].modstart; n < comp[spectype].modstop; n++)
+  for (i = 0; i < ncand; i++)
   {
-    if (good_models[n])
-      weight[n] /= wtot;
+    if (good_models[i])
+      weight[i] /= wtot;
   }
 
 // So now we know the absolute weighting.
@@ -575,18 +940,16 @@ excluded from furthur consideration */
   else if (ngood == 1 && nmodel_error < 20)
   {
     Error ("model: Only one model after pruning for parameters, consider larger model grid\n");
-    for (n = comp[spectype].modstart; n < comp[spectype].modstop; n++)
+    for (i = 0; i < ncand; i++)
     {
-      if (good_models[n])
+      if (good_models[i])
       {
-        Error ("model: %s %8.2f %8.2f\n", mods[n].name, par[0], par[1]);
+        Error ("model: %s %8.2f %8.2f\n", mods[cand[i]].name, par[0], par[1]);
       }
     }
     nmodel_error++;
   }
 
-  nwaves = comp[spectype].nwaves;
-
 // Now create the spectrum
   for (j = 0; j < nwaves; j++)
   {
@@ -594,13 +957,14 @@ excluded from furthur consideration */
   }
 
 
-  for (n = comp[spectype].modstart; n < comp[spectype].modstop; n++)
+  for (i = 0; i < ncand; i++)
   {
-    if (good_models[n])
+    if (good_models[i])
     {
+      n = cand[i];
       for (j = 0; j < nwaves; j++)
       {
-        flux[j] += weight[n] * mods[n].f[j];
+        flux[j] += weight[i] * mods[n].f[j];
       }
     }
   }
@@ -680,8 +1044,248 @@ even, and so for those cases we want to make sure to calculate the ratio of qs d
     comp[spectype].xmod.par[j] = par[j];
   }
 
-
+  model_cache_add (spectype, par, flux);
 
 
   return (nwaves);
 }
+
+
+
+/**********************************************************/
+/**
+ * @brief      sort the models of one type by their first parameter
+ *
+ * @param [in] int  spectype   The set of models to sort
+ * @return     N/A
+ *
+ * @details
+ * The sorted list, comp[spectype].order, is used by model to find the models
+ * which bracket the requested first parameter by bisection.  Models with the same
+ * first parameter are left in the order in which they were read.
+ *
+ **********************************************************/
+
+static void
+model_order (spectype)
+     int spectype;
+{
+  int i, n, m;
+  int *order;
+
+  free (comp[spectype].order);
+  order = comp[spectype].order = calloc (comp[spectype].nmods > 0 ? comp[spectype].nmods : 1, sizeof (int));
+  if (order == NULL)
+  {
+    Error ("model_order: Could not allocate memory for %d models\n", comp[spectype].nmods);
+    Exit (0);
+  }
+
+  /* An insertion sort, which is stable and fast since the models are usually read in
+     order of their first parameter */
+
+  for (i = 0; i < comp[spectype].nmods; i++)
+  {
+    m = comp[spectype].modstart + i;
+    n = i;
+    while (n > 0 && mods[order[n - 1]].par[0] > mods[m].par[0])
+    {
+      order[n] = order[n - 1];
+      n--;
+    }
+    order[n] = m;
+  }
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      the position in the hash table of interpolated models at which a set
+ * of parameters is, or should be, stored
+ *
+ **********************************************************/
+
+static int
+model_cache_slot (spectype, par)
+     int spectype;
+     double par[];
+{
+  unsigned long hash;
+  unsigned char *bytes;
+  int i, k, slot;
+
+  bytes = (unsigned char *) par;
+  hash = 14695981039346656037UL;
+  for (i = 0; i < comp[spectype].npars * (int) sizeof (double); i++)
+  {
+    hash ^= bytes[i];
+    hash *= 1099511628211UL;
+  }
+
+  slot = hash & (MODEL_CACHE_SLOTS - 1);
+  while ((k = comp[spectype].cache_slot[slot]) >= 0)
+  {
+    for (i = 0; i < comp[spectype].npars; i++)
+    {
+      if (comp[spectype].cache_par[k * comp[spectype].npars + i] != par[i])
+        break;
+    }
+    if (i == comp[spectype].npars)
+      break;
+    slot = (slot + 1) & (MODEL_CACHE_SLOTS - 1);
+  }
+
+  return (slot);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      find a previously interpolated model in the cache
+ *
+ * @param [in] int  spectype   The set of models
+ * @param [in] double  par[]   The parameters of the model
+ * @return     The position of the fluxes in comp[spectype].cache_f, or -1 if they
+ * are not there
+ *
+ **********************************************************/
+
+static int
+model_cache_find (spectype, par)
+     int spectype;
+     double par[];
+{
+  int k;
+
+  if (comp[spectype].nkeys == 0)
+    return (-1);
+
+  if ((k = comp[spectype].cache_slot[model_cache_slot (spectype, par)]) < 0)
+    return (-1);
+
+  return (comp[spectype].cache_index[k]);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      empty the cache of interpolated models
+ *
+ **********************************************************/
+
+static void
+model_cache_reset (xcomp)
+     struct ModSum *xcomp;
+{
+  int i;
+
+  for (i = 0; i < MODEL_CACHE_SLOTS; i++)
+    xcomp->cache_slot[i] = -1;
+  xcomp->nkeys = xcomp->ncache = 0;
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      add an interpolated model to the cache
+ *
+ * @param [in] int  spectype   The set of models
+ * @param [in] double  par[]   The parameters of the model
+ * @param [in] double  flux[]   The interpolated fluxes
+ * @return     N/A
+ *
+ * @details
+ * The fluxes for a set of parameters are only cached the second time they are
+ * interpolated, since many models, such as those for the fine radial grid used to
+ * set up the disk rings, are only needed once.  The first time only the parameters
+ * are recorded.
+ *
+ * The cache is allocated the first time it is needed, with room for the fluxes of
+ * as many models as fit in MODEL_CACHE_MB, and the parameters of up to half the size
+ * of the hash table.  When either is full it is emptied, since the models which are
+ * needed change as for example the temperatures of the disk rings change from cycle
+ * to cycle.
+ *
+ **********************************************************/
+
+static void
+model_cache_add (spectype, par, flux)
+     int spectype;
+     double par[], flux[];
+{
+  struct ModSum *xcomp;
+  int i, k, slot, nwaves, npars;
+
+  xcomp = &comp[spectype];
+  nwaves = xcomp->nwaves;
+  npars = xcomp->npars;
+
+  if (xcomp->ncache_max < 0)
+    return;
+
+  for (i = 0; i < npars; i++)
+  {
+    if (par[i] != par[i])
+      return;                   // Do not try to cache a NaN
+  }
+
+  if (xcomp->ncache_max == 0)
+  {
+    xcomp->ncache_max = MODEL_CACHE_MB * 1000000. / (nwaves * sizeof (double));
+    if (xcomp->ncache_max > MODEL_CACHE_SLOTS / 2)
+      xcomp->ncache_max = MODEL_CACHE_SLOTS / 2;
+
+    xcomp->cache_slot = calloc (MODEL_CACHE_SLOTS, sizeof (int));
+    xcomp->cache_par = calloc (MODEL_CACHE_SLOTS / 2 * npars, sizeof (double));
+    xcomp->cache_index = calloc (MODEL_CACHE_SLOTS / 2, sizeof (int));
+    xcomp->cache_f = calloc ((size_t) xcomp->ncache_max * nwaves, sizeof (double));
+    if (xcomp->ncache_max < 1 || xcomp->cache_slot == NULL || xcomp->cache_par == NULL || xcomp->cache_index == NULL
+        || xcomp->cache_f == NULL)
+    {
+      Error ("model_cache_add: Could not allocate a cache of interpolated models for %s\n", xcomp->name);
+      free (xcomp->cache_slot);
+      free (xcomp->cache_par);
+      free (xcomp->cache_index);
+      free (xcomp->cache_f);
+      xcomp->cache_slot = xcomp->cache_index = NULL;
+      xcomp->cache_par = xcomp->cache_f = NULL;
+      xcomp->ncache_max = -1;
+      return;
+    }
+    model_cache_reset (xcomp);
+  }
+
+  slot = model_cache_slot (spectype, par);
+
+  if ((k = xcomp->cache_slot[slot]) >= 0)
+  {
+    if (xcomp->cache_index[k] >= 0)
+      return;                   // Already cached
+
+    /* This is the second time this model was needed, so keep its fluxes */
+    if (xcomp->ncache < xcomp->ncache_max)
+    {
+      xcomp->cache_index[k] = xcomp->ncache++;
+      memcpy (&xcomp->cache_f[(size_t) xcomp->cache_index[k] * nwaves], flux, nwaves * sizeof (double));
+      return;
+    }
+    model_cache_reset (xcomp);
+    slot = model_cache_slot (spectype, par);
+  }
+
+  if (xcomp->nkeys == MODEL_CACHE_SLOTS / 2)
+  {
+    model_cache_reset (xcomp);
+    slot = model_cache_slot (spectype, par);
+  }
+
+  k = xcomp->nkeys++;
+  for (i = 0; i < npars; i++)
+    xcomp->cache_par[k * npars + i] = par[i];
+  xcomp->cache_index[k] = -1;
+  xcomp->cache_slot[slot] = k;
+}
@@ -49,17 +49,15 @@
  *
  **********************************************************/
 
+static struct wind_stencil dvwind_stencil = {.ndom = -1 };
+
 double
 dvwind_ds_cmf (p)
      PhotPtr p;
 {
   double v_grad[3][3];
   double lmn[3], dvel_ds[3], dvds;
-  int j, k, nn;
   struct photon pp;
-  int nnn[4], nelem;
-  double frac[4];
-  double x;
   int ndom;
 
   ndom = wmain[p->grid].ndom;
@@ -126,21 +124,7 @@ dvwind_ds_cmf (p)
   else                          // for non spherical coords we interpolate on v_grad
   {
 
-    coord_fraction (ndom, 0, pp.x, nnn, frac, &nelem);
-
-
-    for (j = 0; j < 3; j++)
-    {
-      for (k = 0; k < 3; k++)
-      {
-        x = 0;
-        for (nn = 0; nn < nelem; nn++)
-          x += wmain[nnn[nn]].v_grad[j][k] * frac[nn];
-
-        v_grad[j][k] = x;
-
-      }
-    }
+    stencil_vwind (ndom, pp.x, &dvwind_stencil, NULL, v_grad);
 
     /* v_grad is in cylindrical coordinates, or more precisely intended
        to be azimuthally symmetric.  One could either
@@ -581,7 +581,7 @@ int
 calloc_dyn_plasma (nelem)
      int nelem;
 {
-  int n;
+  int n, m;
 
 /*  Loop over all elements in the plasma array, adding one for an empty cell 
  *  used for extrapolations.
@@ -680,6 +680,17 @@ calloc_dyn_plasma (nelem)
       Error ("calloc_dyn_plasma: Error in allocating memory for kbf_use\n");
       Exit (0);
     }
+
+    /* The blocks of the cell spectra are allocated on first use if the spectra are sparse */
+
+    for (m = 0; m < NCELL_SPEC_BLOCKS; m++)
+    {
+      plasmamain[n].cell_spec_block[m] = NULL;
+      if (modes.sparse_cell_spec == FALSE)
+      {
+        cell_spec_alloc_block (&plasmamain[n], m);
+      }
+    }
   }
 
   Log
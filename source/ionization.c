@@ -10,6 +10,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "atomic.h"
@@ -62,6 +63,7 @@ int
 ion_abundances (PlasmaPtr xplasma, int mode)
 {
   int ireturn;
+  double t_profile;
 
   if (mode == IONMODE_ML93_FIXTE)
   {
@@ -119,7 +121,9 @@ ion_abundances (PlasmaPtr xplasma, int mode)
   {
 /*  spectral_estimators does the work of getting banded W and alpha. Then oneshot gets called. */
 
+    t_profile = wu_profile_start ();
     spectral_estimators (xplasma);
+    wu_profile_stop (WU_PHASE_SPECTRAL_ESTIMATORS, t_profile);
     update_old_plasma_variables (xplasma);
     ireturn = one_shot (xplasma, mode);
 
@@ -172,6 +176,9 @@ convergence (PlasmaPtr xplasma)
   int trcheck, techeck, hccheck, whole_check;
   double min_gain, gain_damp, max_gain, gain_amp, cyc_frac;
   double epsilon;
+  double t_profile;
+
+  t_profile = wu_profile_start ();
 
   // TODO: are these values optimal?
   min_gain = 0.1;
@@ -280,6 +287,8 @@ convergence (PlasmaPtr xplasma)
       xplasma->gain = max_gain;
   }
 
+  wu_profile_stop (WU_PHASE_CONVERGENCE, t_profile);
+
   return (whole_check);
 }
 
@@ -459,6 +468,11 @@ meaning in nebular concentrations.
 
 
 
+/* The number of times zero_emit has been called, which is used to count the
+   cost of each call to calc_te */
+
+static int n_zero_emit = 0;
+
 /**********************************************************/
 /**
  * @brief  find the electron termperature for a cell where the heating and cooling 
@@ -480,12 +494,21 @@ meaning in nebular concentrations.
  *
  * xxxplasma is just a way to tranmit information to zero_emit
  *
+ * There are two solvers, chosen by modes.te_solver.  The default brackets
+ * the root with the cooling at tmin and tmax and then uses zero_find. The
+ * alternative, calc_te_secant, starts from the current temperature of the
+ * cell, which is usually close to the answer, and caches the temperature
+ * dependent rate coefficients for the duration of the solve.  The number of
+ * evaluations of zero_emit is recorded in xplasma->te_nevals in either case.
+ *
  **********************************************************/
 
 double
 calc_te (PlasmaPtr xplasma, double tmin, double tmax)
 {
   double z1, z2;
+  double t_guess;
+  double t_profile;
   int ierr = FALSE;
 
 
@@ -494,36 +517,51 @@ calc_te (PlasmaPtr xplasma, double tmin, double tmax)
    */
 
   xxxplasma = xplasma;
+  t_profile = wu_profile_start ();
 
   xxxplasma->heat_tot += xxxplasma->heat_ch_ex;
 
-  xplasma->t_e = tmin;
-  z1 = zero_emit (tmin);
-  xplasma->t_e = tmax;
-  z2 = zero_emit (tmax);
+  n_zero_emit = 0;
+  t_guess = xplasma->t_e;
 
-  /* The way this works is that if we have a situation where the cooling
-   * at tmax and tmin brackets the heating, then we use zbrent to improve
-   * the estimated temperature, but if not we chose the best direction
-   */
-
-  if ((z1 * z2 < 0.0))
-  {                             // Then the interval is bracketed
-    xplasma->t_e = zero_find (zero_emit2, tmin, tmax, 50., &ierr);
-    if (ierr)
-    {
-      Error ("calc_te: zero_find failed to find a temperature\n");
-    }
-
-  }
-  else if (fabs (z1) < fabs (z2))
+  if (modes.te_solver == TE_SOLVER_SECANT)
   {
-    xplasma->t_e = tmin;
+    te_coeff_cache_start (tmin, tmax);
+    xplasma->t_e = calc_te_secant (tmin, tmax, t_guess);
+    te_coeff_cache_stop ();
   }
   else
   {
+    xplasma->t_e = tmin;
+    z1 = zero_emit (tmin);
     xplasma->t_e = tmax;
+    z2 = zero_emit (tmax);
+
+    /* The way this works is that if we have a situation where the cooling
+     * at tmax and tmin brackets the heating, then we use zbrent to improve
+     * the estimated temperature, but if not we chose the best direction
+     */
+
+    if ((z1 * z2 < 0.0))
+    {                           // Then the interval is bracketed
+      xplasma->t_e = zero_find (zero_emit2, tmin, tmax, TE_SOLVER_TOL, &ierr);
+      if (ierr)
+      {
+        Error ("calc_te: zero_find failed to find a temperature\n");
+      }
+
+    }
+    else if (fabs (z1) < fabs (z2))
+    {
+      xplasma->t_e = tmin;
+    }
+    else
+    {
+      xplasma->t_e = tmax;
+    }
   }
+
+  xplasma->te_nevals = n_zero_emit;
   /* With the new temperature in place for the cell, get the correct value of heat_tot.
      SS June  04 */
 
@@ -554,6 +592,7 @@ calc_te (PlasmaPtr xplasma, double tmin, double tmax)
   xplasma->heat_tot += xplasma->heat_photo_macro;
   xplasma->heat_photo += xplasma->heat_photo_macro;
 
+  wu_profile_stop (WU_PHASE_CALC_TE, t_profile);
 
   return (xplasma->t_e);
 
@@ -605,6 +644,8 @@ zero_emit (double t)
 {
   double difference;
 
+  n_zero_emit++;
+
   /*Original method */
   xxxplasma->t_e = t;
 
@@ -662,3 +703,327 @@ zero_emit2 (double t, void *params)
 {
   return (zero_emit (t));
 }
+
+
+
+/**********************************************************/
+/**
+ * @brief  find the temperature where heating and cooling balance with a
+ * safeguarded secant method, starting from a guess
+ *
+ * @param [in] double  tmin   The minimum temperature allowed
+ * @param [in] double  tmax   The maximum temperature allowed
+ * @param [in] double  t_guess   The starting temperature, normally the current t_e
+ * @return     The temperature where heating and cooling match
+ *
+ * @details
+ * From one cycle to the next the temperature of a cell normally changes by a few
+ * per cent, so starting from the current temperature a secant iteration usually
+ * converges in a handful of calls to zero_emit, compared to the two bracketing
+ * calls plus the Brent iterations needed by zero_find.
+ *
+ * Once a sign change in zero_emit has been seen, the iteration is safeguarded:
+ * the bracket is kept up to date, and any secant step which leaves it is replaced
+ * by a bisection.  If the root lies beyond tmin or tmax, the nearest limit is
+ * returned, as is the case for the bracketing method in calc_te.
+ *
+ * ### Notes ###
+ *
+ * The plasma cell is communicated through xxxplasma, which must have been set
+ * by the caller.
+ *
+ **********************************************************/
+
+double
+calc_te_secant (double tmin, double tmax, double t_guess)
+{
+  double t0, t1, t2, z0, z1;
+  double t_lo, t_hi, z_lo, z_hi;
+  int bracketed;
+  int niter;
+
+  if (t_guess < tmin || t_guess > tmax)
+  {
+    t_guess = 0.5 * (tmin + tmax);
+  }
+
+  t0 = t_guess;
+  z0 = zero_emit (t0);
+
+  /* Take a small first step in the direction which reduces the difference
+     between heating and cooling; cooling increases with temperature */
+
+  t1 = (z0 > 0.0) ? t0 * (1. + TE_SOLVER_FIRST_STEP) : t0 * (1. - TE_SOLVER_FIRST_STEP);
+  if (t1 > tmax)
+    t1 = tmax;
+  if (t1 < tmin)
+    t1 = tmin;
+
+  bracketed = FALSE;
+  t_lo = t_hi = t0;
+  z_lo = z_hi = z0;
+
+  for (niter = 0; niter < TE_SOLVER_MAX_ITER; niter++)
+  {
+    z1 = zero_emit (t1);
+
+    if (z0 * z1 <= 0.0)
+    {
+      bracketed = TRUE;
+      if (t0 < t1)
+      {
+        t_lo = t0;
+        z_lo = z0;
+        t_hi = t1;
+        z_hi = z1;
+      }
+      else
+      {
+        t_lo = t1;
+        z_lo = z1;
+        t_hi = t0;
+        z_hi = z0;
+      }
+    }
+    else if (bracketed)
+    {
+      /* Shrink the existing bracket, keeping the sign change inside it */
+      if (z1 * z_lo > 0.0)
+      {
+        t_lo = t1;
+        z_lo = z1;
+      }
+      else
+      {
+        t_hi = t1;
+        z_hi = z1;
+      }
+    }
+
+    if (z1 == 0.0)
+    {
+      return (t1);
+    }
+
+    /* If we have stepped to a limit and still not seen a sign change, the
+       balance lies beyond the limit */
+
+    if (!bracketed && (t1 == tmin || t1 == tmax) && fabs (z1) <= fabs (z0))
+    {
+      return (t1);
+    }
+
+    if (z1 != z0)
+    {
+      t2 = t1 - z1 * (t1 - t0) / (z1 - z0);
+    }
+    else
+    {
+      t2 = 0.5 * (t0 + t1);
+    }
+
+    if (bracketed && (t2 <= t_lo || t2 >= t_hi))
+    {
+      t2 = 0.5 * (t_lo + t_hi);
+    }
+    else if (!bracketed)
+    {
+      if (t2 > tmax)
+        t2 = tmax;
+      if (t2 < tmin)
+        t2 = tmin;
+    }
+
+    /* Converged, either because the next step is small or the bracket is narrow */
+
+    if (fabs (t2 - t1) < TE_SOLVER_TOL || (bracketed && t_hi - t_lo < TE_SOLVER_TOL))
+    {
+      return (t2);
+    }
+
+    t0 = t1;
+    z0 = z1;
+    t1 = t2;
+  }
+
+  Error ("calc_te_secant: failed to converge in %d iterations for cell %d\n", TE_SOLVER_MAX_ITER, xxxplasma->nplasma);
+
+  if (bracketed)
+  {
+    return ((fabs (z_lo) < fabs (z_hi)) ? t_lo : t_hi);
+  }
+
+  return (t1);
+}
+
+
+
+/* The cache of temperature dependent rate coefficients used while calc_te_secant
+   is looking for a temperature.  The coefficients are stored for every ion on a
+   grid of nodes which is uniform in ln(T), with nodes only being calculated when
+   a temperature between them is requested. */
+
+#define TE_COEFF_DLNT   0.01    /* The spacing of the nodes in ln(T) */
+#define TE_COEFF_NNODES 128     /* The maximum number of nodes */
+
+static struct
+{
+  int active;
+  int nnodes;
+  double ln_tmin;
+  int filled[TE_COEFF_NTYPES][TE_COEFF_NNODES];
+  double *coeffs[TE_COEFF_NTYPES];
+} te_coeff_cache = { FALSE, 0, 0.0 };
+
+
+
+/**********************************************************/
+/**
+ * @brief  turn on caching of the temperature dependent rate coefficients
+ *
+ * @param [in] double  tmin   The lowest temperature which will be requested
+ * @param [in] double  tmax   The highest temperature which will be requested
+ * @return     Always returns 0
+ *
+ * @details
+ * Whilst the cache is active, compute_dr_coeffs, compute_di_coeffs and
+ * compute_qrecomb_coeffs interpolate the coefficients from nodes which are
+ * calculated on demand, rather than calculating them at every temperature.
+ * The coefficients only depend on temperature, so the cache must be stopped
+ * with te_coeff_cache_stop before the coefficients are used for another cell.
+ *
+ **********************************************************/
+
+int
+te_coeff_cache_start (double tmin, double tmax)
+{
+  int i, n;
+
+  if (te_coeff_cache.coeffs[0] == NULL)
+  {
+    for (i = 0; i < TE_COEFF_NTYPES; i++)
+    {
+      te_coeff_cache.coeffs[i] = calloc (TE_COEFF_NNODES * NIONS, sizeof (double));
+      if (te_coeff_cache.coeffs[i] == NULL)
+      {
+        Error ("te_coeff_cache_start: unable to allocate memory for the coefficient cache\n");
+        Exit (EXIT_FAILURE);
+      }
+    }
+  }
+
+  te_coeff_cache.ln_tmin = log (tmin);
+  te_coeff_cache.nnodes = (int) ((log (tmax) - te_coeff_cache.ln_tmin) / TE_COEFF_DLNT) + 2;
+  if (te_coeff_cache.nnodes > TE_COEFF_NNODES)
+  {
+    te_coeff_cache.nnodes = TE_COEFF_NNODES;    /* temperatures beyond the last node are calculated directly */
+  }
+
+  for (i = 0; i < TE_COEFF_NTYPES; i++)
+  {
+    for (n = 0; n < TE_COEFF_NNODES; n++)
+    {
+      te_coeff_cache.filled[i][n] = FALSE;
+    }
+  }
+
+  te_coeff_cache.active = TRUE;
+
+  return (0);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief  turn off caching of the temperature dependent rate coefficients
+ *
+ * @return     Always returns 0
+ *
+ **********************************************************/
+
+int
+te_coeff_cache_stop (void)
+{
+  te_coeff_cache.active = FALSE;
+
+  return (0);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief  interpolate a set of rate coefficients from the cache
+ *
+ * @param [in] int  type   Which coefficients, TE_COEFF_DR, TE_COEFF_DI or TE_COEFF_QRECOMB
+ * @param [in] double  t   The temperature
+ * @param [out] double *  coeffs   The global array of coefficients to fill
+ * @return     TRUE if coeffs was filled from the cache, FALSE if the cache is not
+ * active or t is outside it, in which case the caller calculates the coefficients
+ *
+ * @details
+ * The interpolation is linear in ln(coefficient) against ln(T), which is very
+ * accurate for the Arrhenius-like form of the rates, falling back to linear
+ * interpolation when one of the coefficients is zero.
+ *
+ **********************************************************/
+
+int
+te_coeff_cache_lookup (int type, double t, double *coeffs)
+{
+  int n, k, node;
+  double x, frac;
+  double *lower, *upper;
+
+  if (te_coeff_cache.active == FALSE || t <= 0.0)
+  {
+    return (FALSE);
+  }
+
+  x = (log (t) - te_coeff_cache.ln_tmin) / TE_COEFF_DLNT;
+  k = (int) floor (x);
+  if (k < 0 || k + 1 >= te_coeff_cache.nnodes)
+  {
+    return (FALSE);
+  }
+  frac = x - k;
+
+  /* Calculate any nodes which are missing, by calling the routine which
+     normally fills coeffs with the cache turned off */
+
+  for (node = k; node <= k + 1; node++)
+  {
+    if (te_coeff_cache.filled[type][node] == FALSE)
+    {
+      te_coeff_cache.active = FALSE;
+      if (type == TE_COEFF_DR)
+        compute_dr_coeffs (exp (te_coeff_cache.ln_tmin + node * TE_COEFF_DLNT));
+      else if (type == TE_COEFF_DI)
+        compute_di_coeffs (exp (te_coeff_cache.ln_tmin + node * TE_COEFF_DLNT));
+      else
+        compute_qrecomb_coeffs (exp (te_coeff_cache.ln_tmin + node * TE_COEFF_DLNT));
+      te_coeff_cache.active = TRUE;
+
+      memcpy (&te_coeff_cache.coeffs[type][node * NIONS], coeffs, NIONS * sizeof (double));
+      te_coeff_cache.filled[type][node] = TRUE;
+    }
+  }
+
+  lower = &te_coeff_cache.coeffs[type][k * NIONS];
+  upper = &te_coeff_cache.coeffs[type][(k + 1) * NIONS];
+
+  for (n = 0; n < NIONS; n++)
+  {
+    if (lower[n] > 0.0 && upper[n] > 0.0)
+    {
+      coeffs[n] = exp ((1. - frac) * log (lower[n]) + frac * log (upper[n]));
+    }
+    else
+    {
+      coeffs[n] = (1. - frac) * lower[n] + frac * upper[n];
+    }
+  }
+
+  return (TRUE);
+}
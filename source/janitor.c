@@ -61,12 +61,23 @@ free_domains (void)
 void
 free_wind_grid (void)
 {
-  int n_wind;
+  int n_wind, j;
 
-  for (n_wind = 0; n_wind < NDIM2; ++n_wind)
-  {
-    free (wmain[n_wind].paths);
-    free (wmain[n_wind].line_paths);
+  if (geo.reverb == REV_WIND || geo.reverb == REV_MATOM)
+  {                             //The path histograms are only allocated by reverb_init
+    for (n_wind = 0; n_wind < NDIM2; ++n_wind)
+    {
+      wind_paths_free (wmain[n_wind].paths);
+      if (wmain[n_wind].line_paths != NULL)
+      {
+        for (j = 0; j < geo.reverb_lines; j++)
+        {
+          wind_paths_free (wmain[n_wind].line_paths[j]);
+        }
+      }
+      free (wmain[n_wind].line_paths);
+    }
+    reverb_free ();
   }
 
   free (wmain);
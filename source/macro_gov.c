@@ -343,11 +343,14 @@ macro_pops (xplasma, xne)
   int n_iterations, n_inversions;
   double *a_data, *b_data;
   double *populations;
+  double t_profile;
   double rate_matrix[NLEVELS_MACRO][NLEVELS_MACRO];
   int radiative_flag[NLEVELS_MACRO][NLEVELS_MACRO];     // array to flag if two levels are radiatively linked
   int conf_to_matrix[NLEVELS_MACRO];    // links config number to elements in arrays
   MacroPtr mplasma = &macromain[xplasma->nplasma];
 
+  t_profile = wu_profile_start ();
+
   /*
    * In cells where there are no photons, we don't have any estimators yet
    * so we should first use dilute estimators to avoid problems further
@@ -497,6 +500,7 @@ macro_pops (xplasma, xne)
           if (n_iterations == MAXITERATIONS)
           {
             Error ("macro_pops: failed to converge for plasma cell %d\n", xplasma->nplasma);
+            wu_profile_stop (WU_PHASE_MACRO_POPS, t_profile);
             return EXIT_FAILURE;
           }
         }
@@ -504,6 +508,7 @@ macro_pops (xplasma, xne)
     }                           // end of if statement for macro-atoms
   }                             // end of elements loop
 
+  wu_profile_stop (WU_PHASE_MACRO_POPS, t_profile);
 
   return (0);
 }
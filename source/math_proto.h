@@ -14,6 +14,9 @@ int init_rand(int seed);
 void init_rng_directory(char *root, int rank);
 void save_gsl_rng_state(void);
 void reload_gsl_rng_state(void);
+int stratify_init(long nsamples, int ndim);
+int stratify_sample(long isample);
+double stratify_dispersion(int counts[], double expected[], int nbins);
 double random_number(double min, double max);
 /* cdf.c */
 int cdf_gen_from_func(CdfPtr cdf, double (*func)(double, void *), double xmin, double xmax, int njumps, double jump[]);
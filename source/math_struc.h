@@ -3,6 +3,7 @@
                                 //the size of any model that is read in, hence larger than NWAVE_EXTRACT in models.h
 #define FUNC_CDF  2000          //The size for CDFs made from functional form CDFs
 #define ARRAY_PDF 1000          //The size for PDFs to be turned into CDFs from arrays
+#define STRATIFY_MAX_DIM 8      //The maximum number of random numbers per sample which can be stratified
 
 
 /**
@@ -602,18 +602,34 @@ xalpha_sp (cont_ptr, xplasma, ichoice)
 }
 
 
+/**********************************************************/
+/**
+ * @brief the frequency integral which appears in alpha_sp
+ *
+ * @param [in] struct topbase_phot cont_ptr pointer to calculate
+ * @param [in] double temp the electron temperature
+ * @param [in] int ichoice one of several types or rates to calculate
+ *
+ * @return the integral of a(nu) nu2 exp [(chi- h nu)/kT], weighted
+ * according to ichoice
+ *
+ * @details
+ * This is the part of alpha_sp which depends on the temperature
+ * only through the integrand.  It is separated out so that
+ * it can be stored in the cache of free-bound integrals in recomb.c
+***********************************************************/
+
 double
-alpha_sp (cont_ptr, xplasma, ichoice)
+alpha_sp_integral (cont_ptr, temp, ichoice)
      struct topbase_phot *cont_ptr;
-     PlasmaPtr xplasma;
+     double temp;
      int ichoice;
 {
   double alpha_sp_value;
   double fthresh, flast;
-  double temp;
 
   temp_choice = ichoice;
-  temp = temp_ext = xplasma->t_e;       //external for use in alph_sp_integrand
+  temp_ext = temp;              //external for use in alph_sp_integrand
   cont_ext_ptr = cont_ptr;      //"
 
   fthresh = cont_ptr->freq[0];  //first frequency in list
@@ -684,6 +700,23 @@ alpha_sp (cont_ptr, xplasma, ichoice)
 
   /* This is the end of the modification */
 
+  return (alpha_sp_value);
+}
+
+
+double
+alpha_sp (cont_ptr, xplasma, ichoice)
+     struct topbase_phot *cont_ptr;
+     PlasmaPtr xplasma;
+     int ichoice;
+{
+  double alpha_sp_value;
+
+  if (modes.fb_cache)
+    alpha_sp_value = fb_cache_alpha_sp (cont_ptr, xplasma->t_e, ichoice);
+  else
+    alpha_sp_value = alpha_sp_integral (cont_ptr, xplasma->t_e, ichoice);
+
   /* The lines above evaluate the integral in alpha_sp. Now we just want to multiply
      through by the appropriate constant. */
   if (cont_ptr->macro_info == TRUE && geo.macro_simple == FALSE)
@@ -10,6 +10,7 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <gsl/gsl_blas.h>
 #include <gsl/gsl_linalg.h>
@@ -256,6 +257,314 @@ cpu_invert_matrix (double *matrix, double *inverse_out, int matrix_size)
   return EXIT_SUCCESS;
 }
 
+/* ****************************************************************************************************************** */
+/**
+ * Workspace for the dense LU backend. The matrices we solve are small (a few tens of rows for an ionization block
+ * or a macro-atom element), so rather than allocating fresh GSL structures for every system the workspace is kept
+ * between calls and only grown when a larger system comes along.
+ *
+ *  ***************************************************************************************************************** */
+
+static double *lu_work_matrix = NULL;
+static double *lu_work_vectors = NULL;
+static int *lu_work_pivot = NULL;
+static int lu_work_size = 0;
+
+/* ****************************************************************************************************************** */
+/**
+ * @brief Make sure the LU workspace is large enough for a matrix of a given size
+ *
+ * @param [in] matrix_size the number of rows (and columns) in the matrix
+ *
+ * @return an integer representing the error state
+ *
+ *  ***************************************************************************************************************** */
+
+static int
+lu_reserve_workspace (int matrix_size)
+{
+  if (matrix_size <= lu_work_size)
+  {
+    return EXIT_SUCCESS;
+  }
+
+  free (lu_work_matrix);
+  free (lu_work_vectors);
+  free (lu_work_pivot);
+
+  lu_work_matrix = malloc (matrix_size * matrix_size * sizeof (double));
+  lu_work_vectors = malloc (2 * matrix_size * sizeof (double));
+  lu_work_pivot = malloc (matrix_size * sizeof (int));
+
+  if (lu_work_matrix == NULL || lu_work_vectors == NULL || lu_work_pivot == NULL)
+  {
+    Error ("lu_reserve_workspace: unable to allocate workspace for matrix of size %d\n", matrix_size);
+    lu_work_size = 0;
+    return GSL_ENOMEM;
+  }
+
+  lu_work_size = matrix_size;
+
+  return EXIT_SUCCESS;
+}
+
+/* ****************************************************************************************************************** */
+/**
+ * @brief Compute the LU decomposition of a row-major matrix in place, with partial pivoting
+ *
+ * @param [in,out] lu the matrix to decompose, replaced by L (unit diagonal, not stored) and U
+ * @param [out] pivot the row permutation
+ * @param [in] matrix_size the number of rows (and columns) in the matrix
+ *
+ * @return 0 if successful, or 4 if the matrix is singular
+ *
+ * @details
+ *
+ * This is the textbook Doolittle algorithm. For the small systems in Python the inner loop is a contiguous row
+ * update, which the compiler vectorises, and there is none of the bookkeeping overhead of a general library call.
+ *
+ *  ***************************************************************************************************************** */
+
+static int
+lu_decompose (double *lu, int *pivot, int matrix_size)
+{
+  int i, j, k, i_max;
+  double max_val, factor, tmp;
+  double *row_k, *row_i;
+
+  for (k = 0; k < matrix_size; k++)
+  {
+    i_max = k;
+    max_val = fabs (lu[k * matrix_size + k]);
+    for (i = k + 1; i < matrix_size; i++)
+    {
+      if (fabs (lu[i * matrix_size + k]) > max_val)
+      {
+        max_val = fabs (lu[i * matrix_size + k]);
+        i_max = i;
+      }
+    }
+
+    pivot[k] = i_max;
+
+    if (max_val == 0.0)
+    {
+      return 4;
+    }
+
+    if (i_max != k)
+    {
+      row_k = &lu[k * matrix_size];
+      row_i = &lu[i_max * matrix_size];
+      for (j = 0; j < matrix_size; j++)
+      {
+        tmp = row_k[j];
+        row_k[j] = row_i[j];
+        row_i[j] = tmp;
+      }
+    }
+
+    row_k = &lu[k * matrix_size];
+    for (i = k + 1; i < matrix_size; i++)
+    {
+      row_i = &lu[i * matrix_size];
+      if (row_i[k] == 0.0)
+      {
+        continue;               /* the rate matrices are sparse, so this saves a lot of work */
+      }
+      factor = row_i[k] / row_k[k];
+      row_i[k] = factor;
+      for (j = k + 1; j < matrix_size; j++)
+      {
+        row_i[j] -= factor * row_k[j];
+      }
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
+
+/* ****************************************************************************************************************** */
+/**
+ * @brief Solve L U x = P b by forward and backward substitution
+ *
+ * @param [in] lu the LU decomposition from lu_decompose
+ * @param [in] pivot the row permutation from lu_decompose
+ * @param [in] matrix_size the number of rows (and columns) in the matrix
+ * @param [in] b_vector the right hand side
+ * @param [out] x_vector the solution
+ *
+ *  ***************************************************************************************************************** */
+
+static void
+lu_substitute (const double *lu, const int *pivot, int matrix_size, const double *b_vector, double *x_vector)
+{
+  int i, j;
+  double sum, tmp;
+
+  for (i = 0; i < matrix_size; i++)
+  {
+    x_vector[i] = b_vector[i];
+  }
+
+  for (i = 0; i < matrix_size; i++)
+  {
+    if (pivot[i] != i)
+    {
+      tmp = x_vector[i];
+      x_vector[i] = x_vector[pivot[i]];
+      x_vector[pivot[i]] = tmp;
+    }
+  }
+
+  for (i = 1; i < matrix_size; i++)
+  {
+    sum = x_vector[i];
+    for (j = 0; j < i; j++)
+    {
+      sum -= lu[i * matrix_size + j] * x_vector[j];
+    }
+    x_vector[i] = sum;
+  }
+
+  for (i = matrix_size - 1; i >= 0; i--)
+  {
+    sum = x_vector[i];
+    for (j = i + 1; j < matrix_size; j++)
+    {
+      sum -= lu[i * matrix_size + j] * x_vector[j];
+    }
+    x_vector[i] = sum / lu[i * matrix_size + i];
+  }
+}
+
+/* ****************************************************************************************************************** */
+/**
+ * @brief Solve the linear system A x = b using the dense LU backend
+ *
+ * @param  [in]  a_matrix a square matrix on the LHS
+ * @param  [in]  b_vector the B resultant vector
+ * @param  [in]  matrix_size the number of rows (and columns) in the square matrix matrix and vectors
+ * @param  [out] x_vector the x vector on the RHS
+ * @param  [in]  nplasma the index of the plasma cell we are working on
+ *
+ * @return an integer representing the error state, using the same codes as cpu_solve_matrix
+ *
+ * @details
+ *
+ * Unlike cpu_solve_matrix, a_matrix is not modified. The solution is checked against the original matrix in the same
+ * way as for the GSL backend.
+ *
+ *  ***************************************************************************************************************** */
+
+static int
+lu_solve_matrix (double *a_matrix, double *b_vector, int matrix_size, double *x_vector, int nplasma)
+{
+  int i, j, error;
+  int n_error = 0;
+  double test_val;
+
+  if ((error = lu_reserve_workspace (matrix_size)))
+  {
+    return error;
+  }
+
+  memcpy (lu_work_matrix, a_matrix, matrix_size * matrix_size * sizeof (double));
+
+  if (lu_decompose (lu_work_matrix, lu_work_pivot, matrix_size))
+  {
+    Error ("Solve_matrix: singular matrix in LU decomposition for plasma cell %i\n", nplasma);
+    return (4);
+  }
+
+  lu_substitute (lu_work_matrix, lu_work_pivot, matrix_size, b_vector, x_vector);
+
+  /* Check that x_vector really is a solution, with the same tests as are applied to the GSL solution */
+
+  for (i = 0; i < matrix_size; i++)
+  {
+    test_val = 0.0;
+    for (j = 0; j < matrix_size; j++)
+    {
+      test_val += a_matrix[i * matrix_size + j] * x_vector[j];
+    }
+
+    if (b_vector[i] > 0.0)
+    {
+      if (n_error == 0 && fabs ((test_val - b_vector[i]) / test_val) > EPSILON)
+      {
+        Error ("Solve_matrix: test solution fails relative error for row %i %e != %e frac_error %e in plasma cell %d\n", i, test_val,
+               b_vector[i], fabs ((test_val - b_vector[i]) / test_val), nplasma);
+        error = 2;
+        n_error += 1;
+      }
+    }
+    else if (n_error == 0 && fabs (test_val - b_vector[i]) > EPSILON)
+    {
+      Error ("Solve_matrix: test solution fails absolute error for row %i %e != %e in plasma cell %d\n", i, test_val, b_vector[i], nplasma);
+      error = 3;
+      n_error += 1;
+    }
+  }
+
+  return error;
+}
+
+/* ****************************************************************************************************************** */
+/**
+ * @brief Calculate the inverse of a square matrix using the dense LU backend
+ *
+ * @param  [in]  matrix the matrix to compute the inverse for, which is not modified
+ * @param  [out] inverse_out the inverse of `matrix`
+ * @param  [in]  matrix_size  the size of the matrix
+ *
+ * @return an integer representing the error state
+ *
+ * @details
+ *
+ * The inverse is built one column at a time by substituting the columns of the identity matrix, re-using the
+ * single factorisation.
+ *
+ *  ***************************************************************************************************************** */
+
+static int
+lu_invert_matrix (double *matrix, double *inverse_out, int matrix_size)
+{
+  int i, j, error;
+  double *unit_vector, *column;
+
+  if ((error = lu_reserve_workspace (matrix_size)))
+  {
+    return error;
+  }
+
+  memcpy (lu_work_matrix, matrix, matrix_size * matrix_size * sizeof (double));
+
+  if (lu_decompose (lu_work_matrix, lu_work_pivot, matrix_size))
+  {
+    Error ("invert_matrix: singular matrix in LU decomposition\n");
+    return GSL_ESING;
+  }
+
+  unit_vector = lu_work_vectors;
+  column = lu_work_vectors + matrix_size;
+
+  for (j = 0; j < matrix_size; j++)
+  {
+    for (i = 0; i < matrix_size; i++)
+    {
+      unit_vector[i] = (i == j) ? 1.0 : 0.0;
+    }
+    lu_substitute (lu_work_matrix, lu_work_pivot, matrix_size, unit_vector, column);
+    for (i = 0; i < matrix_size; i++)
+    {
+      inverse_out[i * matrix_size + j] = column[i];
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
+
 #endif
 
 /* ****************************************************************************************************************** */
@@ -295,7 +604,9 @@ get_matrix_error_string (int error_code)
  * @details
  * Performs LU decomposition to solve for x in the linear system A x = b.
  *
- * This function is a wrapper around two others: `cpu_solve_linear_system` and `gpu_solve_linear_system`.
+ * This function is a wrapper around the GPU and CPU solvers. On the CPU, the solver is chosen at run time by
+ * modes.matrix_solver: either the GSL routines (the default) or a hand-written dense LU decomposition which re-uses
+ * its workspace between calls and is faster for the small systems we usually solve.
  *
  * ### Notes ###
  *
@@ -303,34 +614,94 @@ get_matrix_error_string (int error_code)
  *
  *  ***************************************************************************************************************** */
 
-#include <time.h>
-#include <sys/time.h>
-
 int
 solve_matrix (double *a_matrix, double *b_matrix, int size, double *x_matrix, int nplasma)
 {
   int error;
+  double t_profile;
+
+  t_profile = wu_profile_start ();
 
 #ifdef CUDA_ON
   error = gpu_solve_matrix (a_matrix, b_matrix, size, x_matrix);
 #else
-  error = cpu_solve_matrix (a_matrix, b_matrix, size, x_matrix, nplasma);
+  if (modes.matrix_solver == MATRIX_SOLVER_LU)
+  {
+    error = lu_solve_matrix (a_matrix, b_matrix, size, x_matrix, nplasma);
+  }
+  else
+  {
+    error = cpu_solve_matrix (a_matrix, b_matrix, size, x_matrix, nplasma);
+  }
 #endif
 
+  wu_profile_stop (WU_PHASE_MATRIX_SOLVE, t_profile);
+
   return error;
 }
 
 /* ****************************************************************************************************************** */
 /**
- * @brief
+ * @brief Solve a batch of independent linear systems A_i x_i = b_i
  *
- * @param  [in]  a_matrix
- * @param  [out] a_inverse
- * @param  [in]  num_rows
+ * @param  [in]  a_matrices - the square matrices packed one after the other, each in row-major order
+ * @param  [in]  b_vectors - the B resultant vectors packed one after the other
+ * @param  [in]  sizes - the number of rows (and columns) for each system
+ * @param  [in]  n_systems - the number of systems in the batch
+ * @param  [out] x_vectors - the solution vectors, packed in the same way as b_vectors
+ * @param  [in]  nplasma - the index of the plasma cell we are working on
  *
  * @return an integer representing the error state
  *
  * @details
+ * The systems are solved one after the other with the backend selected by solve_matrix, which for the dense LU
+ * backend means that the workspace is shared across the whole batch. If any system fails with a singular matrix
+ * (error 4) then that is returned, otherwise the first non-zero error is returned.
+ *
+ * ### Notes ###
+ *
+ * Systems of size zero are allowed, and are skipped.
+ *
+ *  ***************************************************************************************************************** */
+
+int
+solve_matrix_batch (double *a_matrices, double *b_vectors, int *sizes, int n_systems, double *x_vectors, int nplasma)
+{
+  int i, error;
+  int batch_error = EXIT_SUCCESS;
+  long a_offset = 0;
+  long b_offset = 0;
+
+  for (i = 0; i < n_systems; i++)
+  {
+    if (sizes[i] > 0)
+    {
+      error = solve_matrix (&a_matrices[a_offset], &b_vectors[b_offset], sizes[i], &x_vectors[b_offset], nplasma);
+      if (error == 4 || (error && batch_error == EXIT_SUCCESS))
+      {
+        batch_error = error;
+      }
+    }
+    a_offset += (long) sizes[i] * sizes[i];
+    b_offset += sizes[i];
+  }
+
+  return batch_error;
+}
+
+/* ****************************************************************************************************************** */
+/**
+ * @brief Calculate the inverse of the square matrix `matrix`
+ *
+ * @param  [in]  matrix - the matrix to invert
+ * @param  [out] inverted_matrix - the inverse of matrix
+ * @param  [in]  num_rows - the number of rows (and columns) in the matrix
+ *
+ * @return an integer representing the error state
+ *
+ * @details
+ *
+ * A wrapper around the GPU, GSL and dense LU routines, which are selected in the same way as for solve_matrix.
  *
  *  ***************************************************************************************************************** */
 
@@ -342,8 +713,44 @@ invert_matrix (double *matrix, double *inverted_matrix, int num_rows)
 #ifdef CUDA_ON
   error = gpu_invert_matrix (matrix, inverted_matrix, num_rows);
 #else
-  error = cpu_invert_matrix (matrix, inverted_matrix, num_rows);
+  if (modes.matrix_solver == MATRIX_SOLVER_LU)
+  {
+    error = lu_invert_matrix (matrix, inverted_matrix, num_rows);
+  }
+  else
+  {
+    error = cpu_invert_matrix (matrix, inverted_matrix, num_rows);
+  }
 #endif
 
   return error;
 }
+
+/* ****************************************************************************************************************** */
+/**
+ * @brief Release the workspace kept between calls by the dense LU backend
+ *
+ * @return an integer representing the error state
+ *
+ * @details
+ *
+ * The workspace is grown as required by lu_reserve_workspace and re-used for the whole run, so this only needs to be
+ * called once the matrix solvers are no longer needed. It is safe to call if the workspace was never allocated.
+ *
+ *  ***************************************************************************************************************** */
+
+int
+free_matrix_workspace (void)
+{
+#ifndef CUDA_ON
+  free (lu_work_matrix);
+  free (lu_work_vectors);
+  free (lu_work_pivot);
+  lu_work_matrix = NULL;
+  lu_work_vectors = NULL;
+  lu_work_pivot = NULL;
+  lu_work_size = 0;
+#endif
+
+  return EXIT_SUCCESS;
+}
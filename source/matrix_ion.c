@@ -58,13 +58,14 @@ matrix_ion_populations (xplasma, mode)
 
 {
   double elem_dens[NELEMENTS];  //The density of each element
-  int nn, mm, nrows;
+  int nn, mm, nelem, first, offset, n_packed;
+  int block_size[NELEMENTS];    //The number of ions, and so rows, in the block of the rate matrix for each element
   double rate_matrix[nions][nions];     //The rate matrix that we are going to try and solve
   double newden[NIONS];         //A temporary array to hold our intermediate solutions
   double nh, nh1, nh2, t_e;
   double xne, xxne, xxxne;      //Various stores for intermediate guesses at electron density
   double b_temp[nions];         //The b matrix
-  double *b_data, *a_data;      //These arrays are allocated later and sent to the matrix solver
+  double *b_data, *a_data, *x_data;     //These arrays are allocated later and sent to the matrix solver
   double *populations;          //This array is allocated later and is retrieved from the matrix solver
   int matrix_err, niterate;     //counters for errors and the number of iterations we have tried to get a converged electron density
   double xnew;
@@ -208,6 +209,23 @@ matrix_ion_populations (xplasma, mode)
 
   xne = xxne = xxxne = get_ne (xplasma->density);       //Even though the abundances are fractional, we need the real electron density
 
+  /* No process links the ions of different elements, so the rate matrix is block diagonal with one block per element.
+     Rather than solving the full nions x nions system, which costs O(nions^3), we pack the block for each element one
+     after the other and solve them together as a batch. The packed arrays are the same for every iteration, so are
+     allocated once here. */
+
+  n_packed = 0;
+  for (nelem = 0; nelem < nelements; nelem++)
+  {
+    block_size[nelem] = (ele[nelem].firstion < 0) ? 0 : ele[nelem].nions;
+    n_packed += block_size[nelem] * block_size[nelem];
+  }
+
+  a_data = (double *) calloc (n_packed, sizeof (double));
+  b_data = (double *) calloc (nions, sizeof (double));
+  x_data = (double *) calloc (nions, sizeof (double));
+  populations = (double *) calloc (nions, sizeof (double));
+
 
   /* xne is the current working number xxne */
 
@@ -241,61 +259,75 @@ matrix_ion_populations (xplasma, mode)
     populate_ion_rate_matrix (rate_matrix, pi_rates, inner_rates, rr_rates, b_temp, xne, nh1, nh2);
 
 
-    /* The array is now fully populated, and we can begin the process of solving it */
-
-    nrows = nions;              /* This is a placeholder, we may end up removing rows and columns that have no rates (or very
-                                   low rates) connecting them to other rows. This may improve stability but will need to be
-                                   done carefully */
+    /* The array is now fully populated, and we can begin the process of solving it. Here we solve the matrix equation
+       M x = b, where x is our vector containing level populations as a fraction w.r.t the whole element. The b_data
+       column matrix is the total number density for each element, placed into the row which relates to the neutral
+       ion. This matches the row in the rate matrix which is just 1 1 1 1 for all stages. NB, we could have chosen any
+       line for this. The actual LU decomposition - the process of obtaining a solution - is done by the routine
+       solve_matrix_batch() */
 
-    /* Here we solve the matrix equation M x = b, where x is our vector containing level populations as a fraction w.r.t the
-       whole element. The actual LU decomposition- the process of obtaining a solution - is done by the routine solve_matrix() */
-
-    a_data = (double *) calloc (sizeof (double), nrows * nrows);
-    populations = (double *) calloc (nrows, sizeof (double));
-
-    /* This b_data column matrix is the total number density for each element, placed into the row which relates to the neutral
-       ion. This matches the row in the rate matrix which is just 1 1 1 1 for all stages. NB, we could have chosen any line for
-       this. */
-
-    b_data = (double *) calloc (nrows, sizeof (double));
-
-    /* We now copy our rate matrix into the prepared matrix */
-    for (mm = 0; mm < nrows; mm++)
+    offset = 0;
+    for (nelem = 0; nelem < nelements; nelem++)
     {
-      for (nn = 0; nn < nrows; nn++)
+      first = ele[nelem].firstion;
+      for (mm = 0; mm < block_size[nelem]; mm++)
       {
-        a_data[mm * nrows + nn] = rate_matrix[mm][nn];  /* row-major */
+        for (nn = 0; nn < block_size[nelem]; nn++)
+        {
+          a_data[offset + mm * block_size[nelem] + nn] = rate_matrix[first + mm][first + nn];   /* row-major */
+        }
       }
+      offset += block_size[nelem] * block_size[nelem];
     }
 
-    for (nn = 0; nn < nrows; nn++)
+    offset = 0;
+    for (nelem = 0; nelem < nelements; nelem++)
     {
-      b_data[nn] = b_temp[nn];
+      for (mm = 0; mm < block_size[nelem]; mm++)
+      {
+        b_data[offset + mm] = b_temp[ele[nelem].firstion + mm];
+      }
+      offset += block_size[nelem];
     }
 
-    matrix_err = solve_matrix (a_data, b_data, nrows, populations, xplasma->nplasma);
+    matrix_err = solve_matrix_batch (a_data, b_data, block_size, nelements, x_data, xplasma->nplasma);
 
     if (matrix_err)
     {
       Error ("matrix_ion_populations: %s\n", get_matrix_error_string (matrix_err));
     }
 
-    /* free memory */
-    free (a_data);
-    free (b_data);
-
     if (matrix_err == 4)
     {
+      free (a_data);
+      free (b_data);
+      free (x_data);
       free (populations);
       return (-1);
     }
 
+    /* Unpack the solution for each element back into ion order */
+
+    offset = 0;
+    for (nelem = 0; nelem < nelements; nelem++)
+    {
+      for (mm = 0; mm < block_size[nelem]; mm++)
+      {
+        populations[ele[nelem].firstion + mm] = x_data[offset + mm];
+      }
+      offset += block_size[nelem];
+    }
+
     /* Calculate level populations for macro-atoms */
     if (geo.macro_ioniz_mode == MACRO_IONIZ_MODE_ESTIMATORS)
     {
       int mp_err = macro_pops (xplasma, xne);
       if (mp_err != EXIT_SUCCESS)
       {
+        free (a_data);
+        free (b_data);
+        free (x_data);
+        free (populations);
         return -1;
       }
     }
@@ -321,7 +353,7 @@ matrix_ion_populations (xplasma, mode)
       else
       {
 
-        for (mm = 0; mm < nrows; mm++)  // inner loop over the elements of the population array
+        for (mm = 0; mm < nions; mm++)  // inner loop over the elements of the population array
         {
           if (xion[mm] == nn)   // if this element contains the population of the ion is question
           {
@@ -333,7 +365,6 @@ matrix_ion_populations (xplasma, mode)
       if (newden[nn] < DENSITY_MIN)     // this wil also capture the case where population doesnt have a value for this ion
         newden[nn] = DENSITY_MIN;
     }
-    free (populations);
 
 
 /* We need to get the 'true' new electron density so we need to do a little loop here to compute it */
@@ -377,10 +408,19 @@ matrix_ion_populations (xplasma, mode)
 
       Error ("matrix_ion_populations: xxne %e theta %e\n", xxne);
 
+      free (a_data);
+      free (b_data);
+      free (x_data);
+      free (populations);
       return (-1);              /* If we get to MAXITERATIONS, we return without copying the new populations into plasma */
     }
   }                             /* This is the end of the iteration loop */
 
+  free (a_data);
+  free (b_data);
+  free (x_data);
+  free (populations);
+
 
   xplasma->ne = xnew;
   for (nn = 0; nn < nions; nn++)
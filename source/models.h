@@ -75,6 +75,27 @@ struct ModSum
   struct Cdf xcdf;              /**< The current cumulative distribution 
                                   * function for this component
                                   */
+  int *order;                   /**< The indices of the models of this type sorted
+                                  * by their first parameter, used to find the models
+                                  * which bracket the requested one
+                                  */
+  int nkeys;                    /**< The number of sets of parameters for which models
+                                  * have been interpolated since the cache was last emptied
+                                  */
+  int ncache, ncache_max;       /**< The number of interpolated models which have been
+                                  * cached and the maximum number which can be
+                                  */
+  int *cache_slot;              /**< A hash table of the positions in cache_par of each
+                                  * set of parameters, -1 for empty slots
+                                  */
+  double *cache_par;            /**< The parameters of the interpolated models */
+  int *cache_index;             /**< The position in cache_f of the fluxes for each set of
+                                  * parameters, or -1 if they have not been cached
+                                  */
+  double *cache_f;              /**< The fluxes of the cached models */
 };
 
+#define MODEL_CACHE_SLOTS  8192 // The size of the hash table of interpolated models, a power of 2
+#define MODEL_CACHE_MB     64   // The maximum memory for interpolated models of one type
+
 extern struct ModSum comp[NCOMPS];
@@ -172,6 +172,161 @@ parse_command_line (argc, argv)
         Log ("Not storing the macro-atom matrix (on-the-fly method) if Matom.ransition_mode is matrix.\n");
         j = i;
       }
+      else if (strcmp (argv[i], "-profile_wind_update") == 0)
+      {
+        modes.profile_wind_update = TRUE;
+        Log ("Timing the phases of wind_update for each cell, and writing a report every ionization cycle\n");
+        j = i;
+      }
+      else if (strcmp (argv[i], "-fb_cache") == 0)
+      {
+        modes.fb_cache = TRUE;
+        Log ("Interpolating free-bound integrals from a temperature-gridded cache\n");
+        j = i;
+      }
+      else if (strcmp (argv[i], "-compton_tables") == 0)
+      {
+        modes.compton_tables = TRUE;
+        Log ("Using tables for Compton scattering directions, reweighting and thermal electron speeds\n");
+        j = i;
+      }
+      else if (strcmp (argv[i], "-sparse_cell_spec") == 0)
+      {
+        modes.sparse_cell_spec = TRUE;
+        Log ("Only storing and communicating the parts of the cell spectra in which photons have deposited flux\n");
+        j = i;
+      }
+      else if (strcmp (argv[i], "-binary_delay_dump") == 0)
+      {
+        modes.binary_delay_dump = TRUE;
+        Log ("Writing the reverberation delay dump as binary records to root.delay_dump.bin\n");
+        j = i;
+      }
+      else if (strcmp (argv[i], "-atomic_image") == 0)
+      {
+        use_atomic_image = TRUE;
+        Log ("Reading the atomic data from a binary image of the masterfile, which is remade if the data files change\n");
+        j = i;
+      }
+      else if (strcmp (argv[i], "-model_image") == 0)
+      {
+        modes.model_image = TRUE;
+        Log ("Reading grids of models from a binary image of each list of models, which is remade if the models change\n");
+        j = i;
+      }
+      else if (strcmp (argv[i], "-ray_velocity") == 0)
+      {
+        modes.ray_velocity = TRUE;
+        Log ("Finding local frame frequencies and velocity gradients within a segment of a photon path from a fit to the velocity\n");
+        j = i;
+      }
+      else if (strcmp (argv[i], "-disk_table") == 0)
+      {
+        modes.disk_table = TRUE;
+        Log ("Finding where photons hit a vertically extended disk from a table of the disk surface\n");
+        j = i;
+      }
+      else if (strcmp (argv[i], "-thin_cells") == 0)
+      {
+        if (i + 1 < argc && sscanf (argv[i + 1], "%le", &modes.thin_cells_tau) == 1 && modes.thin_cells_tau > 0)
+        {
+          modes.thin_cells = TRUE;
+          Log ("Crossing cells with optical depths less than %.2e without finding resonances\n", modes.thin_cells_tau);
+        }
+        else
+        {
+          Error ("sirocco: Expected a positive optical depth after -thin_cells switch\n");
+          exit (1);
+        }
+        i++;
+        j = i;
+      }
+      else if (strcmp (argv[i], "-mrw") == 0)
+      {
+        if (i + 1 < argc && sscanf (argv[i + 1], "%le", &modes.mrw_tau) == 1 && modes.mrw_tau > 0)
+        {
+          modes.mrw = TRUE;
+          Log ("Replacing electron scatters by random walk steps in cells with optical depths to their walls above %.2e\n",
+               modes.mrw_tau);
+        }
+        else
+        {
+          Error ("sirocco: Expected a positive optical depth after -mrw switch\n");
+          exit (1);
+        }
+        i++;
+        j = i;
+      }
+      else if (strcmp (argv[i], "-photon_waves") == 0)
+      {
+        modes.photon_waves = TRUE;
+        Log ("Transporting the photons of each flight together, in waves sorted by wind cell\n");
+        j = i;
+      }
+      else if (strcmp (argv[i], "-photon_events") == 0)
+      {
+        modes.photon_events = TRUE;
+        Log ("Transporting the photons of each flight together, in queues of photons waiting for the same event\n");
+        j = i;
+      }
+      else if (strcmp (argv[i], "-stratify") == 0)
+      {
+        modes.stratify = TRUE;
+        Log ("Stratifying the random numbers used to generate photons from the star, disk and wind\n");
+        j = i;
+      }
+      else if (strcmp (argv[i], "-photon_batch") == 0)
+      {
+        if (i + 1 < argc && sscanf (argv[i + 1], "%d", &modes.photon_batch) == 1 && modes.photon_batch > 0)
+        {
+          Log ("Generating, transporting and tallying photons in batches of at most %d per MPI task\n", modes.photon_batch);
+        }
+        else
+        {
+          Error ("sirocco: Expected a positive number of photons after -photon_batch switch\n");
+          exit (1);
+        }
+        i++;
+        j = i;
+      }
+      else if (strcmp (argv[i], "-matrix_solver") == 0)
+      {
+        if (i + 1 < argc && strcmp (argv[i + 1], "gsl") == 0)
+        {
+          modes.matrix_solver = MATRIX_SOLVER_GSL;
+        }
+        else if (i + 1 < argc && strcmp (argv[i + 1], "lu") == 0)
+        {
+          modes.matrix_solver = MATRIX_SOLVER_LU;
+        }
+        else
+        {
+          Error ("sirocco: Expected gsl or lu after -matrix_solver switch\n");
+          exit (1);
+        }
+        Log ("Using the %s backend to solve rate matrices\n", argv[i + 1]);
+        i++;
+        j = i;
+      }
+      else if (strcmp (argv[i], "-te_solver") == 0)
+      {
+        if (i + 1 < argc && strcmp (argv[i + 1], "brent") == 0)
+        {
+          modes.te_solver = TE_SOLVER_BRENT;
+        }
+        else if (i + 1 < argc && strcmp (argv[i + 1], "secant") == 0)
+        {
+          modes.te_solver = TE_SOLVER_SECANT;
+        }
+        else
+        {
+          Error ("sirocco: Expected brent or secant after -te_solver switch\n");
+          exit (1);
+        }
+        Log ("Using the %s method to find electron temperatures\n", argv[i + 1]);
+        i++;
+        j = i;
+      }
 
       else if (strcmp (argv[i], "--version") == 0)
       {
@@ -289,6 +444,12 @@ parse_command_line (argc, argv)
     strcpy (dummy, argv[argc - 1]);
     get_root (files.root, dummy);
 
+    if (modes.photon_waves && modes.photon_events)
+    {
+      Error ("sirocco: -photon_waves and -photon_events are different ways of transporting the photons, so only one can be used\n");
+      exit (1);
+    }
+
     /* This completes the parsing of the command line */
 
     /* Create a subdirectory to store diaganostic files */
@@ -394,6 +555,40 @@ These are largely diagnostic or for special cases. These include\n\
  -ignore_partial_cells  Ignore wind cells that are only partially filled by the wind (This is now the default)  \n\
  -include_partial_cells Include wind cells that are only partially filled by the wind   \n\
  -no-matrix-storage     Do not store macro-atom transition matrices if using the macro-atom line transfer and the matrix matom_transition_mode.\n\
+ -profile_wind_update   Time ion_abundances, spectral_estimators, calc_te, macro_pops, matrix solves and convergence checks\n\
+                        for each cell in every ionization cycle, and write them to diag_root/root.wind_update_profile.csv\n\
+ -fb_cache              Interpolate free-bound, macro-atom recombination and blackbody photoionization integrals from a\n\
+                        temperature-gridded cache, rather than integrating them directly or using the fixed tables.\n\
+ -compton_tables        Interpolate Compton scattering directions and thermal electron speeds in tables of the inverse\n\
+                        Klein-Nishina and Maxwell-Boltzmann distributions, rather than root finding and sampling a cdf.\n\
+ -sparse_cell_spec      Only allocate, save and communicate the blocks of the detailed cell spectra in which photons have\n\
+                        deposited flux, which reduces memory use for large grids. The coarse banded spectra are unaffected.\n\
+ -binary_delay_dump     Write the photons for reverberation mapping to root.delay_dump.bin as fixed size binary records, rather\n\
+                        than as text to root.delay_dump. Use py_progs/delay_dump2txt.py to convert it to the text format.\n\
+ -photon_batch n        Generate, transport and tally the photons in each cycle in batches of at most n photons per MPI task,\n\
+                        so that memory for photons no longer grows with the number of photons per cycle.\n\
+ -atomic_image          Read the atomic data from a binary image of the masterfile, masterfile.image, which is read once and\n\
+                        broadcast to all MPI tasks. The image is made from the text files when it is missing or out of date.\n\
+ -model_image           Read each grid of stellar or disk models from a binary image, modellist.image, which holds one copy of the\n\
+                        wavelengths and all the fluxes. The image is made from the individual models when it is missing or out of date.\n\
+ -ray_velocity          Fit the wind velocity along each segment of a photon's path through a cell, and use the fit to find how\n\
+                        far the segment can extend with a linear Doppler shift, and the velocity gradients of any resonances.\n\
+ -disk_table            Find where photons hit a vertically extended disk by intersecting their paths with a table of conical\n\
+                        segments of the disk surface, rather than by root finding.\n\
+ -thin_cells tau        Let photons cross cells which were optically thin at their frequency in the last ionization cycle,\n\
+                        with a total line and continuum optical depth less than tau, without finding the resonances in them.\n\
+ -mrw tau               After an electron scatter in a cell where the electron scattering optical depth to the nearest wall\n\
+                        is more than tau, move the photon to the surface of a sphere in one step of a modified random walk.\n\
+ -photon_waves          Transport the photons of each cycle or batch together, moving each through one cell in turn and then\n\
+                        sorting them by the cell they are in, so that wind and line data are reused between photons.\n\
+ -photon_events         Transport the photons of each cycle or batch together, by processing queues of the photons which are\n\
+                        waiting to move through a cell, to be reflected by the star or disk, or to scatter, in turn.\n\
+ -stratify              Spread the positions, directions and frequencies of the photons made by the star, disk and wind evenly\n\
+                        over each set of photons, rather than drawing them independently, to reduce the noise per photon.\n\
+ -matrix_solver x       Choose how rate matrices are solved on the CPU, where x is gsl (the default) or lu, a dense LU solver\n\
+                        which is faster for the small matrices in the ionization and macro-atom calculations.\n\
+ -te_solver x           Choose how electron temperatures are found, where x is brent (the default) or secant, which starts\n\
+                        from the temperature in the previous cycle and usually needs fewer evaluations of the cooling.\n\
 \n\
  -xtest                 Instead of running sirocco, call the routine xtest so that one can diagnose issues associted with the \n\
                         setup.  This is only useful to devlopers \n\
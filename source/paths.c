@@ -25,7 +25,18 @@
  * ###Notes###
  * 10/15	-	Written by SWM
 ***********************************************************/
-double *reverb_path_bin;
+double *reverb_path_bin = NULL;
+double reverb_path_bin_log_min, reverb_path_bin_log_delta;
+
+/**********************************************************/
+/** @var *int reverb_line_slot
+ * @brief	Array giving the tracked line for each line
+ *
+ * Set in reverb_init(), for each line in lin_ptr contains
+ * the position of that line in geo.reverb_line, or -1 if
+ * the line is not being tracked.
+***********************************************************/
+int *reverb_line_slot = NULL;
 
 /**********************************************************/
 /** 
@@ -34,8 +45,11 @@ double *reverb_path_bin;
  * @param [in,out] wind		Pointer to parent wind cell
  * @return 					Pointer to onstructed histogram
  *
- * Allocates path bins for a passed wind cell and returns a
- * pointer to the allocated space.
+ * Allocates a path histogram for a passed wind cell and
+ * returns a pointer to the allocated space. The bins are not
+ * allocated until a photon is first added to the histogram,
+ * by wind_paths_alloc_bins(), as most of the histograms for
+ * tracked lines are never used.
  *
  * ###Notes###
  * 9/3/15	-	Written by SWM
@@ -50,22 +64,96 @@ wind_paths_constructor (WindPtr wind)
     Error ("wind_paths_constructor: Could not allocate memory for cell %d\n", wind->nwind);
     Exit (0);
   }
+  return (paths);
+}
 
-  paths->ad_path_flux = (double *) calloc (sizeof (double), geo.reverb_path_bins);
-  paths->ai_path_num = (int *) calloc (sizeof (int), geo.reverb_path_bins);
-  paths->ad_path_flux_cent = (double *) calloc (sizeof (double), geo.reverb_path_bins);
-  paths->ai_path_num_cent = (int *) calloc (sizeof (int), geo.reverb_path_bins);
-  paths->ad_path_flux_disk = (double *) calloc (sizeof (double), geo.reverb_path_bins);
-  paths->ai_path_num_disk = (int *) calloc (sizeof (int), geo.reverb_path_bins);
-  paths->ad_path_flux_wind = (double *) calloc (sizeof (double), geo.reverb_path_bins);
-  paths->ai_path_num_wind = (int *) calloc (sizeof (int), geo.reverb_path_bins);
+/**********************************************************/
+/** 
+ * @brief	Allocates the bins of a path histogram
+ *
+ * @param [in,out] paths	Path histogram to allocate
+ * @return 					0
+ *
+ * The flux and number arrays, for all photons and for each
+ * source, are each allocated as one block, to which the
+ * individual arrays point.
+***********************************************************/
+int
+wind_paths_alloc_bins (Wind_Paths_Ptr paths)
+{
+  int n = geo.reverb_path_bins;
+  double *flux = (double *) calloc (sizeof (double), 4 * n);
+  int *num = (int *) calloc (sizeof (int), 4 * n);
 
-  if (paths->ad_path_flux == NULL || paths->ai_path_num_wind == NULL)
+  if (flux == NULL || num == NULL)
   {
-    Error ("wind_paths_constructor: Could not allocate memory for cell %d bins\n", wind->nwind);
+    Error ("wind_paths_alloc_bins: Could not allocate memory for %d path bins\n", n);
     Exit (0);
   }
-  return (paths);
+
+  paths->ad_path_flux = flux;
+  paths->ad_path_flux_cent = flux + n;
+  paths->ad_path_flux_disk = flux + 2 * n;
+  paths->ad_path_flux_wind = flux + 3 * n;
+  paths->ai_path_num = num;
+  paths->ai_path_num_cent = num + n;
+  paths->ai_path_num_disk = num + 2 * n;
+  paths->ai_path_num_wind = num + 3 * n;
+  return (0);
+}
+
+/**********************************************************/
+/** 
+ * @brief	Frees a path histogram
+ *
+ * @param [in] paths		Path histogram to free
+ * @return 					0
+***********************************************************/
+int
+wind_paths_free (Wind_Paths_Ptr paths)
+{
+  if (paths != NULL)
+  {
+    free (paths->ad_path_flux);
+    free (paths->ai_path_num);
+    free (paths);
+  }
+  return (0);
+}
+
+/**********************************************************/
+/** 
+ * @brief	Finds the path bin a path length lies in
+ *
+ * @param [in] path			Path length
+ * @return 					Index of the bin, or -1 if the path
+ * 							is outside the bins
+ *
+ * The bins are evenly spaced in log(path), so the bin is
+ * found directly, then checked against the bin boundaries in
+ * case of rounding error. As before, a path which lies on a
+ * boundary is placed in the lower bin.
+***********************************************************/
+int
+path_bin_index (double path)
+{
+  int i, n = geo.reverb_path_bins;
+
+  if (!(path >= reverb_path_bin[0] && path <= reverb_path_bin[n]))
+    return (-1);
+
+  i = (int) ((log (path) - reverb_path_bin_log_min) / reverb_path_bin_log_delta);
+  if (i < 0)
+    i = 0;
+  else if (i > n - 1)
+    i = n - 1;
+
+  while (i > 0 && path <= reverb_path_bin[i])
+    i--;
+  while (i < n - 1 && path > reverb_path_bin[i + 1])
+    i++;
+
+  return (i);
 }
 
 /**********************************************************/
@@ -132,6 +220,23 @@ reverb_init (WindPtr wind)
     {                           //Set up the bounds for these bins
       reverb_path_bin[i] = exp (r_rad_min_log + i * r_delta);
     }
+    reverb_path_bin_log_min = r_rad_min_log;
+    reverb_path_bin_log_delta = r_delta;
+
+    //Record which tracked line, if any, each line corresponds to
+    reverb_line_slot = (int *) calloc (sizeof (int), nlines > 0 ? nlines : 1);
+    for (n = 0; n < nlines; n++)
+    {
+      reverb_line_slot[n] = -1;
+      for (i = 0; i < geo.reverb_lines; i++)
+      {
+        if (lin_ptr[n]->where_in_list == geo.reverb_line[i])
+        {
+          reverb_line_slot[n] = i;
+          break;
+        }
+      }
+    }
 
     wind_paths_init (wind);
 
@@ -164,6 +269,29 @@ reverb_init (WindPtr wind)
   return (0);
 }
 
+/**********************************************************/
+/** 
+ * @brief	Frees the arrays allocated by reverb_init()
+ *
+ * @return 					0
+ *
+ * Frees the path bin boundaries and the tracked line lookup.
+ * The per-cell path histograms are freed separately with
+ * wind_paths_free().
+ *
+ * @see reverb_init()
+***********************************************************/
+int
+reverb_free (void)
+{
+  free (reverb_path_bin);
+  free (reverb_line_slot);
+  reverb_path_bin = NULL;
+  reverb_line_slot = NULL;
+
+  return (0);
+}
+
 /**********************************************************/
 /** 
  * @brief	Initialises wind path structures
@@ -215,46 +343,61 @@ wind_paths_init (WindPtr wind)
 int
 line_paths_add_phot (WindPtr wind, PhotPtr pp, int *nres)
 {
-  int i, j;
+  int i;
 
   if (geo.reverb_disk == REV_DISK_IGNORE && pp->origin_orig == PTYPE_DISK)
     return (0);
-  if (*nres > nlines || *nres < 0)
+  if (*nres >= nlines || *nres < 0)
     return (0);                 //This is a continuum photon
 
-  for (i = 0; i < geo.reverb_lines; i++)
-  {                             //Iterate over each tracked line
-    if (lin_ptr[*nres]->where_in_list == geo.reverb_line[i])
-    {                           //If the passed line exists within the tracked line array
-      for (j = 0; j < geo.reverb_path_bins; j++)
-      {                         //Iterate over the path bins
-        if (pp->path >= reverb_path_bin[j] && pp->path <= reverb_path_bin[j + 1])
-        {                       //If the photon's path lies in this bin's bounds, record it
-          //printf("DEBUG: Added to line %d in cell %d - path %g weight %g\n",geo.reverb_line[i], wind->nwind, pp->path, pp->w);
-          wind->line_paths[i]->ad_path_flux[j] += pp->w;
-          wind->line_paths[i]->ai_path_num[j]++;
-          switch (pp->origin)
-          {
-          case PTYPE_STAR:
-          case PTYPE_AGN:
-          case PTYPE_BL:
-            wind->line_paths[i]->ad_path_flux_cent[j] += pp->w;
-            wind->line_paths[i]->ai_path_num_cent[j]++;
-            break;
-          case PTYPE_DISK:
-            wind->line_paths[i]->ad_path_flux_disk[j] += pp->w;
-            wind->line_paths[i]->ai_path_num_disk[j]++;
-            break;
-          default:
-            wind->line_paths[i]->ad_path_flux_wind[j] += pp->w;
-            wind->line_paths[i]->ai_path_num_wind[j]++;
-            break;
-          }
-          //Exit out of this loop
-          return (0);
-        }
-      }
-    }
+  if ((i = reverb_line_slot[*nres]) < 0)
+    return (0);                 //This line is not being tracked
+
+  wind_paths_add_to_bin (wind->line_paths[i], pp);
+  return (0);
+}
+
+/****************************************************************/
+/** 
+ * @brief		Adds a photon to a path histogram
+ * 
+ * @param [in, out] paths	Path histogram to add the photon to
+ * @param [in] pp			Photon to add
+ * @return 					0
+ *  
+ * Adds the photon's weight to the bin for its path, both for
+ * all photons and for the type of source it came from.
+*****************************************************************/
+int
+wind_paths_add_to_bin (Wind_Paths_Ptr paths, PhotPtr pp)
+{
+  int i;
+
+  if ((i = path_bin_index (pp->path)) < 0)
+    return (0);
+
+  if (paths->ad_path_flux == NULL)
+    wind_paths_alloc_bins (paths);
+
+  paths->ad_path_flux[i] += pp->w;
+  paths->ai_path_num[i]++;
+
+  switch (pp->origin)
+  {
+  case PTYPE_STAR:
+  case PTYPE_AGN:
+  case PTYPE_BL:
+    paths->ad_path_flux_cent[i] += pp->w;
+    paths->ai_path_num_cent[i]++;
+    break;
+  case PTYPE_DISK:
+    paths->ad_path_flux_disk[i] += pp->w;
+    paths->ai_path_num_disk[i]++;
+    break;
+  default:
+    paths->ad_path_flux_wind[i] += pp->w;
+    paths->ai_path_num_wind[i]++;
+    break;
   }
   return (0);
 }
@@ -276,37 +419,10 @@ line_paths_add_phot (WindPtr wind, PhotPtr pp, int *nres)
 int
 wind_paths_add_phot (WindPtr wind, PhotPtr pp)
 {
-  int i;
   if (geo.reverb_disk == REV_DISK_IGNORE && pp->origin_orig == PTYPE_DISK)
     return (0);
 
-  for (i = 0; i < geo.reverb_path_bins; i++)
-  {                             //For each bin
-    if (pp->path >= reverb_path_bin[i] && pp->path <= reverb_path_bin[i + 1])
-    {                           //If the path falls within its bounds, add photon weight
-      wind->paths->ad_path_flux[i] += pp->w;
-      wind->paths->ai_path_num[i]++;
-
-      switch (pp->origin)
-      {
-      case PTYPE_STAR:
-      case PTYPE_AGN:
-      case PTYPE_BL:
-        wind->paths->ad_path_flux_cent[i] += pp->w;
-        wind->paths->ai_path_num_cent[i]++;
-        break;
-      case PTYPE_DISK:
-        wind->paths->ad_path_flux_disk[i] += pp->w;
-        wind->paths->ai_path_num_disk[i]++;
-        break;
-      default:
-        wind->paths->ad_path_flux_wind[i] += pp->w;
-        wind->paths->ai_path_num_wind[i]++;
-        break;
-      }
-      return (0);
-    }
-  }
+  wind_paths_add_to_bin (wind->paths, pp);
   return (0);
 }
 
@@ -449,29 +565,23 @@ line_paths_gen_phot (WindPtr wind, PhotPtr pp, int nres)
   {                             //If this line is invalid, continuum or non-matom then default to wind
     pp->path = r_draw_from_path_histogram (wind->paths);
   }
-  else
-  {                             //Iterate over array to see if this line is tracked. If so, use that 
-    //array index to find the path array for the line (i.e. the n^th line
-    //being tracked is the n^th line path histogram).
-    for (i = 0; i < geo.reverb_lines; i++)
-    {
-      if (lin_ptr[nres]->where_in_list == geo.reverb_line[i])
-      {                         //Line identified using its position in nres as unique ID
-        if (wind->line_paths[i]->i_num > 0)
-        {                       //If there photons recorded in this histogram
-          pp->path = r_draw_from_path_histogram (wind->line_paths[i]);
-        }
-        else
-        {                       //If there are no photons in this histogram, log and default
-          //to using the wind path histogram.
-          //Error("line_paths_gen_phot: No path data for line %d in cell %d at r=%g, z=%g\n",
-          // wind->nwind, nres, sqrt(wind->x[0]*wind->x[0] + wind->x[1]*wind->x[1]), wind->x[2]);
-          pp->path = r_draw_from_path_histogram (wind->paths);
-        }
-        return (0);
-      }
+  else if ((i = reverb_line_slot[nres]) >= 0)
+  {                             //If this line is tracked, the i^th line being tracked has
+    //the i^th line path histogram.
+    if (wind->line_paths[i]->i_num > 0)
+    {                           //If there photons recorded in this histogram
+      pp->path = r_draw_from_path_histogram (wind->line_paths[i]);
+    }
+    else
+    {                           //If there are no photons in this histogram, log and default
+      //to using the wind path histogram.
+      //Error("line_paths_gen_phot: No path data for line %d in cell %d at r=%g, z=%g\n",
+      // wind->nwind, nres, sqrt(wind->x[0]*wind->x[0] + wind->x[1]*wind->x[1]), wind->x[2]);
+      pp->path = r_draw_from_path_histogram (wind->paths);
     }
-    //If the line isn't being tracked, default to wind
+  }
+  else
+  {                             //If the line isn't being tracked, default to wind
     pp->path = r_draw_from_path_histogram (wind->paths);
   }
   return (0);
@@ -501,6 +611,9 @@ wind_paths_evaluate_single (Wind_Paths_Ptr paths)
   paths->d_path = 0.0;
   paths->i_num = 0;
 
+  if (paths->ad_path_flux == NULL)
+    return (0);                 //No photons have been added to this histogram
+
   for (i = 0; i < geo.reverb_path_bins; i++)
   {                             //For each path bin, add its contribution to total flux & avg path
     paths->d_flux += paths->ad_path_flux[i];
@@ -587,6 +700,15 @@ wind_paths_dump (WindPtr wind, int rank_global)
   char c_file[LINELENGTH];
   int j, k;
 
+  //Make sure that histograms with no photons in them have bins to print
+  if (wind->paths->ad_path_flux == NULL)
+    wind_paths_alloc_bins (wind->paths);
+  for (j = 0; j < geo.reverb_lines; j++)
+  {
+    if (wind->line_paths[j]->ad_path_flux == NULL)
+      wind_paths_alloc_bins (wind->line_paths[j]);
+  }
+
   //Setup file name and open the file
   sprintf (c_file, "%.100s.wind_paths_%d.%d.csv", files.root, wind->nwind, rank_global);
   fptr = fopen (c_file, "w");
@@ -73,7 +73,10 @@ init_dummy_phot (p)
  * This just a simple utility to copy a photon bundle
  *
  * ### Notes ###
- * All variables are (or should be) copied.
+ * All variables are copied, by structure assignment, so that
+ * fields added to the photon structure are copied automatically.
+ * Routines which only need the position of a photon after it
+ * has moved should not copy the whole photon to get it.
  *
  **********************************************************/
 
@@ -81,38 +84,7 @@ int
 stuff_phot (pin, pout)
      PhotPtr pin, pout;
 {
-  pout->x[0] = pin->x[0];
-  pout->x[1] = pin->x[1];
-  pout->x[2] = pin->x[2];
-
-  pout->lmn[0] = pin->lmn[0];
-  pout->lmn[1] = pin->lmn[1];
-  pout->lmn[2] = pin->lmn[2];
-
-  pout->w = pin->w;
-  pout->w_orig = pin->w_orig;
-  pout->freq = pin->freq;
-  pout->freq_orig = pin->freq_orig;
-  pout->tau = pin->tau;
-
-  pout->istat = pin->istat;
-  pout->frame = pin->frame;
-  pout->nres = pin->nres;
-  pout->line_res = pin->line_res;
-  pout->nmacro = pin->nmacro;
-  pout->nrscat = pin->nrscat;
-  pout->nscat = pin->nscat;
-  pout->nnscat = pin->nnscat;
-  pout->grid = pin->grid;
-  pout->origin = pin->origin;
-  pout->origin_orig = pin->origin_orig;
-  pout->nnscat = pin->nnscat;
-  pout->np = pin->np;
-
-  pout->path = pin->path;
-
-  pout->ds = pin->ds;
-
+  *pout = *pin;
   return (0);
 }
 
@@ -230,25 +202,32 @@ ds_to_cone (cc, p)
   double a, b, c, root[2];
   double s_to_zero;             /* The path length to the xy plane */
   int i;
-  struct photon pp;
-
-  /* First of all let's work only in the "northern" hemisphere */
-  stuff_phot (p, &pp);
-
-  if (pp.x[2] < 0.0)
+  double x[3], lmn[3];
+
+  /* First of all let's work only in the "northern" hemisphere.  Only the position
+     and direction of the photon are needed, so rather than copying the whole photon
+     only these are copied */
+  x[0] = p->x[0];
+  x[1] = p->x[1];
+  x[2] = p->x[2];
+  lmn[0] = p->lmn[0];
+  lmn[1] = p->lmn[1];
+  lmn[2] = p->lmn[2];
+
+  if (x[2] < 0.0)
   {                             /*move the photon to the northen hemisphere */
-    pp.x[2] = -pp.x[2];
-    pp.lmn[2] = -pp.lmn[2];
+    x[2] = -x[2];
+    lmn[2] = -lmn[2];
   }
 
   /* Set up and solve the quadratic equation that gives the cone intercept */
 
   dzdr2 = cc->dzdr * cc->dzdr;
-  dz = pp.x[2] - cc->z;
+  dz = x[2] - cc->z;
 
-  a = dzdr2 * (pp.lmn[0] * pp.lmn[0] + pp.lmn[1] * pp.lmn[1]) - (pp.lmn[2] * pp.lmn[2]);
-  b = 2. * (dzdr2 * (pp.lmn[0] * pp.x[0] + pp.lmn[1] * pp.x[1]) - pp.lmn[2] * dz);
-  c = dzdr2 * (pp.x[0] * pp.x[0] + pp.x[1] * pp.x[1]) - dz * dz;
+  a = dzdr2 * (lmn[0] * lmn[0] + lmn[1] * lmn[1]) - (lmn[2] * lmn[2]);
+  b = 2. * (dzdr2 * (lmn[0] * x[0] + lmn[1] * x[1]) - lmn[2] * dz);
+  c = dzdr2 * (x[0] * x[0] + x[1] * x[1]) - dz * dz;
 
   i = quadratic (a, b, c, root);        /* root[i] is the smallest positive root unless i is
                                            negative in which case either both roots were negative or both roots were imaginary */
@@ -257,10 +236,10 @@ ds_to_cone (cc, p)
      photon is travelling in the xy plane or if the intercept is in the negative
      direction set the path length to infinity */
 
-  if (pp.x[2] * pp.lmn[2] >= 0)
+  if (x[2] * lmn[2] >= 0)
     s_to_zero = VERY_BIG;
   else
-    s_to_zero = (-pp.x[2] / pp.lmn[2]);
+    s_to_zero = (-x[2] / lmn[2]);
 
 
   if (i >= 0 && root[i] < s_to_zero)
@@ -477,19 +456,25 @@ ds_to_plane (pl, p, force_positive_z)
      int force_positive_z;
 {
   double denom, diff[3], numer;
-  struct photon ptest;
+  double x[3], lmn[3];
 
-  stuff_phot (p, &ptest);
-  if (ptest.lmn[2] < 0 && (force_positive_z == TRUE))
+  x[0] = p->x[0];
+  x[1] = p->x[1];
+  x[2] = p->x[2];
+  lmn[0] = p->lmn[0];
+  lmn[1] = p->lmn[1];
+  lmn[2] = p->lmn[2];
+
+  if (lmn[2] < 0 && (force_positive_z == TRUE))
   {
-    ptest.x[2] = -ptest.x[2];   /* force the photon to be in the positive x,z quadrant */
-    ptest.lmn[2] = -ptest.lmn[2];       /* force the photon to moving in the positive z direction */
+    x[2] = -x[2];               /* force the photon to be in the positive x,z quadrant */
+    lmn[2] = -lmn[2];           /* force the photon to moving in the positive z direction */
   }
 
-  if ((denom = dot (ptest.lmn, pl->lmn)) == 0)
+  if ((denom = dot (lmn, pl->lmn)) == 0)
     return (VERY_BIG);
 
-  vsub (pl->x, ptest.x, diff);
+  vsub (pl->x, x, diff);
 
   numer = dot (diff, pl->lmn);
 
@@ -580,3 +565,49 @@ both roots were imaginary */
     return (root[i]);
   return (VERY_BIG);
 }
+
+
+
+/**********************************************************/
+/**
+ * @brief      A lower limit on the distance a photon must travel to reach a
+ * 	cylindrical annulus which is symmetric about the xy plane
+ *
+ * @param [in] double  rhomin   The inner radius of the annulus
+ * @param [in] double  rhomax   The outer radius of the annulus
+ * @param [in] double  zmin   The lower height of the annulus, above the xy plane
+ * @param [in] double  zmax   The upper height of the annulus
+ * @param [in] double  rho   The cylindrical radius of the photon
+ * @param [in] double  z   The absolute value of the height of the photon
+ * @return     The distance from the photon to the nearest point of the annulus,
+ * 	or 0 if the photon is inside it
+ *
+ * @details
+ * The annulus is the region rhomin < rho < rhomax, zmin < |z| < zmax, and any
+ * point on its surface is at least this far from the photon whatever the
+ * direction of the photon.
+ *
+ * ### Notes ###
+ *
+ **********************************************************/
+
+double
+ds_to_annulus_min (rhomin, rhomax, zmin, zmax, rho, z)
+     double rhomin, rhomax, zmin, zmax, rho, z;
+{
+  double drho, dz;
+
+  drho = dz = 0;
+
+  if (rho < rhomin)
+    drho = rhomin - rho;
+  else if (rho > rhomax)
+    drho = rho - rhomax;
+
+  if (z < zmin)
+    dz = zmin - z;
+  else if (z > zmax)
+    dz = z - zmax;
+
+  return (sqrt (drho * drho + dz * dz));
+}
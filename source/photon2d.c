@@ -210,6 +210,58 @@ translate_in_space (pp)
 
 
 
+/* The fractional accuracy assumed for the distances to the boundaries of the wind,
+   when deciding whether a boundary could be closer than one which has been found */
+
+#define DS_LIMIT_ACCURACY 1e-6
+
+
+/**********************************************************/
+/**
+ * @brief      Reduce a lower limit on the distance to a boundary to allow for
+ * 	the rounding errors in the distances found by solving for the intercepts
+ *
+ * @param [in] double  ds_min   The lower limit on the distance to a boundary
+ * @param [in] double  r   A measure of the distance of the photon from the origin
+ * @return     A lower limit which is safe to compare with a calculated distance
+ *
+ **********************************************************/
+
+static double
+ds_limit (ds_min, r)
+     double ds_min, r;
+{
+  return (ds_min - DS_LIMIT_ACCURACY * (ds_min + r));
+}
+
+
+/**********************************************************/
+/**
+ * @brief      Find where a photon would be after moving a distance ds,
+ * 	without moving it
+ *
+ * @param [in] PhotPtr  pp   A photon
+ * @param [in] double  ds   The distance
+ * @param [out] double  x[]   The position after moving ds
+ *
+ * @details
+ * The position is calculated exactly as move_phot would calculate it
+ *
+ **********************************************************/
+
+static void
+move_position (pp, ds, x)
+     PhotPtr pp;
+     double ds;
+     double x[];
+{
+  x[0] = pp->x[0] + pp->lmn[0] * ds;
+  x[1] = pp->x[1] + pp->lmn[1] * ds;
+  x[2] = pp->x[2] + pp->lmn[2] * ds;
+}
+
+
+
 /**********************************************************/
 /**
  * @brief      calculates the photon pathlength to the edge of the wind.
@@ -254,6 +306,12 @@ translate_in_space (pp)
  *
  * ksl 2201 - It is unclear what the comment I made in 1802 actually means anymore.
  *
+ * With several domains there are many boundaries to consider, most of which are far from
+ * the photon.  All of the boundaries of a CORONA or an imported cylindrical domain lie on the
+ * surface of an annulus, and if the photon is further from the annulus, in any direction, than
+ * the nearest boundary found so far, none of them are checked.  The result is the same as if
+ * every boundary had been checked.
+ *
  **********************************************************/
 
 double
@@ -261,33 +319,36 @@ ds_to_wind (pp, ndom_current)
      PhotPtr pp;
      int *ndom_current;
 {
-  struct photon ptest, qtest;
-  double ds, x, rho, z;
+  double ds, x, xtest[3], rho, z, zlo, zhi, rho_hit, z_hit;
   int ndom;
 
-  stuff_phot (pp, &ptest);
-
   /* First calculated the distance to the edge of the of
      all of the "computatational domain */
 
-  ds = ds_to_sphere (geo.rmax, &ptest);
+  ds = ds_to_sphere (geo.rmax, pp);
   *ndom_current = (-1);
   xxxbound = BOUND_NONE;
 
+  /* The position of the photon, from which a lower limit on the distance to
+     the boundaries of a domain can be found without solving for the intercepts */
+
+  rho = sqrt (pp->x[0] * pp->x[0] + pp->x[1] * pp->x[1]);
+  z = fabs (pp->x[2]);
+
   for (ndom = 0; ndom < geo.ndomain; ndom++)
   {
     if ((zdom[ndom].wind_type != IMPORT || (zdom[ndom].wind_type == IMPORT && zdom[ndom].coord_type != CYLIND)) &&
         zdom[ndom].wind_type != CORONA)
     {
       /* Check if the photon hits the inner or outer radius of the wind */
-      if ((x = ds_to_sphere (zdom[ndom].rmax, &ptest)) < ds)
+      if ((x = ds_to_sphere (zdom[ndom].rmax, pp)) < ds)
       {
         ds = x;
         *ndom_current = ndom;
         xxxbound = BOUND_RMIN;
       }
 
-      if ((x = ds_to_sphere (zdom[ndom].rmin, &ptest)) < ds)
+      if ((x = ds_to_sphere (zdom[ndom].rmin, pp)) < ds)
       {
         ds = x;
         *ndom_current = ndom;
@@ -296,13 +357,13 @@ ds_to_wind (pp, ndom_current)
 
       /* Check if the photon hits the inner or outer windcone */
 
-      if ((x = ds_to_cone (&zdom[ndom].windcone[0], &ptest)) < ds)
+      if ((x = ds_to_cone (&zdom[ndom].windcone[0], pp)) < ds)
       {
         ds = x;
         *ndom_current = ndom;
         xxxbound = BOUND_INNER_CONE;
       }
-      if ((x = ds_to_cone (&zdom[ndom].windcone[1], &ptest)) < ds)
+      if ((x = ds_to_cone (&zdom[ndom].windcone[1], pp)) < ds)
       {
         ds = x;
         *ndom_current = ndom;
@@ -317,26 +378,36 @@ ds_to_wind (pp, ndom_current)
 
     else if (zdom[ndom].wind_type == CORONA || (zdom[ndom].wind_type == IMPORT && zdom[ndom].coord_type == CYLIND))
     {
-      x = ds_to_plane (&zdom[ndom].windplane[0], &ptest, TRUE);
+      /* All of the boundaries which are accepted lie on the surface of the region, so
+         if the photon is further from the region than the boundary already found, none
+         of them need to be checked */
+
+      zlo = fmin (zdom[ndom].zmin, fmin (fabs (zdom[ndom].windplane[0].x[2]), fabs (zdom[ndom].windplane[1].x[2])));
+      zhi = fmax (zdom[ndom].zmax, fmax (fabs (zdom[ndom].windplane[0].x[2]), fabs (zdom[ndom].windplane[1].x[2])));
+
+      if (ds_limit (ds_to_annulus_min (zdom[ndom].wind_rhomin_at_disk, zdom[ndom].wind_rhomax_at_disk, zlo, zhi, rho, z), rho + z) >= ds)
+      {
+        continue;
+      }
+
+      x = ds_to_plane (&zdom[ndom].windplane[0], pp, TRUE);
       if (x > 0 && x < ds)
       {
-        stuff_phot (pp, &qtest);
-        move_phot (&qtest, x);
-        rho = sqrt (qtest.x[0] * qtest.x[0] + qtest.x[1] * qtest.x[1]);
-        if (zdom[ndom].wind_rhomin_at_disk <= rho && rho <= zdom[ndom].wind_rhomax_at_disk)
+        move_position (pp, x, xtest);
+        rho_hit = sqrt (xtest[0] * xtest[0] + xtest[1] * xtest[1]);
+        if (zdom[ndom].wind_rhomin_at_disk <= rho_hit && rho_hit <= zdom[ndom].wind_rhomax_at_disk)
         {
           ds = x;
           *ndom_current = ndom;
           xxxbound = BOUND_ZMIN;
         }
       }
-      x = ds_to_plane (&zdom[ndom].windplane[1], &ptest, TRUE);
+      x = ds_to_plane (&zdom[ndom].windplane[1], pp, TRUE);
       if (x > 0 && x < ds)
       {
-        stuff_phot (pp, &qtest);
-        move_phot (&qtest, x);
-        rho = sqrt (qtest.x[0] * qtest.x[0] + qtest.x[1] * qtest.x[1]);
-        if (zdom[ndom].wind_rhomin_at_disk <= rho && rho <= zdom[ndom].wind_rhomax_at_disk)
+        move_position (pp, x, xtest);
+        rho_hit = sqrt (xtest[0] * xtest[0] + xtest[1] * xtest[1]);
+        if (zdom[ndom].wind_rhomin_at_disk <= rho_hit && rho_hit <= zdom[ndom].wind_rhomax_at_disk)
         {
           ds = x;
           *ndom_current = ndom;
@@ -344,13 +415,12 @@ ds_to_wind (pp, ndom_current)
         }
       }
 
-      x = ds_to_cylinder (zdom[ndom].wind_rhomin_at_disk, &ptest);
+      x = ds_to_cylinder (zdom[ndom].wind_rhomin_at_disk, pp);
       if (x > 0 && x < ds)
       {
-        stuff_phot (pp, &qtest);
-        move_phot (&qtest, x);
-        z = fabs (qtest.x[2]);
-        if (zdom[ndom].zmin <= z && z <= zdom[ndom].zmax)
+        move_position (pp, x, xtest);
+        z_hit = fabs (xtest[2]);
+        if (zdom[ndom].zmin <= z_hit && z_hit <= zdom[ndom].zmax)
         {
           ds = x;
           *ndom_current = ndom;
@@ -358,13 +428,12 @@ ds_to_wind (pp, ndom_current)
         }
       }
 
-      x = ds_to_cylinder (zdom[ndom].wind_rhomax_at_disk, &ptest);
+      x = ds_to_cylinder (zdom[ndom].wind_rhomax_at_disk, pp);
       if (x > 0 && x < ds)
       {
-        stuff_phot (pp, &qtest);
-        move_phot (&qtest, x);
-        z = fabs (qtest.x[2]);
-        if (zdom[ndom].zmin <= z && z <= zdom[ndom].zmax)
+        move_position (pp, x, xtest);
+        z_hit = fabs (xtest[2]);
+        if (zdom[ndom].zmin <= z_hit && z_hit <= zdom[ndom].zmax)
         {
           ds = x;
           *ndom_current = ndom;
@@ -410,6 +479,10 @@ ds_to_wind (pp, ndom_current)
  * having to do with the radiation field via calls to radiation (simple atoms)
  * or update_bf_estimators (macro-atoms)
  *
+ * With modes.thin_cells, a photon in a cell which thin_cells_check finds to be optically thin
+ * at its frequency crosses the cell without calling calculate_ds, see thin_cells.c.  This is
+ * not done in ionization cycles with macro atoms.
+ *
  **********************************************************/
 int
 translate_in_wind (w, p, tau_scat, tau, nres)
@@ -419,13 +492,12 @@ translate_in_wind (w, p, tau_scat, tau, nres)
      int *nres;
 {
   int n;
-  double smax, ds_current, ds_cmf;
+  double smax, ds_current, tau_start;
   int istat;
   int nplasma;
 
   WindPtr one;
   PlasmaPtr xplasma;
-  struct photon phot_mid, phot_mid_cmf; // Photon at the midpt of its path in the cell
 
   /* First verify that the photon is in the grid, and if not
      return and record an error */
@@ -462,7 +534,30 @@ translate_in_wind (w, p, tau_scat, tau, nres)
   }
   else
   {
-    ds_current = calculate_ds (w, p, tau_scat, tau, nres, smax, &istat);
+    if (modes.thin_cells && one->inwind == W_ALL_INWIND && !(geo.rt_mode == RT_MODE_MACRO && geo.ioniz_or_extract == CYCLE_IONIZ)
+        && thin_cells_check (p, nplasma, tau_scat - *tau))
+    {
+      /* The cell is optically thin at the frequency of the photon, and the photon cannot
+         reach its next scattering within it, so it moves straight to the edge of the cell.
+         Only electron scattering is added to its optical depth.  This is not done in
+         ionization cycles with macro atoms, where calculate_ds increments the bb estimators
+         and the heating by lines of simple ions */
+
+      ds_current = smax;
+      istat = P_INWIND;
+      *nres = -1;
+      *tau += klein_nishina (p->freq) * xplasma->ne * zdom[one->ndom].fill * smax;
+    }
+    else
+    {
+      tau_start = *tau;
+      ds_current = calculate_ds (w, p, tau_scat, tau, nres, smax, &istat);
+
+      if (modes.thin_cells && geo.ioniz_or_extract == CYCLE_IONIZ)
+      {
+        thin_cells_record (nplasma, p->freq, *tau - tau_start, ds_current, smax);
+      }
+    }
 
     if (p->nres == NRES_ES)
       xplasma->nscat_es++;
@@ -474,34 +569,7 @@ translate_in_wind (w, p, tau_scat, tau, nres)
      * the weight of the photon due to continuum absorption, e.g. free free.
      */
 
-    if (geo.rt_mode == RT_MODE_MACRO)
-    {
-      /* In the macro-method, b-f and other continuum processes do not reduce the photon
-         weight, but are treated as as scattering processes.  Therefore most of what was in
-         subroutine radiation for the simple atom case can be avoided.  
-       */
-      if (geo.ioniz_or_extract == CYCLE_IONIZ)
-      {
-        /* Provide inputs to bf_estimators in the local frame  */
-        stuff_phot (p, &phot_mid);
-        move_phot (&phot_mid, 0.5 * ds_current);
-        observer_to_local_frame (&phot_mid, &phot_mid_cmf);
-        ds_cmf = observer_to_local_frame_ds (&phot_mid, ds_current);
-        if (p->grid >= 0 && p->grid < geo.ndim2)
-        {
-          bf_estimators_increment (&w[p->grid], &phot_mid_cmf, ds_cmf);
-        }
-        else
-        {
-          Error ("translate_in_wind: Cannot call bf_estimators for photon not in wind: %d\n", p->np);
-        }
-
-      }
-    }
-    else
-    {
-      radiation (p, ds_current);
-    }
+    increment_path_estimators (w, p, ds_current);
 
     if (*nres > -1 && *nres <= NLINES && *nres == p->nres && istat == P_SCAT)
     {
@@ -529,6 +597,66 @@ translate_in_wind (w, p, tau_scat, tau, nres)
 
 
 
+/**********************************************************/
+/**
+ * @brief      increments the estimators of the radiation field in a cell for
+ * a photon which travels a distance ds from its current position
+ *
+ * @param [in] WindPtr  w   The entire wind
+ * @param [in, out] PhotPtr  p   A photon in the observer frame
+ * @param [in] double  ds   The distance the photon travels in the observer frame
+ * @return     Always returns 0
+ *
+ * @details
+ * For simple atoms this is radiation, which also reduces the weight of the photon
+ * due to continuum absorption.  In the macro-method, b-f and other continuum
+ * processes do not reduce the photon weight, but are treated as scattering
+ * processes, so only the bf estimators are incremented, in the local frame, and
+ * only in ionization cycles.
+ *
+ * The photon is not moved.
+ *
+ **********************************************************/
+
+int
+increment_path_estimators (w, p, ds)
+     WindPtr w;
+     PhotPtr p;
+     double ds;
+{
+  double ds_cmf;
+  struct photon phot_mid, phot_mid_cmf; // Photon at the midpt of its path in the cell
+
+  if (geo.rt_mode == RT_MODE_MACRO)
+  {
+    if (geo.ioniz_or_extract == CYCLE_IONIZ)
+    {
+      /* Provide inputs to bf_estimators in the local frame  */
+      stuff_phot (p, &phot_mid);
+      move_phot (&phot_mid, 0.5 * ds);
+      observer_to_local_frame (&phot_mid, &phot_mid_cmf);
+      ds_cmf = observer_to_local_frame_ds (&phot_mid, ds);
+      if (p->grid >= 0 && p->grid < geo.ndim2)
+      {
+        bf_estimators_increment (&w[p->grid], &phot_mid_cmf, ds_cmf);
+      }
+      else
+      {
+        Error ("increment_path_estimators: Cannot call bf_estimators for photon not in wind: %d\n", p->np);
+      }
+    }
+  }
+  else
+  {
+    radiation (p, ds);
+  }
+
+  return (0);
+}
+
+
+
+
 /* ************************************************************************* */
 /**
  * @brief           Calculate the maximum distance a photon can travel in its
@@ -25,17 +25,54 @@ int iwind_old = 0;
 #define PRINT_OFF 0
 #define PRINT_ON  1
 
+/* The sources of photons within a band, in the order in which xmake_phot generates them */
+
+#define SRC_STAR   0
+#define SRC_BL     1
+#define SRC_WIND   2
+#define SRC_DISK   3
+#define SRC_AGN    4
+#define SRC_KPKT   5
+#define SRC_MATOM  6
+#define NSRC       7
+
+
+/* The plan for generating the photons of one cycle, which is set up by define_phot
+ * and then carried out in batches by next_phot_batch.  The bands are those of xband, or
+ * a single band if banding is not in use, followed if necessary by a band for the
+ * k-packets produced by non-radiative heating.
+ */
+
+static struct
+{
+  int ioniz_or_extract;
+  int iwind;
+  int freq_sampling;
+  int nbands;                   /* The number of bands, including any k-packet band */
+  int kpkt_band;                /* The band holding k-packets from non-radiative heating, or -1 */
+  double f1[NBANDS + 1], f2[NBANDS + 1];
+  double weight[NBANDS + 1];
+  int nphot[NBANDS + 1];
+  int nsrc[NBANDS + 1][NSRC];   /* The number of photons from each source in each band */
+  int iband;                    /* The band being generated */
+  int nmade_band;               /* The number of photons made so far in iband */
+  int nmade;                    /* The number of photons made so far in this cycle */
+  double lum_star_back;         /* Irradiation of the star in the previous cycle */
+  double disk_heat[NRINGS];     /* Irradiation of the disk in the previous cycle */
+} phot_plan;
+
+static int plan_band_sources (int iband);
+
 
 /**********************************************************/
 /**
  * @brief
  * the controlling routine for creating the underlying photon distribution.
  *
- * @param [out] PhotPtr  p   The structure where all photons are stored
  * @param [in] double  f1   The mininum frequency
  * @param [in] double  f2   The maximum frequency if a uniform distribution
  * @param [in] long  nphot_tot   The total number of photons that need to be generated to reach the total
- * luminosity, not necessarilly the number of photons which will be generated by the call to define_phot,
+ * luminosity, not necessarilly the number of photons which will be generated in this cycle,
  * which instead is defined by NPHOT
  * @param [in] int  ioniz_or_extract   CYCLE_IONIZ -> this is for the wind ionization calculation,
  * CYCLE_EXTRACT-> it is for the final spectrum calculation
@@ -57,6 +94,10 @@ int iwind_old = 0;
  * still used for detailed spectrum calculation. Which of this choices to use is controlled by freq_sampling
  * (The weights are established here)
  *
+ * define_phot only decides how many photons of what weight are to be made in each band.  The
+ * photons themselves are made by next_phot_batch, all at once or in batches of a fixed size, so
+ * that they can be transported and tallied before the next batch is made.
+ *
  * iwind is a variable that determines how or whether to create photons from the wind:
  * * -1-> Do not consider wind photons under any circumstances
  * * 0  ->Consider wind photons.  There is no need to recalculate the
@@ -69,11 +110,14 @@ int iwind_old = 0;
  * ### Notes ###
  * @bug Is this correct, have subcycles been removed.
  *
+ * The irradiation of the star and the disk in the previous cycle, which sets their temperatures,
+ * is saved here, because by the time later bands are initialised by next_phot_batch the photons
+ * of earlier batches will have started to record the irradiation of the current cycle.
+ *
  **********************************************************/
 
 int
-define_phot (p, f1, f2, nphot_tot, ioniz_or_extract, iwind, freq_sampling)
-     PhotPtr p;
+define_phot (f1, f2, nphot_tot, ioniz_or_extract, iwind, freq_sampling)
      double f1, f2;
      long nphot_tot;
      int ioniz_or_extract;
@@ -84,11 +128,20 @@ define_phot (p, f1, f2, nphot_tot, ioniz_or_extract, iwind, freq_sampling)
   double natural_weight, weight;
   double ftot;
   int n;
-  int iphot_start, nphot_rad, nphot_k;
+  int nphot_rad, nphot_k;
   long nphot_tot_rad, nphot_tot_k;
-  nphot_k = nphot_tot_k = natural_weight = iphot_start = 0;     // Initialize to avoid compiler warnings
-
-  /* if we are generating nonradiative kpackets, then we need to subtract 
+  nphot_k = nphot_tot_k = natural_weight = 0;   // Initialize to avoid compiler warnings
+
+  phot_plan.ioniz_or_extract = ioniz_or_extract;
+  phot_plan.iwind = iwind;
+  phot_plan.freq_sampling = freq_sampling;
+  phot_plan.kpkt_band = -1;
+  phot_plan.iband = phot_plan.nmade_band = phot_plan.nmade = 0;
+  phot_plan.lum_star_back = geo.lum_star_back;
+  for (n = 0; n < NRINGS; n++)
+    phot_plan.disk_heat[n] = qdisk.heat[n];
+
+  /* if we are generating nonradiative kpackets, then we need to subtract
      off the fraction reserved for k-packets */
   if (geo.nonthermal && (geo.rt_mode == RT_MODE_MACRO) && (ioniz_or_extract == CYCLE_IONIZ))
   {
@@ -118,10 +171,11 @@ define_phot (p, f1, f2, nphot_tot, ioniz_or_extract, iwind, freq_sampling)
 
     geo.weight = (weight) = (geo.f_tot) / (nphot_tot_rad);
 
-    for (n = 0; n < NPHOT; n++)
-      p[n].path = -1.0;         /* SWM - Zero photon paths */
-
-    xmake_phot (p, f1, f2, ioniz_or_extract, iwind, weight, 0, nphot_rad);
+    phot_plan.nbands = 1;
+    phot_plan.f1[0] = f1;
+    phot_plan.f2[0] = f2;
+    phot_plan.weight[0] = weight;
+    phot_plan.nphot[0] = nphot_rad;
   }
   else
   {
@@ -131,41 +185,29 @@ define_phot (p, f1, f2, nphot_tot, ioniz_or_extract, iwind, freq_sampling)
 
     ftot = populate_bands (ioniz_or_extract, iwind, &xband);
 
-    for (n = 0; n < NPHOT; n++)
-      p[n].path = -1.0;         /* SWM - Zero photon paths */
+    /* The weight of each photon is designed so that all of the photons add up to the
+       luminosity of the photosphere.  This implies that photons must be generated in such
+       a way that it mimics the energy distribution of the star. */
 
-    /* Now generate the photons */
+    geo.weight = (natural_weight) = (ftot) / (nphot_tot_rad);
 
-    iphot_start = 0;
+    phot_plan.nbands = xband.nbands;
 
     for (n = 0; n < xband.nbands; n++)
     {
+      phot_plan.f1[n] = xband.f1[n];
+      phot_plan.f2[n] = xband.f2[n];
+      phot_plan.nphot[n] = xband.nphot[n];
 
       if (xband.nphot[n] > 0)
       {
-        /* Reinitialization is required here always because we are changing
-         * the frequencies around all the time */
-        Log ("Defining photons for band %d...\n", n);
-        if (n == 0)
-          xdefine_phot (xband.f1[n], xband.f2[n], ioniz_or_extract, iwind, PRINT_ON, 1);
-        else
-          xdefine_phot (xband.f1[n], xband.f2[n], ioniz_or_extract, iwind, PRINT_ON, 0);
-        /* The weight of each photon is designed so that all of the photons add up to the
-           luminosity of the photosphere.  This implies that photons must be generated in such
-           a way that it mimics the energy distribution of the star. */
-        geo.weight = (natural_weight) = (ftot) / (nphot_tot_rad);
-        xband.weight[n] = weight = natural_weight * xband.nat_fraction[n] / xband.used_fraction[n];
-        xmake_phot (p, xband.f1[n], xband.f2[n], ioniz_or_extract, iwind, weight, iphot_start, xband.nphot[n]);
-
-        iphot_start += xband.nphot[n];
+        xband.weight[n] = phot_plan.weight[n] = natural_weight * xband.nat_fraction[n] / xband.used_fraction[n];
       }
       else
       {
         Error ("photon_gen: No photons for band %d\n", n);
       }
-
     }
-
   }
 
   /* deal with k-packets generated from nonradiative heating */
@@ -175,7 +217,7 @@ define_phot (p, f1, f2, nphot_tot, ioniz_or_extract, iwind, freq_sampling)
     geo.f_kpkt = get_kpkt_heating_f ();
 
     /* get the number of photons we have reserved in the photon structure */
-    //nphot_k = geo.frac_extra_kpkts * NPHOT; 
+    //nphot_k = geo.frac_extra_kpkts * NPHOT;
     weight = (geo.f_kpkt) / (nphot_tot_k);
 
     /* throw an error if the k-packet weight is too high or low */
@@ -188,18 +230,124 @@ define_phot (p, f1, f2, nphot_tot, ioniz_or_extract, iwind, freq_sampling)
 
     Log ("!! xdefine_phot: total & banded kpkt luminosity due to non-radiative heating: %8.2e %8.2e \n", geo.heat_shock, geo.f_kpkt);
 
-
-    /* generate the actual photons produced by the k-packets */
-    photo_gen_kpkt (p, weight, iphot_start, nphot_k);
+    phot_plan.kpkt_band = phot_plan.nbands++;
+    phot_plan.weight[phot_plan.kpkt_band] = weight;
+    phot_plan.nphot[phot_plan.kpkt_band] = nphot_k;
   }
 
+  return (0);
+
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Make the next batch of the photons planned by define_phot
+ *
+ * @param [out] PhotPtr  p   The structure where the batch of photons is stored
+ * @param [in] int  nmax   The maximum number of photons to make
+ * @return     The number of photons that were made, which is 0 once all of the
+ * photons for the cycle have been made
+ *
+ * @details
+ * Photons are made band by band, in the order laid out by define_phot, and a batch
+ * can span more than one band.  Calling this with nmax equal to NPHOT makes all of
+ * the photons of a cycle at once; with a smaller nmax the cycle can be generated,
+ * transported and tallied a batch at a time, so that only nmax photons need to be
+ * held in memory.
+ *
+ * Each photon is numbered (in np) by its position in the cycle as a whole, not in
+ * the batch.
+ *
+ **********************************************************/
+
+int
+next_phot_batch (p, nmax)
+     PhotPtr p;
+     int nmax;
+{
+  int n, nphot, nleft;
+  int iband, isrc, first, last, nstart;
+  int nslice[NSRC];
+  double lum_star_back, disk_heat[NRINGS];
 
-  for (n = 0; n < NPHOT; n++)
+  nphot = 0;
+
+  while (nphot < nmax && phot_plan.iband < phot_plan.nbands)
+  {
+    iband = phot_plan.iband;
+
+    if ((nleft = phot_plan.nphot[iband] - phot_plan.nmade_band) <= 0)
+    {
+      phot_plan.iband++;
+      phot_plan.nmade_band = 0;
+      continue;
+    }
+    if (nleft > nmax - nphot)
+      nleft = nmax - nphot;
+
+    for (n = nphot; n < nphot + nleft; n++)
+      p[n].path = -1.0;         /* SWM - Zero photon paths */
+
+    if (iband == phot_plan.kpkt_band)
+    {
+      /* generate the actual photons produced by the k-packets */
+      photo_gen_kpkt (p, phot_plan.weight[iband], nphot, nleft);
+    }
+    else
+    {
+      if (phot_plan.freq_sampling && phot_plan.nmade_band == 0)
+      {
+        /* Reinitialization is required here always because we are changing
+         * the frequencies around all the time */
+        Log ("Defining photons for band %d...\n", iband);
+
+        lum_star_back = geo.lum_star_back;
+        geo.lum_star_back = phot_plan.lum_star_back;
+        for (n = 0; n < NRINGS; n++)
+        {
+          disk_heat[n] = qdisk.heat[n];
+          qdisk.heat[n] = phot_plan.disk_heat[n];
+        }
+
+        xdefine_phot (phot_plan.f1[iband], phot_plan.f2[iband], phot_plan.ioniz_or_extract, phot_plan.iwind, PRINT_ON, iband == 0);
+
+        geo.lum_star_back = lum_star_back;
+        for (n = 0; n < NRINGS; n++)
+          qdisk.heat[n] = disk_heat[n];
+      }
+      if (phot_plan.nmade_band == 0)
+        plan_band_sources (iband);
+
+      /* The photons of a band are laid out source by source, so a batch takes
+         whatever part of each source's photons falls in its slice of the band */
+
+      nstart = 0;
+      for (isrc = 0; isrc < NSRC; isrc++)
+      {
+        first = (nstart > phot_plan.nmade_band) ? nstart : phot_plan.nmade_band;
+        last = nstart + phot_plan.nsrc[iband][isrc];
+        if (last > phot_plan.nmade_band + nleft)
+          last = phot_plan.nmade_band + nleft;
+        nslice[isrc] = (last > first) ? last - first : 0;
+        nstart += phot_plan.nsrc[iband][isrc];
+      }
+
+      xmake_phot (p, phot_plan.f1[iband], phot_plan.f2[iband], phot_plan.ioniz_or_extract, phot_plan.iwind, phot_plan.weight[iband],
+                  nphot, nslice);
+    }
+
+    phot_plan.nmade_band += nleft;
+    nphot += nleft;
+  }
+
+  for (n = 0; n < nphot; n++)
   {
     p[n].w_orig = p[n].w;
     p[n].freq_orig = p[n].freq;
     p[n].origin_orig = p[n].origin;
-    p[n].np = n;
+    p[n].np = phot_plan.nmade + n;
     p[n].ds = 0;
     p[n].line_res = NRES_NOT_SET;
     p[n].frame = F_OBSERVER;
@@ -207,8 +355,121 @@ define_phot (p, f1, f2, nphot_tot, ioniz_or_extract, iwind, freq_sampling)
       simple_paths_gen_phot (&p[n]);
   }
 
+  phot_plan.nmade += nphot;
+
+  return (nphot);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Decide how many of the photons in a band come from each source
+ *
+ * @param [in] int  iband   The band in the plan
+ * @return     Always returns 0
+ *
+ * @details
+ * The photons of a band are shared amongst the star, the bl, the wind, the disk,
+ * the agn, and k-packets and macro atoms, using the ratio of the band limited
+ * luminosity of each source to the total band limited luminosity.  Any photons
+ * lost in rounding down are given to the disk if there is one, or otherwise to
+ * the first of the wind, the bl, the agn or the star that has photons.
+ *
+ * ### Notes ###
+ * This is done once for each band, after xdefine_phot has set up the band limited
+ * luminosities, so that the counts do not depend on how the band is split into
+ * batches by next_phot_batch.
+ *
+ **********************************************************/
+
+static int
+plan_band_sources (iband)
+     int iband;
+{
+  int isrc, nphot, nphotons;
+  int *nsrc;
+
+  nsrc = phot_plan.nsrc[iband];
+  nphotons = phot_plan.nphot[iband];
+
+  for (isrc = 0; isrc < NSRC; isrc++)
+    nsrc[isrc] = 0;
+
+  if (geo.star_radiation)
+  {
+    nsrc[SRC_STAR] = geo.f_star / geo.f_tot * nphotons;
+  }
+  if (geo.bl_radiation)
+  {
+    nsrc[SRC_BL] = geo.f_bl / geo.f_tot * nphotons;
+  }
+  if (phot_plan.iwind >= 0)
+  {
+    nsrc[SRC_WIND] = geo.f_wind / geo.f_tot * nphotons;
+  }
+  if (geo.disk_radiation)
+  {
+    nsrc[SRC_DISK] = geo.f_disk / geo.f_tot * nphotons;
+  }
+  if (geo.agn_radiation)
+  {
+    nsrc[SRC_AGN] = geo.f_agn / geo.f_tot * nphotons;
+  }
+  if (geo.matom_radiation || geo.nonthermal)
+  {
+    nsrc[SRC_KPKT] = geo.f_kpkt / geo.f_tot * nphotons;
+
+    if (geo.matom_radiation)
+      nsrc[SRC_MATOM] = geo.f_matom / geo.f_tot * nphotons;
+  }
+
+  nphot = 0;
+  for (isrc = 0; isrc < NSRC; isrc++)
+    nphot += nsrc[isrc];
+
+  if (nphot < nphotons)         /* Ensure that nphotons photons are created */
+  {
+    if (nsrc[SRC_DISK] > 0)
+      nsrc[SRC_DISK] += (nphotons - nphot);
+    else if (nsrc[SRC_WIND] > 0)
+      nsrc[SRC_WIND] += (nphotons - nphot);
+    else if (nsrc[SRC_BL] > 0)
+      nsrc[SRC_BL] += (nphotons - nphot);
+    else if (nsrc[SRC_AGN] > 0)
+      nsrc[SRC_AGN] += (nphotons - nphot);
+    else
+      nsrc[SRC_STAR] += (nphotons - nphot);
+  }
+
+  Log
+    ("photon_gen: band %6.2e to %6.2e weight %6.2e nphotons %8d ndisk %7d nwind %7d nstar %7d npow %d \n",
+     phot_plan.f1[iband], phot_plan.f2[iband], phot_plan.weight[iband], nphotons, nsrc[SRC_DISK], nsrc[SRC_WIND], nsrc[SRC_STAR],
+     nsrc[SRC_AGN]);
+
   return (0);
+}
 
+
+
+/**********************************************************/
+/**
+ * @brief      The number of photons which are generated and transported together
+ *
+ * @return     The batch size
+ *
+ * @details
+ * Unless a batch size has been chosen with the -photon_batch command line
+ * option, all of the photons in a cycle are generated at once.
+ *
+ **********************************************************/
+
+int
+phot_batch_size ()
+{
+  if (modes.photon_batch > 0 && modes.photon_batch < NPHOT)
+    return (modes.photon_batch);
+  return (NPHOT);
 }
 
 
@@ -535,35 +796,44 @@ phot_status ()
  * @param [in] int  iwind   A flag indicating whether or not to generate any wind photons.
  * @param [in] double  weight   The weight of photons to generate
  * @param [in] int  iphot_start   The position in the photon structure to start storing photons
- * @param [in] int  nphotons   The number of photons to generate
+ * @param [in] int  nsrc[]   The number of photons to generate from each source
  * @return     Always returns 0
  *
  * @details
  * make_phot controls the actual generation of photons.  All of the initializations should
  * have been done previously (xdefine_phot).  xmake_phot cycles through the various possible
  * sources of the wind, including for example, the disk, the central object, and the
- * wind, and creates photons for each, using the ratio of the band limited luminosites to the
- * total band limited luminosity to determine how many photons to select from each source.
+ * wind, and creates the number of photons for each that has been set out for this batch
+ * by next_phot_batch from the counts decided for the whole band by plan_band_sources.
  *
  * ### Notes ###
  *
  **********************************************************/
 
 int
-xmake_phot (p, f1, f2, ioniz_or_extract, iwind, weight, iphot_start, nphotons)
+xmake_phot (p, f1, f2, ioniz_or_extract, iwind, weight, iphot_start, nsrc)
      PhotPtr p;
      double f1, f2;
      int ioniz_or_extract;
      int iwind;
      double weight;
      int iphot_start;           //The place to begin putting photons in the photon structure in this call
-     int nphotons;              //The total number of photons to generate in this call
+     int nsrc[];                //The number of photons to generate from each source in this call
 {
 
-  int nphot, nn;
+  int nphot, nn, nphotons;
   int nstar, nbl, nwind, ndisk, nmatom, nagn, nkpkt;
   double agn_f1;
 
+  nstar = nsrc[SRC_STAR];
+  nbl = nsrc[SRC_BL];
+  nwind = nsrc[SRC_WIND];
+  ndisk = nsrc[SRC_DISK];
+  nagn = nsrc[SRC_AGN];
+  nkpkt = nsrc[SRC_KPKT];
+  nmatom = nsrc[SRC_MATOM];
+  nphotons = nstar + nbl + nwind + ndisk + nagn + nkpkt + nmatom;
+
   /* For the diagnostic searchlight mode
      we intercept the normal procedure for generating
      photons and substitute searchlight mode.  
@@ -604,59 +874,6 @@ xmake_phot (p, f1, f2, ioniz_or_extract, iwind, weight, iphot_start, nphotons)
 
 /* End of generation of photons via the seaach light mode */
 
-  nstar = nbl = nwind = ndisk = 0;
-  nagn = nkpkt = nmatom = 0;
-
-  if (geo.star_radiation)
-  {
-    nstar = geo.f_star / geo.f_tot * nphotons;
-  }
-  if (geo.bl_radiation)
-  {
-    nbl = geo.f_bl / geo.f_tot * nphotons;
-  }
-  if (iwind >= 0)
-  {
-    nwind = geo.f_wind / geo.f_tot * nphotons;
-  }
-  if (geo.disk_radiation)
-  {
-    ndisk = geo.f_disk / geo.f_tot * nphotons;  /* Ensure that nphot photons are created */
-  }
-  if (geo.agn_radiation)
-  {
-    nagn = geo.f_agn / geo.f_tot * nphotons;    /* Ensure that nphot photons are created */
-  }
-  if (geo.matom_radiation || geo.nonthermal)
-  {
-    nkpkt = geo.f_kpkt / geo.f_tot * nphotons;
-
-    if (geo.matom_radiation)
-      nmatom = geo.f_matom / geo.f_tot * nphotons;
-  }
-
-
-  nphot = ndisk + nwind + nbl + nstar + nagn + nkpkt + nmatom;
-
-  if (nphot < nphotons)
-  {
-    if (ndisk > 0)
-      ndisk += (nphotons - nphot);
-    else if (nwind > 0)
-      nwind += (nphotons - nphot);
-    else if (nbl > 0)
-      nbl += (nphotons - nphot);
-    else if (nagn > 0)
-      nagn += (nphotons - nphot);
-    else
-      nstar += (nphotons - nphot);
-  }
-
-
-  Log
-    ("photon_gen: band %6.2e to %6.2e weight %6.2e nphotons %8d ndisk %7d nwind %7d nstar %7d npow %d \n",
-     f1, f2, weight, nphotons, ndisk, nwind, nstar, nagn);
-
   /* Generate photons from the star, the bl, the wind and then from the disk */
   /* Now adding generation from kpkts and macro atoms too (SS June 04) */
 
@@ -915,8 +1132,15 @@ photo_gen_star (p, r, t, weight, f1, f2, spectype, istart, nphot)
   freqmin = f1;
   freqmax = f2;
   r = (1. + EPSILON) * r;       /* Generate photons just outside the photosphere */
+
+  if (modes.stratify)
+    stratify_init (nphot, STRATIFY_MAX_DIM);
+
   for (i = istart; i < iend; i++)
   {
+    if (modes.stratify)
+      stratify_sample (i - istart);
+
     p[i].origin = PTYPE_STAR;   // For BL photons this is corrected in photon_gen
     p[i].frame = F_OBSERVER;    // Stellar photons are not redshifted
     p[i].w = weight;
@@ -979,6 +1203,9 @@ photo_gen_star (p, r, t, weight, f1, f2, spectype, istart, nphot)
     //  save_photons (&p[i], "STAR");
 
   }
+
+  stratify_sample (-1);
+
   return (0);
 }
 
@@ -1050,6 +1277,7 @@ bl_init (lum_bl, t_bl, freqmin, freqmax, ioniz_or_extract, f)
  * Perform some simple checks on the photon distribution just produced.
  *
  * @param [in] PhotPtr  p  The photon structure
+ * @param [in] int  nphot   The number of photons in p
  * @param [in] double  freqmin   The minimum fequency that was used to generate the photons
  * @param [in] double  freqmax   The maximum fequency that was used to generate the photons
  * @param [in] char *  comment   A comment that accompanies this particular call
@@ -1071,10 +1299,6 @@ bl_init (lum_bl, t_bl, freqmin, freqmax, ioniz_or_extract, f)
  * The frequency limits are not enforced on photons that have excited
  * macro-atoms.
  *
- * The routine also determines the calculates some features of the
- * photon distribution, specifically having to do with the ionizing
- * photons.  It is not entirely clear why this is where this is done
- *
  * 181009 - ksl - Previously, this routine caused Python to exit 
  * if photon_checks produced more than a small number of errors. I
  * have removed this extreme measure but that does not mean that
@@ -1083,15 +1307,14 @@ bl_init (lum_bl, t_bl, freqmin, freqmax, ioniz_or_extract, f)
  **********************************************************/
 
 int
-photon_checks (p, freqmin, freqmax, comment)
+photon_checks (p, nphot, freqmin, freqmax, comment)
      char *comment;
      PhotPtr p;
+     int nphot;
      double freqmin, freqmax;
 {
   int nnn, nn;
   int nlabel;
-  geo.n_ioniz = 0;
-  geo.cool_tot_ioniz = 0.0;
   nnn = 0;
   nlabel = 0;
 
@@ -1110,14 +1333,8 @@ photon_checks (p, freqmin, freqmax, comment)
   freqmax *= (1.8);
   freqmin *= (0.6);
 
-  for (nn = 0; nn < NPHOT; nn++)
+  for (nn = 0; nn < nphot; nn++)
   {
-    if (PLANCK * p[nn].freq > ion[0].ip)
-    {
-      geo.cool_tot_ioniz += p[nn].w;
-      geo.n_ioniz += p[nn].w / (PLANCK * p[nn].freq);
-    }
-
     if (sane_check (p[nn].freq) != 0 || sane_check (p[nn].w))
     {
       if (nlabel == 0)
@@ -1159,7 +1376,7 @@ photon_checks (p, freqmin, freqmax, comment)
     Debug ("photon_checks: All photons passed checks successfully\n");
   else
   {
-    Log ("photon_checks: %d of %d or %e per cent of photons failed checks\n", nnn, NPHOT, nnn * 100. / NPHOT);
+    Log ("photon_checks: %d of %d or %e per cent of photons failed checks\n", nnn, nphot, nnn * 100. / nphot);
   }
 
   return (0);
@@ -13,6 +13,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <gsl/gsl_sf_gamma.h>
+#include <gsl/gsl_errno.h>
 
 #include "atomic.h"
 #include "sirocco.h"
@@ -68,13 +70,8 @@ calc_pi_rate (nion, xplasma, mode, type)
   int j;
   double pi_rate;
   int ntmin, nvmin;
-  double fthresh, fmax, fmaxtemp;
+  double fthresh, fmax;
   double f1, f2;
-  double exp_qromb, pl_qromb;
-
-
-  exp_qromb = 1e-4;             /*These are the two tolerance values for the rhomberg integrals */
-  pl_qromb = 1e-4;
 
   ntmin = nvmin = -1;           /* Initialize these to an unreasonable number. We dont use them all the time */
 
@@ -149,48 +146,19 @@ calc_pi_rate (nion, xplasma, mode, type)
         f2 = xplasma->fmax_mod[j];      //NSH 131114 - Set the high frequency limit to the highest frequency that the model applies to
         if (f1 < fthresh && fthresh < f2 && f1 < fmax && fmax < f2)     //Case 1-
         {
-          if (xplasma->spec_mod_type[j] == SPEC_MOD_PL)
-          {
-            pi_rate += num_int (tb_logpow, fthresh, fmax, pl_qromb);
-
-          }
-          else
-          {
-            pi_rate += num_int (tb_exp, fthresh, fmax, exp_qromb);
-          }
+          pi_rate += pi_model_integral (xplasma->spec_mod_type[j], fthresh, fmax);
         }
         else if (f1 < fthresh && fthresh < f2 && f2 < fmax)     //case 2
         {
-          if (xplasma->spec_mod_type[j] == SPEC_MOD_PL)
-          {
-            pi_rate += num_int (tb_logpow, fthresh, f2, pl_qromb);
-          }
-          else
-          {
-            pi_rate += num_int (tb_exp, fthresh, f2, exp_qromb);
-          }
+          pi_rate += pi_model_integral (xplasma->spec_mod_type[j], fthresh, f2);
         }
         else if (f1 > fthresh && f1 < fmax && fmax < f2)        //case 3
         {
-          if (xplasma->spec_mod_type[j] == SPEC_MOD_PL)
-          {
-            pi_rate += num_int (tb_logpow, f1, fmax, pl_qromb);
-          }
-          else
-          {
-            pi_rate += num_int (tb_exp, f1, fmax, exp_qromb);
-          }
+          pi_rate += pi_model_integral (xplasma->spec_mod_type[j], f1, fmax);
         }
         else if (f1 > fthresh && f2 < fmax)     // case 4
         {
-          if (xplasma->spec_mod_type[j] == SPEC_MOD_PL)
-          {
-            pi_rate += num_int (tb_logpow, f1, f2, pl_qromb);
-          }
-          else
-          {
-            pi_rate += num_int (tb_exp, f1, f2, exp_qromb);
-          }
+          pi_rate += pi_model_integral (xplasma->spec_mod_type[j], f1, f2);
         }
         else                    //case 5 - should only be the case where the band is outside the range for the integral.
         {
@@ -202,17 +170,13 @@ calc_pi_rate (nion, xplasma, mode, type)
   }
   else if (mode == 2)           //blackbody mode
   {
-    fmaxtemp = xtop->freq[xtop->np - 1];        //Set the maximum frequency temporarily to the maximum cross section frequency
-    fmax = check_freq_max (fmaxtemp, xplasma->t_r);     /*Check that the requested maximum frequency is sensible - if it is way
-                                                           off the end of the wien tail then the integration can fail - reset if necessary. */
-    if (fthresh > fmax)         //The threshold for PI is above the maximum frequency of the radiation
+    if (modes.fb_cache)         //The integral depends only on t_r, so it can be interpolated from the cache in recomb.c
     {
-      pi_rate = 0.0;
+      pi_rate = xplasma->w * fb_cache_pi_planck (xtop, xplasma->t_r);
     }
-    else                        //We are OK - do the integral
+    else
     {
-      qromb_temp = xplasma->t_r;
-      pi_rate = xplasma->w * num_int (tb_planck, fthresh, fmax, 1.e-4);
+      pi_rate = xplasma->w * pi_planck_integral (xtop, xplasma->t_r);
     }
   }
 
@@ -225,6 +189,133 @@ calc_pi_rate (nion, xplasma, mode, type)
 }
 
 
+
+/**********************************************************/
+/**
+ * @brief      integrate the cross section times a blackbody, for the PI rate in a BB radiation field
+ *
+ * @param [in] struct topbase_phot *  x_ptr   The photoionization cross section
+ * @param [in] double  t_r   The radiation temperature
+ * @return     The integral of sigma B_nu/nu from threshold to the end of the cross section
+ *
+ * @details
+ * This is the integral needed by calc_pi_rate for a dilute blackbody, without the dilution
+ * factor or the constants.  It depends only on the cross section and the radiation
+ * temperature, and so it can be stored in the cache of integrals in recomb.c.
+ *
+ **********************************************************/
+
+double
+pi_planck_integral (x_ptr, t_r)
+     struct topbase_phot *x_ptr;
+     double t_r;
+{
+  double fthresh, fmax;
+
+  xtop = x_ptr;
+  fthresh = xtop->freq[0];
+  fmax = check_freq_max (xtop->freq[xtop->np - 1], t_r);        /*Check that the requested maximum frequency is sensible - if it is way
+                                                                   off the end of the wien tail then the integration can fail - reset if necessary. */
+  if (fthresh > fmax)           //The threshold for PI is above the maximum frequency of the radiation
+  {
+    return (0.0);
+  }
+
+  qromb_temp = t_r;
+  return (num_int (tb_planck, fthresh, fmax, 1.e-4));
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      integrate the cross section times a modelled J_nu over part of a band
+ *
+ * @param [in] int  spec_mod_type   The type of model, SPEC_MOD_PL or SPEC_MOD_EXP
+ * @param [in] double  fmin   The lower limit of the integral
+ * @param [in] double  fmax   The upper limit of the integral
+ * @return     The integral of sigma J_nu/nu between fmin and fmax
+ *
+ * @details
+ * The cross section is xtop and the model parameters are xpl_logw, xpl_alpha, xexp_w and xexp_temp,
+ * all of which are set by calc_pi_rate.
+ *
+ * sigma_phot interpolates cross sections linearly in log space, so between two tabulated points the
+ * cross section is a power law in frequency.  The integral over each segment can therefore be written
+ * down exactly: for a power law model it is elementary, and for an exponential model it is a difference of
+ * two incomplete gamma functions.  The integral is the sum over the segments which overlap [fmin, fmax],
+ * which is both faster and more accurate than integrating numerically.
+ *
+ * ### Notes ###
+ * If a segment cannot be done this way, for example because a cross section is zero or an incomplete
+ * gamma function cannot be evaluated, that segment is integrated numerically instead.
+ *
+ **********************************************************/
+
+double
+pi_model_integral (spec_mod_type, fmin, fmax)
+     int spec_mod_type;
+     double fmin, fmax;
+{
+  int n, status;
+  double lo, hi, slope, log_sigma, log_ratio, p;
+  double beta, x1, x2, integral;
+  gsl_sf_result gamma1, gamma2;
+
+  integral = 0.0;
+  beta = PLANCK / (BOLTZMANN * xexp_temp);
+
+  for (n = 0; n < xtop->np - 1; n++)
+  {
+    lo = xtop->freq[n];
+    hi = xtop->freq[n + 1];
+    if (hi <= fmin)
+      continue;
+    if (lo >= fmax)
+      break;
+    if (lo < fmin)
+      lo = fmin;
+    if (hi > fmax)
+      hi = fmax;
+    if (hi <= lo)
+      continue;
+
+    slope = (xtop->log_x[n + 1] - xtop->log_x[n]) / (xtop->log_freq[n + 1] - xtop->log_freq[n]);
+    log_sigma = xtop->log_x[n] + slope * (log (lo) - xtop->log_freq[n]);        //The log of the cross section at lo
+    log_ratio = log (hi / lo);
+
+    if (!isfinite (slope) || !isfinite (log_sigma))
+    {
+      integral += num_int (spec_mod_type == SPEC_MOD_PL ? tb_logpow : tb_exp, lo, hi, 1e-4);
+    }
+    else if (spec_mod_type == SPEC_MOD_PL)
+    {
+      /* sigma(nu) 10**logw nu**(alpha-1) = exp (log_sigma + logw ln10 + alpha ln lo) (nu/lo)**(slope+alpha-1) / lo */
+      p = slope + xpl_alpha;
+      if (fabs (p * log_ratio) < 1e-8)
+        integral += exp (log_sigma + xpl_logw * log (10.) + xpl_alpha * log (lo)) * log_ratio;
+      else
+        integral += exp (log_sigma + xpl_logw * log (10.) + xpl_alpha * log (lo)) * expm1 (p * log_ratio) / p;
+    }
+    else
+    {
+      /* w sigma(nu) exp(-beta nu) / nu = w sigma(lo) (beta lo)**(-slope) x**(slope-1) exp(-x) dx, with x = beta nu */
+      x1 = beta * lo;
+      x2 = beta * hi;
+      status = gsl_sf_gamma_inc_e (slope, x1, &gamma1);
+      if (status == GSL_SUCCESS || status == GSL_EUNDRFLW)
+        status = gsl_sf_gamma_inc_e (slope, x2, &gamma2);
+      if (status == GSL_SUCCESS || status == GSL_EUNDRFLW)
+        integral += xexp_w * exp (log_sigma - slope * log (x1)) * (gamma1.val - gamma2.val);
+      else
+        integral += num_int (tb_exp, lo, hi, 1e-4);
+    }
+  }
+
+  return (integral);
+}
+
+
 /**********************************************************/
 /**
  * @brief      The integrand for working out the PI rate in a BB radiation field
@@ -90,6 +90,7 @@ radiation (PhotPtr p, double ds)
   struct photon phot, phot_cmf, phot_mid, phot_mid_cmf, p_cmf;
   int ndom;
   double ds_cmf, w_ave_cmf;
+  double v_start[3], v_mid[3], v_stop[3];
 
 
 
@@ -130,19 +131,23 @@ radiation (PhotPtr p, double ds)
   stuff_phot (p, &phot_mid);
   move_phot (&phot_mid, ds / 2.);
 
-  /* calculate photon frequencies in rest frame of cell */
+  /* calculate photon frequencies in rest frame of cell.  The velocities at the
+     start and middle of the path are kept for the transformations of ds below */
 
-  if (observer_to_local_frame (&phot, &phot_cmf))
+  vwind_xyz (ndom, &phot, v_stop);
+  if (observer_to_local_frame_with_v (&phot, &phot_cmf, v_stop))
   {
     Error ("radiation: observer to local frame error\n");
   }
 
-  if (observer_to_local_frame (p, &p_cmf))
+  vwind_xyz (ndom, p, v_start);
+  if (observer_to_local_frame_with_v (p, &p_cmf, v_start))
   {
     Error ("radiation: observer to local frame error\n");
   }
 
-  if (observer_to_local_frame (&phot_mid, &phot_mid_cmf))
+  vwind_xyz (ndom, &phot_mid, v_mid);
+  if (observer_to_local_frame_with_v (&phot_mid, &phot_mid_cmf, v_mid))
   {
     Error ("radiation: observer to local frame error\n");
   }
@@ -349,7 +354,7 @@ radiation (PhotPtr p, double ds)
   /* finished looping over cross-sections to calculate bf opacity
      we can now reduce weights and record certain estimators */
 
-  kappa_tot_obs = kappa_tot / observer_to_local_frame_ds (p, 1);
+  kappa_tot_obs = kappa_tot / observer_to_local_frame_ds_with_v (p, 1, v_start);
   tau = kappa_tot_obs * ds;
 
   w_in = p->w;
@@ -430,7 +435,7 @@ radiation (PhotPtr p, double ds)
    * Following bug #391, we now wish to use the mean, doppler shifted freqiency in the cell.
    * Update_banded_estimators requires photon freq and ds and w_ave in cmf frame */
 
-  ds_cmf = observer_to_local_frame_ds (&phot_mid, ds);
+  ds_cmf = observer_to_local_frame_ds_with_v (&phot_mid, ds, v_mid);
   update_banded_estimators (xplasma, &phot_mid_cmf, ds_cmf, w_ave_cmf, ndom);
   update_flux_estimators (xplasma, &phot_mid, ds, w_ave_obs, ndom);
 
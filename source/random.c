@@ -548,6 +548,187 @@ reload_gsl_rng_state ()
   }
 }
 
+/* The state of stratified sampling, which is set up by stratify_init.  Each dimension
+   d is a randomly shifted rank-1 lattice, with sample i assigned to the stratum
+   (mult[d] * i + shift[d]) mod nsamples */
+
+static struct
+{
+  long nsamples;
+  int ndim;
+  long mult[STRATIFY_MAX_DIM];
+  long shift[STRATIFY_MAX_DIM];
+  long isample;                 /* The sample whose numbers are being drawn, or -1 */
+  int idim;                     /* The dimension of the next number that is drawn */
+} strat = {
+0, 0, {0}, {0}, -1, 0};
+
+
+/**********************************************************/
+/**
+ * @brief	Set up stratified sampling for a set of samples
+ *
+ * @param [in] long  nsamples   The number of samples, e.g. photons, in the set
+ * @param [in] int  ndim   The number of random numbers for each sample that are stratified
+ * @return 	     0
+ *
+ * @details
+ * Once set up, each call to stratify_sample(i) makes the next ndim calls to
+ * random_number return stratified values for sample i.  In each dimension the
+ * unit interval is divided into nsamples equal strata, and each sample falls
+ * in a different one, so that the set as a whole covers the interval evenly.
+ * Taken together the dimensions form a randomly shifted rank-1 lattice, whose
+ * generator follows the generalised golden ratio, so the strata are also
+ * spread evenly in the projections onto pairs of dimensions.
+ *
+ * ###Notes###
+ *
+ * The shift of each dimension and the position of each number within its
+ * stratum are drawn from the GSL generator, so for a single sample the
+ * numbers are independent and uniform, exactly as if they had been drawn
+ * directly.  Stratification therefore changes only the correlations between
+ * samples, and anything estimated from them remains unbiased.  Because all
+ * numbers come from the same generator, save_gsl_rng_state and
+ * reload_gsl_rng_state reproduce stratified runs as well.
+ *
+ * Unlike a randomly permuted Latin hypercube, no storage is needed for
+ * the strata, so nsamples can be as large as the number of photons.
+ *
+***********************************************************/
+
+int
+stratify_init (nsamples, ndim)
+     long nsamples;
+     int ndim;
+{
+  int d;
+  long a, x, y, t;
+  double phi, alpha;
+
+  if (ndim > STRATIFY_MAX_DIM)
+    ndim = STRATIFY_MAX_DIM;
+
+  strat.nsamples = nsamples;
+  strat.ndim = ndim;
+  strat.isample = -1;
+
+  if (nsamples < 2)
+  {
+    strat.ndim = 0;
+    return (0);
+  }
+
+  /* The generalised golden ratio, the root of phi^(ndim+1) = phi + 1 */
+
+  phi = 2.0;
+  for (d = 0; d < 30; d++)
+    phi = pow (1.0 + phi, 1.0 / (ndim + 1));
+
+  for (d = 0; d < ndim; d++)
+  {
+    alpha = pow (1.0 / phi, d + 1);
+    alpha -= floor (alpha);
+
+    /* The multiplier must be coprime with nsamples for each sample to have its own stratum */
+    a = (long) (alpha * nsamples);
+    if (a < 1)
+      a = 1;
+    while (1)
+    {
+      x = a;
+      y = nsamples;
+      while (y)
+      {
+        t = x % y;
+        x = y;
+        y = t;
+      }
+      if (x == 1)
+        break;
+      a++;
+    }
+
+    strat.mult[d] = a % nsamples;
+    strat.shift[d] = (long) (gsl_rng_uniform (rng) * nsamples) % nsamples;
+  }
+
+  return (0);
+}
+
+
+/**********************************************************/
+/**
+ * @brief	Choose the sample for which stratified numbers are drawn
+ *
+ * @param [in] long  isample   The sample, between 0 and the nsamples given to
+ * stratify_init, or -1 to return to drawing numbers independently
+ * @return 	     0
+ *
+ * @details
+ * After this call, the next ndim calls to random_number are stratified for
+ * isample.  Any further calls draw numbers independently, as normal.
+ *
+***********************************************************/
+
+int
+stratify_sample (isample)
+     long isample;
+{
+  if (isample >= strat.nsamples)
+  {
+    Error ("stratify_sample: sample %ld is not in the set of %ld samples\n", isample, strat.nsamples);
+    isample = -1;
+  }
+  strat.isample = isample;
+  strat.idim = 0;
+  return (0);
+}
+
+
+/**********************************************************/
+/**
+ * @brief	Measure how evenly a set of samples is spread amongst a set of bins
+ *
+ * @param [in] int  counts[]   The number of samples which fell in each bin
+ * @param [in] double  expected[]   The number of samples expected in each bin
+ * @param [in] int  nbins   The number of bins
+ * @return 	     The index of dispersion of the counts
+ *
+ * @details
+ * This is chi-squared per degree of freedom for the counts, ignoring bins in
+ * which no samples are expected.  It is about 1 when the samples are drawn
+ * independently, and smaller by the factor by which stratification has reduced
+ * the variance, per sample, of anything tallied in the bins.
+ *
+***********************************************************/
+
+double
+stratify_dispersion (counts, expected, nbins)
+     int counts[];
+     double expected[];
+     int nbins;
+{
+  int n, nused;
+  double chi2;
+
+  chi2 = 0;
+  nused = 0;
+  for (n = 0; n < nbins; n++)
+  {
+    if (expected[n] > 0)
+    {
+      chi2 += (counts[n] - expected[n]) * (counts[n] - expected[n]) / expected[n];
+      nused++;
+    }
+  }
+
+  if (nused < 2)
+    return (0.0);
+
+  return (chi2 / (nused - 1));
+}
+
+
 /**********************************************************/
 /** 
  * @brief	Gets a random number from the generator set up in init_rand
@@ -558,6 +739,10 @@ reload_gsl_rng_state ()
  *
  * Produces a number from min to max (exclusive).
  *
+ * If stratified sampling has been set up with stratify_init and
+ * stratify_sample, the number is placed in the stratum of the current
+ * sample.
+ *
  * ###Notes###
  * 2/18	-	Written by NSH
 ***********************************************************/
@@ -567,6 +752,17 @@ double
 random_number (double min, double max)
 {
   double num = gsl_rng_uniform_pos (rng);
-  double x = min + ((max - min) * num);
+  double x;
+  long stratum;
+
+  if (strat.isample >= 0 && strat.idim < strat.ndim)
+  {
+    stratum = (strat.mult[strat.idim] * strat.isample + strat.shift[strat.idim]) % strat.nsamples;
+    strat.idim++;
+    if ((num = (stratum + num) / strat.nsamples) >= 1.0)
+      num = (stratum + 0.5) / strat.nsamples;   /* Roundoff for very large sets of samples */
+  }
+
+  x = min + ((max - min) * num);
   return (x);
 }
@@ -285,6 +285,9 @@ fb_topbase_partial2 (double freq, void *params)
  *
  * ### Notes ###
  *
+ * If modes.fb_cache is set (with -fb_cache), the pre-calculated values come
+ * from the temperature-gridded cache maintained by fb_cache_integ, rather than
+ * from the tables set up by init_freebound.
  *
  **********************************************************/
 
@@ -299,6 +302,13 @@ integ_fb (t, f1, f2, nion, fb_choice, mode)
   double fnu;
   int n;
 
+  if (modes.fb_cache && (mode == OUTER_SHELL || mode == INNER_SHELL)
+      && (fb_choice == FB_FULL || fb_choice == FB_REDUCED || fb_choice == FB_RATE))
+  {
+    fnu = fb_cache_integ (t, f1, f2, nion, fb_choice, mode);
+    return (fnu);
+  }
+
   if (mode == OUTER_SHELL)
   {
 
@@ -458,7 +468,7 @@ total_fb (xplasma, t, f1, f2, fb_choice, mode)
   if (t < 100. || f2 < f1)
     t = 100.;                   /* Set the temperature to 100 K so that if there are free electrons emission by this process continues */
 
-  if (mode == OUTER_SHELL)
+  if (mode == OUTER_SHELL && modes.fb_cache == FALSE)
     init_freebound (100., 1.e9, f1, f2);
 
 
@@ -1163,6 +1173,409 @@ get_fb (t, nion, narray, fb_choice, mode)
 
 
 
+/***************************FB_CACHE ***********************************/
+/* The next section contains a cache of the frequency integrals that are
+ * needed for free-bound emissivities, cooling rates, recombination rates
+ * and the macro-atom spontaneous recombination coefficients.
+ *
+ * The integrals are smooth functions of temperature, so they are stored
+ * on a fixed grid in log T which is shared by all of the tables, and
+ * filled only as nodes are actually needed.  Each table either describes
+ * one frequency band, in which case there is a slot for every ion and
+ * every combination of fb_choice and mode, or the alpha_sp integrals,
+ * in which case there is a slot for every photoionization x-section
+ * and choice of alpha_sp, or the blackbody photoionization integrals
+ * used by calc_pi_rate, where there is a slot for every x-section.
+ *
+ * The first time an interval between two nodes is used, the integral
+ * is also evaluated at the (log) midpoint of the interval and compared to
+ * the interpolated value.  If the two do not agree to within FB_CACHE_TOL,
+ * the interval is marked so that all future requests in it are integrated
+ * directly.
+*/
+
+#define FB_CACHE_LTMIN   1.0    // log10 of the lowest temperature in the cache
+#define FB_CACHE_LTMAX   10.0   // log10 of the highest temperature in the cache
+#define FB_CACHE_DLT     0.05   // The spacing of the nodes in log10 T
+#define FB_CACHE_NTEMPS  181    // The number of nodes, (LTMAX-LTMIN)/DLT+1
+#define FB_CACHE_TOL     1.e-3  // The fractional error allowed when interpolating
+#define FB_CACHE_NBANDS  40     // The maximum number of frequency bands which can be cached
+#define FB_CACHE_NCHOICE 6      // The number of slots per ion in a band, one for each fb_choice and mode
+
+#define FB_CACHE_UNCHECKED 0    // The interval has not been used yet
+#define FB_CACHE_INTERP    1    // Interpolation has been checked and is accurate enough
+#define FB_CACHE_DIRECT    2    // Interpolation is not accurate enough, so integrate directly
+
+typedef struct fb_cache_slot
+{
+  double value[FB_CACHE_NTEMPS];        // The integral at each node
+  char filled[FB_CACHE_NTEMPS]; // TRUE if value has been calculated
+  char state[FB_CACHE_NTEMPS - 1];      // The state of the interval above each node
+} fb_cache_slot_dummy, *FbCacheSlotPtr;
+
+struct fb_cache
+{
+  double f1, f2;                // The frequency band, unused for alpha_sp
+  int nslots;                   // The number of slots in the table
+  FbCacheSlotPtr *slot;         // Pointers to the slots, NULL until a slot is first used
+};
+
+static struct fb_cache fb_cache_band[FB_CACHE_NBANDS];
+static int fb_cache_nbands = 0;
+static struct fb_cache fb_cache_alpha;
+static struct fb_cache fb_cache_planck;
+
+/// The parameters passed through fb_cache_lookup to the routines which calculate the integrals
+struct fb_cache_params
+{
+  double f1, f2;
+  int nion;
+  int fb_choice;
+  int mode;
+  struct topbase_phot *cont_ptr;
+};
+
+
+
+/**********************************************************/
+/**
+ * @brief      calculates the integral stored in a slot of one of the frequency band tables
+ *
+ * @param [in] double  t   The temperature
+ * @param [in] void *  params   A pointer to a struct fb_cache_params
+ * @return     The integral from xinteg_fb or xinteg_inner_fb
+ *
+ **********************************************************/
+
+static double
+fb_cache_integ_exact (double t, void *params)
+{
+  struct fb_cache_params *p = (struct fb_cache_params *) params;
+
+  if (p->mode == OUTER_SHELL)
+    return (xinteg_fb (t, p->f1, p->f2, p->nion, p->fb_choice));
+
+  return (xinteg_inner_fb (t, p->f1, p->f2, p->nion, p->fb_choice));
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      calculates the integral stored in a slot of the alpha_sp table
+ *
+ * @param [in] double  t   The temperature
+ * @param [in] void *  params   A pointer to a struct fb_cache_params
+ * @return     The integral from alpha_sp_integral
+ *
+ **********************************************************/
+
+static double
+fb_cache_alpha_exact (double t, void *params)
+{
+  struct fb_cache_params *p = (struct fb_cache_params *) params;
+
+  return (alpha_sp_integral (p->cont_ptr, t, p->fb_choice));
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      calculates the integral stored in a slot of the blackbody photoionization table
+ *
+ * @param [in] double  t   The radiation temperature
+ * @param [in] void *  params   A pointer to a struct fb_cache_params
+ * @return     The integral from pi_planck_integral
+ *
+ **********************************************************/
+
+static double
+fb_cache_planck_exact (double t, void *params)
+{
+  struct fb_cache_params *p = (struct fb_cache_params *) params;
+
+  return (pi_planck_integral (p->cont_ptr, t));
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      returns a cached node of a slot, calculating it if necessary
+ *
+ **********************************************************/
+
+static double
+fb_cache_node (FbCacheSlotPtr xslot, int j, double (*exact) (double, void *), void *params)
+{
+  if (xslot->filled[j] == FALSE)
+  {
+    xslot->value[j] = exact (pow (10., FB_CACHE_LTMIN + FB_CACHE_DLT * j), params);
+    xslot->filled[j] = TRUE;
+  }
+  return (xslot->value[j]);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      interpolates between two nodes of a slot
+ *
+ * @details
+ * The integrals are interpolated in log-log space, except where one of
+ * the nodes is zero, when linear interpolation is used instead.
+ *
+ **********************************************************/
+
+static double
+fb_cache_interp (double y1, double y2, double frac)
+{
+  if (y1 > 0.0 && y2 > 0.0)
+    return (exp ((1. - frac) * log (y1) + frac * log (y2)));
+
+  return ((1. - frac) * y1 + frac * y2);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      returns an integral at temperature t from one slot of a cache table
+ *
+ * @param [in, out] struct fb_cache *  cache   The table
+ * @param [in] int  nslot   The slot in the table
+ * @param [in] double  t   The temperature
+ * @param [in] double (*exact) (double, void *)   The routine which calculates the integral directly
+ * @param [in] void *  params   The parameters passed to exact
+ * @return     The integral, either interpolated or calculated directly
+ *
+ * @details
+ * Temperatures outside the range of the cache, and intervals in which
+ * interpolation has been found to be inaccurate, are integrated directly.
+ * Otherwise the two nodes which bracket t are filled if necessary, and
+ * the interval is checked against the exact value at its midpoint the
+ * first time it is used.
+ *
+ * ### Notes ###
+ * Sirocco is parallelised with MPI, so each rank holds its own cache.
+ * The nodes and the checks depend only on the grid, not on the order in
+ * which cells are processed, so all ranks return the same values.
+ *
+ **********************************************************/
+
+static double
+fb_cache_lookup (struct fb_cache *cache, int nslot, double t, double (*exact) (double, void *), void *params)
+{
+  FbCacheSlotPtr xslot;
+  double lt, frac, y1, y2, ymid, yinterp;
+  int j;
+
+  lt = log10 (t);
+  if (lt < FB_CACHE_LTMIN || lt >= FB_CACHE_LTMAX)
+    return (exact (t, params));
+
+  if ((xslot = cache->slot[nslot]) == NULL)
+  {
+    if ((xslot = cache->slot[nslot] = calloc (1, sizeof (fb_cache_slot_dummy))) == NULL)
+    {
+      Error ("fb_cache_lookup: Unable to allocate memory for a cache slot\n");
+      Exit (1);
+    }
+  }
+
+  j = (int) ((lt - FB_CACHE_LTMIN) / FB_CACHE_DLT);
+  if (j > FB_CACHE_NTEMPS - 2)
+    j = FB_CACHE_NTEMPS - 2;
+
+  if (xslot->state[j] == FB_CACHE_DIRECT)
+    return (exact (t, params));
+
+  y1 = fb_cache_node (xslot, j, exact, params);
+  y2 = fb_cache_node (xslot, j + 1, exact, params);
+
+  if (xslot->state[j] == FB_CACHE_UNCHECKED)
+  {
+    ymid = exact (pow (10., FB_CACHE_LTMIN + FB_CACHE_DLT * (j + 0.5)), params);
+    yinterp = fb_cache_interp (y1, y2, 0.5);
+    if (fabs (yinterp - ymid) <= FB_CACHE_TOL * fabs (ymid))
+      xslot->state[j] = FB_CACHE_INTERP;
+    else
+    {
+      xslot->state[j] = FB_CACHE_DIRECT;
+      return (exact (t, params));
+    }
+  }
+
+  frac = (lt - FB_CACHE_LTMIN) / FB_CACHE_DLT - j;
+  return (fb_cache_interp (y1, y2, frac));
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      returns a band-limited free-bound integral from the cache
+ *
+ * @param [in] double  t   The temperature
+ * @param [in] double  f1   The minimum frequency
+ * @param [in] double  f2   The maximum frequency
+ * @param [in] int  nion   The ion of interest
+ * @param [in] int  fb_choice   FB_FULL, FB_REDUCED or FB_RATE
+ * @param [in] int  mode   OUTER_SHELL or INNER_SHELL
+ * @return     The same quantity as xinteg_fb or xinteg_inner_fb would return
+ *
+ * @details
+ * A table is created for each new frequency band.  If there are more than
+ * FB_CACHE_NBANDS bands, the integrals for the extra bands are calculated
+ * directly.
+ *
+ **********************************************************/
+
+double
+fb_cache_integ (t, f1, f2, nion, fb_choice, mode)
+     double t, f1, f2;
+     int nion;
+     int fb_choice;
+     int mode;
+{
+  struct fb_cache_params params;
+  int n;
+
+  params.f1 = f1;
+  params.f2 = f2;
+  params.nion = nion;
+  params.fb_choice = fb_choice;
+  params.mode = mode;
+  params.cont_ptr = NULL;
+
+  for (n = 0; n < fb_cache_nbands; n++)
+  {
+    if (fb_cache_band[n].f1 == f1 && fb_cache_band[n].f2 == f2)
+      break;
+  }
+
+  if (n == fb_cache_nbands)
+  {
+    if (n == FB_CACHE_NBANDS)
+    {
+      Error ("fb_cache_integ: No space to cache the band %e to %e, increase FB_CACHE_NBANDS\n", f1, f2);
+      return (fb_cache_integ_exact (t, &params));
+    }
+    fb_cache_band[n].f1 = f1;
+    fb_cache_band[n].f2 = f2;
+    fb_cache_band[n].nslots = nions * FB_CACHE_NCHOICE;
+    if ((fb_cache_band[n].slot = calloc (fb_cache_band[n].nslots, sizeof (FbCacheSlotPtr))) == NULL)
+    {
+      Error ("fb_cache_integ: Unable to allocate memory for the band %e to %e\n", f1, f2);
+      Exit (1);
+    }
+    fb_cache_nbands++;
+  }
+
+  return (fb_cache_lookup (&fb_cache_band[n], nion * FB_CACHE_NCHOICE + 3 * (mode - OUTER_SHELL) + fb_choice, t,
+                           fb_cache_integ_exact, &params));
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      returns the integral part of alpha_sp from the cache
+ *
+ * @param [in] struct topbase_phot *  cont_ptr   The photoionization x-section
+ * @param [in] double  t   The temperature
+ * @param [in] int  ichoice   The choice of alpha_sp, see alpha_sp in matom.c
+ * @return     The same value as alpha_sp_integral would return
+ *
+ * @details
+ * The alpha_sp integrals are needed for every cell and every macro-atom
+ * continuum in each ionization cycle, so they share the cache used for
+ * free-bound integrals of simple ions.
+ *
+ **********************************************************/
+
+double
+fb_cache_alpha_sp (cont_ptr, t, ichoice)
+     struct topbase_phot *cont_ptr;
+     double t;
+     int ichoice;
+{
+  struct fb_cache_params params;
+  int nphot;
+
+  params.cont_ptr = cont_ptr;
+  params.fb_choice = ichoice;
+
+  nphot = cont_ptr - phot_top;
+  if (nphot < 0 || nphot >= nphot_total)
+    return (fb_cache_alpha_exact (t, &params));
+
+  if (fb_cache_alpha.slot == NULL)
+  {
+    fb_cache_alpha.nslots = nphot_total * 3;
+    if ((fb_cache_alpha.slot = calloc (fb_cache_alpha.nslots, sizeof (FbCacheSlotPtr))) == NULL)
+    {
+      Error ("fb_cache_alpha_sp: Unable to allocate memory for the cache\n");
+      Exit (1);
+    }
+  }
+
+  return (fb_cache_lookup (&fb_cache_alpha, 3 * nphot + ichoice, t, fb_cache_alpha_exact, &params));
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      returns the blackbody photoionization integral from the cache
+ *
+ * @param [in] struct topbase_phot *  x_ptr   An outer or inner shell photoionization x-section
+ * @param [in] double  t_r   The radiation temperature
+ * @return     The same value as pi_planck_integral would return
+ *
+ * @details
+ * calc_pi_rate needs this integral for every ion in every cell when
+ * the mean intensity is modelled as a dilute blackbody, and it only
+ * depends on the radiation temperature, so it is stored in the same way
+ * as the free-bound integrals. The outer shell x-sections come first
+ * in the table, followed by the inner shell x-sections.
+ *
+ **********************************************************/
+
+double
+fb_cache_pi_planck (x_ptr, t_r)
+     struct topbase_phot *x_ptr;
+     double t_r;
+{
+  struct fb_cache_params params;
+  int nslot;
+
+  params.cont_ptr = x_ptr;
+
+  if (x_ptr >= phot_top && x_ptr < phot_top + nphot_total)
+    nslot = x_ptr - phot_top;
+  else if (x_ptr >= inner_cross && x_ptr < inner_cross + n_inner_tot)
+    nslot = nphot_total + (x_ptr - inner_cross);
+  else
+    return (fb_cache_planck_exact (t_r, &params));
+
+  if (fb_cache_planck.slot == NULL)
+  {
+    fb_cache_planck.nslots = nphot_total + n_inner_tot;
+    if ((fb_cache_planck.slot = calloc (fb_cache_planck.nslots, sizeof (FbCacheSlotPtr))) == NULL)
+    {
+      Error ("fb_cache_pi_planck: Unable to allocate memory for the cache\n");
+      Exit (1);
+    }
+  }
+
+  return (fb_cache_lookup (&fb_cache_planck, nslot, t_r, fb_cache_planck_exact, &params));
+}
+
+
+
 
 
 /**********************************************************/
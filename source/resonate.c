@@ -93,8 +93,13 @@ calculate_ds (w, p, tau_scat, tau, nres, smax, istat)
   double ds_current, ds;
   double dvds_cmf, density_cmf;
   double dvds1, dvds2;
-  struct photon p_start, p_stop, p_now;
+  struct photon p_stop, p_now;
   struct photon p_start_cmf, p_stop_cmf, p_now_cmf;
+  struct ray_velocity ray;
+  double v_start[3], v_now[3], v_stop[3];
+  double freq_now, freq_stop, smax_init;
+  int ray_fitted;
+  double x_res[3];
   int init_dvds;
   double kap_bf_tot, kap_ff, kap_cont, kap_cont_obs;
   double tau_sobolev;
@@ -127,40 +132,69 @@ calculate_ds (w, p, tau_scat, tau, nres, smax, istat)
      frequencies at the ends of the paths, but we do not want photon direction to change to CMF frame
    */
 
-  stuff_phot (p, &p_start);
-  observer_to_local_frame (&p_start, &p_start_cmf);
+  /* The velocity of the wind at the start of the path is kept, since it is
+   * needed again for the continuum opacity */
+
+  vwind_xyz (ndom, p, v_start);
+  observer_to_local_frame_with_v (p, &p_start_cmf, v_start);
 
   stuff_phot (p, &p_stop);
   move_phot (&p_stop, smax);
-  observer_to_local_frame (&p_stop, &p_stop_cmf);
+  vwind_xyz (ndom, &p_stop, v_stop);
+  observer_to_local_frame_with_v (&p_stop, &p_stop_cmf, v_stop);
 
   /* At this point p_start_cmf and p_stop_cmf are in the local frame
    * at the and p_stop is at the maximum distance it can 
    * travel. We want to check that the frequency shift is
    * not too great along the path that a linear approximation
    * to the change in frequency is not reasonable
+   *
+   * With modes.ray_velocity, the velocities at the start, middle and end
+   * of the path are used to fit the velocity along it, and later halvings
+   * of the path use the fit rather than interpolating on the wind grid
    */
 
+  ray_fitted = FALSE;
+  freq_stop = p_stop_cmf.freq;
+  smax_init = smax;
+
   while (smax > wmain[p->grid].dfudge)
   {
-    stuff_phot (p, &p_now);
-    move_phot (&p_now, smax * 0.5);
-    observer_to_local_frame (&p_now, &p_now_cmf);
-    diff = fabs (p_now_cmf.freq - 0.5 * (p_start_cmf.freq + p_stop_cmf.freq)) / p_start_cmf.freq;
+    if (ray_fitted)
+    {
+      freq_now = ray_local_freq (&ray, smax * 0.5);
+    }
+    else
+    {
+      stuff_phot (p, &p_now);
+      move_phot (&p_now, smax * 0.5);
+      vwind_xyz (ndom, &p_now, v_now);
+      observer_to_local_frame_with_v (&p_now, &p_now_cmf, v_now);
+      freq_now = p_now_cmf.freq;
+      if (modes.ray_velocity)
+      {
+        ray_velocity_fit (&ray, p, smax, v_start, v_now, v_stop);
+        ray_fitted = TRUE;
+      }
+    }
+    diff = fabs (freq_now - 0.5 * (p_start_cmf.freq + freq_stop)) / p_start_cmf.freq;
     if (diff < MAXDIFF)
     {
       break;
     }
-    stuff_phot (&p_now, &p_stop);
-    stuff_phot (&p_now_cmf, &p_stop_cmf);
+    freq_stop = freq_now;
     smax *= 0.5;
   }
 
-
+  if (smax < smax_init)
+  {
+    stuff_phot (p, &p_stop);
+    move_phot (&p_stop, smax);
+  }
 
 
   freq_inner = p_start_cmf.freq;
-  freq_outer = p_stop_cmf.freq;
+  freq_outer = freq_stop;
 
   if (freq_inner < 0 || freq_outer < 0)
   {
@@ -186,7 +220,7 @@ calculate_ds (w, p, tau_scat, tau, nres, smax, istat)
 
   if (fabs (dfreq) < EPSILON)
   {
-    Error ("calculate_ds: frequency along photon %d path's in cell %d (nplasma %d) is the same (dfreq=%8.2e)\n", p_now.np, one->nwind,
+    Error ("calculate_ds: frequency along photon %d path's in cell %d (nplasma %d) is the same (dfreq=%8.2e)\n", p->np, one->nwind,
            one->nplasma, dfreq);
     limit_lines (freq_inner, freq_outer);
     nstart = nline_min;
@@ -249,7 +283,7 @@ calculate_ds (w, p, tau_scat, tau, nres, smax, istat)
      230918 - The current version of this added in 87e
    */
 
-  kap_cont_obs = kap_cont * observer_to_local_frame_ds (p, 1.);
+  kap_cont_obs = kap_cont * observer_to_local_frame_ds_with_v (p, 1., v_start);
 
 
   /* Finally begin the loop over the resonances that can interact
@@ -269,7 +303,7 @@ calculate_ds (w, p, tau_scat, tau, nres, smax, istat)
        * within dfudge then we skip over the resonance.
        */
 
-      if (p_now.nres == current_res_number && ds < wmain[p->grid].dfudge)
+      if (p->nres == current_res_number && ds < wmain[p->grid].dfudge)
       {
         continue;
       }
@@ -302,11 +336,14 @@ calculate_ds (w, p, tau_scat, tau, nres, smax, istat)
         nion_for_resonance = lin_ptr[current_res_number]->nion;
 
         /* The density is calculated in the wind array at the center of a cell.
-         * We use that as the first estimate of the density.  */
+         * We use that as the first estimate of the density. Only the position of
+         * the resonance is needed for this, so the photon is not copied and moved
+         * unless the resonance has to be recorded in macro-atom mode */
 
-        stuff_phot (p, &p_now);
-        move_phot (&p_now, ds_current);
-        density_cmf = get_ion_density (ndom, p_now.x, nion_for_resonance);
+        x_res[0] = p->x[0] + p->lmn[0] * ds_current;
+        x_res[1] = p->x[1] + p->lmn[1] * ds_current;
+        x_res[2] = p->x[2] + p->lmn[2] * ds_current;
+        density_cmf = get_ion_density (ndom, x_res, nion_for_resonance);
 
         if (density_cmf > LDEN_MIN)
         {
@@ -314,21 +351,28 @@ calculate_ds (w, p, tau_scat, tau, nres, smax, istat)
            * Otherwise there is no need to do this, especially as dvwind_ds_cmf is an
            * expensive calculation time wise */
 
-          if (init_dvds == FALSE)
+          if (ray_fitted)
           {
-            dvds1 = dvwind_ds_cmf (p);
-            dvds2 = dvwind_ds_cmf (&p_stop);
-            init_dvds = TRUE;
+            dvds_cmf = ray_dvds (&ray, ds_current);
           }
+          else
+          {
+            if (init_dvds == FALSE)
+            {
+              dvds1 = dvwind_ds_cmf (p);
+              dvds2 = dvwind_ds_cmf (&p_stop);
+              init_dvds = TRUE;
+            }
 
-          dvds_cmf = (1. - fraction_to_resonance) * dvds1 + fraction_to_resonance * dvds2;
+            dvds_cmf = (1. - fraction_to_resonance) * dvds1 + fraction_to_resonance * dvds2;
+          }
 
           /* sobolev does not use x, unless density_cmf is less than 0. tau_sobolev is invariant, but all inputs
            * must be in the same frame, using cmf here.  Note that dvds_cmf could be negative, but this is
            * fixed in sobolev. 
            */
 
-          tau_sobolev = sobolev (one, p_now.x, density_cmf, lin_ptr[current_res_number], dvds_cmf);
+          tau_sobolev = sobolev (one, x_res, density_cmf, lin_ptr[current_res_number], dvds_cmf);
           running_tau += tau_sobolev;
 
           if (geo.rt_mode == RT_MODE_MACRO)
@@ -339,6 +383,8 @@ calculate_ds (w, p, tau_scat, tau, nres, smax, istat)
              * second get a pointer to the grid cell where the resonance really happens.
              */
 
+            stuff_phot (p, &p_now);
+            move_phot (&p_now, ds_current);
             check_in_grid = walls (&p_now, p, normal);
 
             if (check_in_grid != P_HIT_STAR && check_in_grid != P_HIT_DISK && check_in_grid != P_ESCAPE)
@@ -21,6 +21,45 @@ int delay_dump_bank_size = 65535, delay_dump_bank_curr = 0;
 int *delay_dump_spec;
 PhotPtr delay_dump_bank;
 
+/* The dump file is held open between batches, with a large buffer so
+ * that it is written in a few big blocks rather than line by line */
+
+#define DELAY_DUMP_STREAM_BUFFER 16777216
+
+FILE *delay_dump_fptr = NULL;
+char *delay_dump_stream_buffer = NULL;
+
+/* Layout of the binary delay dump (-binary_delay_dump). The file starts
+ * with a single header, followed by one fixed size record per photon in
+ * the order they were dumped. Records from different ranks are appended
+ * one after another by delay_dump_combine, so the number of records is
+ * (file size - header size) / record_size, and any record can be read
+ * directly by seeking to it. The record holds the same quantities as a
+ * line of the text file, except for the wavelength, which is c/freq.
+ * py_progs/delay_dump2txt.py converts a binary file to the text format. */
+
+#define DELAY_DUMP_MAGIC "SIRDELAY"
+#define DELAY_DUMP_FORMAT_VERSION 1
+
+typedef struct delay_dump_header
+{
+  char magic[8];
+  int version;
+  int record_size;
+  int n_doubles, n_ints;        /**< Number of doubles and ints at the start of each record */
+  int rank;                     /**< Rank which wrote the file, 0 once the files are combined */
+  int n_ranks;
+} delay_dump_header_dummy;
+
+typedef struct delay_dump_record
+{
+  double freq, w, x[3], delay;
+  int np, nscat, nrscat, spec, origin, nres, line_res;
+  int padding;                  /**< Keeps the record size a multiple of 8 bytes */
+} delay_dump_record_dummy, *DelayDumpRecordPtr;
+
+DelayDumpRecordPtr delay_dump_records;
+
 
 /**********************************************************/
 /** 
@@ -63,6 +102,8 @@ delay_to_observer (PhotPtr pp)
  * run prints out a header for the file. Filename is set per
  * thread. The file is then built up in batches using
  * delay_dump() in increments of #delay_dump_bank_size.
+ * With -binary_delay_dump the file is root.delay_dump.bin,
+ * and starts with a delay_dump_header rather than text.
  *
  * ###Notes###
  * 9/14	-	Written by SWM
@@ -77,16 +118,22 @@ delay_dump_prep (int restart_stat)
   //Get output filename
   if (rank_global > 0)
   {
-    sprintf (delay_dump_file, "%.100s.delay_dump%d", files.root, rank_global);
+    sprintf (delay_dump_file, "%.100s.delay_dump%s%d", files.root, modes.binary_delay_dump ? ".bin" : "", rank_global);
   }
   else
   {
-    sprintf (delay_dump_file, "%.100s.delay_dump", files.root);
+    sprintf (delay_dump_file, "%.100s.delay_dump%s", files.root, modes.binary_delay_dump ? ".bin" : "");
   }
 
   //Allocate and zero dump files and set extract status
   delay_dump_bank = (PhotPtr) calloc (sizeof (p_dummy), delay_dump_bank_size);
   delay_dump_spec = (int *) calloc (sizeof (int), delay_dump_bank_size);
+  delay_dump_records = (DelayDumpRecordPtr) calloc (sizeof (delay_dump_record_dummy), delay_dump_bank_size);
+  if (delay_dump_bank == NULL || delay_dump_spec == NULL || delay_dump_records == NULL)
+  {
+    Error ("delay_dump_prep: Unable to allocate memory for the delay dump bank\n");
+    Exit (0);
+  }
   for (i = 0; i < delay_dump_bank_size; i++)
     delay_dump_spec[i] = 0;
 
@@ -97,6 +144,30 @@ delay_dump_prep (int restart_stat)
   }
 
 
+  if (modes.binary_delay_dump)
+  {
+    delay_dump_header_dummy header;
+
+    if ((fptr = fopen (delay_dump_file, "wb")) == NULL)
+    {
+      Error ("delay_dump_prep: Thread %d failed to open file '%s' due to error %d: %s\n", rank_global, delay_dump_file, errno,
+             strerror (errno));
+      return (0);
+    }
+    memset (&header, 0, sizeof (header));
+    memcpy (header.magic, DELAY_DUMP_MAGIC, sizeof (header.magic));
+    header.version = DELAY_DUMP_FORMAT_VERSION;
+    header.record_size = sizeof (delay_dump_record_dummy);
+    header.n_doubles = 6;
+    header.n_ints = 7;
+    header.rank = rank_global;
+    header.n_ranks = np_mpi_global;
+    fwrite (&header, sizeof (header), 1, fptr);
+    fclose (fptr);
+    Log ("delay_dump_prep: Thread %d successfully prepared binary file '%s' for writing\n", rank_global, delay_dump_file);
+    return (0);
+  }
+
   if ((fptr = fopen (delay_dump_file, "w")) != NULL)
   {                             //If this isn't a continue run, prep the output file
     if (rank_global > 0)
@@ -128,7 +199,8 @@ delay_dump_prep (int restart_stat)
  *
  * @return 					0
  *
- * Dumps the remaining tracked photons to file, frees memory.
+ * Dumps the remaining tracked photons to file, closes the
+ * file and frees memory.
  *
  * ###Notes###
  * 6/15	-	Written by SWM
@@ -136,13 +208,22 @@ delay_dump_prep (int restart_stat)
 int
 delay_dump_finish (void)
 {
-  Log ("delay_dump_finish: Dumping %d photons to file\n", delay_dump_bank_curr - 1);
+  Log ("delay_dump_finish: Dumping %d photons to file\n", delay_dump_bank_curr);
   if (delay_dump_bank_curr > 0)
   {
-    delay_dump (delay_dump_bank, delay_dump_bank_curr - 1);
+    delay_dump (delay_dump_bank, delay_dump_bank_curr);
+    delay_dump_bank_curr = 0;
   }
+  if (delay_dump_fptr != NULL)
+  {
+    fclose (delay_dump_fptr);
+    delay_dump_fptr = NULL;
+  }
+  free (delay_dump_stream_buffer);
   free (delay_dump_bank);
   free (delay_dump_spec);
+  free (delay_dump_records);
+  delay_dump_stream_buffer = NULL;
   return (0);
 }
 
@@ -163,6 +244,12 @@ int
 delay_dump_combine (int i_ranks)
 {
   FILE *fopen ();               //, *f_base, *f_cat;
+
+  if (modes.binary_delay_dump)
+  {
+    return (delay_dump_combine_binary (i_ranks));
+  }
+
   char c_call[LINELENGTH];      //, c_cat[LINELENGTH], c_char;
   //int i;
 /*
@@ -195,6 +282,88 @@ delay_dump_combine (int i_ranks)
   return (0);
 }
 
+/**********************************************************/
+/** 
+ * @brief	Combines the binary delay dump files
+ *
+ * @param [in] i_ranks		Number of parallel processes
+ * @return 					0
+ *
+ * Appends the records in the binary delay dump file of each of
+ * the other ranks to the file written by rank 0, in rank order,
+ * and then removes them. The headers of the other files are
+ * checked, so that files written with a different record layout
+ * are not mixed together.
+ *
+ * ###Notes###
+ * As the records have a fixed size, the records from rank n
+ * start after those of ranks 0 to n-1, and the combined file
+ * does not need a separate index.
+***********************************************************/
+int
+delay_dump_combine_binary (int i_ranks)
+{
+  FILE *f_base, *f_rank;
+  char rank_file[LINELENGTH];
+  delay_dump_header_dummy header;
+  size_t n_read, n_total;
+  int n;
+
+  if ((f_base = fopen (delay_dump_file, "ab")) == NULL)
+  {
+    Error ("delay_dump_combine_binary: Unable to open %s for appending\n", delay_dump_file);
+    return (0);
+  }
+
+  if (delay_dump_stream_buffer == NULL)
+  {
+    delay_dump_stream_buffer = malloc (DELAY_DUMP_STREAM_BUFFER);
+  }
+  if (delay_dump_stream_buffer == NULL)
+  {
+    Error ("delay_dump_combine_binary: Unable to allocate memory for the copy buffer\n");
+    fclose (f_base);
+    return (0);
+  }
+
+  for (n = 1; n < i_ranks; n++)
+  {
+    sprintf (rank_file, "%.200s%d", delay_dump_file, n);
+    if ((f_rank = fopen (rank_file, "rb")) == NULL)
+    {
+      Error ("delay_dump_combine_binary: Missing file %s\n", rank_file);
+      continue;
+    }
+
+    if (fread (&header, sizeof (header), 1, f_rank) != 1 || strncmp (header.magic, DELAY_DUMP_MAGIC, sizeof (header.magic)) != 0
+        || header.version != DELAY_DUMP_FORMAT_VERSION || header.record_size != sizeof (delay_dump_record_dummy))
+    {
+      Error ("delay_dump_combine_binary: %s is not a delay dump file in the current format, not combining it\n", rank_file);
+      fclose (f_rank);
+      continue;
+    }
+
+    n_total = 0;
+    while ((n_read = fread (delay_dump_stream_buffer, 1, DELAY_DUMP_STREAM_BUFFER, f_rank)) > 0)
+    {
+      fwrite (delay_dump_stream_buffer, 1, n_read, f_base);
+      n_total += n_read;
+    }
+    fclose (f_rank);
+
+    Log ("delay_dump_combine_binary: Appended %zu records from %s\n", n_total / sizeof (delay_dump_record_dummy), rank_file);
+    if (remove (rank_file) != 0)
+    {
+      Error ("delay_dump_combine_binary: Unable to remove %s\n", rank_file);
+    }
+  }
+
+  fclose (f_base);
+  free (delay_dump_stream_buffer);
+  delay_dump_stream_buffer = NULL;
+  return (0);
+}
+
 /**********************************************************/
 /** 
  * @brief	Dumps tracked photons to file
@@ -216,19 +385,31 @@ int
 delay_dump (PhotPtr p, int np)
 {
   FILE *fopen (), *fptr;
-  int nphot, mscat, mtopbot, i, subzero;
+  int nphot, mscat, mtopbot, i, subzero, nrecords;
   double delay;
+  DelayDumpRecordPtr record;
   subzero = 0;
+  nrecords = 0;
 
   Log ("delay_dump: Dumping %d photons\n", np);
   /*
-   * Open a file for writing the spectrum
+   * Open the file for writing the photons, if this is the first batch. It
+   * is kept open until delay_dump_finish is called.
    */
-  if ((fptr = fopen (delay_dump_file, "a")) == NULL)
+  if (delay_dump_fptr == NULL)
   {
-    Error ("delay_dump: Unable to reopen %s for writing\n", delay_dump_file);
-    Exit (0);
+    if ((delay_dump_fptr = fopen (delay_dump_file, modes.binary_delay_dump ? "ab" : "a")) == NULL)
+    {
+      Error ("delay_dump: Unable to reopen %s for writing\n", delay_dump_file);
+      Exit (0);
+    }
+    if ((delay_dump_stream_buffer = malloc (DELAY_DUMP_STREAM_BUFFER)) != NULL)
+    {
+      setvbuf (delay_dump_fptr, delay_dump_stream_buffer, _IOFBF, DELAY_DUMP_STREAM_BUFFER);
+    }
   }
+  fptr = delay_dump_fptr;
+
   for (nphot = 0; nphot < np; nphot++)
   {
     /*
@@ -250,17 +431,42 @@ delay_dump (PhotPtr p, int np)
       if (delay < 0)
         subzero++;
 
-      fprintf (fptr, "%-12d %-12.5g %-12.7g %-12.5g %-12.5g %-12.5g %-12.5g %-12d %-12d %-12.5g %-12d %-12d %-12d %-12d\n",
-               p[nphot].np, p[nphot].freq, VLIGHT * 1e8 / p[nphot].freq, p[nphot].w, p[nphot].x[0], p[nphot].x[1], p[nphot].x[2],
-               p[nphot].nscat, p[nphot].nrscat, delay, i - MSPEC, p[nphot].origin, p[nphot].nres, p[nphot].line_res);
+      if (modes.binary_delay_dump)
+      {
+        record = &delay_dump_records[nrecords++];
+        record->freq = p[nphot].freq;
+        record->w = p[nphot].w;
+        record->x[0] = p[nphot].x[0];
+        record->x[1] = p[nphot].x[1];
+        record->x[2] = p[nphot].x[2];
+        record->delay = delay;
+        record->np = p[nphot].np;
+        record->nscat = p[nphot].nscat;
+        record->nrscat = p[nphot].nrscat;
+        record->spec = i - MSPEC;
+        record->origin = p[nphot].origin;
+        record->nres = p[nphot].nres;
+        record->line_res = p[nphot].line_res;
+        record->padding = 0;
+      }
+      else
+      {
+        fprintf (fptr, "%-12d %-12.5g %-12.7g %-12.5g %-12.5g %-12.5g %-12.5g %-12d %-12d %-12.5g %-12d %-12d %-12d %-12d\n",
+                 p[nphot].np, p[nphot].freq, VLIGHT * 1e8 / p[nphot].freq, p[nphot].w, p[nphot].x[0], p[nphot].x[1], p[nphot].x[2],
+                 p[nphot].nscat, p[nphot].nrscat, delay, i - MSPEC, p[nphot].origin, p[nphot].nres, p[nphot].line_res);
+      }
     }
   }
 
+  if (nrecords > 0 && (int) fwrite (delay_dump_records, sizeof (delay_dump_record_dummy), nrecords, fptr) != nrecords)
+  {
+    Error ("delay_dump: Failed to write %d records to %s\n", nrecords, delay_dump_file);
+  }
+
   if (subzero > 0)
   {
     Error ("delay_dump: %d photons with <0 delay found! Increase path bin resolution to minimise this error.", subzero);
   }
-  fclose (fptr);
   return (0);
 }
 
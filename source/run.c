@@ -23,6 +23,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <sys/time.h>
 
 #include "atomic.h"
 #include "sirocco.h"
@@ -59,6 +60,8 @@ calculate_ionization (restart_stat)
   double freqmin, freqmax, x;
   long nphot_to_define, nphot_min;
   int iwind;
+  int nphot, nbatch;
+  struct timeval timer_t0;
 
 
   /* Save the the windfile before the first ionization cycle in order to
@@ -180,8 +183,7 @@ calculate_ionization (restart_stat)
     nphot_to_define = (long) NPHOT;
 
     xsignal (files.root, "%-20s Creating photons before transport\n", "NOK");
-    define_phot (p, freqmin, freqmax, nphot_to_define, CYCLE_IONIZ, iwind, 1);
-    photon_checks (p, freqmin, freqmax, "Check before transport");
+    define_phot (freqmin, freqmax, nphot_to_define, CYCLE_IONIZ, iwind, 1);
 
     /* Zero the arrays, and other variables that need to be zeroed after the photons are generated. */
 
@@ -190,18 +192,7 @@ calculate_ionization (restart_stat)
     geo.lum_disk_back = 0;
 
     /* Prepare qdisk for recording photon pages */
-    qdisk_reinit (p);
-
-
-
-    zz = 0.0;
-    for (nn = 0; nn < NPHOT; nn++)
-    {
-      zz += p[nn].w;
-    }
-
-    Log ("!!sirocco: Total photon luminosity before transphot %18.12e\n", zz);
-    Log_flush ();
+    qdisk_reinit ();
 
     /* kbf_need determines how many & which bf processes one needs to considere.  It was introduced
      * as a way to speed up the program.  It has to be recalculated evey time one changes
@@ -215,12 +206,10 @@ calculate_ionization (restart_stat)
     if (gaunt_n_gsqrd > 0)
       pop_kappa_ff_array ();
 
-    /* Transport the photons through the wind */
-    trans_phot (w, p, FALSE);
-
     /* Determine how much energy was absorbed in the wind. first zero counters. 
        There are counters for total energy absorbed and for each entry in the istat enum,
        The second loop is for the energy radiated (i.e. that actually escapes) */
+    zz = 0.0;
     z_abs_all = z_else = z_abs_all_orig = z_else_orig = 0.0;
     for (nn = 0; nn < N_ISTAT; nn++)
     {
@@ -234,32 +223,69 @@ calculate_ionization (restart_stat)
       radiated_orig[nn] = 0.0;
     }
 
-    /* loop over the different photon istats to determine where the luminosity went */
-    for (nn = 0; nn < NPHOT; nn++)
-    {
+    /* Generate the photons, transport them through the wind and tally them, a batch at a time.
+       Unless a batch size was set with -photon_batch, the batch is the whole cycle */
 
-      z_abs_all += p[nn].w;
-      z_abs_all_orig += p[nn].w_orig;
+    nbatch = phot_batch_size ();
 
-      /* we want the istat to be >1 (not P_SCAT or P_INWIND) */
-      if (p[nn].istat < N_ISTAT)
-      {
-        z_abs[p[nn].istat] += p[nn].w;
-        z_orig[p[nn].istat] += p[nn].w_orig;
-        nphot_istat[p[nn].istat]++;
-      }
-      if (p[nn].istat == P_ESCAPE)
+    xsignal (files.root, "%-20s Photon transport started\n", "NOK");
+    timer_t0 = init_timer_t0 ();
+
+    while ((nphot = next_phot_batch (p, nbatch)) > 0)
+    {
+      photon_checks (p, nphot, freqmin, freqmax, "Check before transport");
+      qdisk_record_emission (p, nphot);
+
+      for (nn = 0; nn < nphot; nn++)
       {
-        radiated[p[nn].origin] += p[nn].w;
-        radiated_orig[p[nn].origin] += p[nn].w_orig;
+        zz += p[nn].w;
       }
-      else
+
+      /* Transport the photons through the wind */
+      trans_phot (w, p, nphot, FALSE);
+
+      /* loop over the different photon istats to determine where the luminosity went */
+      for (nn = 0; nn < nphot; nn++)
       {
-        z_else += p[nn].w;
-        z_else_orig += p[nn].w_orig;
+
+        z_abs_all += p[nn].w;
+        z_abs_all_orig += p[nn].w_orig;
+
+        /* we want the istat to be >1 (not P_SCAT or P_INWIND) */
+        if (p[nn].istat < N_ISTAT)
+        {
+          z_abs[p[nn].istat] += p[nn].w;
+          z_orig[p[nn].istat] += p[nn].w_orig;
+          nphot_istat[p[nn].istat]++;
+        }
+        if (p[nn].istat == P_ESCAPE)
+        {
+          radiated[p[nn].origin] += p[nn].w;
+          radiated_orig[p[nn].origin] += p[nn].w_orig;
+        }
+        else
+        {
+          z_else += p[nn].w;
+          z_else_orig += p[nn].w_orig;
+        }
+
+        if (PLANCK * p[nn].freq > ion[0].ip)
+        {
+          geo.cool_tot_ioniz += p[nn].w;
+          geo.n_ioniz += p[nn].w / (PLANCK * p[nn].freq);
+        }
       }
+
+      photon_checks (p, nphot, freqmin, freqmax, "Check after transport");
+      spectrum_create (p, nphot, geo.nangles, geo.select_extract);
     }
 
+    print_timer_duration ("!!sirocco: photon transport completed in", timer_t0);
+    xsignal (files.root, "%-20s Photon transport completed\n", "NOK");
+
+    Log ("!!sirocco: Total photon luminosity before transphot %18.12e\n", zz);
+    Log_flush ();
+
     for (nn = 0; nn < N_ISTAT; nn++)
     {
       Log ("XXX stat %8d     %8d      %12.3e    %12.3e\n", nn, nphot_istat[nn], z_abs[nn], z_orig[nn]);
@@ -300,8 +326,7 @@ calculate_ionization (restart_stat)
       Log ("!!sirocco: luminosity lost by hitting the secondary %18.12e \n", z_abs[P_SEC]);
 
 
-    photon_checks (p, freqmin, freqmax, "Check after transport");
-    spectrum_create (p, geo.nangles, geo.select_extract);
+    spectrum_create_summary ();
     Log ("!!sirocco: Number of ionizing photons %g lum of ionizing photons %g\n", geo.n_ioniz, geo.cool_tot_ioniz);
 
 
@@ -463,6 +488,8 @@ make_spectra (restart_stat)
   long nphot_to_define;
   int iwind;
   int n;
+  int nphot, nbatch;
+  struct timeval timer_t0;
 
   int icheck;
 
@@ -583,29 +610,43 @@ make_spectra (restart_stat)
     NPHOT = NPHOT_MAX;          // Assure that we really are creating as many photons as we expect.
 
     nphot_to_define = (long) NPHOT *(long) geo.pcycles;
-    define_phot (p, freqmin, freqmax, nphot_to_define, CYCLE_EXTRACT, iwind, 0);
+    define_phot (freqmin, freqmax, nphot_to_define, CYCLE_EXTRACT, iwind, 0);
 
-//    if (modes.save_photons || modes.save_extract_photons)
-//    {
-//      for (n = 0; n < NPHOT; n++)
-//        save_photons (&p[n], "B4Extract");
-//    }
+    /* Generate the photons and transport them through the wind a batch at a time.  Unless
+       a batch size was set with -photon_batch, the batch is the whole cycle */
 
+    nbatch = phot_batch_size ();
 
-    for (icheck = 0; icheck < NPHOT; icheck++)
+    xsignal (files.root, "%-20s Photon transport started\n", "NOK");
+    timer_t0 = init_timer_t0 ();
+
+    while ((nphot = next_phot_batch (p, nbatch)) > 0)
     {
-      if (sane_check (p[icheck].freq))
+//      if (modes.save_photons || modes.save_extract_photons)
+//      {
+//        for (n = 0; n < nphot; n++)
+//          save_photons (&p[n], "B4Extract");
+//      }
+
+      for (icheck = 0; icheck < nphot; icheck++)
       {
-        Error ("sirocco after define phot:sane_check unnatural frequency for photon %d\n", icheck);
+        if (sane_check (p[icheck].freq))
+        {
+          Error ("sirocco after define phot:sane_check unnatural frequency for photon %d\n", p[icheck].np);
+        }
       }
-    }
 
+      /* Tranport photons through the wind */
 
-    /* Tranport photons through the wind */
+      trans_phot (w, p, nphot, geo.select_extract);
+
+      spectrum_create (p, nphot, geo.nangles, geo.select_extract);
+    }
 
-    trans_phot (w, p, geo.select_extract);
+    print_timer_duration ("!!sirocco: photon transport completed in", timer_t0);
+    xsignal (files.root, "%-20s Photon transport completed\n", "NOK");
 
-    spectrum_create (p, geo.nangles, geo.select_extract);
+    spectrum_create_summary ();
 
 /* Write out the detailed spectrum each cycle so that one can see the statistics build up! */
     renorm = ((double) (geo.pcycles)) / (geo.pcycle + 1.0);
@@ -334,6 +334,7 @@ init_advanced_modes ()
 
   //note write_atomicdata  is defined in atomic.h, rather than the modes structure
   write_atomicdata = FALSE;     // print out summary of atomic data
+  use_atomic_image = FALSE;     // read the atomic data from the text files rather than a binary image
 
 
   modes.keep_photoabs = TRUE;   // keep photoabsorption in final spectrum
@@ -350,6 +351,25 @@ init_advanced_modes ()
 
   modes.no_macro_pops_for_ions = FALSE; /* use the ion densities from macro_pops where applicable */
 
+  modes.matrix_solver = MATRIX_SOLVER_GSL;      /* solve rate matrices with GSL unless asked otherwise */
+  modes.te_solver = TE_SOLVER_BRENT;    /* bracket the electron temperature and use zero_find */
+  modes.profile_wind_update = FALSE;    /* do not time the phases of wind_update for each cell */
+  modes.fb_cache = FALSE;       /* integrate free-bound integrals directly, or use the fixed tables */
+  modes.sparse_cell_spec = FALSE;       /* allocate every bin of the cell spectra */
+  modes.compton_tables = FALSE; /* find Compton scattering directions by root finding */
+  modes.binary_delay_dump = FALSE;      /* write the reverberation delay dump as text */
+  modes.photon_batch = 0;       /* generate all of the photons in a cycle at once */
+  modes.stratify = FALSE;       /* draw the random numbers for each source photon independently */
+  modes.model_image = FALSE;    /* read models from the individual files listed for them */
+  modes.ray_velocity = FALSE;   /* interpolate the velocity on the wind grid everywhere along a photon path */
+  modes.disk_table = FALSE;     /* find where photons hit a vertically extended disk by root finding */
+  modes.thin_cells = FALSE;     /* find the resonances in every cell a photon crosses */
+  modes.thin_cells_tau = 1e-3;
+  modes.mrw = FALSE;            /* follow every electron scatter in optically thick cells */
+  modes.mrw_tau = 10.;
+  modes.photon_waves = FALSE;   /* transport the photons of a flight one after another */
+  modes.photon_events = FALSE;  /* do not transport the photons of a flight in queues of events */
+
   return (0);
 }
 
@@ -606,6 +626,7 @@ PhotPtr
 init_photons ()
 {
   PhotPtr p;
+  int nphot_alloc;
 
   /* Although Photons_per_cycle is really an integer,
      read in as a double so it is easier for input
@@ -651,9 +672,6 @@ init_photons ()
     Log ("After that, the windsave file will be written to disk but then the program will exit\n");
   }
 
-  /* Allocate the memory for the photon structure now that NPHOT is established */
-
-  photmain = p = (PhotPtr) calloc (sizeof (p_dummy), NPHOT);
   /* If the number of photons per cycle is changed, NPHOT can be less, so we define NPHOT_MAX
    * to the maximum number of photons that one can create.  NPHOT is used extensively with
    * Python.  It is the NPHOT in a particular cycle, in a given thread.
@@ -661,6 +679,12 @@ init_photons ()
 
   NPHOT_MAX = NPHOT;
 
+  /* Allocate the memory for the photon structure now that NPHOT is established.  If the
+   * photons are generated in batches, only one batch is held at a time */
+
+  nphot_alloc = phot_batch_size ();
+  photmain = p = (PhotPtr) calloc (sizeof (p_dummy), nphot_alloc);
+
 
   if (p == NULL)
   {
@@ -672,8 +696,8 @@ init_photons ()
     /* large photon numbers can cause problems / runs to crash. Report to use (see #209) */
     Log
       ("Allocated %10d bytes for each of %5d elements of photon structure totaling %10.1f Mb \n",
-       sizeof (p_dummy), NPHOT, 1.e-6 * NPHOT * sizeof (p_dummy));
-    if ((NPHOT * sizeof (p_dummy)) > 1e9)
+       sizeof (p_dummy), nphot_alloc, 1.e-6 * nphot_alloc * sizeof (p_dummy));
+    if ((nphot_alloc * sizeof (p_dummy)) > 1e9)
       Error ("Over 1 GIGABYTE of photon structure allocated. Could cause serious problems.\n");
   }
 
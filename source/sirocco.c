@@ -601,6 +601,13 @@ main (argc, argv)
 
   DFUDGE = setup_dfudge ();
 
+  /* The Compton tables are made here, rather than when they are first needed during photon transport */
+
+  if (modes.compton_tables)
+  {
+    init_compton_tables ();
+  }
+
   /* Next line finally defines the wind if this is the initial time this model is being run */
 
   if (geo.run_type == RUN_TYPE_NEW)
@@ -746,6 +753,8 @@ main (argc, argv)
   error_summary ("End of program");     // Summarize the errors that were recorded by the program
 #endif
 
+  free_matrix_workspace ();
+
 #ifdef CUDA_ON
   cusolver_destroy ();
 #endif
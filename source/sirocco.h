@@ -568,6 +568,8 @@ struct geometry
   double xfreq[NXBANDS + 1];    /**<  the frequency boundaries for the coarse spectra  */
 
 #define NBINS_IN_CELL_SPEC   1000       /**< The number of bins in the cell spectra  */
+#define CELL_SPEC_BLOCK_SIZE 50         /**< The number of bins in each separately allocated block of a cell spectrum */
+#define NCELL_SPEC_BLOCKS    (NBINS_IN_CELL_SPEC / CELL_SPEC_BLOCK_SIZE)        /**< The number of blocks in a cell spectrum */
 
   double cell_log_freq_min, cell_log_freq_max, cell_delta_lfreq;        /**< Parameters defining freqency intervals for cell spectra.
                                                                            These are defined as logarithmic frequency intervals */
@@ -862,6 +864,37 @@ wind_dummy, *WindPtr;
 
 extern WindPtr wmain;
 
+/** The weights and vertex data needed to interpolate the velocity of the wind at a position,
+  * as found by coord_stencil.  A stencil belongs to its caller, and is reused from one call to
+  * the next, so the search for the bracketing vertices starts from those of the last position,
+  * and the velocities and velocity gradients at the vertices are only gathered from wmain
+  * when the vertices change.  Set ndom to -1 before the first use. */
+typedef struct wind_stencil
+{
+  int ndom;                     /**< The domain of the last position, or -1 if the stencil is unused */
+  int ix, iz;                   /**< The lower bracketing vertices of the last position */
+  int nelem;                    /**< The number of vertices which contribute, 2 for spherical coordinates, otherwise 4 */
+  int nnn[4];                   /**< The vertices which contribute */
+  double frac[4];               /**< Their weights */
+  int have_v, have_grad;        /**< TRUE once v and v_grad have been gathered for the vertices in nnn */
+  int generation;               /**< The value of stencil_generation when they were gathered */
+  double v[4][3];               /**< The velocities at the vertices */
+  double v_grad[4][3][3];       /**< The velocity gradients at the vertices */
+} stencil_dummy, *StencilPtr;
+
+/* The phases of wind_update which are timed for each cell when modes.profile_wind_update
+   is set.  The phases nest, ION_ABUNDANCES includes all of the others, so
+   the times are inclusive */
+enum wind_update_phase_enum
+{ WU_PHASE_ION_ABUNDANCES = 0,
+  WU_PHASE_SPECTRAL_ESTIMATORS,
+  WU_PHASE_CALC_TE,
+  WU_PHASE_MACRO_POPS,
+  WU_PHASE_MATRIX_SOLVE,
+  WU_PHASE_CONVERGENCE,
+  WU_PHASE_NTYPES
+};
+
 /*****************************PLASMA STRUCTURE**************************/
 /** Plasma is a structure that contains information about the properties of the
  * plasma in regions of the geometry that are actually included in the wind
@@ -870,6 +903,12 @@ extern WindPtr wmain;
 
 typedef struct plasma
 {
+  /* The transport block.  These are the fields which are read for every step a photon
+   * takes through the cell, in calculate_ds, kappa_bf, kappa_ff, radiation and the
+   * scattering routines.  They only change between cycles, and they are kept together
+   * at the start of the structure so that looking up a cell touches as few cache lines
+   * as possible.  Fields should only be added here if the photon loop reads them.
+   */
   int nwind;                    /**<  A cross reference to the corresponding cell in the  wind structure */
   int nplasma;                  /**<  A self reference to this  in the plasma structure */
   double ne;                    /**<  Electron density in the shell (CMF) */
@@ -877,37 +916,43 @@ typedef struct plasma
   double vol;                   /**<  Volume of this cell in CMF frame (more specifically the volume  that is filled with material
                                    which can differs from the valid volume of the cell due to clumping.) */
   double xgamma;                /**<  1./sqrt(1-beta**2) at center of cell */
+  double t_r;                   /**< radiation temperature of cell */
+  double t_e;                   /**< electron temperature of cell */
+  double w;                     /**< The dilution factor of the wind */
+  double kappa_ff_factor;       /**<  Multiplicative factor for calculating the FF heating for a photon. */
   double *density;              /**<  The number density of a specific ion in the CMF.  The order of the ions is
                                    the same as read in by the atomic data routines. */
   double *partition;            /**<  The partition function for each  ion.  */
   double *levden;               /* The number density (occupation number?) of a specific level */
 
-  double kappa_ff_factor;       /**<  Multiplicative factor for calculating the FF heating for a photon. */
+  /* kbf_use and kbf_nuse are set by the routine kbf_need, and they provide indices into the photoinization processes
+   * that are "significant" in a plasma cell, based on the density of a particular ion in a cell and the x-section
+   * at the photoinization edge.  This process was introduced as a means to speed the program up by ignoring those
+   * bf processes that would contribute negligibly to the bf opacity
+   */
 
+  int *kbf_use;                 /**<  List of the indices of the photoionization processes to be used for kappa_bf.  */
+  int kbf_nuse;                 /**<  Total number of photoionization processes to be used for kappa_bf. (SS) */
 
   double *recomb_simple;        /**<  "alpha_e - alpha" (in Leon's notation) for b-f processes in simple atoms. */
   double *recomb_simple_upweight;       /* multiplicative factor to account for ratio of total to "cooling" energy for b-f processes in simple atoms. */
 
+  /* End of the transport block.  The estimators which are accumulated as photons pass
+   * through the cell, and the quantities derived from them in the ionization calculation,
+   * follow, and the large diagnostic arrays are at the end of the structure.
+   */
+
 /* Beginning of macro information */
   double kpkt_emiss;            /**< This is the luminosity produced due to the conversion k-packet -> r-packet in the cell
                                    in the frequency range that is required for the final spectral synthesis. (SS) */
 
   double kpkt_abs;              /**<  k-packet equivalent of matom_abs. (SS) */
 
-  /* kbf_use and kbf_nuse are set by the routine kbf_need, and they provide indices into the photoinization processes
-   * that are "significant" in a plasma cell, based on the density of a particular ion in a cell and the x-section
-   * at the photoinization edge.  This process was introduced as a means to speed the program up by ignoring those
-   * bf processes that would contribute negligibly to the bf opacity
-   */
-
-  int *kbf_use;                 /**<  List of the indices of the photoionization processes to be used for kappa_bf.  */
-  int kbf_nuse;                 /**<  Total number of photoionization processes to be used for kappa_bf. (SS) */
-
 /* End of macro information */
 
 
-  double t_r, t_r_old;          /**< radiation temperature of cell */
-  double t_e, t_e_old;          /**< electron temperature of cell */
+  double t_r_old;               /**< radiation temperature of cell in the previous cycle */
+  double t_e_old;               /**< electron temperature of cell in the previous cycle */
   double dt_e, dt_e_old;        /**< How much t_e changed in the previous iteration */
   double heat_tot, heat_tot_old;        /**<  heating from all sources */
   double abs_tot;
@@ -921,7 +966,6 @@ typedef struct plasma
   double heat_ch_ex;
   double abs_photo, abs_auger;  /**<  this is the energy absorbed from the photon due to these processes - different from
                                    the heating rate because of the binding energy */
-  double w;                     /**< The dilution factor of the wind */
 
   int ntot;                     /**< Total number of photon passages */
 
@@ -990,22 +1034,6 @@ typedef struct plasma
   double exp_temp[NXBANDS];     /**<  The effective temperature of an exponential representation of the radiation field in a cell */
   double exp_w[NXBANDS];        /**<  The prefactor of an exponential representation of the radiation field in a cell */
 
-  double cell_spec_flux[NBINS_IN_CELL_SPEC];    /**< The array where the cell spectra are accumulated. */
-
-#define NFLUX_ANGLES 36 /**< The number of bins into which the directional flux is calculated */
-
-
-  /*Binned fluxes */
-  double F_UV_ang_theta[NFLUX_ANGLES];
-  double F_UV_ang_phi[NFLUX_ANGLES];
-  double F_UV_ang_r[NFLUX_ANGLES];
-
-
-  /*A version of the binned flux that is averaged over cycles */
-  double F_UV_ang_theta_persist[NFLUX_ANGLES];
-  double F_UV_ang_phi_persist[NFLUX_ANGLES];
-  double F_UV_ang_r_persist[NFLUX_ANGLES];
-
   /* The term direct here means from photons which have not been scattered. These are photons which have been
      created by the central object, or the disk, or in the simple case the wind, but which have not undergone
      any kind of interaction which would change their direction
@@ -1040,11 +1068,6 @@ typedef struct plasma
                                                         into and from ionization pool
                                                         in BF_SIMPLE_EMISSIVITY_APPROACH
                                                         */
-#define N_PHOT_PROC 500
-  int n_bf_in[N_PHOT_PROC], n_bf_out[N_PHOT_PROC];
-                                                 /**<Counters to track bf excitations and de-exitations.
-                                                   */
-
   double comp_nujnu;            /**<  The integral of alpha(nu)nuj(nu) used to
                                    compute compton cooling-  only needs computing once per cycle
                                  */
@@ -1087,6 +1110,11 @@ typedef struct plasma
      of the convergence checks indicated convergence. converging is an indicator of whether
      the program thought the cell is on the way to convergence 0 implies converging */
 
+  int te_nevals;                /**< The number of evaluations of zero_emit used by calc_te in the last
+                                  ionization cycle, or 0 if calc_te was not called */
+  double wu_time[WU_PHASE_NTYPES];      /**< The wall-clock time in seconds spent in each phase of wind_update
+                                          for this cell in the last ionization cycle, if -profile_wind_update is set */
+
 #define CELL_CONVERGING 0       /*  converging - temperature is oscillating and decreasing */
 #define CELL_NOT_CONVERGING 1   /*  not converging (temperature is shooting off in one direction) */
 #define CONVERGENCE_CHECK_PASS 0        /* Cell has passed a convergence check */
@@ -1097,6 +1125,31 @@ typedef struct plasma
                                   divided by the number density of hydrogen for the cell.  This is the definnition used in Cloudy */
   double xi;                    /**<  Ionization parameter as defined by Tarter, Tucker, and Salpeter  1969 (ApJ 156, 943).  
                                   It is the ionizing flux over the number of hydrogen atoms */
+
+  /* The large arrays of spectra, binned fluxes and counters, which are mainly
+   * diagnostics, are kept at the end of the structure, away from the transport block */
+
+  double *cell_spec_block[NCELL_SPEC_BLOCKS];   /**< The cell spectrum, stored as blocks of CELL_SPEC_BLOCK_SIZE bins. A
+                                                  * NULL block holds no flux. Access through cell_spec_get and cell_spec_add */
+
+#define NFLUX_ANGLES 36 /**< The number of bins into which the directional flux is calculated */
+
+
+  /*Binned fluxes */
+  double F_UV_ang_theta[NFLUX_ANGLES];
+  double F_UV_ang_phi[NFLUX_ANGLES];
+  double F_UV_ang_r[NFLUX_ANGLES];
+
+
+  /*A version of the binned flux that is averaged over cycles */
+  double F_UV_ang_theta_persist[NFLUX_ANGLES];
+  double F_UV_ang_phi_persist[NFLUX_ANGLES];
+  double F_UV_ang_r_persist[NFLUX_ANGLES];
+
+#define N_PHOT_PROC 500
+  int n_bf_in[N_PHOT_PROC], n_bf_out[N_PHOT_PROC];
+                                                 /**<Counters to track bf excitations and de-exitations.
+                                                   */
 } plasma_dummy, *PlasmaPtr;
 
 extern PlasmaPtr plasmamain;
@@ -1253,11 +1306,16 @@ extern int size_Jbar_est, size_gamma_est, size_alpha_est;
   */
 typedef struct photon
 {
+  /* The fields used as a photon is transported through the wind come first,
+     so that they are packed together in memory. The fields after np are
+     bookkeeping, which is mostly only read when the spectra are made */
+
   double x[3];                  /**<  The position of packet */
   double lmn[3];                /**<  Direction cosines of the packet */
-  double freq, freq_orig;       /**<  current, original frequency (redshifted) of this packet */
-  double w, w_orig;             /**<  current and original weight of this packet */
+  double freq;                  /**<  current frequency (redshifted) of this packet */
+  double w;                     /**<  current weight of this packet */
   double tau;                   /**<  optical depth of the photon since its creation or last interaction */
+  double ds;                    /* the distance a photon has moved since its creation or last interaction */
 
 #define N_ISTAT 13              /**<  number of entries in the istat_enum */
   enum istat_enum
@@ -1283,24 +1341,30 @@ typedef struct photon
     F_OBSERVER = 1   /**< The photon is in the observer frame */
   } frame;
 
-  int nscat;         /**< Number of scatters for this photon */
-  int nrscat;        /**<  number of resonance scatterings */
-  int nmacro;        /**<  number of macro atom interactions */
-
+  int grid;          /**< grid position of the photon in the wind, if
+                       * the photon is in the wind.  If the photon is not
+                       * in the wind, then -1 implies inside the wind cone and
+                       * -2 implies outside the wind */
   int nres;          /**< For line scattering, indicates the actual transition;
                                    for continuum scattering, meaning
                                    depends on matom vs non-matom. See headers of emission.c
                                    or matom.c for details. */
+  int nscat;         /**< Number of scatters for this photon */
+  int np;                       /* The photon number, which eases tracking a photon for diagnostic
+                                   purposes */
+
+  double freq_orig;             /**<  original frequency (redshifted) of this packet */
+  double w_orig;                /**<  original weight of this packet */
+  double path;                  /* The total path length of a photon (used for reverberation calcuations) */
+
+  int nrscat;        /**<  number of resonance scatterings */
+  int nmacro;        /**<  number of macro atom interactions */
   int line_res;      /**<  The line which a photon belongs to. A photon can tagged as a line, then continuum
                                    scatter. line_res will still be tagged as the same line until it scatters off another line. */
   int nnscat;        /**<  Used for the thermal trapping model of
                        * anisotropic scattering to carry the number of
                        * scattering to "extract" when needed for wind
                        * generated photons SS05. */
-  int grid;          /**< grid position of the photon in the wind, if
-                       * the photon is in the wind.  If the photon is not
-                       * in the wind, then -1 implies inside the wind cone and
-                       * -2 implies outside the wind */
 
   enum origin_enum
   { PTYPE_STAR = 0,
@@ -1324,13 +1388,31 @@ typedef struct photon
      Comment - ksl - 180712 - The logic for all of this is obscure to me, since we keep track of the
      photons origin separately.  At some point one might want to revisit the necessity for this
    */
-  int np;                       /* The photon number, which eases tracking a photon for diagnostic
-                                   purposes */
-  double path;                  /* The total path length of a photon (used for reverberation calcuations) */
-  double ds;                    /* the distance a photon has moved since its creation or last interaction */
 }
 p_dummy, *PhotPtr;
 
+/** The state of a photon during its flight through the wind, which trans_phot_step
+  * carries from one cell to the next */
+typedef struct transport_state
+{
+  struct photon pp;             /**< The photon at the point it has reached */
+  double tau_scat;              /**< The optical depth at which the photon will next scatter */
+  double tau;                   /**< The optical depth the photon has travelled since it last scattered */
+  double weight_min;            /**< The weight below which the photon is considered to be absorbed */
+  int istat;                    /**< The outcome of the last move of the photon */
+  int nres;                     /**< The resonance at which the photon stopped in its last move */
+  double normal[3];             /**< The normal to the surface the photon hit in its last move */
+} transport_dummy, *TransportPtr;
+
+/** A quadratic model of the wind velocity along a straight segment of the path of a
+  * photon, v(s) = v0 + a s + b s^2, which is fitted by ray_velocity_fit */
+typedef struct ray_velocity
+{
+  double v0[3], a[3], b[3];     /**< The coefficients of the model */
+  double lmn[3];                /**< The direction of the photon */
+  double freq;                  /**< The frequency of the photon in the observer frame */
+} ray_dummy, *RayVelPtr;
+
 #define NRES_ES (-1)
 #define NRES_FF (-2)
 #define NRES_NOT_SET (-3)
@@ -1388,6 +1470,7 @@ typedef struct spectrum
   char name[40];
   double freqmin, freqmax, dfreq;
   double lfreqmin, lfreqmax, ldfreq;    /**<  NSH 1302 - values for logarithmic spectra */
+  double inv_dfreq, inv_ldfreq; /**<  1/dfreq and 1/ldfreq, used to find the bin a photon falls in */
   double lmn[3];
   double mmax, mmin;            /**<  Used only in live or die situations, mmax=cos(angle-DANG_LIVE_OR_DIE)
                                   * and mmim=cos(angle+DANG_LIVE_OR_DIE).   In actually defining this
@@ -1542,6 +1625,31 @@ enum partial_cells_enum
                       */
 };
 
+enum te_solver_enum
+{ TE_SOLVER_BRENT = 0,    /**< Bracket the temperature with tmin and tmax, and use zero_find */
+  TE_SOLVER_SECANT = 1    /**< Start from the current temperature and use a safeguarded secant method,
+                            * caching the temperature dependent rate coefficients */
+};
+
+#define TE_SOLVER_TOL        50.        /**< The tolerance in K to which calc_te finds a temperature */
+#define TE_SOLVER_FIRST_STEP 0.02       /**< The fractional size of the first step taken by calc_te_secant */
+#define TE_SOLVER_MAX_ITER   50         /**< The maximum number of iterations in calc_te_secant */
+
+/* The sets of temperature dependent rate coefficients which can be cached by calc_te */
+enum te_coeff_enum
+{ TE_COEFF_DR = 0,
+  TE_COEFF_DI = 1,
+  TE_COEFF_QRECOMB = 2,
+  TE_COEFF_NTYPES = 3
+};
+
+enum matrix_solver_enum
+{ MATRIX_SOLVER_GSL = 0,  /**< Solve linear systems with the GSL LU routines */
+  MATRIX_SOLVER_LU = 1    /**< Solve linear systems with the dense LU solver in matrix_cpu.c,
+                            * which re-uses its workspace and is faster for small matrices
+                            */
+};
+
 
 /***********************ADVANCED_MODES STRUCTURE **********************/
 /**
@@ -1631,6 +1739,40 @@ struct advanced_modes
                                   that make it less useful than it might seem. */
   int no_macro_pops_for_ions;     /* if true, then use the ion densities from the ionization mode
                                      for macro-atoms, rather than from macro_pops */
+  int matrix_solver;              /**< The backend used by solve_matrix and invert_matrix on the CPU,
+                                    * set with the -matrix_solver command line option */
+  int te_solver;                  /**< The method used by calc_te to find the electron temperature,
+                                    * set with the -te_solver command line option */
+  int profile_wind_update;        /**< if true, time the phases of wind_update for each cell and write
+                                    * a report each cycle, set with -profile_wind_update */
+  int fb_cache;                   /**< if true, free-bound, alpha_sp and blackbody photoionization integrals
+                                    * are interpolated from a cache in recomb.c, set with -fb_cache */
+  int sparse_cell_spec;           /**< if true, blocks of the cell spectra are only allocated once a photon
+                                    * deposits flux in them, set with -sparse_cell_spec */
+  int compton_tables;             /**< if true, Compton scattering directions, reweighting and thermal electron
+                                    * speeds are interpolated from tables, set with -compton_tables */
+  int binary_delay_dump;          /**< if true, reverberation photons are dumped as fixed size binary records
+                                    * to root.delay_dump.bin, set with -binary_delay_dump */
+  int photon_batch;               /**< if greater than 0, the maximum number of photons per MPI task which
+                                    * are generated, transported and tallied together, set with -photon_batch */
+  int stratify;                   /**< if true, the random numbers used to generate star, disk and wind photons
+                                    * are stratified over the photons made in each call, set with -stratify */
+  int model_image;                /**< if true, lists of models are read from, and saved to, a binary image
+                                    * of the list, set with -model_image */
+  int ray_velocity;               /**< if true, calculate_ds uses a quadratic fit to the velocity along the path
+                                    * of a photon through a cell, set with -ray_velocity */
+  int disk_table;                 /**< if true, ds_to_disk uses a table of the surface of a vertically extended disk,
+                                    * set with -disk_table */
+  int thin_cells;                 /**< if true, photons cross cells which are optically thin at their frequency
+                                    * without finding resonances, set with -thin_cells */
+  double thin_cells_tau;          /**< the optical depth below which a cell is considered thin */
+  int mrw;                        /**< if true, photons take modified random walk steps through cells which
+                                    * are optically thick to electron scattering, set with -mrw */
+  double mrw_tau;                 /**< the optical depth to the nearest cell wall above which a step is taken */
+  int photon_waves;               /**< if true, the photons of a flight are transported together in waves, sorted
+                                    * by wind cell, set with -photon_waves */
+  int photon_events;              /**< if true, the photons of a flight are transported together in queues by
+                                    * the event they are waiting for, set with -photon_events */
 };
 
 extern struct advanced_modes modes;
@@ -54,16 +54,18 @@ void
 create_optical_depth_spectrum (double u_freq_min, double u_freq_max, double *input_inclinations)
 {
   int i, j;
+  int j_start, j_stop;
   int err;
   double *tau_spectrum;
-  double c_optical_depth, c_column_density;
-  double c_frequency, freq_min, freq_max, d_freq;
+  double freq_min, freq_max, d_freq;
   struct photon photon;
+  SightLinePath_t path = { 0, 0, NULL, 0.0 };
 
   int n_inclinations;
   SightLines_t *inclinations = initialize_inclination_angles (&n_inclinations, input_inclinations);
 
-  printf ("Creating optical depth spectra:\n");
+  if (rank_global == 0)
+    printf ("Creating optical depth spectra:\n");
 
   tau_spectrum = calloc (n_inclinations * NUM_FREQUENCY_BINS, sizeof *tau_spectrum);
   if (tau_spectrum == NULL)
@@ -135,36 +137,41 @@ create_optical_depth_spectrum (double u_freq_min, double u_freq_max, double *inp
   kbf_need (freq_min, freq_max);
 
   /*
-   * Now create the optical depth spectra for each inclination
+   * Now create the optical depth spectra for each inclination. The path along
+   * each sight line does not depend on frequency, so it is traced once and
+   * then used for every frequency bin. The frequency bins are split between
+   * the MPI ranks, and the spectra are collected on rank 0 to be written out
    */
 
+  get_parallel_nrange (rank_global, NUM_FREQUENCY_BINS, np_mpi_global, &j_start, &j_stop);
+
   for (i = 0; i < n_inclinations; i++)
   {
-    printf ("  - Creating spectrum: %s\n", inclinations[i].name);
-    c_frequency = log10 (freq_min);
+    if (rank_global == 0)
+      printf ("  - Creating spectrum: %s\n", inclinations[i].name);
 
-    for (j = 0; j < NUM_FREQUENCY_BINS; j++)
+    err = create_photon (&photon, freq_min, inclinations[i].lmn);
+    if (err == EXIT_FAILURE)
     {
-      c_optical_depth = 0.0;
-      c_column_density = 0.0;
-
-      err = create_photon (&photon, pow (10, c_frequency), inclinations[i].lmn);
-      if (err == EXIT_FAILURE)
-      {
-        errormsg ("skipping photon of frequency %e\n", pow (10, c_frequency));
-        continue;
-      }
+      errormsg ("skipping sight line %s\n", inclinations[i].name);
+      continue;
+    }
 
-      err = integrate_tau_across_wind (&photon, &c_column_density, &c_optical_depth);
-      if (err == EXIT_FAILURE)
-        continue;
+    err = trace_sight_line (&photon, &path);
+    if (err == EXIT_FAILURE)
+      continue;
 
-      tau_spectrum[i * NUM_FREQUENCY_BINS + j] = c_optical_depth;
-      c_frequency += d_freq;
+    for (j = j_start; j < j_stop; j++)
+    {
+      tau_spectrum[i * NUM_FREQUENCY_BINS + j] = integrate_tau_along_path (&path, pow (10, log10 (freq_min) + j * d_freq));
     }
   }
 
-  write_optical_depth_spectrum (inclinations, n_inclinations, tau_spectrum, freq_min, d_freq);
+  reduce_results_to_root (tau_spectrum, n_inclinations * NUM_FREQUENCY_BINS);
+  if (rank_global == 0)
+    write_optical_depth_spectrum (inclinations, n_inclinations, tau_spectrum, freq_min, d_freq);
+
+  free (path.steps);
   free (tau_spectrum);
   free (inclinations);
 }
@@ -197,10 +204,11 @@ void
 evaluate_photoionization_edges (double *input_inclinations)
 {
   int i, j;
+  int i_start, i_stop;
   int err;
-  double c_frequency, c_optical_depth, c_column_density;
   double *optical_depth_values = NULL, *column_density_values = NULL;
   struct photon photon;
+  SightLinePath_t path = { 0, 0, NULL, 0.0 };
   enum RunModeEnum original_run_mode = RUN_MODE;
   RUN_MODE = RUN_MODE_NO_ES_OPACITY;
 
@@ -231,35 +239,39 @@ evaluate_photoionization_edges (double *input_inclinations)
   }
 
   /*
-   * Now extract the optical depths and mass column densities. We loop over
-   * each PI edge for each inclination angle.
+   * Now extract the optical depths and mass column densities. Each sight line
+   * is traced once and the optical depth found along it for each PI edge.
+   * The sight lines are split between the MPI ranks.
    */
 
-  for (i = 0; i < n_inclinations; i++)
+  get_parallel_nrange (rank_global, n_inclinations, np_mpi_global, &i_start, &i_stop);
+
+  for (i = i_start; i < i_stop; i++)
   {
-    for (j = 0; j < n_edges; j++)
+    err = create_photon (&photon, edges[0].freq, inclinations[i].lmn);
+    if (err == EXIT_FAILURE)
     {
-      c_optical_depth = 0.0;
-      c_column_density = 0.0;
-      c_frequency = edges[j].freq;
-
-      err = create_photon (&photon, c_frequency, inclinations[i].lmn);
-      if (err == EXIT_FAILURE)
-      {
-        errormsg ("skipping photon of frequency %e\n", c_frequency);
-        continue;
-      }
+      errormsg ("skipping sight line %s\n", inclinations[i].name);
+      continue;
+    }
 
-      err = integrate_tau_across_wind (&photon, &c_column_density, &c_optical_depth);
-      if (err == EXIT_FAILURE)
-        continue;               // do not throw extra warning when one is already thrown in integrate_tau_across_wind
+    err = trace_sight_line (&photon, &path);
+    if (err == EXIT_FAILURE)
+      continue;                 // do not throw extra warning when one is already thrown in trace_sight_line
 
-      optical_depth_values[i * n_edges + j] = c_optical_depth;
-      column_density_values[i] = c_column_density;
+    for (j = 0; j < n_edges; j++)
+    {
+      optical_depth_values[i * n_edges + j] = integrate_tau_along_path (&path, edges[j].freq);
     }
+    column_density_values[i] = path.column_density;
   }
 
-  print_optical_depths (inclinations, n_inclinations, edges, n_edges, optical_depth_values, column_density_values);
+  reduce_results_to_root (optical_depth_values, n_inclinations * n_edges);
+  reduce_results_to_root (column_density_values, n_inclinations);
+  if (rank_global == 0)
+    print_optical_depths (inclinations, n_inclinations, edges, n_edges, optical_depth_values, column_density_values);
+
+  free (path.steps);
   free (inclinations);
   free (optical_depth_values);
   free (column_density_values);
@@ -282,6 +294,7 @@ void
 find_photosphere (void)
 {
   int i, err;
+  int i_start, i_stop;
   double optical_depth, column_density;
   struct photon photon;
   SightLines_t *inclinations;
@@ -302,9 +315,17 @@ find_photosphere (void)
 
   const double test_freq = 8e14;        // todo: this probably need to be a possible input
 
-  printf ("Locating electron scattering photosphere surface for tau_es = %f\n", TAU_DEPTH);
+  if (rank_global == 0)
+    printf ("Locating electron scattering photosphere surface for tau_es = %f\n", TAU_DEPTH);
 
-  for (i = 0; i < n_inclinations; i++)
+  /*
+   * The sight lines are split between the MPI ranks. Each photon stops at a
+   * different optical depth, so these are traced one at a time
+   */
+
+  get_parallel_nrange (rank_global, n_inclinations, np_mpi_global, &i_start, &i_stop);
+
+  for (i = i_start; i < i_stop; i++)
   {
     err = create_photon (&photon, test_freq, inclinations[i].lmn);
     if (err)
@@ -327,7 +348,9 @@ find_photosphere (void)
     positions[i].z = photon.x[2];
   }
 
-  write_photosphere_location_to_file (positions, n_inclinations);
+  reduce_results_to_root ((double *) positions, n_inclinations * sizeof (Positions_t) / sizeof (double));
+  if (rank_global == 0)
+    write_photosphere_location_to_file (positions, n_inclinations);
   free (inclinations);
   free (positions);
 }
@@ -352,6 +375,8 @@ print_help (void)
     "If none of these have been defined, then a set of default lines of sight are used\n"
     "instead or can be specified using -i. This program can also find the surface of\n"
     "constant electron scattering optical using the -p option.\n\n"
+    "It can be run with mpirun, in which case the sight lines, or the frequencies\n"
+    "of the optical depth spectra, are split between the processes.\n\n"
     "Please see below for a list of all flags.\n\n"
     "-h               Print this help message and exit\n"
     "-d ndom          Set the domain to launch photons from\n"
@@ -591,6 +616,21 @@ main (int argc, char *argv[])
   char windsave_filename[LINELENGTH + 24];
   char specsave_filename[LINELENGTH + 24];
 
+  /*
+   * Initialize MPI. The sight lines, or the frequencies along them, are split
+   * between ranks and the results are written out by rank 0
+   */
+
+#ifdef MPI_ON
+  MPI_Init (&argc, &argv);
+  MPI_Comm_rank (MPI_COMM_WORLD, &rank_global);
+  MPI_Comm_size (MPI_COMM_WORLD, &np_mpi_global);
+#else
+  rank_global = 0;
+  np_mpi_global = 1;
+#endif
+  Log_set_mpi_rank (rank_global, np_mpi_global);
+
   timer ();
 
   /*
@@ -711,5 +751,9 @@ main (int argc, char *argv[])
 
   error_summary ("end of program");
 
+#ifdef MPI_ON
+  MPI_Finalize ();
+#endif
+
   return EXIT_SUCCESS;
 }
@@ -54,6 +54,29 @@ typedef struct Positions_s
   double x, y, z;
 } Positions_t;
 
+/** Structure to hold one step of a photon along a sight line, within a single
+  * cell, so the optical depth can be found at many frequencies from one trace
+  */
+
+typedef struct PathStep_s
+{
+  struct photon p_start;        // the photon at the start of the step, in the observer frame
+  double ds;                    // the length of the step
+  double ratio_inner;           // the ratio of the CMF to observer frequency at the start of the step
+  double ratio_mean;            // the ratio of the mean CMF frequency along the step to the observer frequency
+} PathStep_t;
+
+/** Structure to hold the path of a photon along a sight line through the wind
+  */
+
+typedef struct SightLinePath_s
+{
+  int n_steps;
+  int n_alloc;
+  PathStep_t *steps;
+  double column_density;
+} SightLinePath_t;
+
 /** Enumerator used to control the column density which is extracted, i.e. by
   * default mass density/N_H is extracted by the density of an ion can also
   * be extracted
@@ -90,8 +113,11 @@ extern double TAU_DEPTH;
 // External functions from other files
 
 int create_photon (PhotPtr p_out, double freq, double *lmn);
+void reduce_results_to_root (double *values, int n_values);
 SightLines_t *initialize_inclination_angles (int *n_angles, double *input_inclinations);
 int integrate_tau_across_wind (PhotPtr photon, double *c_column_density, double *c_optical_depth);
+int trace_sight_line (PhotPtr photon, SightLinePath_t * path);
+double integrate_tau_along_path (SightLinePath_t * path, double freq);
 void print_optical_depths (SightLines_t * inclinations, int n_inclinations, Edges_t edges[], int n_edges, double *optical_depth,
                            double *column_density);
 void write_optical_depth_spectrum (SightLines_t * inclinations, int n_inclinations, double *tau_spectrum, double freq_min, double d_freq);
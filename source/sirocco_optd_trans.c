@@ -20,66 +20,41 @@ static const double MAXDIFF = VCHECK / VLIGHT;  // For linear velocity requireme
 
 /* ************************************************************************* */
 /**
- * @brief  Calculate the total optical depth a photon experiences across the
- *         cell of distance SMAX_FRAC * smax.
+ * @brief  Find the distance a photon can move across its current cell.
+ *
  * @param[in]  photon  The photon packet
- * @param[in,out]  *c_column_density  The column density the photon has moved
- *                                    through
- * @param[in,out]  *c_optical_depth  The optical depth experienced by the photon
+ * @param[out]  *smax  The distance the photon can move
+ * @param[out]  *freq_inner  The CMF frequency at the start of the path
+ * @param[out]  *freq_outer  The CMF frequency at the end of the path
  *
- * @return p_istat  The current photon status or EXIT_FAILURE on failure.
+ * @return  EXIT_SUCCESS or EXIT_FAILURE
  *
  * @details
  *
- * This function is concerned with finding the opacity of the photon's current
- * cell, the distance the photon can move in the cell and hence it increments
- * the optical depth tau a photon has experienced as it moves through the wind.
+ * The distance is SMAX_FRAC * smax, reduced further until the change in
+ * frequency along the path is close enough to linear. None of this depends on
+ * the frequency of the photon, other than that the CMF frequencies scale with
+ * it, which is what lets trace_sight_line reuse one path for every frequency.
  *
  * ************************************************************************** */
 
 int
-integrate_tau_across_cell (PhotPtr photon, double *c_column_density, double *c_optical_depth)
+find_cell_path_length (PhotPtr photon, double *smax, double *freq_inner, double *freq_outer)
 {
-  int p_istat;
-  int n_domain, n_plasma;
-  double kappa_total, density;
-  double smax, diff;
-  double freq_inner, freq_outer, mean_freq;
-  WindPtr c_wind_cell;
-  PlasmaPtr c_plasma_cell;
+  double diff;
   struct photon p_start, p_stop, p_now;
 
   photon->grid = where_in_grid (wmain[photon->grid].ndom, photon->x);
   if (photon->grid < 0)
   {
-    printf ("integrate_tau_across_cell: photon is not in a grid cell\n");
+    printf ("find_cell_path_length: photon is not in a grid cell\n");
     return EXIT_FAILURE;
   }
 
-  /*
-   * Determine where in the plasma grid the cell is. This is required so a
-   * column density can be calculated. Also calculate the maximum distance the
-   * photon can traverse across the cell
-   */
-
-  c_wind_cell = &wmain[photon->grid];
-  n_domain = c_wind_cell->ndom;
-  n_plasma = wmain[photon->grid].nplasma;
-  c_plasma_cell = &plasmamain[n_plasma];
-
-  if (COLUMN_MODE == COLUMN_MODE_RHO)
-  {
-    density = c_plasma_cell->rho;
-  }
-  else
-  {
-    density = c_plasma_cell->density[COLUMN_MODE_ION_NUMBER];
-  }
-
-  smax = smax_in_cell (photon) * SMAX_FRAC;
-  if (smax < 0)
+  *smax = smax_in_cell (photon) * SMAX_FRAC;
+  if (*smax < 0)
   {
-    errormsg ("smax %e < 0 in cell %d\n", smax, photon->grid);
+    errormsg ("smax %e < 0 in cell %d\n", *smax, photon->grid);
     return EXIT_FAILURE;
   }
 
@@ -90,7 +65,7 @@ integrate_tau_across_cell (PhotPtr photon, double *c_column_density, double *c_o
 
   observer_to_local_frame (photon, &p_start);
   stuff_phot (photon, &p_stop);
-  move_phot (&p_stop, smax);
+  move_phot (&p_stop, *smax);
   observer_to_local_frame (&p_stop, &p_stop);
 
   /* At this point p_start and p_stop are in the local frame
@@ -100,21 +75,43 @@ integrate_tau_across_cell (PhotPtr photon, double *c_column_density, double *c_o
    * to the change in frequency is not reasonable
    */
 
-  while (smax > DFUDGE)
+  while (*smax > DFUDGE)
   {
     stuff_phot (photon, &p_now);
-    move_phot (&p_now, smax * 0.5);
+    move_phot (&p_now, *smax * 0.5);
     observer_to_local_frame (&p_now, &p_now);
     diff = fabs (p_now.freq - 0.5 * (p_start.freq + p_stop.freq)) / p_start.freq;
     if (diff < MAXDIFF)
       break;
     stuff_phot (&p_now, &p_stop);
-    smax *= 0.5;
+    *smax *= 0.5;
   }
 
-  freq_inner = p_start.freq;
-  freq_outer = p_stop.freq;
-  mean_freq = 0.5 * (freq_inner + freq_outer);
+  *freq_inner = p_start.freq;
+  *freq_outer = p_stop.freq;
+
+  return EXIT_SUCCESS;
+}
+
+/* ************************************************************************* */
+/**
+ * @brief  Calculate the opacity a photon sees along a path in its cell.
+ *
+ * @param[in]  photon  The photon packet, at the start of the path
+ * @param[in]  smax  The length of the path
+ * @param[in]  freq_inner  The CMF frequency at the start of the path
+ * @param[in]  mean_freq  The mean CMF frequency along the path
+ *
+ * @return  The total opacity
+ *
+ * ************************************************************************** */
+
+double
+cell_path_opacity (PhotPtr photon, double smax, double freq_inner, double mean_freq)
+{
+  double kappa_total;
+  WindPtr c_wind_cell = &wmain[photon->grid];
+  PlasmaPtr c_plasma_cell = &plasmamain[c_wind_cell->nplasma];
 
   /*
    * Now we can finally calculate the opacity due to all the continuum
@@ -146,9 +143,64 @@ integrate_tau_across_cell (PhotPtr photon, double *c_column_density, double *c_o
 
   if (RUN_MODE != RUN_MODE_NO_ES_OPACITY)
   {
-    kappa_total += klein_nishina (mean_freq) * c_plasma_cell->ne * zdom[n_domain].fill;
+    kappa_total += klein_nishina (mean_freq) * c_plasma_cell->ne * zdom[c_wind_cell->ndom].fill;
+  }
+
+  return kappa_total;
+}
+
+/* ************************************************************************* */
+/**
+ * @brief  Return the density used for the column density in a cell.
+ *
+ * ************************************************************************** */
+
+double
+column_density_in_cell (int n_grid)
+{
+  PlasmaPtr c_plasma_cell = &plasmamain[wmain[n_grid].nplasma];
+
+  if (COLUMN_MODE == COLUMN_MODE_RHO)
+  {
+    return c_plasma_cell->rho;
+  }
+
+  return c_plasma_cell->density[COLUMN_MODE_ION_NUMBER];
+}
+
+/* ************************************************************************* */
+/**
+ * @brief  Calculate the total optical depth a photon experiences across the
+ *         cell of distance SMAX_FRAC * smax.
+ * @param[in]  photon  The photon packet
+ * @param[in,out]  *c_column_density  The column density the photon has moved
+ *                                    through
+ * @param[in,out]  *c_optical_depth  The optical depth experienced by the photon
+ *
+ * @return p_istat  The current photon status or EXIT_FAILURE on failure.
+ *
+ * @details
+ *
+ * This function is concerned with finding the opacity of the photon's current
+ * cell, the distance the photon can move in the cell and hence it increments
+ * the optical depth tau a photon has experienced as it moves through the wind.
+ *
+ * ************************************************************************** */
+
+int
+integrate_tau_across_cell (PhotPtr photon, double *c_column_density, double *c_optical_depth)
+{
+  int p_istat;
+  double kappa_total;
+  double smax, freq_inner, freq_outer;
+
+  if (find_cell_path_length (photon, &smax, &freq_inner, &freq_outer))
+  {
+    return EXIT_FAILURE;
   }
 
+  kappa_total = cell_path_opacity (photon, smax, freq_inner, 0.5 * (freq_inner + freq_outer));
+
   /*
    * Increment the optical depth and column density variables and move the
    * photon to the edge of the cell
@@ -156,7 +208,7 @@ integrate_tau_across_cell (PhotPtr photon, double *c_column_density, double *c_o
 
   photon->nscat++;
 
-  *c_column_density += smax * density;
+  *c_column_density += smax * column_density_in_cell (photon->grid);
   *c_optical_depth += smax * kappa_total;
   move_phot (photon, smax);
   p_istat = photon->istat;
@@ -261,3 +313,139 @@ integrate_tau_across_wind (PhotPtr photon, double *c_column_density, double *c_o
 
   return EXIT_SUCCESS;
 }
+
+/* ************************************************************************* */
+/**
+ * @brief  Trace a sight line through the wind once, recording the path
+ *         through each cell.
+ *
+ * @param[in]  photon  The photon packet to extract, at any frequency
+ * @param[out]  path  The path of the photon through the wind
+ *
+ * @return  EXIT_SUCCESS or EXIT_FAILURE
+ *
+ * @details
+ *
+ * This follows the photon in the same way as integrate_tau_across_wind, but
+ * rather than finding the optical depth it records where the photon is at the
+ * start of each step, how far it moves and the ratio of the CMF to observer
+ * frame frequencies. The path does not depend on frequency, so
+ * integrate_tau_along_path can then find the optical depth at any frequency
+ * without tracing the photon through the grid again. This is not used when
+ * finding the photosphere, where the photon stops at a given optical depth.
+ *
+ * ************************************************************************** */
+
+int
+trace_sight_line (PhotPtr photon, SightLinePath_t *path)
+{
+  int n_dom, where;
+  enum istat_enum p_istat;
+  const int max_translate_in_space = 10;
+  int n_in_space;
+  double norm[3];
+  double smax, freq_inner, freq_outer;
+  struct photon p_extract;
+  PathStep_t *step;
+
+  path->n_steps = 0;
+  path->column_density = 0.0;
+
+  p_istat = P_INWIND;
+  stuff_phot (photon, &p_extract);
+
+  n_in_space = 0;
+  while (p_istat == P_INWIND)
+  {
+    where = where_in_wind (p_extract.x, &n_dom);
+
+    if (where < 0)
+    {
+      translate_in_space (&p_extract);
+      if (++n_in_space > max_translate_in_space)
+      {
+        errormsg ("something has gone wrong as this photon has translated in space %d times\n", n_in_space);
+        return EXIT_FAILURE;
+      }
+    }
+    else if ((p_extract.grid = where_in_grid (n_dom, p_extract.x)) >= 0)
+    {
+      if (find_cell_path_length (&p_extract, &smax, &freq_inner, &freq_outer))
+        return EXIT_FAILURE;
+
+      if (path->n_steps == path->n_alloc)
+      {
+        path->n_alloc = path->n_alloc > 0 ? 2 * path->n_alloc : 256;
+        path->steps = realloc (path->steps, path->n_alloc * sizeof *path->steps);
+        if (path->steps == NULL)
+        {
+          errormsg ("cannot allocate %lu bytes for the sight line path\n", path->n_alloc * sizeof *path->steps);
+          exit (EXIT_FAILURE);
+        }
+      }
+
+      step = &path->steps[path->n_steps++];
+      stuff_phot (&p_extract, &step->p_start);
+      step->ds = smax;
+      step->ratio_inner = freq_inner / p_extract.freq;
+      step->ratio_mean = 0.5 * (freq_inner + freq_outer) / p_extract.freq;
+
+      p_extract.nscat++;
+      path->column_density += smax * column_density_in_cell (p_extract.grid);
+      move_phot (&p_extract, smax);
+    }
+    else
+    {
+      errormsg ("photon in unknown location grid stat %i\n", p_extract.grid);
+      return EXIT_FAILURE;
+    }
+
+    p_istat = walls (&p_extract, photon, norm);
+  }
+
+  /*
+   * As in integrate_tau_across_wind, hitting the disk is always an error but
+   * the photon may hit the central source when electron scattering is ignored
+   */
+
+  if (p_istat == P_HIT_DISK || (p_istat == P_HIT_STAR && RUN_MODE == RUN_MODE_TAU_INTEGRATE))
+  {
+    errormsg ("photon hit central source or disk incorrectly istat = %i\n", p_istat);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+/* ************************************************************************* */
+/**
+ * @brief  Find the optical depth along a path made by trace_sight_line, for
+ *         a photon of a given frequency.
+ *
+ * @param[in]  path  The path of the photon through the wind
+ * @param[in]  freq  The observer frame frequency of the photon
+ *
+ * @return  The optical depth along the path
+ *
+ * ************************************************************************** */
+
+double
+integrate_tau_along_path (SightLinePath_t *path, double freq)
+{
+  int i;
+  double optical_depth;
+  struct photon p_step;
+  PathStep_t *step;
+
+  optical_depth = 0.0;
+
+  for (i = 0; i < path->n_steps; i++)
+  {
+    step = &path->steps[i];
+    stuff_phot (&step->p_start, &p_step);
+    p_step.freq = p_step.freq_orig = freq;
+    optical_depth += step->ds * cell_path_opacity (&p_step, step->ds, freq * step->ratio_inner, freq * step->ratio_mean);
+  }
+
+  return optical_depth;
+}
@@ -390,3 +390,33 @@ create_photon (PhotPtr p_out, double freq, double *lmn)
 
   return EXIT_SUCCESS;
 }
+
+/* ************************************************************************* */
+/**
+ * @brief  Sum an array which each MPI rank has filled in part of onto rank 0.
+ *
+ * @param[in,out]  values  The array, which holds the sum on rank 0 on return
+ * @param[in]  n_values  The number of elements in the array
+ *
+ * @details
+ *
+ * Each rank works on a different range of sight lines or frequencies and
+ * leaves the elements it has not worked on as zero, so a sum collects the
+ * results for rank 0 to write out. This does nothing without MPI.
+ *
+ * ************************************************************************** */
+
+void
+reduce_results_to_root (double *values, int n_values)
+{
+#ifdef MPI_ON
+  if (rank_global == 0)
+  {
+    MPI_Reduce (MPI_IN_PLACE, values, n_values, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+  }
+  else
+  {
+    MPI_Reduce (values, NULL, n_values, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+  }
+#endif
+}
@@ -194,6 +194,8 @@ spectrum_init (f1, f2, nangle, angle, phase, scat_select, top_bot_select, select
     xxspec[n].lfreqmin = lfreqmin;
     xxspec[n].lfreqmax = lfreqmax;
     xxspec[n].ldfreq = ldfreq;
+    xxspec[n].inv_dfreq = 1. / dfreq;
+    xxspec[n].inv_ldfreq = 1. / ldfreq;
 
     for (i = 0; i < NSTAT; i++)
     {
@@ -363,6 +365,7 @@ spectrum_init (f1, f2, nangle, angle, phase, scat_select, top_bot_select, select
  *  	cycles and for detailed spectra in the Live or Die option).
  *
  * @param [in] PhotPtr  p   A flight of photons
+ * @param [in] int  nphot_flight   The number of photons in the flight
  * @param [in] int  nangle  The number of different angles and phases for which to create detailed spectra
  * @param [in] int  select_extract   Parameter to select whether to use the Live or Die (0) or extract option
  * @return     Always returns 0
@@ -372,7 +375,8 @@ spectrum_init (f1, f2, nangle, angle, phase, scat_select, top_bot_select, select
  * photon during ionization cycles.  In the Live or Die option, the spectra at specific angles
  * are also created here when detailed spectra are created.
  *
- * The routine is called after each batch of photons has been transported through the wind and
+ * The routine is called after each batch of photons has been transported through the wind.
+ * Once all of the batches in a cycle have been processed, spectrum_create_summary
  * prints some intermediate results to assure the user that the program is still running.
  *
  * ### Notes ###
@@ -387,23 +391,27 @@ spectrum_init (f1, f2, nangle, angle, phase, scat_select, top_bot_select, select
  *
  **********************************************************/
 
+/* The number of photons counted by spectrum_create since spectrum_create_summary
+   was last called, and how many of them had frequencies outside the spectra */
+static double spec_nphot = 0, spec_nlow = 0, spec_nhigh = 0;
+
 int
-spectrum_create (p, nangle, select_extract)
+spectrum_create (p, nphot_flight, nangle, select_extract)
      PhotPtr p;
+     int nphot_flight;
      int nangle;
      int select_extract;
 
 {
   int nphot, istat, j, k, k1, n;
   int nspec, nwave, spectype;
-  double freqmin, freqmax, dfreq, ldfreq;
+  double freqmin, freqmax;
   double x1;
   int mscat, mtopbot;
   double delta;
   double nlow, nhigh;
   int k_orig, k1_orig;
   int iwind;
-  int max_scat, max_res;
 
   if (geo.ioniz_or_extract == CYCLE_IONIZ)
   {
@@ -418,15 +426,13 @@ spectrum_create (p, nangle, select_extract)
 
   freqmin = xxspec[SPEC_CREATED].freqmin;
   freqmax = xxspec[SPEC_CREATED].freqmax;
-  dfreq = xxspec[SPEC_CREATED].dfreq;
-  ldfreq = xxspec[SPEC_CREATED].ldfreq;
 
   nspec = nangle + MSPEC;
   nlow = 0.0;                   // variable to store the number of photons that have frequencies which are too low
   nhigh = 0.0;                  // variable to store the number of photons that have frequencies which are too high
   delta = 0.0;                  // fractional frequency error allowod
 
-  for (nphot = 0; nphot < NPHOT; nphot++)
+  for (nphot = 0; nphot < nphot_flight; nphot++)
   {
     if ((j = p[nphot].nscat) < 0 || j > MAXSCAT)
       nscat[MAXSCAT]++;
@@ -454,53 +460,22 @@ spectrum_create (p, nangle, select_extract)
      * the photoon
      */
 
-    k1 = (int) ((log10 (p[nphot].freq) - log10 (freqmin)) / ldfreq);
-    if (k1 < 0)
-    {
-      k1 = 0;
-    }
-    if (k1 > nwave - 1)
-    {
-      k1 = nwave - 1;
-    }
+    k1 = spectrum_log_bin (&xxspec[SPEC_CREATED], p[nphot].freq, nwave);
+    k1_orig = spectrum_log_bin (&xxspec[SPEC_CREATED], p[nphot].freq_orig, nwave);
+    k = spectrum_linear_bin (&xxspec[SPEC_CREATED], p[nphot].freq, nwave);
+    k_orig = spectrum_linear_bin (&xxspec[SPEC_CREATED], p[nphot].freq_orig, nwave);
 
-    k1_orig = (int) ((log10 (p[nphot].freq_orig) - log10 (freqmin)) / ldfreq);
-    if (k1_orig < 0)
+    if (geo.rt_mode != RT_MODE_MACRO)
     {
-      k1_orig = 0;
-    }
-    if (k1_orig > nwave - 1)
-    {
-      k1_orig = nwave - 1;
-    }
-
-
-    k = (int) ((p[nphot].freq - freqmin) / dfreq);
-    if (k < 0)
-    {
-      if (((1. - p[nphot].freq / freqmin) > delta) && (geo.rt_mode != RT_MODE_MACRO))
+      if ((1. - p[nphot].freq / freqmin) > delta)
         nlow = nlow + 1;
-      k = 0;
-    }
-    else if (k > nwave - 1)
-    {
-      if (((1. - freqmax / p[nphot].freq) > delta) && (geo.rt_mode != RT_MODE_MACRO))
+      else if ((1. - freqmax / p[nphot].freq) > delta)
         nhigh = nhigh + 1;
-      k = nwave - 1;
-    }
 
-    k_orig = (int) ((p[nphot].freq_orig - freqmin) / dfreq);
-    if (k_orig < 0)
-    {
-      if (((1. - p[nphot].freq_orig / freqmin) > delta) && (geo.rt_mode != RT_MODE_MACRO))
+      if ((1. - p[nphot].freq_orig / freqmin) > delta)
         nlow = nlow + 1;
-      k_orig = 0;
-    }
-    else if (k_orig > nwave - 1)
-    {
-      if (((1. - freqmax / p[nphot].freq_orig) > delta) && (geo.rt_mode != RT_MODE_MACRO))
+      else if ((1. - freqmax / p[nphot].freq_orig) > delta)
         nhigh = nhigh + 1;
-      k_orig = nwave - 1;
     }
 
     /* Having worked out what spectral bins to increment, we now actually increment the various spectra */
@@ -509,14 +484,12 @@ spectrum_create (p, nangle, select_extract)
 
     if (p[nphot].origin == PTYPE_WIND || p[nphot].origin == PTYPE_WIND_MATOM)
     {
-      xxspec[SPEC_CWIND].f[k_orig] += p[nphot].w_orig;
-      xxspec[SPEC_CWIND].lf[k1_orig] += p[nphot].w_orig;
+      spectrum_add (&xxspec[SPEC_CWIND], k_orig, k1_orig, p[nphot].w_orig, FALSE);
       xxspec[SPEC_CWIND].nphot[istat]++;
     }
     else
     {
-      xxspec[SPEC_CREATED].f[k_orig] += p[nphot].w_orig;
-      xxspec[SPEC_CREATED].lf[k1_orig] += p[nphot].w_orig;
+      spectrum_add (&xxspec[SPEC_CREATED], k_orig, k1_orig, p[nphot].w_orig, FALSE);
       xxspec[SPEC_CREATED].nphot[istat]++;
     }
 
@@ -528,13 +501,7 @@ spectrum_create (p, nangle, select_extract)
 
     if (istat == P_ESCAPE)
     {
-      xxspec[SPEC_EMITTED].f[k] += p[nphot].w;
-      xxspec[SPEC_EMITTED].lf[k1] += p[nphot].w;
-      if (iwind)
-      {
-        xxspec[SPEC_EMITTED].f_wind[k] += p[nphot].w;
-        xxspec[SPEC_EMITTED].lf_wind[k1] += p[nphot].w;
-      }
+      spectrum_add (&xxspec[SPEC_EMITTED], k, k1, p[nphot].w, iwind);
       xxspec[SPEC_EMITTED].nphot[istat]++;
       spectype = p[nphot].origin;
 
@@ -547,36 +514,18 @@ spectrum_create (p, nangle, select_extract)
 
       if (p[nphot].nmacro == 0 && (spectype == PTYPE_STAR || spectype == PTYPE_BL || spectype == PTYPE_AGN))
       {
-        xxspec[SPEC_CENSRC].f[k] += p[nphot].w;
-        xxspec[SPEC_CENSRC].lf[k1] += p[nphot].w;
-        if (iwind)
-        {
-          xxspec[SPEC_CENSRC].f_wind[k] += p[nphot].w;
-          xxspec[SPEC_CENSRC].lf_wind[k1] += p[nphot].w;
-        }
+        spectrum_add (&xxspec[SPEC_CENSRC], k, k1, p[nphot].w, iwind);
         xxspec[SPEC_CENSRC].nphot[istat]++;
       }
       else if (p[nphot].nmacro == 0 && spectype == PTYPE_DISK)
       {
-        xxspec[SPEC_DISK].f[k] += p[nphot].w;
-        xxspec[SPEC_DISK].lf[k1] += p[nphot].w;
-        if (iwind)
-        {
-          xxspec[SPEC_DISK].f_wind[k] += p[nphot].w;
-          xxspec[SPEC_DISK].lf_wind[k1] += p[nphot].w;
-        }
+        spectrum_add (&xxspec[SPEC_DISK], k, k1, p[nphot].w, iwind);
         xxspec[SPEC_DISK].nphot[istat]++;
       }
       else if (spectype == PTYPE_WIND || p[nphot].nmacro > 0)
       {
         /* In macro atom mode a photon is regarded as being in the wind if it has had a macro atom interaction */
-        xxspec[SPEC_WIND].f[k] += p[nphot].w;   /* wind spectrum */
-        xxspec[SPEC_WIND].lf[k1] += p[nphot].w; /* logarithmic wind spectrum */
-        if (iwind)
-        {
-          xxspec[SPEC_WIND].f_wind[k] += p[nphot].w;    /* emitted spectrum */
-          xxspec[SPEC_WIND].lf_wind[k1] += p[nphot].w;  /* logarithmic emitted spectrum */
-        }
+        spectrum_add (&xxspec[SPEC_WIND], k, k1, p[nphot].w, iwind);
         xxspec[SPEC_WIND].nphot[istat]++;
       }
       else
@@ -601,13 +550,7 @@ spectrum_create (p, nangle, select_extract)
           {
             if (xxspec[n].mmin < x1 && x1 < xxspec[n].mmax)
             {
-              xxspec[n].f[k] += p[nphot].w;
-              xxspec[n].lf[k1] += p[nphot].w;
-              if (iwind)
-              {
-                xxspec[n].f_wind[k] += p[nphot].w;
-                xxspec[n].lf_wind[k1] += p[nphot].w;
-              }
+              spectrum_add (&xxspec[n], k, k1, p[nphot].w, iwind);
             }
           }
         }
@@ -620,17 +563,11 @@ spectrum_create (p, nangle, select_extract)
 
     if (istat == P_ESCAPE && (p[nphot].nscat > 0 || p[nphot].nrscat > 0))
     {
-      xxspec[SPEC_SCATTERED].f[k] += p[nphot].w;
-      xxspec[SPEC_SCATTERED].lf[k1] += p[nphot].w;
+      spectrum_add (&xxspec[SPEC_SCATTERED], k, k1, p[nphot].w, iwind);
       if (p[nphot].w > 0 && p[nphot].w < 1e-100)
       {
         Log ("spectrum_create: very small weight %e (%e) for phot %d\n", p[nphot].w, p[nphot].w_orig, nphot);
       }
-      if (iwind)
-      {
-        xxspec[SPEC_SCATTERED].f_wind[k] += p[nphot].w;
-        xxspec[SPEC_SCATTERED].lf_wind[k1] += p[nphot].w;
-      }
       if (istat < 0 || istat > NSTAT - 1)
         xxspec[SPEC_SCATTERED].nphot[NSTAT - 1]++;
       else
@@ -643,20 +580,49 @@ spectrum_create (p, nangle, select_extract)
       nstat[istat]++;
   }
 
-  /* At this point all of the spectra have been incremented and so we performe a simple check on the number of
-     photons were lost and then we print out some statistics having to do with the number of 
-     scatters each photon has undergone.
-   */
+  spec_nphot += nphot_flight;
+  spec_nlow += nlow;
+  spec_nhigh += nhigh;
+
+  return (0);
+
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Report on the photons that have been added to the spectra
+ *
+ * @return     Always returns 0
+ *
+ * @details
+ * This is called once all of the flights of photons in a cycle have been
+ * passed to spectrum_create.  It performs a simple check on the number of
+ * photons that were lost and then prints out some statistics having to do
+ * with the number of scatters each photon has undergone.
+ *
+ **********************************************************/
+
+int
+spectrum_create_summary ()
+{
+  int j, n;
+  int max_scat, max_res;
 
-  if ((nlow / nphot > 0.05) || (nhigh / nphot > 0.05))
+  if ((spec_nlow / spec_nphot > 0.05) || (spec_nhigh / spec_nphot > 0.05))
   {
-    Error ("spectrum_create: Fraction of photons lost: %4.2f wi/ freq. low, %4.2f w/freq hi\n", nlow / nphot, nhigh / nphot);
+    Error ("spectrum_create: Fraction of photons lost: %4.2f wi/ freq. low, %4.2f w/freq hi\n", spec_nlow / spec_nphot,
+           spec_nhigh / spec_nphot);
   }
   else
   {
-    Log ("spectrum_create: Fraction of photons lost:  %4.2f wi/ freq. low, %4.2f w/freq hi\n", nlow / nphot, nhigh / nphot);
+    Log ("spectrum_create: Fraction of photons lost:  %4.2f wi/ freq. low, %4.2f w/freq hi\n", spec_nlow / spec_nphot,
+         spec_nhigh / spec_nphot);
   }
 
+  spec_nphot = spec_nlow = spec_nhigh = 0;
+
   max_scat = max_res = 0;
 
   for (j = 1; j < MAXSCAT; j++)
@@ -765,12 +731,7 @@ spec_add_one (p, spec_type)
   }
 
 
-  k = (freq - xxspec[spec_type].freqmin) / xxspec[spec_type].dfreq;
-
-  if (k > NWAVE_NOW - 1)
-    k = NWAVE_NOW - 1;
-  else if (k < 0)
-    k = 0;
+  k = spectrum_linear_bin (&xxspec[spec_type], freq, NWAVE_NOW);
 
   xxspec[spec_type].f[k] += p->w;
 
@@ -779,12 +740,7 @@ spec_add_one (p, spec_type)
     xxspec[SPEC_SCATTERED].f_wind[k] += p->w;
   }
 
-  k = (log10 (freq) - xxspec[spec_type].lfreqmin) / xxspec[spec_type].ldfreq;
-
-  if (k > NWAVE_NOW - 1)
-    k = NWAVE_NOW - 1;
-  else if (k < 0)
-    k = 0;
+  k = spectrum_log_bin (&xxspec[spec_type], freq, NWAVE_NOW);
 
   xxspec[spec_type].lf[k] += p->w;
   if (iwind)
@@ -798,6 +754,96 @@ spec_add_one (p, spec_type)
 
 
 
+/**********************************************************/
+/**
+ * @brief      find the bin of a linearly binned spectrum in which a
+ * frequency lies
+ *
+ * @param [in] SpecPtr spec  The spectrum
+ * @param [in] double freq  The frequency
+ * @param [in] int nwave  The number of bins in use
+ * @return     The bin, forced to lie between 0 and nwave-1
+ *
+ * @details
+ * The bin is found by multiplying by the inverse of the bin width
+ * stored by spectrum_init, rather than by dividing by the width.
+ *
+ **********************************************************/
+
+int
+spectrum_linear_bin (SpecPtr spec, double freq, int nwave)
+{
+  double x;
+
+  x = (freq - spec->freqmin) * spec->inv_dfreq;
+
+  if (x < 0)
+    return (0);
+  if (x >= nwave)
+    return (nwave - 1);
+  return ((int) x);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      find the bin of a logarithmically binned spectrum in
+ * which a frequency lies
+ *
+ * @param [in] SpecPtr spec  The spectrum
+ * @param [in] double freq  The frequency
+ * @param [in] int nwave  The number of bins in use
+ * @return     The bin, forced to lie between 0 and nwave-1
+ *
+ **********************************************************/
+
+int
+spectrum_log_bin (SpecPtr spec, double freq, int nwave)
+{
+  double x;
+
+  x = (log10 (freq) - spec->lfreqmin) * spec->inv_ldfreq;
+
+  if (x < 0)
+    return (0);
+  if (x >= nwave)
+    return (nwave - 1);
+  return ((int) x);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      add a weight to the linear and logarithmic bins of a
+ * spectrum
+ *
+ * @param [in, out] SpecPtr spec  The spectrum to increment
+ * @param [in] int k  The bin in the linearly binned spectrum
+ * @param [in] int k1  The bin in the logarithmically binned spectrum
+ * @param [in] double w  The weight to add
+ * @param [in] int iwind  If TRUE, the weight is also added to the
+ * spectra of photons created or scattered in the wind
+ * @return     Always returns 0
+ *
+ **********************************************************/
+
+int
+spectrum_add (SpecPtr spec, int k, int k1, double w, int iwind)
+{
+  spec->f[k] += w;
+  spec->lf[k1] += w;
+  if (iwind)
+  {
+    spec->f_wind[k] += w;
+    spec->lf_wind[k1] += w;
+  }
+  return (0);
+}
+
+
+
 
 /**********************************************************/
 /**
@@ -8,6 +8,7 @@ int randwind_thermal_trapping(PhotPtr p, int *nnscat);
 /* atomic_extern_init.c */
 /* atomicdata.c */
 int get_atomic_data(char masterfile[]);
+int check_atomic_data(int ierr);
 /* atomicdata_init.c */
 int init_atomic_data(void);
 /* atomicdata_sub.c */
@@ -70,6 +71,9 @@ void broadcast_wind_luminosity(const int n_start, const int n_stop, const int n_
 void broadcast_wind_cooling(const int n_start, const int n_stop, const int n_cells_rank);
 int broadcast_updated_plasma_properties(const int n_start_rank, const int n_stop_rank, const int n_cells_rank);
 int reduce_simple_estimators(void);
+int get_max_cell_spec_blocks_per_rank(const int n_start, const int n_stop);
+void pack_cell_spec(PlasmaPtr cell, char *comm_buffer, const int comm_buffer_size, int *position);
+void unpack_cell_spec(PlasmaPtr cell, char *comm_buffer, const int comm_buffer_size, int *position);
 /* communicate_spectra.c */
 int normalize_spectra_across_ranks(void);
 /* communicate_wind.c */
@@ -91,6 +95,11 @@ double compton_beta(double nu);
 double comp_cool_integrand(double nu, void *params);
 double compton_reweight_norm(double nu);
 int compton_reweight(PhotPtr p_in, PhotPtr p_out);
+double compton_kn_invert(double x, double u);
+void init_compton_tables(void);
+double compton_kn_sample(double x, double u);
+double compton_reweight_norm_sample(double nu);
+double compton_thermal_sample(double u);
 /* continuum.c */
 double one_continuum(int spectype, double t, double g, double freqmin, double freqmax);
 double emittance_continuum(int spectype, double freqmin, double freqmax, double t, double g);
@@ -159,12 +168,14 @@ double geff(double x);
 double vdisk(double x[], double v[]);
 double zdisk(double r);
 double ds_to_disk(struct photon *p, int allow_negative, int *hit);
+double ds_to_disk_surface(PhotPtr p, double smin, double smax, int *ierr);
 double disk_height(double s, void *params);
 double disk_colour_correction(double t);
 /* disk_init.c */
 double disk_init(double rmin, double rmax, double m, double mdot, double freqmin, double freqmax, int ioniz_or_extract, double *ftot);
 int qdisk_init(double rmin, double rmax, double m, double mdot);
-int qdisk_reinit(PhotPtr p);
+int qdisk_reinit(void);
+int qdisk_record_emission(PhotPtr p, int nphot_flight);
 int qdisk_save(char *diskfile, int ichoice);
 int read_non_standard_disk_profile(char *tprofile);
 /* disk_photon_gen.c */
@@ -208,6 +219,11 @@ double mean_frequency_nu_range(double T, double nu_min, double nu_max);
 double estimate_temperature_from_mean_frequency(double mean_nu_target, double nu_min, double nu_max, double initial_guess);
 int normalise_simple_estimators(PlasmaPtr xplasma);
 void update_persistent_directional_flux_estimators(int nplasma, double flux_persist_scale);
+double *cell_spec_alloc_block(PlasmaPtr xplasma, int nblock);
+int cell_spec_add(PlasmaPtr xplasma, int i, double value);
+double cell_spec_get(PlasmaPtr xplasma, int i);
+int cell_spec_zero(PlasmaPtr xplasma);
+int cell_spec_count_blocks(int n_start, int n_stop);
 /* extract.c */
 int extract(WindPtr w, PhotPtr p, int itype);
 int extract_one(WindPtr w, PhotPtr pp, int nspec);
@@ -215,16 +231,21 @@ int extract_one(WindPtr w, PhotPtr pp, int nspec);
 int check_frame(PhotPtr p, enum frame desired_frame, char *msg);
 double calculate_gamma_factor(double vel[3]);
 int observer_to_local_frame(PhotPtr p_in, PhotPtr p_out);
+int observer_to_local_frame_with_v(PhotPtr p_in, PhotPtr p_out, double v[]);
 int local_to_observer_frame(PhotPtr p_in, PhotPtr p_out);
 int observer_to_local_frame_disk(PhotPtr p_in, PhotPtr p_out);
 int local_to_observer_frame_disk(PhotPtr p_in, PhotPtr p_out);
 double observer_to_local_frame_ds(PhotPtr p_obs, double ds_obs);
+double observer_to_local_frame_ds_with_v(PhotPtr p_obs, double ds_obs, double v[]);
 double local_to_observer_frame_ds(PhotPtr p_obs, double ds_cmf);
 double observer_to_local_frame_velocity(double *v_obs, double *v, double *v_cmf);
 double local_to_observer_frame_velocity(double *v_cmf, double *v, double *v_obs);
 int local_to_observer_frame_ruler_transform(double v[], double dx_cmf[], double dx_obs[]);
 int observer_to_local_frame_ruler_transform(double v[], double dx_obs[], double dx_cmf[]);
 int lorentz_transform(PhotPtr p_in, PhotPtr p_out, double v[]);
+int ray_velocity_fit(RayVelPtr ray, PhotPtr p, double smax, double v_start[], double v_mid[], double v_stop[]);
+double ray_local_freq(RayVelPtr ray, double s);
+double ray_dvds(RayVelPtr ray, double s);
 /* gradv.c */
 double dvwind_ds_cmf(PhotPtr p);
 int calculate_cell_dvds_ave(int ndom, WindPtr cell);
@@ -297,6 +318,10 @@ int one_shot(PlasmaPtr xplasma, int mode);
 double calc_te(PlasmaPtr xplasma, double tmin, double tmax);
 double zero_emit(double t);
 double zero_emit2(double t, void *params);
+double calc_te_secant(double tmin, double tmax, double t_guess);
+int te_coeff_cache_start(double tmin, double tmax);
+int te_coeff_cache_stop(void);
+int te_coeff_cache_lookup(int type, double t, double *coeffs);
 /* janitor.c */
 void free_domains(void);
 void free_wind_grid(void);
@@ -345,6 +370,7 @@ void macro_pops_copy_to_xplasma(PlasmaPtr xplasma, int index_element, double *po
 int matom(PhotPtr p, int *nres, int *escape);
 double b12(struct lines *line_ptr);
 double xalpha_sp(struct topbase_phot *cont_ptr, PlasmaPtr xplasma, int ichoice);
+double alpha_sp_integral(struct topbase_phot *cont_ptr, double temp, int ichoice);
 double alpha_sp(struct topbase_phot *cont_ptr, PlasmaPtr xplasma, int ichoice);
 double scaled_alpha_sp_integral_band_limited(struct topbase_phot *cont_ptr, PlasmaPtr xplasma, int ichoice, double freq_min, double freq_max);
 double alpha_sp_integrand(double freq, void *params);
@@ -357,7 +383,9 @@ int matom_emiss_report(void);
 /* matrix_cpu.c */
 const char *get_matrix_error_string(int error_code);
 int solve_matrix(double *a_matrix, double *b_matrix, int size, double *x_matrix, int nplasma);
+int solve_matrix_batch(double *a_matrices, double *b_vectors, int *sizes, int n_systems, double *x_vectors, int nplasma);
 int invert_matrix(double *matrix, double *inverted_matrix, int num_rows);
+int free_matrix_workspace(void);
 /* matrix_ion.c */
 int matrix_ion_populations(PlasmaPtr xplasma, int mode);
 int populate_ion_rate_matrix(double rate_matrix[nions][nions], double pi_rates[nions], double inner_rates[n_inner_tot], double rr_rates[nions], double b_temp[nions], double xne, double nh1, double nh2);
@@ -376,9 +404,14 @@ int partition_functions(PlasmaPtr xplasma, int mode);
 int partition_functions_2(PlasmaPtr xplasma, int xnion, double temp, double weight);
 /* paths.c */
 Wind_Paths_Ptr wind_paths_constructor(WindPtr wind);
+int wind_paths_alloc_bins(Wind_Paths_Ptr paths);
+int wind_paths_free(Wind_Paths_Ptr paths);
+int path_bin_index(double path);
 int reverb_init(WindPtr wind);
+int reverb_free(void);
 int wind_paths_init(WindPtr wind);
 int line_paths_add_phot(WindPtr wind, PhotPtr pp, int *nres);
+int wind_paths_add_to_bin(Wind_Paths_Ptr paths, PhotPtr pp);
 int wind_paths_add_phot(WindPtr wind, PhotPtr pp);
 int simple_paths_gen_phot(PhotPtr pp);
 double r_draw_from_path_histogram(Wind_Paths_Ptr PathPtr);
@@ -403,23 +436,27 @@ int quadratic(double a, double b, double c, double r[]);
 double ds_to_plane(struct plane *pl, struct photon *p, int force_positive_z);
 double ds_to_closest_approach(double x[], struct photon *p, double *impact_parameter);
 double ds_to_cylinder(double rho, struct photon *p);
+double ds_to_annulus_min(double rhomin, double rhomax, double zmin, double zmax, double rho, double z);
 /* photon2d.c */
 int translate(WindPtr w, PhotPtr pp, double tau_scat, double *tau, int *nres);
 int translate_in_space(PhotPtr pp);
 double ds_to_wind(PhotPtr pp, int *ndom_current);
 int translate_in_wind(WindPtr w, PhotPtr p, double tau_scat, double *tau, int *nres);
+int increment_path_estimators(WindPtr w, PhotPtr p, double ds);
 double smax_in_cell(PhotPtr p);
 double ds_in_cell(int ndom, PhotPtr p);
 /* photon_gen.c */
-int define_phot(PhotPtr p, double f1, double f2, long nphot_tot, int ioniz_or_extract, int iwind, int freq_sampling);
+int define_phot(double f1, double f2, long nphot_tot, int ioniz_or_extract, int iwind, int freq_sampling);
+int next_phot_batch(PhotPtr p, int nmax);
+int phot_batch_size(void);
 double populate_bands(int ioniz_or_extract, int iwind, struct xbands *band);
 int xdefine_phot(double f1, double f2, int ioniz_or_extract, int iwind, int print_mode, int tot_flag);
 int phot_status(void);
-int xmake_phot(PhotPtr p, double f1, double f2, int ioniz_or_extract, int iwind, double weight, int iphot_start, int nphotons);
+int xmake_phot(PhotPtr p, double f1, double f2, int ioniz_or_extract, int iwind, double weight, int iphot_start, int nsrc[]);
 int star_init(double freqmin, double freqmax, int ioniz_or_extract, double *f);
 int photo_gen_star(PhotPtr p, double r, double t, double weight, double f1, double f2, int spectype, int istart, int nphot);
 double bl_init(double lum_bl, double t_bl, double freqmin, double freqmax, int ioniz_or_extract, double *f);
-int photon_checks(PhotPtr p, double freqmin, double freqmax, char *comment);
+int photon_checks(PhotPtr p, int nphot, double freqmin, double freqmax, char *comment);
 /* photon_gen_matom.c */
 double get_kpkt_f(void);
 double get_kpkt_heating_f(void);
@@ -427,6 +464,8 @@ int photo_gen_kpkt(PhotPtr p, double weight, int photstart, int nphot);
 int photo_gen_matom(PhotPtr p, double weight, int photstart, int nphot);
 /* pi_rates.c */
 double calc_pi_rate(int nion, PlasmaPtr xplasma, int mode, int type);
+double pi_planck_integral(struct topbase_phot *x_ptr, double t_r);
+double pi_model_integral(int spec_mod_type, double fmin, double fmax);
 double tb_planck(double freq, void *params);
 double tb_logpow(double freq, void *params);
 double tb_exp(double freq, void *params);
@@ -450,6 +489,9 @@ int init_rand(int seed);
 void init_rng_directory(char *root, int rank);
 void save_gsl_rng_state(void);
 void reload_gsl_rng_state(void);
+int stratify_init(long nsamples, int ndim);
+int stratify_sample(long isample);
+double stratify_dispersion(int counts[], double expected[], int nbins);
 double random_number(double min, double max);
 /* rdpar.c */
 int opar(char filename[]);
@@ -495,6 +537,9 @@ double fb(PlasmaPtr xplasma, double t, double freq, int ion_choice, int fb_choic
 int init_freebound(double t1, double t2, double f1, double f2);
 double get_nrecomb(double t, int nion, int mode);
 double get_fb(double t, int nion, int narray, int fb_choice, int mode);
+double fb_cache_integ(double t, double f1, double f2, int nion, int fb_choice, int mode);
+double fb_cache_alpha_sp(struct topbase_phot *cont_ptr, double t, int ichoice);
+double fb_cache_pi_planck(struct topbase_phot *x_ptr, double t_r);
 double xinteg_fb(double t, double f1, double f2, int nion, int fb_choice);
 double xinteg_inner_fb(double t, double f1, double f2, int nion, int fb_choice);
 double total_rrate(int nion, double T);
@@ -514,6 +559,7 @@ double delay_to_observer(PhotPtr pp);
 int delay_dump_prep(int restart_stat);
 int delay_dump_finish(void);
 int delay_dump_combine(int i_ranks);
+int delay_dump_combine_binary(int i_ranks);
 int delay_dump(PhotPtr p, int np);
 int delay_dump_single(PhotPtr pp, int i_spec);
 /* roche.c */
@@ -585,8 +631,12 @@ int check_time(char *root);
 /* spectra.c */
 void spectrum_allocate(int nspec);
 int spectrum_init(double f1, double f2, int nangle, double angle[], double phase[], int scat_select[], int top_bot_select[], int select_extract, double rho_select[], double z_select[], double az_select[], double r_select[]);
-int spectrum_create(PhotPtr p, int nangle, int select_extract);
+int spectrum_create(PhotPtr p, int nphot_flight, int nangle, int select_extract);
+int spectrum_create_summary(void);
 int spec_add_one(PhotPtr p, int spec_type);
+int spectrum_linear_bin(SpecPtr spec, double freq, int nwave);
+int spectrum_log_bin(SpecPtr spec, double freq, int nwave);
+int spectrum_add(SpecPtr spec, int k, int k1, double w, int iwind);
 int spectrum_summary(char filename[], int nspecmin, int nspecmax, int select_spectype, double renorm, int loglin, int iwind);
 int spectrum_restart_renormalise(int nangle);
 /* spectral_estimators.c */
@@ -626,14 +676,25 @@ double sv_wind_mdot_integral(double r, void *params);
 int get_question_name_length(char question[]);
 int are_synonym_lists_valid(void);
 int is_input_line_synonym_for_question(char question[], char input_line[]);
+/* thin_cells.c */
+int thin_cells_record(int nplasma, double freq, double dtau, double ds, double smax);
+int thin_cells_update(void);
+int thin_cells_check(PhotPtr p, int nplasma, double tau_left);
+int thin_cells_report(void);
 /* time.c */
 double timer(void);
 int get_time(char curtime[]);
 struct timeval init_timer_t0(void);
 void print_timer_duration(char *msg, struct timeval timer_t0);
 /* trans_phot.c */
-int trans_phot(WindPtr w, PhotPtr p, int iextract);
+int trans_phot(WindPtr w, PhotPtr p, int nphot_flight, int iextract);
 int trans_phot_single(WindPtr w, PhotPtr p, int iextract);
+int trans_phot_start(PhotPtr p, TransportPtr ts);
+int trans_phot_step(WindPtr w, PhotPtr p, TransportPtr ts, int iextract);
+int trans_phot_waves(WindPtr w, PhotPtr p, int nphot_flight, int iextract);
+int trans_phot_events(WindPtr w, PhotPtr p, int nphot_flight, int iextract);
+int mrw_step(WindPtr w, PhotPtr p, int iextract);
+int mrw_report(void);
 /* vvector.c */
 double dot(double a[], double b[]);
 double length(double a[]);
@@ -663,6 +724,7 @@ int wind_check(WindPtr www, int n);
 /* wind2d.c */
 int where_in_grid(int ndom, double x[]);
 int vwind_xyz(int ndom, PhotPtr p, double v[]);
+int stencil_vwind(int ndom, double x[], StencilPtr st, double v[], double v_grad[][3]);
 int wind_div_v(int ndom, WindPtr cell);
 double rho(WindPtr w, double x[]);
 int mdot_wind(WindPtr w, double z, double rmax);
@@ -680,8 +742,13 @@ void check_heating_rates_for_plasma_cell(const int n_plasma);
 void init_plasma_rad_properties(void);
 void init_macro_rad_properties(void);
 void shell_output_wind_update_diagnostics(double xsum, double psum, double fsum, double csum, double icsum, double lsum, double ausum, double chexsum, double cool_sum, double lum_sum);
+double wu_profile_start(void);
+void wu_profile_stop(int phase, double t0);
+void wind_update_profile_report(void);
 /* wind_util.c */
 int coord_fraction(int ndom, int ichoice, double x[], int ii[], double frac[], int *nelem);
+int coord_stencil(int ndom, double x[], StencilPtr st);
+int stencil_cache_vertices(int fixed);
 int where_in_2dcell(int ichoice, double x[], int n, double *fx, double *fz);
 int wind_n_to_ij(int ndom, int n, int *i, int *j);
 int wind_ij_to_n(int ndom, int i, int j, int *n);
@@ -10,6 +10,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include <CUnit/CUnit.h>
 
 #include "../../atomic.h"
@@ -45,6 +46,48 @@ test_compton_func (void)
   CU_ASSERT_DOUBLE_EQUAL_FATAL (compton_func (three_quarters_f_max, NULL), 1.457703e+02, EPSILON);
 }
 
+/** *******************************************************************************************************************
+ *
+ * @brief Test the tabulated inverse of the Klein-Nishina cumulative distribution
+ *
+ * @details
+ *
+ * The fractional energy change found by compton_kn_invert should be the root of compton_func, and the value
+ * interpolated from the table should agree with it to within the tolerance the table is made with. The tabulated
+ * reweighting normalisation and thermal speeds are checked against the functions they replace in the same way.
+ *
+ * ****************************************************************************************************************** */
+
+void
+test_compton_tables (void)
+{
+  int i, j;
+  double energy_ratio, u, f, f_table, f_max;
+  const double test_frequency[4] = { 5e16, 5e18, 2e20, 5e21 };
+  const double test_u[5] = { 0.0, 0.013, 0.5, 0.87, 1.0 };
+
+  for (i = 0; i < 4; i++)
+  {
+    energy_ratio = (PLANCK * test_frequency[i]) / (MELEC * VLIGHT * VLIGHT);
+    f_max = 1 + (2 * energy_ratio);
+    for (j = 0; j < 5; j++)
+    {
+      u = test_u[j];
+      f = compton_kn_invert (energy_ratio, u);
+      f_table = compton_kn_sample (energy_ratio, u);
+      set_comp_func_values (u, sigma_compton_partial (f_max, energy_ratio), energy_ratio);
+      CU_ASSERT_DOUBLE_EQUAL (compton_func (f, NULL), 0.0, 1e-6);
+      CU_ASSERT_DOUBLE_EQUAL (f_table, f, 2e-4 * f * log (f_max));
+    }
+    CU_ASSERT_DOUBLE_EQUAL (compton_reweight_norm_sample (test_frequency[i]), compton_reweight_norm (test_frequency[i]),
+                            1e-4 * compton_reweight_norm (test_frequency[i]));
+  }
+
+  CU_ASSERT_DOUBLE_EQUAL (compton_thermal_sample (0.0), 0.0, 1e-6);
+  CU_ASSERT_DOUBLE_EQUAL (compton_thermal_sample (1.0), 5.0, 1e-6);
+  CU_ASSERT_DOUBLE_EQUAL (compton_thermal_sample (0.5), 1.0876520, 1e-4);
+}
+
 /** *******************************************************************************************************************
  *
  * @brief Test the Compton cooling cross-section formula
@@ -133,7 +176,8 @@ create_compton_test_suite (void)
   if ((CU_add_test (suite, "Klein-Nisina Formula", test_klein_nishina) == NULL) ||
       (CU_add_test (suite, "Compton Alpha - heating cross section ", test_compton_alpha) == NULL) ||
       (CU_add_test (suite, "Compton Beta - cooling cross section", test_compton_beta) == NULL) ||
-      (CU_add_test (suite, "Compton Formula", test_compton_func) == NULL))
+      (CU_add_test (suite, "Compton Formula", test_compton_func) == NULL) ||
+      (CU_add_test (suite, "Compton Tables", test_compton_tables) == NULL))
   {
     fprintf (stderr, "Failed to add tests to `Compton Processes` suite\n");
     CU_cleanup_registry ();
@@ -297,6 +297,110 @@ test_invert_matrix (void)
   call_invert_matrix ("inverse_macro");
 }
 
+/** *******************************************************************************************************************
+ *
+ * @brief Tests for `solve_matrix` and `invert_matrix` using the dense LU backend
+ *
+ * @details
+ *
+ * The same test data are used as for the default backend. When CUDA is enabled, the backend selector is ignored and
+ * these tests are the same as the default tests.
+ *
+ * ****************************************************************************************************************** */
+
+void
+test_lu_backend (void)
+{
+  modes.matrix_solver = MATRIX_SOLVER_LU;
+  call_solve_matrix ("small_matrix");
+  call_solve_matrix ("matrix_ion");
+  call_invert_matrix ("inverse_small");
+  call_invert_matrix ("inverse_macro");
+  modes.matrix_solver = MATRIX_SOLVER_GSL;
+}
+
+/** *******************************************************************************************************************
+ *
+ * @brief Test for `solve_matrix_batch`
+ *
+ * @details
+ *
+ * Packs the two solve_matrix test systems into one batch, with an empty system between them, and checks both
+ * solutions against the verification data.
+ *
+ * ****************************************************************************************************************** */
+
+void
+test_solve_matrix_batch (void)
+{
+  const char *sirocco_path = getenv ((const char *) "SIROCCO");
+  if (sirocco_path == NULL)
+  {
+    CU_FAIL_FATAL ("$SIROCCO has not been set");
+  }
+
+  int i, j;
+  int sizes[3];
+  double *matrix_a[2];
+  double *vector_b[2];
+  double *vector_x[2];
+  char matrix_a_filepath[BUFFER_LENGTH];
+  char vector_b_filepath[BUFFER_LENGTH];
+  char vector_x_filepath[BUFFER_LENGTH];
+  const char *test_names[2] = { "small_matrix", "matrix_ion" };
+
+  for (i = 0; i < 2; ++i)
+  {
+    sprintf (matrix_a_filepath, "%s/source/tests/test_data/matrix/%s/A.txt", sirocco_path, test_names[i]);
+    sprintf (vector_b_filepath, "%s/source/tests/test_data/matrix/%s/b.txt", sirocco_path, test_names[i]);
+    sprintf (vector_x_filepath, "%s/source/tests/test_data/matrix/%s/x.txt", sirocco_path, test_names[i]);
+    if (get_solve_matrix_test_data (matrix_a_filepath, vector_b_filepath, vector_x_filepath, &matrix_a[i], &vector_b[i],
+                                    &vector_x[i], &sizes[2 * i]))
+    {
+      CU_FAIL_MSG_FATAL ("Unable to load test data");
+    }
+  }
+  sizes[1] = 0;
+
+  const int n_a = sizes[0] * sizes[0] + sizes[2] * sizes[2];
+  const int n_b = sizes[0] + sizes[2];
+  double *packed_a = malloc (n_a * sizeof (double));
+  double *packed_b = malloc (n_b * sizeof (double));
+  double *packed_x = malloc (n_b * sizeof (double));
+
+  for (i = 0; i < sizes[0] * sizes[0]; ++i)
+    packed_a[i] = matrix_a[0][i];
+  for (j = 0; j < sizes[2] * sizes[2]; ++j)
+    packed_a[i + j] = matrix_a[1][j];
+  for (i = 0; i < sizes[0]; ++i)
+    packed_b[i] = vector_b[0][i];
+  for (j = 0; j < sizes[2]; ++j)
+    packed_b[i + j] = vector_b[1][j];
+
+  modes.matrix_solver = MATRIX_SOLVER_LU;
+  const int matrix_err = solve_matrix_batch (packed_a, packed_b, sizes, 3, packed_x, -1);
+  modes.matrix_solver = MATRIX_SOLVER_GSL;
+  if (matrix_err)
+  {
+    CU_FAIL ("`solve_matrix_batch` failed with error");
+  }
+
+  const double *first_x = packed_x;
+  const double *second_x = packed_x + sizes[0];
+  CU_ASSERT_DOUBLE_ARRAY_EQUAL_FATAL (first_x, vector_x[0], sizes[0], EPSILON);
+  CU_ASSERT_DOUBLE_ARRAY_EQUAL_FATAL (second_x, vector_x[1], sizes[2], EPSILON);
+
+  for (i = 0; i < 2; ++i)
+  {
+    free (matrix_a[i]);
+    free (vector_b[i]);
+    free (vector_x[i]);
+  }
+  free (packed_a);
+  free (packed_b);
+  free (packed_x);
+}
+
 /** *******************************************************************************************************************
  *
  * @brief Initialise the program for the matrix test suite
@@ -378,7 +482,9 @@ create_matrix_test_suite (void)
 
   /* Add CPU tests to suite */
   if ((CU_add_test (suite, "Solve Matrix", test_solve_matrix) == NULL) ||
-      (CU_add_test (suite, "Invert Matrix", test_invert_matrix) == NULL))
+      (CU_add_test (suite, "Invert Matrix", test_invert_matrix) == NULL) ||
+      (CU_add_test (suite, "Dense LU Backend", test_lu_backend) == NULL) ||
+      (CU_add_test (suite, "Solve Matrix Batch", test_solve_matrix_batch) == NULL))
   {
     fprintf (stderr, "Failed to add tests to `Matrix Functions Suite: CPU`\n");
     CU_cleanup_registry ();
@@ -0,0 +1,287 @@
+/***********************************************************/
+/** @file  thin_cells.c
+ *
+ * @brief  Find the cells of the wind which are optically thin, so
+ * that photons can cross them without looking for resonances
+ *
+ * Much of the outer parts of a wind is optically thin at most frequencies,
+ * but translate_in_wind still finds every resonance a photon passes through
+ * in these cells, with calculate_ds.  When sirocco is run with -thin_cells,
+ * the optical depth per unit length of each segment of a photon path found
+ * by calculate_ds in an ionization cycle is recorded for the plasma cell
+ * and the coarse frequency band (geo.xfreq) of the photon.  At the end of the
+ * cycle, wind_update calls thin_cells_update, which marks a cell as thin in a
+ * band if enough segments were recorded, and the largest optical depth per
+ * unit length times the longest segment is less than modes.thin_cells_tau.
+ *
+ * In the following cycles, a photon which is in a thin cell, and is far enough
+ * from its next scattering that it could not reach it within the cell, moves
+ * straight to the edge of the cell.  Only electron scattering is added to its
+ * optical depth.  The line and continuum optical depth which is ignored is at
+ * most modes.thin_cells_tau for each cell crossed.  The estimators which are
+ * incremented along the path, by radiation or bf_estimators_increment, are
+ * incremented as usual, but those which calculate_ds increments at each
+ * resonance are not.  So with macro atoms, where these are the bb estimators
+ * and the heating by lines of simple ions, photons always take the full path
+ * in ionization cycles.
+ *
+ * One photon in THIN_CELLS_SAMPLE always takes the full path, so that the
+ * optical depths of thin cells continue to be recorded.
+ *
+ ***********************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "atomic.h"
+#include "sirocco.h"
+
+#define THIN_CELLS_NMIN    10   /**< The number of segments in a band needed to decide a cell is thin */
+#define THIN_CELLS_SAMPLE  10   /**< One photon in this many always finds the resonances in thin cells */
+
+static int thin_ncells = 0;     /**< The number of plasma cells for which the arrays are allocated */
+static double *thin_kappa = NULL;       /**< The largest optical depth per unit length of a segment, for each cell and band */
+static int *thin_nseg = NULL;   /**< The number of segments recorded for each cell and band */
+static double *thin_length = NULL;      /**< The longest distance a photon could travel in each cell */
+static char *thin_flag = NULL;  /**< TRUE if a cell is thin in a band */
+
+static long thin_nsteps = 0;    /**< The number of steps through cells in the wind since the last report */
+static long thin_nfast = 0;     /**< The number of these which crossed a thin cell without finding resonances */
+
+
+
+/**********************************************************/
+/**
+ * @brief      Allocate the arrays which record the optical depths of the cells
+ *
+ * @return     Always returns 0
+ *
+ * @details
+ * The arrays are allocated the first time they are needed, by which time
+ * the number of plasma cells is known
+ *
+ **********************************************************/
+
+static int
+thin_cells_alloc (void)
+{
+  if (thin_ncells == NPLASMA)
+    return (0);
+
+  free (thin_kappa);
+  free (thin_nseg);
+  free (thin_length);
+  free (thin_flag);
+
+  thin_ncells = NPLASMA;
+  thin_kappa = calloc (NPLASMA * NXBANDS, sizeof (double));
+  thin_nseg = calloc (NPLASMA * NXBANDS, sizeof (int));
+  thin_length = calloc (NPLASMA, sizeof (double));
+  thin_flag = calloc (NPLASMA * NXBANDS, sizeof (char));
+
+  if (thin_kappa == NULL || thin_nseg == NULL || thin_length == NULL || thin_flag == NULL)
+  {
+    Error ("thin_cells_alloc: Could not allocate memory for %d cells\n", NPLASMA);
+    Exit (EXIT_FAILURE);
+  }
+
+  return (0);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Find the coarse frequency band which contains a frequency
+ *
+ * @param [in] double  freq   The frequency
+ * @return     The band, or -1 if the frequency is outside all of them
+ *
+ **********************************************************/
+
+static int
+thin_cells_band (freq)
+     double freq;
+{
+  int n;
+
+  if (freq < geo.xfreq[0] || freq >= geo.xfreq[geo.nxfreq])
+    return (-1);
+
+  for (n = 0; n < geo.nxfreq - 1; n++)
+  {
+    if (freq < geo.xfreq[n + 1])
+      break;
+  }
+
+  return (n);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Record the optical depth of a segment of a photon path found by calculate_ds
+ *
+ * @param [in] int  nplasma   The plasma cell
+ * @param [in] double  freq   The frequency of the photon
+ * @param [in] double  dtau   The optical depth of the segment
+ * @param [in] double  ds   The length of the segment
+ * @param [in] double  smax   The distance the photon could have travelled in the cell
+ * @return     Always returns 0
+ *
+ **********************************************************/
+
+int
+thin_cells_record (nplasma, freq, dtau, ds, smax)
+     int nplasma;
+     double freq, dtau, ds, smax;
+{
+  int n;
+  double kappa;
+
+  thin_cells_alloc ();
+
+  if ((n = thin_cells_band (freq)) < 0)
+    return (0);
+
+  n += nplasma * NXBANDS;
+
+  if (ds > 0)
+    kappa = dtau / ds;
+  else
+    kappa = (dtau > 0) ? VERY_BIG : 0.0;
+
+  if (kappa > thin_kappa[n])
+    thin_kappa[n] = kappa;
+  thin_nseg[n]++;
+
+  if (smax > thin_length[nplasma])
+    thin_length[nplasma] = smax;
+
+  return (0);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Decide which cells are thin from the optical depths recorded in the last cycle
+ *
+ * @return     The number of cells which are thin in at least one band
+ *
+ * @details
+ * This is called at the end of wind_update.  The records from each MPI task are
+ * combined, so that every task marks the same cells as thin, and the records are
+ * then cleared for the next cycle.
+ *
+ **********************************************************/
+
+int
+thin_cells_update (void)
+{
+  int n, nband, nthin, nthin_band, thin;
+
+  thin_cells_alloc ();
+
+#ifdef MPI_ON
+  MPI_Allreduce (MPI_IN_PLACE, thin_kappa, NPLASMA * NXBANDS, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+  MPI_Allreduce (MPI_IN_PLACE, thin_nseg, NPLASMA * NXBANDS, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  MPI_Allreduce (MPI_IN_PLACE, thin_length, NPLASMA, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+#endif
+
+  nthin = nthin_band = 0;
+  for (n = 0; n < NPLASMA; n++)
+  {
+    thin = FALSE;
+    for (nband = n * NXBANDS; nband < (n + 1) * NXBANDS; nband++)
+    {
+      thin_flag[nband] = (thin_nseg[nband] >= THIN_CELLS_NMIN && thin_kappa[nband] * thin_length[n] < modes.thin_cells_tau);
+      if (thin_flag[nband])
+      {
+        thin = TRUE;
+        nthin_band++;
+      }
+    }
+    if (thin)
+      nthin++;
+  }
+
+  Log ("thin_cells_update: %d of %d cells are optically thin (tau < %.1e) in at least one band, %d cell-bands in all\n",
+       nthin, NPLASMA, modes.thin_cells_tau, nthin_band);
+
+  memset (thin_kappa, 0, NPLASMA * NXBANDS * sizeof (double));
+  memset (thin_nseg, 0, NPLASMA * NXBANDS * sizeof (int));
+  memset (thin_length, 0, NPLASMA * sizeof (double));
+
+  return (nthin);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Decide whether a photon can cross a cell without finding resonances
+ *
+ * @param [in] PhotPtr  p   The photon
+ * @param [in] int  nplasma   The plasma cell the photon is in
+ * @param [in] double  tau_left   The optical depth the photon can travel before it scatters
+ * @return     TRUE if the cell is thin at the frequency of the photon, and the photon
+ * cannot scatter within the cell
+ *
+ * @details
+ * Every call is counted, for the report made by thin_cells_report
+ *
+ **********************************************************/
+
+int
+thin_cells_check (p, nplasma, tau_left)
+     PhotPtr p;
+     int nplasma;
+     double tau_left;
+{
+  int n;
+
+  thin_nsteps++;
+
+  if (thin_flag == NULL || nplasma < 0 || nplasma >= thin_ncells || p->np % THIN_CELLS_SAMPLE == 0)
+    return (FALSE);
+
+  if ((n = thin_cells_band (p->freq)) < 0 || thin_flag[nplasma * NXBANDS + n] == FALSE)
+    return (FALSE);
+
+  if (tau_left < modes.thin_cells_tau)
+    return (FALSE);
+
+  thin_nfast++;
+  return (TRUE);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Log the fraction of steps through the wind which crossed thin cells
+ *
+ * @return     Always returns 0
+ *
+ * @details
+ * This is called at the end of trans_phot, and the counts are reset
+ *
+ **********************************************************/
+
+int
+thin_cells_report (void)
+{
+  if (thin_nsteps > 0)
+  {
+    Log ("thin_cells_report: %ld of %ld steps (%.1f%%) through the wind crossed optically thin cells without finding resonances\n",
+         thin_nfast, thin_nsteps, 100. * thin_nfast / thin_nsteps);
+  }
+
+  thin_nsteps = thin_nfast = 0;
+
+  return (0);
+}
@@ -40,11 +40,16 @@
  * if one has questions about whether the more complex 
  * extract option is functioning properly.  
  *
+ * With -mrw, photons which are scattered by electrons in cells that are
+ * optically thick to electron scattering leave them in steps of a modified
+ * random walk, see mrw_step.
+ *
  *
  ***********************************************************/
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <sys/time.h>
 
@@ -56,10 +61,11 @@ long n_lost_to_dfudge = 0;
 
 /**********************************************************/
 /**
- * @brief      int (w,p,iextract) oversees the propagation of a "flight" of photons
+ * @brief      int (w,p,nphot_flight,iextract) oversees the propagation of a "flight" of photons
  *
  * @param [in] WindPtr  w   The entire wind domain
  * @param [in, out] PhotPtr  p   A pointer to a "fligh" of photons
+ * @param [in] int  nphot_flight   The number of photons in the flight
  * @param [in] int  iextract   An integer controlling whether we are to process the
  * flight in the live or die option (0) or whether we also need to extract photons in
  * specific directions (which is usually the case in constructing spectra
@@ -79,64 +85,75 @@ long n_lost_to_dfudge = 0;
  * last point where the photon was in the wind, * not the outer boundary of
  * the radiative transfer
  *
+ * A flight may be all of the photons in a cycle, or one of the batches in which
+ * they are generated.  Progress is reported against the photon numbers
+ * assigned by next_phot_batch, which count through the whole cycle.
+ *
+ * With -photon_waves, the photons of a flight are transported together, in waves,
+ * by trans_phot_waves, rather than one after another, and with -photon_events they
+ * are transported together by trans_phot_events, which processes them in queues of
+ * photons waiting for the same kind of event.
+ *
  **********************************************************/
 
 int
-trans_phot (WindPtr w, PhotPtr p, int iextract)
+trans_phot (WindPtr w, PhotPtr p, int nphot_flight, int iextract)
 {
   int nphot;
   struct photon pp, pextract;
   int nreport;
-  struct timeval timer_t0;
-
-  xsignal (files.root, "%-20s Photon transport started\n", "NOK");
 
-  nreport = NPHOT / 10;
-  Log ("\n");
+  if ((nreport = NPHOT / 10) < 1)
+    nreport = 1;
 
-  timer_t0 = init_timer_t0 ();
+  /* The wind velocities do not change while photons are transported */
+  stencil_cache_vertices (TRUE);
 
-  for (nphot = 0; nphot < NPHOT; nphot++)
+  if (modes.photon_events)
   {
-    p[nphot].np = nphot;
-    check_frame (&p[nphot], F_OBSERVER, "trans_phot: photon not in observer frame as expeced\n");
-
-    if (nphot % nreport == 0)
+    trans_phot_events (w, p, nphot_flight, iextract);
+  }
+  else if (modes.photon_waves)
+  {
+    trans_phot_waves (w, p, nphot_flight, iextract);
+  }
+  else
+  {
+    for (nphot = 0; nphot < nphot_flight; nphot++)
     {
-      if (geo.ioniz_or_extract == CYCLE_IONIZ)
-      {
-        Log (" Ion. Cycle %d/%d of %s : Photon %10d of %10d or %6.1f per cent \n", geo.wcycle + 1, geo.wcycles, files.root, nphot, NPHOT,
-             nphot * 100. / NPHOT);
-      }
-      else
+      check_frame (&p[nphot], F_OBSERVER, "trans_phot: photon not in observer frame as expeced\n");
+
+      if (p[nphot].np % nreport == 0)
       {
-        Log ("Spec. Cycle %d/%d of %s : Photon %10d of %10d or %6.1f per cent \n", geo.pcycle + 1, geo.pcycles, files.root, nphot, NPHOT,
-             nphot * 100. / NPHOT);
+        if (geo.ioniz_or_extract == CYCLE_IONIZ)
+        {
+          Log (" Ion. Cycle %d/%d of %s : Photon %10d of %10d or %6.1f per cent \n", geo.wcycle + 1, geo.wcycles, files.root, p[nphot].np,
+               NPHOT, p[nphot].np * 100. / NPHOT);
+        }
+        else
+        {
+          Log ("Spec. Cycle %d/%d of %s : Photon %10d of %10d or %6.1f per cent \n", geo.pcycle + 1, geo.pcycles, files.root, p[nphot].np,
+               NPHOT, p[nphot].np * 100. / NPHOT);
+        }
       }
-    }
 
-    Log_flush ();
-    stuff_phot (&p[nphot], &pp);
+      Log_flush ();
+      stuff_phot (&p[nphot], &pp);
 
-    /* The next if statement is executed if we are calculating the detailed spectrum and
-     * makes sure we always run extract on the original photon no matter where it
-     * was generated */
+      /* The next if statement is executed if we are calculating the detailed spectrum and
+       * makes sure we always run extract on the original photon no matter where it
+       * was generated */
 
-    if (iextract)
-    {
-      stuff_phot (&p[nphot], &pextract);
-      extract (w, &pextract, pextract.origin);
-    }
+      if (iextract)
+      {
+        stuff_phot (&p[nphot], &pextract);
+        extract (w, &pextract, pextract.origin);
+      }
 
-    trans_phot_single (w, &p[nphot], iextract);
+      trans_phot_single (w, &p[nphot], iextract);
+    }
   }
 
-  Log ("\n");
-
-  print_timer_duration ("!!sirocco: photon transport completed in", timer_t0);
-  //XXXX Delete when understand what is going on with state machines
-  xsignal (files.root, "%-20s Photon transport completed\n", "NOK");
-
   /* Sometimes a photon will scatter near the edge of the wind and get pushed
    * out by DFUDGE. We record these. */
 
@@ -149,6 +166,14 @@ trans_phot (WindPtr w, PhotPtr p, int iextract)
 
   n_lost_to_dfudge = 0;         // reset the counter
 
+  stencil_cache_vertices (FALSE);
+
+  if (modes.thin_cells)
+    thin_cells_report ();
+
+  if (modes.mrw)
+    mrw_report ();
+
   return (0);
 }
 
@@ -191,7 +216,9 @@ trans_phot (WindPtr w, PhotPtr p, int iextract)
  * ### Notes ###
  *
  * This routine is called by trans_phot once for each photon in a flight of photons
- * Internally, there are two main PhotPtrs p, and pp.  pp is a place that
+ * Each pass through the main loop is made by trans_phot_step.
+ * Internally, there are two main PhotPtrs p, and pp (which is held in the
+ * transport_state).  pp is a place that
  * the photon has reached, and p is the location where it is going.  At
  * the end of the main loop before a new cycle, pp is updated.
  *
@@ -204,346 +231,1247 @@ trans_phot (WindPtr w, PhotPtr p, int iextract)
 int
 trans_phot_single (WindPtr w, PhotPtr p, int iextract)
 {
-  double tau_scat, tau;
-  int i, n_grid, ierr;
-  enum istat_enum istat;
-  int nnscat;
-  int current_nres;
-  double weight_min;
-  struct photon pp, pextract;
-  double normal[3];
-  double rho, dz;
-
+  struct transport_state ts;
 
   /* Initialize parameters that are needed for the flight of the photon through the wind */
 
-  stuff_phot (p, &pp);
-  tau_scat = -log (1. - random_number (0.0, 1.0));
-  weight_min = EPSILON * pp.w;
-  istat = P_INWIND;
-  tau = 0;
+  trans_phot_start (p, &ts);
+
+  /* This is the loop for a single photon, which executes until the photon leaves the wind */
+
+  while (trans_phot_step (w, p, &ts, iextract));
+
+  /* This is set up for looking at photons in spectral cycles at present */
+  // if (modes.save_photons && geo.ioniz_or_extract == CYCLE_EXTRACT)
+  //   save_photons (&pp, "End");
+
+  return (0);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Prepare a photon to be transported through the wind by trans_phot_step
+ *
+ * @param [in] PhotPtr  p   The photon (in the observer frame)
+ * @param [out] TransportPtr  ts   The state of the photon during its flight
+ * @return     Always returns 0
+ *
+ * @details
+ * The random optical depth to the first scatter is drawn here
+ *
+ **********************************************************/
+
+int
+trans_phot_start (p, ts)
+     PhotPtr p;
+     TransportPtr ts;
+{
+  stuff_phot (p, &ts->pp);
+  ts->tau_scat = -log (1. - random_number (0.0, 1.0));
+  ts->weight_min = EPSILON * ts->pp.w;
+  ts->tau = 0;
+
+  return (0);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Translate a photon through one cell, and check whether it has hit the star or disk
+ *
+ * @param [in] WindPtr  w   The entire wind
+ * @param [in, out] PhotPtr  p   The photon (in the observer frame)
+ * @param [in, out] TransportPtr  ts   The state of the photon during its flight
+ * @return     FALSE if the flight of the photon has ended, TRUE otherwise
+ *
+ * @details
+ * The outcome, which decides what trans_phot_step does next, is left in ts->istat
+ * and the resonance the photon stopped at in ts->nres
+ *
+ **********************************************************/
 
-  /* This is the beginning of the loop for a single photon and executes until the photon leaves the wind */
+static int
+trans_phot_move (w, p, ts)
+     WindPtr w;
+     PhotPtr p;
+     TransportPtr ts;
+{
+  PhotPtr pp;
+
+  pp = &ts->pp;
+
+  /* The call to translate below involves only a single cell (or alternatively a single transfer 
+     in the windless region). The returned value, istat, should either 1) be P_INWIND in which case the photon
+     hit the other side of the cell without scattering, 2) P_SCAT in which case there was a scattering event
+     in the cell, 3) P_ESCAPE in which case the photon reached the outside edge of the grid and escaped, 4)
+     P_STAR in which case it reach the inner central object, etc. If the photon escapes then we leave the
+     photon at the position of it's last scatter.  In most other cases though we store the final 
+     position of the photon. */
+
+  ts->istat = translate (w, pp, ts->tau_scat, &ts->tau, &ts->nres);
 
-  while (istat == P_INWIND)
+  if (ts->istat == P_ERROR)
   {
+    Error ("trans_phot: abnormal return from translate on photon %d\n", p->np);
+    return (FALSE);
+  }
+
+  if (pp->w < ts->weight_min)
+  {
+    pp->istat = P_ABSORB;
+    pp->tau = VERY_BIG;
+    stuff_phot (pp, p);
+    return (FALSE);
+  }
+
+  /* Check boundary with walls - note that pp is the proposed new photon location
+   * and p is the "original" location of the photon */
+
+  ts->istat = walls (pp, p, ts->normal);
+
+  return (TRUE);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Reflect or absorb a photon which has hit the star
+ *
+ * @param [in] WindPtr  w   The entire wind
+ * @param [in, out] PhotPtr  p   The photon (in the observer frame)
+ * @param [in, out] TransportPtr  ts   The state of the photon during its flight
+ * @param [in] int  iextract   If TRUE, extract the photon if it is scattered or reflected
+ * @return     FALSE if the flight of the photon has ended, TRUE otherwise
+ *
+ *
+ **********************************************************/
+
+static int
+trans_phot_hit_star (w, p, ts, iextract)
+     WindPtr w;
+     PhotPtr p;
+     TransportPtr ts;
+     int iextract;
+{
+  PhotPtr pp;
+  struct photon pextract;
 
-    /* The call to translate below involves only a single cell (or alternatively a single transfer 
-       in the windless region). The returned value, istat, should either 1) be P_INWIND in which case the photon
-       hit the other side of the cell without scattering, 2) P_SCAT in which case there was a scattering event
-       in the cell, 3) P_ESCAPE in which case the photon reached the outside edge of the grid and escaped, 4)
-       P_STAR in which case it reach the inner central object, etc. If the photon escapes then we leave the
-       photon at the position of it's last scatter.  In most other cases though we store the final 
-       position of the photon. */
+  pp = &ts->pp;
 
-    istat = translate (w, &pp, tau_scat, &tau, &current_nres);
+  /*
+   * The photon has hit the star. Reflect or absorb.
+   */
 
-    if (istat == P_ERROR)
+  geo.lum_star_back += pp->w;
+  spec_add_one (pp, SPEC_HITSURF);
+
+  /* The a new photon direction needs to be defined that will cause the photon to continue in the wind.
+   * Since this is effectively a scattering event we also have to extract a photon to construct the
+   * detailed spectrum.
+   */
+
+  if (geo.absorb_reflect == BACK_RAD_SCATTER)
+  {
+    randvcos (pp->lmn, ts->normal);
+    if (move_phot (pp, DFUDGE))
     {
-      Error ("trans_phot: abnormal return from translate on photon %d\n", p->np);
-      break;
+      Error ("trans_phot_single: photon not in correct frame when reflecting off of star\n");
     }
 
-    if (pp.w < weight_min)
+    p->ds = 0;
+    ts->tau_scat = -log (1. - random_number (0.0, 1.0));
+    ts->istat = pp->istat = P_INWIND;    /* Set the status back to P_INWIND so the photon will continue */
+    ts->tau = 0;
+    stuff_phot (pp, p);
+
+    if (iextract)
     {
-      pp.istat = P_ABSORB;
-      pp.tau = VERY_BIG;
-      stuff_phot (&pp, p);
-      break;
+      stuff_phot (pp, &pextract);
+      extract (w, &pextract, PTYPE_STAR);   // Treat as stellar photon for purpose of extraction
     }
+  }
+  else                      /*Photons that hit the star are simply absorbed  */
+  {
+    stuff_phot (pp, p);
+    return (FALSE);
+  }
 
-    /* Check boundary with walls - note that pp is the proposed new photon location
-     * and p is the "original" location of the photon */
+  return (TRUE);
+}
 
-    istat = walls (&pp, p, normal);
 
 
-    if (istat == P_HIT_STAR)
-    {
+/**********************************************************/
+/**
+ * @brief      Reflect or absorb a photon which has hit the disk
+ *
+ * @param [in] WindPtr  w   The entire wind
+ * @param [in, out] PhotPtr  p   The photon (in the observer frame)
+ * @param [in, out] TransportPtr  ts   The state of the photon during its flight
+ * @param [in] int  iextract   If TRUE, extract the photon if it is scattered or reflected
+ * @return     FALSE if the flight of the photon has ended, TRUE otherwise
+ *
+ *
+ **********************************************************/
+
+static int
+trans_phot_hit_disk (w, p, ts, iextract)
+     WindPtr w;
+     PhotPtr p;
+     TransportPtr ts;
+     int iextract;
+{
+  int i;
+  PhotPtr pp;
+  struct photon pextract;
+  double rho, dz;
+
+  pp = &ts->pp;
+
+  /*
+   * The photon has hit the disk. Reflect or absorb.
+   */
+
+  /* Store the energy of the photon bundle into a disk structure so that one
+     can determine later how much and where the disk was heated by photons.
+     Note that the disk is defined from 0 to NRINGS-2. NRINGS-1 contains the
+     position of the outer radius of the disk. */
+
+  rho = sqrt (pp->x[0] * pp->x[0] + pp->x[1] * pp->x[1]);
 
-      /*
-       * The photon has hit the star. Reflect or absorb.
-       */
+  i = 0;
+  while (rho > qdisk.r[i] && i < NRINGS - 1)
+    i++;
+  i--;                      /* So that the heating refers to the heating between i and i+1 */
 
-      geo.lum_star_back += pp.w;
-      spec_add_one (&pp, SPEC_HITSURF);
+  qdisk.nhit[i]++;
+  geo.lum_disk_back = qdisk.heat[i] += pp->w;
+  qdisk.ave_freq[i] += pp->w * pp->freq;
 
-      /* The a new photon direction needs to be defined that will cause the photon to continue in the wind.
-       * Since this is effectively a scattering event we also have to extract a photon to construct the
-       * detailed spectrum.
-       */
+  if (geo.absorb_reflect == BACK_RAD_SCATTER)
+  {
+    /*
+     * If the disk is vertically extended, then we need to move the photon
+     * outside of the disk and push it by a little amount. It's unclear
+     * to me why we haven't used dfudge here.
+     */
 
-      if (geo.absorb_reflect == BACK_RAD_SCATTER)
+    if (geo.disk_type == DISK_VERTICALLY_EXTENDED)
+    {
+      dz = (zdisk (rho) - fabs (pp->x[2]));
+      if (dz > 0)
       {
-        randvcos (pp.lmn, normal);
-        if (move_phot (&pp, DFUDGE))
+        if (pp->x[2] > 0)
         {
-          Error ("trans_phot_single: photon not in correct frame when reflecting off of star\n");
+          pp->x[2] += (dz + 1000.);
         }
-
-        p->ds = 0;
-        tau_scat = -log (1. - random_number (0.0, 1.0));
-        istat = pp.istat = P_INWIND;    /* Set the status back to P_INWIND so the photon will continue */
-        tau = 0;
-        stuff_phot (&pp, p);
-
-        if (iextract)
+        else
         {
-          stuff_phot (&pp, &pextract);
-          extract (w, &pextract, PTYPE_STAR);   // Treat as stellar photon for purpose of extraction
+          pp->x[2] -= (dz + 1000.);
         }
       }
-      else                      /*Photons that hit the star are simply absorbed  */
-      {
-        stuff_phot (&pp, p);
-        break;
-      }
     }
 
-    if (istat == P_HIT_DISK)
+    spec_add_one (pp, SPEC_HITSURF);
+
+    /* If we got here, a new photon direction needs to be defined that will cause the photon
+     * to continue in the wind.  Since this is effectively a scattering event we also have to
+     * extract a photon to construct the detailed spectrum.
+     */
+
+    randvcos (pp->lmn, ts->normal);
+    p->ds = 0;
+    ts->tau_scat = -log (1. - random_number (0.0, 1.0));
+    ts->istat = pp->istat = P_INWIND;
+    ts->tau = 0;
+    stuff_phot (pp, p);
+
+    if (iextract)
     {
-      /*
-       * The photon has hit the disk. Reflect or absorb.
-       */
+      stuff_phot (pp, &pextract);
+      extract (w, &pextract, PTYPE_DISK);
+    }
+  }
+  else                      /* Photons that hit the disk are to be absorbed */
+  {
+    stuff_phot (pp, p);
+    return (FALSE);
+  }
 
-      /* Store the energy of the photon bundle into a disk structure so that one
-         can determine later how much and where the disk was heated by photons.
-         Note that the disk is defined from 0 to NRINGS-2. NRINGS-1 contains the
-         position of the outer radius of the disk. */
+  return (TRUE);
+}
 
-      rho = sqrt (pp.x[0] * pp.x[0] + pp.x[1] * pp.x[1]);
 
-      i = 0;
-      while (rho > qdisk.r[i] && i < NRINGS - 1)
-        i++;
-      i--;                      /* So that the heating refers to the heating between i and i+1 */
 
-      qdisk.nhit[i]++;
-      geo.lum_disk_back = qdisk.heat[i] += pp.w;
-      qdisk.ave_freq[i] += pp.w * pp.freq;
+/**********************************************************/
+/**
+ * @brief      Scatter a photon which has reached its scattering optical depth in the wind
+ *
+ * @param [in] WindPtr  w   The entire wind
+ * @param [in, out] PhotPtr  p   The photon (in the observer frame)
+ * @param [in, out] TransportPtr  ts   The state of the photon during its flight
+ * @param [in] int  iextract   If TRUE, extract the photon if it is scattered or reflected
+ * @return     FALSE if the flight of the photon has ended, TRUE otherwise
+ *
+ *
+ **********************************************************/
 
-      if (geo.absorb_reflect == BACK_RAD_SCATTER)
-      {
-        /*
-         * If the disk is vertically extended, then we need to move the photon
-         * outside of the disk and push it by a little amount. It's unclear
-         * to me why we haven't used dfudge here.
-         */
+static int
+trans_phot_scatter (w, p, ts, iextract)
+     WindPtr w;
+     PhotPtr p;
+     TransportPtr ts;
+     int iextract;
+{
+  int n_grid, ierr;
+  int nnscat;
+  PhotPtr pp;
+  struct photon pextract;
 
-        if (geo.disk_type == DISK_VERTICALLY_EXTENDED)
-        {
-          dz = (zdisk (rho) - fabs (pp.x[2]));
-          if (dz > 0)
-          {
-            if (pp.x[2] > 0)
-            {
-              pp.x[2] += (dz + 1000.);
-            }
-            else
-            {
-              pp.x[2] -= (dz + 1000.);
-            }
-          }
-        }
+  pp = &ts->pp;
 
-        spec_add_one (&pp, SPEC_HITSURF);
+  /*
+   * The photon has scattered, as either a resonance or continuum scatter.
+   */
 
-        /* If we got here, a new photon direction needs to be defined that will cause the photon
-         * to continue in the wind.  Since this is effectively a scattering event we also have to
-         * extract a photon to construct the detailed spectrum.
-         */
+  pp->grid = n_grid = where_in_grid (wmain[pp->grid].ndom, pp->x);
 
-        randvcos (pp.lmn, normal);
-        p->ds = 0;
-        tau_scat = -log (1. - random_number (0.0, 1.0));
-        istat = pp.istat = P_INWIND;
-        tau = 0;
-        stuff_phot (&pp, p);
+  if (n_grid < 0)
+  {
+    Error ("trans_phot: trying to scatter a photon which is not in the wind grid and the photon has been lost\n");
+    Error ("trans_phot: %d grid %3d x %8.2e %8.2e %8.2e (%8.2e)\n", pp->np, pp->grid, pp->x[0], pp->x[1], pp->x[2],
+           sqrt (pp->x[0] * pp->x[0] + pp->x[1] * pp->x[1] + pp->x[2] * pp->x[2]));
+    pp->istat = P_ERROR;
+    stuff_phot (pp, p);
+    return (FALSE);
+  }
 
-        if (iextract)
-        {
-          stuff_phot (&pp, &pextract);
-          extract (w, &pextract, PTYPE_DISK);
-        }
-      }
-      else                      /* Photons that hit the disk are to be absorbed */
-      {
-        stuff_phot (&pp, p);
-        break;
-      }
-    }
+  if (wmain[n_grid].nplasma == NPLASMA)     /* If the next error reoccurs, see Issue #154 (on GitHub) for discussion */
+  {
+    Error ("trans_phot: Trying to scatter a photon which is not in a cell in the plasma structure\n");
+    Error ("trans_phot: %d grid %3d x %8.2e %8.2e %8.2e\n", pp->np, pp->grid, pp->x[0], pp->x[1], pp->x[2]);
+    Error ("trans_phot: This photon is effectively lost!\n");
+    pp->istat = P_ERROR;
+    stuff_phot (pp, p);
+    return (FALSE);
+  }
 
-    if (istat == P_SCAT)
-    {
+  if (wmain[n_grid].inwind < 0)
+  {
+    Error ("trans_phot: Trying to scatter a photon in a cell with no wind volume and the photon has been lost\n");
+    Error ("trans_phot: istat %d %d grid %3d x %8.2e %8.2e %8.2e\n", ts->istat, pp->np, pp->grid, pp->x[0], pp->x[1], pp->x[2]);
+    pp->istat = P_ERROR;
+    stuff_phot (pp, p);
+    return (FALSE);
+  }
 
-      /*
-       * The photon has scattered, as either a resonance or continuum scatter.
-       */
+  /* Add path lengths for reverberation mapping */
 
-      pp.grid = n_grid = where_in_grid (wmain[pp.grid].ndom, pp.x);
+  if ((geo.reverb == REV_WIND || geo.reverb == REV_MATOM) && geo.ioniz_or_extract == CYCLE_IONIZ && geo.wcycle == geo.wcycles - 1)
+  {
+    wind_paths_add_phot (&wmain[n_grid], pp);
+  }
 
-      if (n_grid < 0)
-      {
-        Error ("trans_phot: trying to scatter a photon which is not in the wind grid and the photon has been lost\n");
-        Error ("trans_phot: %d grid %3d x %8.2e %8.2e %8.2e (%8.2e)\n", pp.np, pp.grid, pp.x[0], pp.x[1], pp.x[2],
-               sqrt (pp.x[0] * pp.x[0] + pp.x[1] * pp.x[1] + pp.x[2] * pp.x[2]));
-        pp.istat = P_ERROR;
-        stuff_phot (&pp, p);
-        break;
-      }
+  nnscat = 1;
+  pp->nscat++;
 
-      if (wmain[n_grid].nplasma == NPLASMA)     /* If the next error reoccurs, see Issue #154 (on GitHub) for discussion */
-      {
-        Error ("trans_phot: Trying to scatter a photon which is not in a cell in the plasma structure\n");
-        Error ("trans_phot: %d grid %3d x %8.2e %8.2e %8.2e\n", pp.np, pp.grid, pp.x[0], pp.x[1], pp.x[2]);
-        Error ("trans_phot: This photon is effectively lost!\n");
-        pp.istat = P_ERROR;
-        stuff_phot (&pp, p);
-        break;
-      }
+  if (ts->nres == NRES_ES)
+  {
+    stuff_phot (pp, &pextract);
+  }
 
-      if (wmain[n_grid].inwind < 0)
-      {
-        Error ("trans_phot: Trying to scatter a photon in a cell with no wind volume and the photon has been lost\n");
-        Error ("trans_phot: istat %d %d grid %3d x %8.2e %8.2e %8.2e\n", istat, pp.np, pp.grid, pp.x[0], pp.x[1], pp.x[2]);
-        pp.istat = P_ERROR;
-        stuff_phot (&pp, p);
-        break;
-      }
+  if ((ierr = scatter (pp, &ts->nres, &nnscat)))       // pp is modified
+  {
+    Error ("trans_phot_single: photon %d returned error code %d whilst scattering \n", pp->np, ierr);
+  }
 
-      /* Add path lengths for reverberation mapping */
+  if (geo.matom_radiation == 1 && geo.rt_mode == RT_MODE_MACRO && pp->w < ts->weight_min)
+  {
+    pp->istat = P_ABSORB;
+    pp->tau = VERY_BIG;
+    stuff_phot (pp, p);
+    return (FALSE);
+  }
 
-      if ((geo.reverb == REV_WIND || geo.reverb == REV_MATOM) && geo.ioniz_or_extract == CYCLE_IONIZ && geo.wcycle == geo.wcycles - 1)
-      {
-        wind_paths_add_phot (&wmain[n_grid], &pp);
-      }
+  /* If this is a BB interaction, calculate the line heating
+   * and break the transport loop if it was absorbed */
 
-      nnscat = 1;
-      pp.nscat++;
+  if (ts->nres > -1 && ts->nres < nlines)
+  {
+    pp->nrscat++;
 
-      if (current_nres == NRES_ES)
-      {
-        stuff_phot (&pp, &pextract);
-      }
+    if (modes.track_resonant_scatters)
+      track_scatters (pp, wmain[n_grid].nplasma, "Resonant");
 
-      if ((ierr = scatter (&pp, &current_nres, &nnscat)))       // pp is modified
-      {
-        Error ("trans_phot_single: photon %d returned error code %d whilst scattering \n", pp.np, ierr);
-      }
+    plasmamain[wmain[n_grid].nplasma].scatters[line[ts->nres].nion] += 1;
 
-      if (geo.matom_radiation == 1 && geo.rt_mode == RT_MODE_MACRO && pp.w < weight_min)
-      {
-        pp.istat = P_ABSORB;
-        pp.tau = VERY_BIG;
-        stuff_phot (&pp, p);
-        break;
-      }
+    if (geo.rt_mode == RT_MODE_2LEVEL)
+    {
+      line_heat (&plasmamain[wmain[n_grid].nplasma], pp, ts->nres);
+    }
 
-      /* If this is a BB interaction, calculate the line heating
-       * and break the transport loop if it was absorbed */
+    if (pp->w < ts->weight_min)
+    {
+      pp->istat = P_ABSORB;
+      pp->tau = VERY_BIG;
+      stuff_phot (pp, p);
+      return (FALSE);
+    }
+  }
 
-      if (current_nres > -1 && current_nres < nlines)
-      {
-        pp.nrscat++;
+  if (pp->w < ts->weight_min)
+  {
+    pp->istat = P_ABSORB;
+    pp->tau = VERY_BIG;
+    stuff_phot (pp, p);
+    return (FALSE);
+  }
 
-        if (modes.track_resonant_scatters)
-          track_scatters (&pp, wmain[n_grid].nplasma, "Resonant");
+  if (pp->istat == P_ERROR_MATOM || pp->istat == P_LOFREQ_FF || pp->istat == P_ADIABATIC)
+  {
+    p->istat = pp->istat;
+    pp->tau = VERY_BIG;
+    stuff_phot (pp, p);
+    return (FALSE);
+  }
 
-        plasmamain[wmain[n_grid].nplasma].scatters[line[current_nres].nion] += 1;
+  /* Now extract photons if we are in detailed the detailed spectrum portion of the program
+   * N.B. To use the anisotropic scattering option, extract needs to follow scatter.
+   * This is because the re-weighting which occurs in extract needs the pdf for scattering
+   * to have been initialized
+   *
+   * For BB photons the photon we pass to extract is the one that has been scattered, but
+   * for ES we pass the photon prior to scattering.
+   */
 
-        if (geo.rt_mode == RT_MODE_2LEVEL)
-        {
-          line_heat (&plasmamain[wmain[n_grid].nplasma], &pp, current_nres);
-        }
+  if (iextract)
+  {
+    if (ts->nres != NRES_ES)
+    {
+      stuff_phot (pp, &pextract);
+    }
+    pextract.nnscat = nnscat;
+    extract (w, &pextract, PTYPE_WIND);
+  }
 
-        if (pp.w < weight_min)
-        {
-          pp.istat = P_ABSORB;
-          pp.tau = VERY_BIG;
-          stuff_phot (&pp, p);
-          break;
-        }
-      }
+  /* Reinitialize parameters for the scattered photon so it can can continue through the wind
+   */
 
-      if (pp.w < weight_min)
-      {
-        pp.istat = P_ABSORB;
-        pp.tau = VERY_BIG;
-        stuff_phot (&pp, p);
-        break;
-      }
+  ts->tau = 0;
+  ts->tau_scat = -log (1. - random_number (0.0, 1.0));
+  pp->istat = P_INWIND;
+  pp->ds = 0;
 
-      if (pp.istat == P_ERROR_MATOM || pp.istat == P_LOFREQ_FF || pp.istat == P_ADIABATIC)
-      {
-        p->istat = pp.istat;
-        pp.tau = VERY_BIG;
-        stuff_phot (&pp, p);
-        break;
-      }
+  /* If the photon was scattered by an electron in an optically thick cell, it leaves
+     the region in one step of a random walk, rather than by scattering many more times */
 
-      /* Now extract photons if we are in detailed the detailed spectrum portion of the program
-       * N.B. To use the anisotropic scattering option, extract needs to follow scatter.
-       * This is because the re-weighting which occurs in extract needs the pdf for scattering
-       * to have been initialized
-       *
-       * For BB photons the photon we pass to extract is the one that has been scattered, but
-       * for ES we pass the photon prior to scattering.
-       */
+  if (modes.mrw && ts->nres == NRES_ES)
+    mrw_step (w, pp, iextract);
 
-      if (iextract)
-      {
-        if (current_nres != NRES_ES)
-        {
-          stuff_phot (&pp, &pextract);
-        }
-        pextract.nnscat = nnscat;
-        extract (w, &pextract, PTYPE_WIND);
-      }
+  stuff_phot (pp, p);
+  ts->istat = p->istat;
 
-      /* Reinitialize parameters for the scattered photon so it can can continue through the wind
-       */
+  return (TRUE);
+}
 
-      tau = 0;
-      tau_scat = -log (1. - random_number (0.0, 1.0));
-      pp.istat = P_INWIND;
-      pp.ds = 0;
 
-      stuff_phot (&pp, p);
-      istat = p->istat;
-    }
 
-    /*
-     * Now we check if a photon has gotten stuck scattering in the wind, this
-     * is mostly done for speed concerns as it is pointless to track photons which
-     * are probably low weight and not contributing. However, in some cases MAXSCAT
-     * should be increased to stop the code from throwing away too many photons
-     */
+/**********************************************************/
+/**
+ * @brief      Finish a step of a photon through the wind
+ *
+ * @param [in, out] PhotPtr  p   The photon (in the observer frame)
+ * @param [in, out] TransportPtr  ts   The state of the photon during its flight
+ * @return     TRUE if the photon is still in the wind and should be moved again,
+ * FALSE if its flight has ended
+ *
+ * @details
+ * Photons which have scattered too many times, or for which the macro atom
+ * machinery failed, are stopped
+ *
+ **********************************************************/
 
-    if (pp.nscat == MAXSCAT)
-    {
-      pp.istat = P_TOO_MANY_SCATTERS;
-      stuff_phot (&pp, p);
-      break;
-    }
+static int
+trans_phot_end_step (p, ts)
+     PhotPtr p;
+     TransportPtr ts;
+{
+  PhotPtr pp;
 
-    if (pp.istat == P_ERROR_MATOM || pp.istat == P_LOFREQ_FF || pp.istat == P_ADIABATIC)
-    {
-      p->istat = pp.istat;
-      stuff_phot (&pp, p);
-      break;
-    }
+  pp = &ts->pp;
+
+  /*
+   * Now we check if a photon has gotten stuck scattering in the wind, this
+   * is mostly done for speed concerns as it is pointless to track photons which
+   * are probably low weight and not contributing. However, in some cases MAXSCAT
+   * should be increased to stop the code from throwing away too many photons
+   */
+
+  if (pp->nscat == MAXSCAT)
+  {
+    pp->istat = P_TOO_MANY_SCATTERS;
+    stuff_phot (pp, p);
+    return (FALSE);
+  }
 
-    /* This is an insurance policy but it is not obvious that, for example nscat
-     * and nrscat, need to be updated */
-    p->istat = istat;
-    p->nscat = pp.nscat;
-    p->nrscat = pp.nrscat;
-    p->w = pp.w;
+  if (pp->istat == P_ERROR_MATOM || pp->istat == P_LOFREQ_FF || pp->istat == P_ADIABATIC)
+  {
+    p->istat = pp->istat;
+    stuff_phot (pp, p);
+    return (FALSE);
   }
 
-  /* This is set up for looking at photons in spectral cycles at present */
-  // if (modes.save_photons && geo.ioniz_or_extract == CYCLE_EXTRACT)
-  //   save_photons (&pp, "End");
+  /* This is an insurance policy but it is not obvious that, for example nscat
+   * and nrscat, need to be updated */
+  p->istat = ts->istat;
+  p->nscat = pp->nscat;
+  p->nrscat = pp->nrscat;
+  p->w = pp->w;
+
+  return (ts->istat == P_INWIND);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Move a photon through a single cell of the wind, and deal with
+ * whatever it meets there
+ *
+ * @param [in] WindPtr  w   The entire wind
+ * @param [in, out] PhotPtr  p   The photon (in the observer frame)
+ * @param [in, out] TransportPtr  ts   The state of the photon during its flight, set
+ * up by trans_phot_start
+ * @param [in] int  iextract   If 0, then process this photon in the live or die option, without
+ * calling extract
+ * @return     TRUE if the photon is still in the wind and should be moved again,
+ * FALSE if its flight has ended
+ *
+ * @details
+ * This is one pass of the main loop of trans_phot_single.  The photon is translated,
+ * checked against the walls by trans_phot_move, and then reflected or scattered if
+ * need be, by trans_phot_hit_star, trans_phot_hit_disk or trans_phot_scatter.
+ * When the flight has ended p holds the final state of the photon.
+ *
+ * Since everything about the flight of a photon between calls is held in p and ts,
+ * the flights of many photons can be interleaved, as in trans_phot_waves, or the
+ * stages of a step can be carried out for many photons at a time, as in
+ * trans_phot_events.
+ *
+ **********************************************************/
+
+int
+trans_phot_step (w, p, ts, iextract)
+     WindPtr w;
+     PhotPtr p;
+     TransportPtr ts;
+     int iextract;
+{
+  if (trans_phot_move (w, p, ts) == FALSE)
+    return (FALSE);
+
+  if (ts->istat == P_HIT_STAR && trans_phot_hit_star (w, p, ts, iextract) == FALSE)
+    return (FALSE);
+
+  if (ts->istat == P_HIT_DISK && trans_phot_hit_disk (w, p, ts, iextract) == FALSE)
+    return (FALSE);
+
+  if (ts->istat == P_SCAT && trans_phot_scatter (w, p, ts, iextract) == FALSE)
+    return (FALSE);
+
+  return (trans_phot_end_step (p, ts));
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Find the bin a photon is sorted into by trans_phot_sort_by_cell
+ *
+ * @param [in] PhotPtr  p   The photon
+ * @param [in] int  ncell   The number of bins
+ * @return     The cell of wmain the photon is in plus one, or 0 if it is not in the grid
+ *
+ **********************************************************/
+
+static int
+trans_phot_wave_cell (p, ncell)
+     PhotPtr p;
+     int ncell;
+{
+  if (p->grid < 0 || p->grid >= ncell - 1)
+    return (0);
+  return (p->grid + 1);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Sort a list of photons in flight by the cell of the wind they are in
+ *
+ * @param [in] TransportPtr  ts   The states of all of the photons in the flight
+ * @param [in, out] int *  list   The photons to sort, as indices into ts
+ * @param [in] int  n   The number of photons in the list
+ * @param [out] int *  work   Space for n indices
+ * @param [out] int *  count   Space for ncell+1 counts
+ * @param [in] int  ncell   The number of bins, geo.ndim2+1
+ * @return     Always returns 0
+ *
+ * @details
+ * This is a counting sort on pp.grid, which keeps photons in the same cell in
+ * their original order
+ *
+ **********************************************************/
+
+static int
+trans_phot_sort_by_cell (ts, list, n, work, count, ncell)
+     TransportPtr ts;
+     int *list;
+     int n;
+     int *work;
+     int *count;
+     int ncell;
+{
+  int i;
+
+  memset (count, 0, (ncell + 1) * sizeof (int));
+  for (i = 0; i < n; i++)
+  {
+    count[trans_phot_wave_cell (&ts[list[i]].pp, ncell) + 1]++;
+  }
+  for (i = 1; i <= ncell; i++)
+  {
+    count[i] += count[i - 1];
+  }
+  for (i = 0; i < n; i++)
+  {
+    work[count[trans_phot_wave_cell (&ts[list[i]].pp, ncell)]++] = list[i];
+  }
+  memcpy (list, work, n * sizeof (int));
+
+  return (0);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Transport a flight of photons through the wind together, in waves
+ *
+ * @param [in] WindPtr  w   The entire wind
+ * @param [in, out] PhotPtr  p   The flight of photons
+ * @param [in] int  nphot_flight   The number of photons in the flight
+ * @param [in] int  iextract   If 0, then process the photons in the live or die option, without
+ * calling extract
+ * @return     The number of waves
+ *
+ * @details
+ * In each wave, every photon which is still in flight is moved through one cell
+ * by trans_phot_step.  The photons that remain are then sorted by the cell of the
+ * wind they are in, so that in the next wave consecutive photons use the same
+ * wind and plasma cells, and the same lines, while they are still in the cache.
+ * The sort is made by trans_phot_sort_by_cell.
+ *
+ * The photons are statistically the same as those transported one after
+ * another by trans_phot_single, but since the random numbers are drawn in a
+ * different order the results are not identical.
+ *
+ **********************************************************/
+
+int
+trans_phot_waves (w, p, nphot_flight, iextract)
+     WindPtr w;
+     PhotPtr p;
+     int nphot_flight;
+     int iextract;
+{
+  TransportPtr ts;
+  struct photon pextract;
+  int *live, *sorted, *count;
+  int n, ncell, nlive, nnext, nwave, nreport, nfinished;
+
+  if (nphot_flight <= 0)
+    return (0);
+
+  ncell = geo.ndim2 + 1;        /* Photons outside the grid are counted in the first bin */
+
+  ts = calloc (nphot_flight, sizeof (struct transport_state));
+  live = calloc (nphot_flight, sizeof (int));
+  sorted = calloc (nphot_flight, sizeof (int));
+  count = calloc (ncell + 1, sizeof (int));
+
+  if (ts == NULL || live == NULL || sorted == NULL || count == NULL)
+  {
+    Error ("trans_phot_waves: Could not allocate memory for %d photons\n", nphot_flight);
+    Exit (EXIT_FAILURE);
+  }
+
+  if ((nreport = nphot_flight / 10) < 1)
+    nreport = 1;
+
+  for (n = 0; n < nphot_flight; n++)
+  {
+    check_frame (&p[n], F_OBSERVER, "trans_phot_waves: photon not in observer frame as expeced\n");
+
+    /* As in trans_phot, extract the original photon no matter where it was generated */
+    if (iextract)
+    {
+      stuff_phot (&p[n], &pextract);
+      extract (w, &pextract, pextract.origin);
+    }
+
+    trans_phot_start (&p[n], &ts[n]);
+    live[n] = n;
+  }
+
+  nlive = nphot_flight;
+  nwave = 0;
+  nfinished = 0;
+
+  while (nlive > 0)
+  {
+    /* Move each photon in flight through one cell */
+
+    nnext = 0;
+    for (n = 0; n < nlive; n++)
+    {
+      if (trans_phot_step (w, &p[live[n]], &ts[live[n]], iextract))
+        live[nnext++] = live[n];
+    }
+    nwave++;
+
+    if ((nphot_flight - nnext) / nreport > nfinished / nreport)
+    {
+      Log ("%s Cycle %d/%d of %s : %10d of %10d photons have finished after %6d waves\n",
+           geo.ioniz_or_extract == CYCLE_IONIZ ? " Ion." : "Spec.",
+           (geo.ioniz_or_extract == CYCLE_IONIZ ? geo.wcycle : geo.pcycle) + 1,
+           geo.ioniz_or_extract == CYCLE_IONIZ ? geo.wcycles : geo.pcycles, files.root, nphot_flight - nnext, nphot_flight, nwave);
+      Log_flush ();
+    }
+    nfinished = nphot_flight - nnext;
+    nlive = nnext;
+
+    /* Sort the photons which are still in flight by the cell they are in */
+
+    trans_phot_sort_by_cell (ts, live, nlive, sorted, count, ncell);
+  }
+
+  Log ("trans_phot_waves: %d photons were transported in %d waves\n", nphot_flight, nwave);
+
+  free (ts);
+  free (live);
+  free (sorted);
+  free (count);
+
+  return (nwave);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Transport a flight of photons through the wind by processing
+ * queues of photons which are waiting for the same kind of event
+ *
+ * @param [in] WindPtr  w   The entire wind
+ * @param [in, out] PhotPtr  p   The flight of photons
+ * @param [in] int  nphot_flight   The number of photons in the flight
+ * @param [in] int  iextract   If 0, then process the photons in the live or die option, without
+ * calling extract
+ * @return     The number of rounds in which the queues were processed
+ *
+ * @details
+ * This is an event-based alternative to the history-based trans_phot_single.  The
+ * photons in flight are held in one of four queues, according to what happens to
+ * them next: moving through a cell, reflection from the star, reflection from the
+ * disk, or scattering.  In each round the queues are processed in turn, each by a
+ * loop which calls just one of trans_phot_move, trans_phot_hit_star,
+ * trans_phot_hit_disk or trans_phot_scatter for all of the photons in it, so that
+ * the same code and (since the move and scatter queues are sorted by cell) the same
+ * wind data are used repeatedly.  A photon which can continue after its event is
+ * put back on the move queue for the next round.
+ *
+ * Each photon goes through exactly the same sequence of events as in
+ * trans_phot_step, so the results are statistically the same as those of
+ * trans_phot_single, but as the random numbers are drawn in a different order
+ * they are not identical.
+ *
+ **********************************************************/
+
+int
+trans_phot_events (w, p, nphot_flight, iextract)
+     WindPtr w;
+     PhotPtr p;
+     int nphot_flight;
+     int iextract;
+{
+  TransportPtr ts;
+  struct photon pextract;
+  int *move, *star, *disk, *scat, *work, *count;
+  int n, k, ncell, nmove, nstar, ndisk, nscat, nnext, nround, nreport, nfinished;
+  long nevents[4];
+
+  if (nphot_flight <= 0)
+    return (0);
+
+  ncell = geo.ndim2 + 1;
+
+  ts = calloc (nphot_flight, sizeof (struct transport_state));
+  move = calloc (nphot_flight, sizeof (int));
+  star = calloc (nphot_flight, sizeof (int));
+  disk = calloc (nphot_flight, sizeof (int));
+  scat = calloc (nphot_flight, sizeof (int));
+  work = calloc (nphot_flight, sizeof (int));
+  count = calloc (ncell + 1, sizeof (int));
+
+  if (ts == NULL || move == NULL || star == NULL || disk == NULL || scat == NULL || work == NULL || count == NULL)
+  {
+    Error ("trans_phot_events: Could not allocate memory for %d photons\n", nphot_flight);
+    Exit (EXIT_FAILURE);
+  }
+
+  if ((nreport = nphot_flight / 10) < 1)
+    nreport = 1;
+
+  for (n = 0; n < nphot_flight; n++)
+  {
+    check_frame (&p[n], F_OBSERVER, "trans_phot_events: photon not in observer frame as expeced\n");
+
+    /* As in trans_phot, extract the original photon no matter where it was generated */
+    if (iextract)
+    {
+      stuff_phot (&p[n], &pextract);
+      extract (w, &pextract, pextract.origin);
+    }
+
+    trans_phot_start (&p[n], &ts[n]);
+    move[n] = n;
+  }
+
+  nmove = nphot_flight;
+  nround = 0;
+  nfinished = 0;
+  nevents[0] = nevents[1] = nevents[2] = nevents[3] = 0;
+
+  while (nmove > 0)
+  {
+    /* Move each photon through one cell, and queue it according to what it met there */
+
+    nstar = ndisk = nscat = nnext = 0;
+    for (n = 0; n < nmove; n++)
+    {
+      k = move[n];
+      if (trans_phot_move (w, &p[k], &ts[k]) == FALSE)
+        continue;
+
+      if (ts[k].istat == P_HIT_STAR)
+        star[nstar++] = k;
+      else if (ts[k].istat == P_HIT_DISK)
+        disk[ndisk++] = k;
+      else if (ts[k].istat == P_SCAT)
+        scat[nscat++] = k;
+      else if (trans_phot_end_step (&p[k], &ts[k]))
+        move[nnext++] = k;
+    }
+    nevents[0] += nmove;
+    nevents[1] += nstar;
+    nevents[2] += ndisk;
+    nevents[3] += nscat;
+
+    /* Process each of the other queues, returning the photons which continue to the move queue */
+
+    for (n = 0; n < nstar; n++)
+    {
+      k = star[n];
+      if (trans_phot_hit_star (w, &p[k], &ts[k], iextract) && trans_phot_end_step (&p[k], &ts[k]))
+        move[nnext++] = k;
+    }
+
+    for (n = 0; n < ndisk; n++)
+    {
+      k = disk[n];
+      if (trans_phot_hit_disk (w, &p[k], &ts[k], iextract) && trans_phot_end_step (&p[k], &ts[k]))
+        move[nnext++] = k;
+    }
+
+    trans_phot_sort_by_cell (ts, scat, nscat, work, count, ncell);
+    for (n = 0; n < nscat; n++)
+    {
+      k = scat[n];
+      if (trans_phot_scatter (w, &p[k], &ts[k], iextract) && trans_phot_end_step (&p[k], &ts[k]))
+        move[nnext++] = k;
+    }
+
+    nround++;
+
+    if ((nphot_flight - nnext) / nreport > nfinished / nreport)
+    {
+      Log ("%s Cycle %d/%d of %s : %10d of %10d photons have finished after %6d rounds\n",
+           geo.ioniz_or_extract == CYCLE_IONIZ ? " Ion." : "Spec.",
+           (geo.ioniz_or_extract == CYCLE_IONIZ ? geo.wcycle : geo.pcycle) + 1,
+           geo.ioniz_or_extract == CYCLE_IONIZ ? geo.wcycles : geo.pcycles, files.root, nphot_flight - nnext, nphot_flight, nround);
+      Log_flush ();
+    }
+    nfinished = nphot_flight - nnext;
+    nmove = nnext;
+
+    trans_phot_sort_by_cell (ts, move, nmove, work, count, ncell);
+  }
+
+  Log ("trans_phot_events: %d photons in %d rounds: %ld moves, %ld reflections from the star, %ld from the disk, %ld scatters\n",
+       nphot_flight, nround, nevents[0], nevents[1], nevents[2], nevents[3]);
+
+  free (ts);
+  free (move);
+  free (star);
+  free (disk);
+  free (scat);
+  free (work);
+  free (count);
+
+  return (nround);
+}
+
+
+
+/* The modified random walk (MRW) of Fleck & Canfield (1984).  A photon which has
+ * just been scattered by an electron, in a cell which is optically thick to electron
+ * scattering, would otherwise scatter of order tau^2 times before it left the cell,
+ * where tau is the optical depth to the walls of the cell.  Instead it is moved in a
+ * single step to the surface of a sphere of radius r about its position, which is
+ * contained in the cell, after a path length drawn from the solution of the diffusion
+ * equation in the sphere.  Lines, continuum absorption and Compton heating are not
+ * tracked during the step, so steps are only taken where they can be neglected.
+ */
+
+#define MRW_NTAB        200     /**< The number of points in the table of the escape probability */
+#define MRW_YMIN        1e-3    /**< The smallest dimensionless escape time in the table */
+#define MRW_YMAX        10.     /**< The largest dimensionless escape time in the table */
+#define MRW_SHRINK      0.99    /**< The radius of the sphere as a fraction of the distance to the nearest wall */
+#define MRW_DFREQ_MAX   0.05    /**< The largest fractional change in frequency from Compton scattering allowed in a step */
+#define MRW_TAU_ABS_MAX 0.1     /**< The largest continuum absorption optical depth allowed along the path of a step */
+
+static double mrw_y[MRW_NTAB], mrw_prob[MRW_NTAB];
+static int mrw_init = FALSE;
+static long mrw_nsteps = 0;     /**< The number of random walk steps taken since the last report */
+static double mrw_nscat = 0;    /**< The expected number of electron scatters these steps replaced */
+
+
+
+/**********************************************************/
+/**
+ * @brief      Find the probability that a photon which starts at the centre of a
+ * sphere has not yet reached its surface by the dimensionless time y
+ *
+ * @param [in] double  y   The time, in units of r^2/D, where D is the diffusion coefficient
+ * @return     The probability
+ *
+ * @details
+ * This is the solution of the diffusion equation in a sphere with an absorbing
+ * surface, P(y) = 2 sum (-1)^(n+1) exp (-(n pi)^2 y), which is summed until the
+ * terms become negligible.  The mean escape time is y=1/6.
+ *
+ **********************************************************/
+
+static double
+mrw_escape_prob (y)
+     double y;
+{
+  double prob, term;
+  int n;
+
+  prob = 0;
+  n = 1;
+  do
+  {
+    term = 2. * exp (-(n * PI) * (n * PI) * y);
+    prob += (n % 2) ? term : -term;
+    n++;
+  }
+  while (term > 1e-12);
+
+  return (prob);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Draw the dimensionless time a photon takes to reach the surface of a sphere
+ *
+ * @return     The time, in units of r^2/D
+ *
+ * @details
+ * The time is found by inverting a table of mrw_escape_prob, made on the first call,
+ * which is uniform in log y
+ *
+ **********************************************************/
+
+static double
+mrw_sample_y (void)
+{
+  double xi, frac;
+  int n, nlo, nhi;
+
+  if (mrw_init == FALSE)
+  {
+    for (n = 0; n < MRW_NTAB; n++)
+    {
+      mrw_y[n] = MRW_YMIN * pow (MRW_YMAX / MRW_YMIN, (double) n / (MRW_NTAB - 1));
+      mrw_prob[n] = mrw_escape_prob (mrw_y[n]);
+    }
+    mrw_init = TRUE;
+  }
+
+  xi = random_number (0.0, 1.0);
+
+  if (xi >= mrw_prob[0])
+    return (mrw_y[0]);
+  if (xi <= mrw_prob[MRW_NTAB - 1])
+    return (mrw_y[MRW_NTAB - 1]);
+
+  /* mrw_prob decreases with y */
+  nlo = 0;
+  nhi = MRW_NTAB - 1;
+  while (nhi - nlo > 1)
+  {
+    n = (nlo + nhi) >> 1;
+    if (mrw_prob[n] >= xi)
+      nlo = n;
+    else
+      nhi = n;
+  }
+
+  frac = (mrw_prob[nlo] - xi) / (mrw_prob[nlo] - mrw_prob[nhi]);
+
+  return (mrw_y[nlo] * pow (mrw_y[nhi] / mrw_y[nlo], frac));
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Find the radius of the largest sphere about a position which lies within its cell
+ *
+ * @param [in] int  ndom   The domain
+ * @param [in] int  n   The cell in wmain containing the position
+ * @param [in] double  x[]   The position
+ * @return     The radius, or 0 if the coordinate system is not supported
+ *
+ **********************************************************/
+
+static double
+mrw_radius (ndom, n, x)
+     int ndom, n;
+     double x[];
+{
+  double r, rho, z, theta, dtheta, dist;
+  int i, j;
+
+  wind_n_to_ij (ndom, n, &i, &j);
+
+  if (zdom[ndom].coord_type == CYLIND)
+  {
+    rho = sqrt (x[0] * x[0] + x[1] * x[1]);
+    z = fabs (x[2]);
+    dist = rho - zdom[ndom].wind_x[i];
+    dist = fmin (dist, zdom[ndom].wind_x[i + 1] - rho);
+    dist = fmin (dist, z - zdom[ndom].wind_z[j]);
+    dist = fmin (dist, zdom[ndom].wind_z[j + 1] - z);
+  }
+  else if (zdom[ndom].coord_type == SPHERICAL)
+  {
+    r = length (x);
+    dist = fmin (r - zdom[ndom].wind_x[i], zdom[ndom].wind_x[i + 1] - r);
+  }
+  else if (zdom[ndom].coord_type == RTHETA)
+  {
+    r = length (x);
+    dist = fmin (r - zdom[ndom].wind_x[i], zdom[ndom].wind_x[i + 1] - r);
+    theta = acos (fabs (x[2]) / r);
+    dtheta = fmin (theta - zdom[ndom].wind_z[j] / RADIAN, zdom[ndom].wind_z[j + 1] / RADIAN - theta);
+    dist = fmin (dist, r * sin (fmin (dtheta, 0.5 * PI)));
+  }
+  else
+  {
+    return (0.0);
+  }
+
+  return (dist > 0 ? MRW_SHRINK * dist : 0.0);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Move a photon which has just been scattered by an electron out of an optically
+ * thick region in one step of a modified random walk
+ *
+ * @param [in] WindPtr  w   The entire wind
+ * @param [in, out] PhotPtr  p   The photon, in the observer frame
+ * @param [in] int  iextract   If TRUE, extract the photon when it leaves the sphere
+ * @return     TRUE if the step was taken, FALSE if the photon was left alone
+ *
+ * @details
+ * A step is taken if the photon is in a cell which is entirely in the wind, and the
+ * electron scattering optical depth tau across the radius r of the largest sphere about
+ * the photon inside the cell is at least modes.mrw_tau.  The mean number of scatters the
+ * photon would take to leave the sphere is tau^2/2, and the step is refused if over these
+ * * the mean fractional frequency change from Compton scattering exceeds MRW_DFREQ_MAX,
+ * * the continuum absorption optical depth exceeds MRW_TAU_ABS_MAX (for simple atoms the
+ *   absorption that remains reduces the weight of the photon as usual),
+ * * there is a line within the range of frequencies over which the photon could wander,
+ *   from the velocity gradient across the sphere and the random walk in thermal Doppler
+ *   shifts.
+ *
+ * The path length s is drawn from the escape time distribution, and the estimators
+ * of the radiation field are incremented for s in straight segments of length less than r
+ * from the centre of the sphere in random directions, which keeps them in the cell.
+ * Each segment starts with the weight left after absorption in the earlier ones.
+ * The photon leaves from a random point on the sphere, with its frequency unchanged
+ * in the local frame, in a direction drawn from the cosine distribution about the
+ * outward normal.
+ *
+ * The step counts as a single scatter in p->nscat, so that MAXSCAT is still
+ * reached in a series of steps, but the electron scatters in the cell are incremented
+ * by the expected number of scatters.
+ *
+ **********************************************************/
+
+int
+mrw_step (w, p, iextract)
+     WindPtr w;
+     PhotPtr p;
+     int iextract;
+{
+  WindPtr one;
+  PlasmaPtr xplasma;
+  struct photon p_cmf, pseg, pextract;
+  double r, kap_es, tau_r, nscat, freq_cmf, delta, v_th;
+  double s, ds, wfrac, w_start;
+  double normal[3];
+  int n, ndom, nseg, iseg;
+
+  if (p->grid < 0 || p->grid >= geo.ndim2)
+    return (FALSE);
+
+  ndom = wmain[p->grid].ndom;
+  if ((n = where_in_grid (ndom, p->x)) < 0 || wmain[n].inwind != W_ALL_INWIND)
+    return (FALSE);
+
+  one = &wmain[n];
+  xplasma = &plasmamain[one->nplasma];
+
+  if ((r = mrw_radius (ndom, n, p->x)) <= 0)
+    return (FALSE);
+
+  p->grid = n;
+  observer_to_local_frame (p, &p_cmf);
+  freq_cmf = p_cmf.freq;
+
+  kap_es = klein_nishina (freq_cmf) * xplasma->ne * zdom[ndom].fill;
+  tau_r = kap_es * r;
+
+  if (tau_r < modes.mrw_tau)
+    return (FALSE);
+
+  nscat = 0.5 * tau_r * tau_r;
+
+  if ((PLANCK * freq_cmf + 4. * BOLTZMANN * xplasma->t_e) / (MELEC * VLIGHT * VLIGHT) * nscat > MRW_DFREQ_MAX)
+    return (FALSE);
+
+  if ((kappa_bf (xplasma, freq_cmf, 0) + kappa_ff (xplasma, freq_cmf)) * nscat / kap_es > MRW_TAU_ABS_MAX)
+    return (FALSE);
+
+  v_th = sqrt (2. * BOLTZMANN * xplasma->t_e / MELEC);
+  delta = (one->dvds_max * r + sqrt (nscat) * v_th) / VLIGHT;
+  if (limit_lines (freq_cmf * (1. - delta), freq_cmf * (1. + delta)) > 0)
+    return (FALSE);
+
+  /* The step will be taken.  Increment the estimators along the path */
+
+  s = 3. * kap_es * r * r * mrw_sample_y ();
+  nseg = ceil (s / r);
+  ds = s / nseg;
+  wfrac = 1.0;
+
+  for (iseg = 0; iseg < nseg; iseg++)
+  {
+    stuff_phot (&p_cmf, &pseg);
+    randvec (pseg.lmn, 1.0);
+    local_to_observer_frame (&pseg, &pseg);
+    pseg.w *= wfrac;            /* The weight which has not been absorbed in the earlier segments */
+    w_start = pseg.w;
+    increment_path_estimators (w, &pseg, ds);
+    wfrac *= pseg.w / w_start;
+  }
+
+  /* Move the photon to the surface of the sphere and scatter it outwards */
+
+  randvec (normal, 1.0);
+  p_cmf.x[0] += r * normal[0];
+  p_cmf.x[1] += r * normal[1];
+  p_cmf.x[2] += r * normal[2];
+  randvcos (p_cmf.lmn, normal);
+
+  local_to_observer_frame (&p_cmf, p);
+  p->w *= wfrac;
+  p->ds = 0;
+  p->nres = NRES_ES;
+  p->nscat++;
+  p->path += s;
+
+  xplasma->nscat_es += kap_es * s;
+  mrw_nsteps++;
+  mrw_nscat += kap_es * s;
+
+  if ((geo.reverb == REV_WIND || geo.reverb == REV_MATOM) && geo.ioniz_or_extract == CYCLE_IONIZ && geo.wcycle == geo.wcycles - 1)
+  {
+    wind_paths_add_phot (&wmain[n], p);
+  }
+
+  if (iextract)
+  {
+    /* The photon that is extracted is the one before its last scatter, which arrives
+       at the surface from a random direction */
+    stuff_phot (&p_cmf, &pextract);
+    randvec (pextract.lmn, 1.0);
+    local_to_observer_frame (&pextract, &pextract);
+    pextract.w = p->w;
+    pextract.nres = NRES_ES;
+    pextract.nnscat = 1;
+    extract (w, &pextract, PTYPE_WIND);
+  }
+
+  return (TRUE);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Log the number of random walk steps taken, and the electron scatters they replaced
+ *
+ * @return     Always returns 0
+ *
+ * @details
+ * This is called at the end of trans_phot, and the counts are reset
+ *
+ **********************************************************/
+
+int
+mrw_report (void)
+{
+  Log ("mrw_report: %ld modified random walk steps replaced %.3e electron scatters, saving %.3e steps\n", mrw_nsteps, mrw_nscat,
+       mrw_nscat - mrw_nsteps);
+
+  mrw_nsteps = 0;
+  mrw_nscat = 0;
 
   return (0);
 }
@@ -13,6 +13,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "atomic.h"
@@ -143,7 +144,9 @@ int ierr_vwind = 0;
  * this routine again.
  *
  * The routine checks to see whether the position for which the velocity is needed
- * and if so short-circuits the calculation returning a stored value
+ * and if so short-circuits the calculation returning a stored value.  Otherwise
+ * the interpolation is done by stencil_vwind, with a stencil that is kept from
+ * one call to the next.
  *
  * vwind_xyz expects the photon position to be in the Observer frame
  * It returns the velocity in the Observer frame.
@@ -159,18 +162,14 @@ struct vwind
   double v[3], pos[3];
 } xvwind[NVWIND];
 
+static struct wind_stencil vwind_stencil = {.ndom = -1 };
+
 int
 vwind_xyz (ndom, p, v)
      int ndom;
      PhotPtr p;
      double v[];
 {
-  int i;
-  double rho, r;
-  double vv[3];
-  double ctheta, stheta;
-  double x, frac[4];
-  int nn, nnn[4], nelem;
   int n;
 
   /* Check if the velocity for this position is in the buffer, and if so return that */
@@ -190,28 +189,137 @@ vwind_xyz (ndom, p, v)
     Error ("vwind_xyz: Received invalid domain  %d\n", ndom);
   }
 
-  coord_fraction (ndom, 0, p->x, nnn, frac, &nelem);
+  if (stencil_vwind (ndom, p->x, &vwind_stencil, v, NULL) < 0)
+  {
+    return (0);                 // The position is on the z axis, so it is not buffered
+  }
+
+  /* Now populate the buffer */
+
+
+  if (nvwind < NVWIND)
+  {
+    nvwind_last = nvwind;
+    nvwind++;
+  }
+  else
+  {
+    nvwind_last = (nvwind_last + 1) % NVWIND;
+  }
+
+
+  xvwind[nvwind_last].pos[0] = p->x[0];
+  xvwind[nvwind_last].pos[1] = p->x[1];
+  xvwind[nvwind_last].pos[2] = p->x[2];
+  xvwind[nvwind_last].v[0] = v[0];
+  xvwind[nvwind_last].v[1] = v[1];
+  xvwind[nvwind_last].v[2] = v[2];
+
+
+  return (0);
+}
+
+
+
+
+/**********************************************************/
+/**
+ * @brief      interpolates the velocity of the wind, and if wanted
+ * its gradient, at a position using a stencil
+ *
+ * @param [in] int  ndom   The domain of interest
+ * @param [in] double  x[]   The position, in the observer frame
+ * @param [in,out] StencilPtr  st   The stencil used for the last position, which
+ * is updated for this one
+ * @param [out] double  v[]   The velocity in cartesian coordinates, or NULL if it is not needed
+ * @param [out] double  v_grad[][3]   The velocity gradient tensor, or NULL if it is not needed
+ * @return     0 on success, -1 if the position is on the z axis, in which case
+ * only v[2] of the velocity is non zero
+ *
+ * @details
+ * This is the interpolation done by vwind_xyz, and also returns the interpolated
+ * velocity gradient, as used by dvwind_ds_cmf, from the same stencil.  The
+ * velocities and gradients at the vertices are only gathered from wmain when the
+ * vertices change, so calls for positions which are in the same cell, for example
+ * along the path of a photon, only need a few multiplications.
+ *
+ * As for the gradients stored in wmain, v_grad is for the xz plane, and has not been
+ * rotated to the position of x.
+ *
+ * Each caller should use its own stencil, see coord_stencil.
+ *
+ **********************************************************/
+
+int
+stencil_vwind (ndom, x, st, v, v_grad)
+     int ndom;
+     double x[];
+     StencilPtr st;
+     double v[];
+     double v_grad[][3];
+{
+  int i, j, k, nn;
+  double rho, r;
+  double vv[3];
+  double ctheta, stheta;
+  double xsum;
+
+  coord_stencil (ndom, x, st);
+
+  if (v_grad != NULL)
+  {
+    if (st->have_grad == FALSE)
+    {
+      for (nn = 0; nn < st->nelem; nn++)
+        memcpy (st->v_grad[nn], wmain[st->nnn[nn]].v_grad, sizeof (st->v_grad[nn]));
+      st->have_grad = TRUE;
+    }
+
+    for (j = 0; j < 3; j++)
+    {
+      for (k = 0; k < 3; k++)
+      {
+        xsum = 0;
+        for (nn = 0; nn < st->nelem; nn++)
+          xsum += st->v_grad[nn][j][k] * st->frac[nn];
+
+        v_grad[j][k] = xsum;
+      }
+    }
+  }
+
+  if (v == NULL)
+  {
+    return (0);
+  }
+
+  if (st->have_v == FALSE)
+  {
+    for (nn = 0; nn < st->nelem; nn++)
+      stuff_v (wmain[st->nnn[nn]].v, st->v[nn]);
+    st->have_v = TRUE;
+  }
 
   for (i = 0; i < 3; i++)
   {
 
-    x = 0;
-    for (nn = 0; nn < nelem; nn++)
-      x += wmain[nnn[nn]].v[i] * frac[nn];
+    xsum = 0;
+    for (nn = 0; nn < st->nelem; nn++)
+      xsum += st->v[nn][i] * st->frac[nn];
 
-    vv[i] = x;
+    vv[i] = xsum;
   }
 
-  rho = sqrt (p->x[0] * p->x[0] + p->x[1] * p->x[1]);
+  rho = sqrt (x[0] * x[0] + x[1] * x[1]);
 
   if (zdom[ndom].coord_type == SPHERICAL)
   {                             // put the velocity into cylindrical coordinates on the xz axis
-    x = sqrt (vv[0] * vv[0] + vv[2] * vv[2]);   //v_r
-    r = length (p->x);
-    vv[0] = rho / r * x;
-    vv[2] = p->x[2] / r * x;
+    xsum = sqrt (vv[0] * vv[0] + vv[2] * vv[2]);        //v_r
+    r = length (x);
+    vv[0] = rho / r * xsum;
+    vv[2] = x[2] / r * xsum;
   }
-  else if (p->x[2] < 0)         // For 2d coord syatems, velocity is reversed if the photon is in the lower hemisphere.
+  else if (x[2] < 0)            // For 2d coord syatems, velocity is reversed if the photon is in the lower hemisphere.
     vv[2] *= -1;
 
   if (rho == 0)
@@ -219,46 +327,23 @@ vwind_xyz (ndom, p, v)
     Error ("vwind_xyz: Cannot determine an xyz velocity on z axis. Returnin 0,0,v[2]\n");
     v[0] = v[1] = 0;
     v[2] = vv[2];
-    return (0);
+    return (-1);
   }
 
   /* Now we have v in cylindrical coordinates, but we would like it in cartesian coordinates.
      Note that could use project_from_cyl_xyz(p->x,vv,v) ?? */
 
-  ctheta = p->x[0] / rho;
-  stheta = p->x[1] / rho;
+  ctheta = x[0] / rho;
+  stheta = x[1] / rho;
   v[0] = vv[0] * ctheta - vv[1] * stheta;
   v[1] = vv[0] * stheta + vv[1] * ctheta;
   v[2] = vv[2];
 
-  /* Now populate the buffer */
-
-
-  if (nvwind < NVWIND)
-  {
-    nvwind_last = nvwind;
-    nvwind++;
-  }
-  else
-  {
-    nvwind_last = (nvwind_last + 1) % NVWIND;
-  }
-
-
-  xvwind[nvwind_last].pos[0] = p->x[0];
-  xvwind[nvwind_last].pos[1] = p->x[1];
-  xvwind[nvwind_last].pos[2] = p->x[2];
-  xvwind[nvwind_last].v[0] = v[0];
-  xvwind[nvwind_last].v[1] = v[1];
-  xvwind[nvwind_last].v[2] = v[2];
-
-
   return (0);
 }
 
 
 
-
 /**********************************************************/
 /**
  * @brief      calculates the divergence of the velocity at the center of all the grid cells.
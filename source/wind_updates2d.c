@@ -15,10 +15,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <sys/time.h>
 
 #include "atomic.h"
 #include "sirocco.h"
 
+/// The cell whose wind_update phases are being timed, or NULL if none is
+PlasmaPtr wu_profile_cell = NULL;
+
 /**********************************************************/
 /**
  * @brief      updates the parameters in the wind that are
@@ -60,6 +64,8 @@ wind_update (WindPtr w)
   double dt_r, dt_e;
   double t_r_ave_old, t_r_ave, t_e_ave_old, t_e_ave;
   int nmax_r, nmax_e;
+  int n_te_cells, n_te_evals, n_te_max, nmax_te;
+  double t_profile;
   int nwind;
   int my_nmin, my_nmax;         //Note that these variables are still used even without MPI on
   int ndom;
@@ -69,6 +75,8 @@ wind_update (WindPtr w)
   dt_e = 0.0;
   nmax_r = -1;
   nmax_e = -1;
+  n_te_cells = n_te_evals = n_te_max = 0;
+  nmax_te = -1;
   t_r_ave_old = 0.0;
   t_r_ave = 0.0;
   t_e_ave_old = 0.0;
@@ -76,6 +84,17 @@ wind_update (WindPtr w)
 
   xsignal (files.root, "%-20s Start wind update\n", "NOK");
 
+  if (modes.profile_wind_update)
+  {
+    for (n_plasma = 0; n_plasma < NPLASMA; ++n_plasma)
+    {
+      for (i = 0; i < WU_PHASE_NTYPES; i++)
+      {
+        plasmamain[n_plasma].wu_time[i] = 0.0;
+      }
+    }
+  }
+
 #ifdef MPI_ON
   n_cells_rank = get_parallel_nrange (rank_global, NPLASMA, np_mpi_global, &my_nmin, &my_nmax);
 #else
@@ -149,7 +168,15 @@ wind_update (WindPtr w)
     }
 
     /* Calculate the densities in various ways depending on the ioniz_mode */
+    plasmamain[n_plasma].te_nevals = 0;
+    if (modes.profile_wind_update)
+    {
+      wu_profile_cell = &plasmamain[n_plasma];
+    }
+    t_profile = wu_profile_start ();
     ion_abundances (&plasmamain[n_plasma], geo.ioniz_mode);
+    wu_profile_stop (WU_PHASE_ION_ABUNDANCES, t_profile);
+    wu_profile_cell = NULL;
   }
 
   /*This is the end of the update loop that is parallised. We now need to exchange data between the tasks. */
@@ -238,6 +265,18 @@ wind_update (WindPtr w)
       nmax_e = n_plasma;
     }
 
+    /* Record the cost of finding the electron temperature in the cells where calc_te was used */
+    if (plasmamain[n_plasma].te_nevals > 0)
+    {
+      n_te_cells++;
+      n_te_evals += plasmamain[n_plasma].te_nevals;
+      if (plasmamain[n_plasma].te_nevals > n_te_max)
+      {
+        n_te_max = plasmamain[n_plasma].te_nevals;
+        nmax_te = n_plasma;
+      }
+    }
+
     t_r_ave += plasmamain[n_plasma].t_r;
     t_e_ave += plasmamain[n_plasma].t_e;
     t_r_ave_old += plasmamain[n_plasma].t_r_old;
@@ -306,6 +345,23 @@ wind_update (WindPtr w)
     ("wind_update: mean intensity: %8.4e occurrences, this cycle, this thread of 'photon freq is outside frequency range of spectral model'\n",
      nerr_Jmodel_wrong_freq);
 
+  if (n_te_cells > 0)
+  {
+    Log ("wind_update: calc_te evaluated the cooling %.1f times per cell on average, with a maximum of %d in cell %d\n",
+         (double) n_te_evals / n_te_cells, n_te_max, nmax_te);
+  }
+
+  if (modes.profile_wind_update)
+  {
+    wind_update_profile_report ();
+  }
+
+  /* Decide which cells can be crossed in the next cycle without finding resonances */
+  if (modes.thin_cells)
+  {
+    thin_cells_update ();
+  }
+
   /* zero the counters which record diagnostics from the function mean_intensity */
   nerr_Jmodel_wrong_freq = 0;
   nerr_no_Jmodel = 0;
@@ -642,10 +698,7 @@ init_plasma_rad_properties (void)
       plasmamain[i].fmin[j] = geo.xfreq[j + 1]; /* Set the minium frequency to the max frequency in the band */
       plasmamain[i].fmax[j] = geo.xfreq[j];     /* Set the maximum frequency to the min frequency in the band */
     }
-    for (j = 0; j < NBINS_IN_CELL_SPEC; ++j)
-    {
-      plasmamain[i].cell_spec_flux[j] = 0.0;
-    }
+    cell_spec_zero (&plasmamain[i]);
 
     for (j = 0; j < nions; j++)
     {
@@ -961,3 +1014,163 @@ shell_output_wind_update_diagnostics (double xsum, double psum, double fsum, dou
     }
   }
 }
+
+/**********************************************************/
+/**
+ * @brief Start timing a phase of wind_update
+ *
+ * @return The current wall-clock time in seconds, or 0 if no cell is being profiled
+ *
+ * @details
+ *
+ * The value returned is passed to wu_profile_stop at the end of the phase.
+ * When modes.profile_wind_update is not set, wu_profile_cell is NULL and
+ * neither routine reads the clock, so the timers cost essentially nothing.
+ *
+ **********************************************************/
+
+double
+wu_profile_start (void)
+{
+  struct timeval tv;
+
+  if (wu_profile_cell == NULL)
+  {
+    return (0.0);
+  }
+
+  gettimeofday (&tv, NULL);
+
+  return (tv.tv_sec + 1.e-6 * tv.tv_usec);
+}
+
+/**********************************************************/
+/**
+ * @brief Stop timing a phase of wind_update and add the time to the cell being profiled
+ *
+ * @param [in] int phase    The phase being timed, one of wind_update_phase_enum
+ * @param [in] double t0    The time returned by wu_profile_start at the start of the phase
+ *
+ * @details
+ *
+ * The time is added to wu_time in the plasma cell being profiled, so phases which
+ * happen more than once per cell, such as matrix solves, are summed.
+ *
+ **********************************************************/
+
+void
+wu_profile_stop (int phase, double t0)
+{
+  struct timeval tv;
+
+  if (wu_profile_cell == NULL)
+  {
+    return;
+  }
+
+  gettimeofday (&tv, NULL);
+  wu_profile_cell->wu_time[phase] += tv.tv_sec + 1.e-6 * tv.tv_usec - t0;
+}
+
+/**********************************************************/
+/**
+ * @brief Write the per-cell timings of wind_update, and summarise them by rank
+ *
+ * @details
+ *
+ * This is called at the end of wind_update when modes.profile_wind_update is set,
+ * after the timings of every cell have been broadcast with the other updated plasma
+ * properties.  Rank 0 appends one line per plasma cell to the file
+ * diag_root/root.wind_update_profile.csv, giving the cycle, the cell, the rank which
+ * updated it and the time spent in each phase.  The file is overwritten by the first
+ * cycle of a run.
+ *
+ * The total time spent by each rank, and the cell which took the longest, are
+ * written to the log so that load imbalance between ranks can be seen directly.
+ *
+ **********************************************************/
+
+void
+wind_update_profile_report (void)
+{
+  static int first_call = TRUE;
+  char filename[LINELENGTH];
+  FILE *fptr;
+  int n_plasma, n_rank, i;
+  int n_start, n_stop;
+  int n_slowest;
+  double t_rank, t_rank_max, t_total;
+  double t_phase[WU_PHASE_NTYPES];
+
+  if (rank_global == 0)
+  {
+    sprintf (filename, "%.100s%.100s.wind_update_profile.csv", files.diagfolder, files.root);
+    if ((fptr = fopen (filename, first_call ? "w" : "a")) == NULL)
+    {
+      Error ("wind_update_profile_report: Unable to open %s\n", filename);
+      return;
+    }
+
+    if (first_call)
+    {
+      fprintf (fptr, "cycle,nplasma,nwind,rank,t_e,te_nevals,"
+               "ion_abundances,spectral_estimators,calc_te,macro_pops,matrix_solve,convergence\n");
+    }
+
+    for (n_rank = 0; n_rank < np_mpi_global; n_rank++)
+    {
+      get_parallel_nrange (n_rank, NPLASMA, np_mpi_global, &n_start, &n_stop);
+      for (n_plasma = n_start; n_plasma < n_stop; n_plasma++)
+      {
+        fprintf (fptr, "%d,%d,%d,%d,%.6e,%d", geo.wcycle, n_plasma, plasmamain[n_plasma].nwind, n_rank, plasmamain[n_plasma].t_e,
+                 plasmamain[n_plasma].te_nevals);
+        for (i = 0; i < WU_PHASE_NTYPES; i++)
+        {
+          fprintf (fptr, ",%.6e", plasmamain[n_plasma].wu_time[i]);
+        }
+        fprintf (fptr, "\n");
+      }
+    }
+
+    fclose (fptr);
+  }
+
+  first_call = FALSE;
+
+  for (i = 0; i < WU_PHASE_NTYPES; i++)
+  {
+    t_phase[i] = 0.0;
+  }
+
+  t_total = t_rank_max = 0.0;
+  n_slowest = 0;
+  for (n_rank = 0; n_rank < np_mpi_global; n_rank++)
+  {
+    get_parallel_nrange (n_rank, NPLASMA, np_mpi_global, &n_start, &n_stop);
+    t_rank = 0.0;
+    for (n_plasma = n_start; n_plasma < n_stop; n_plasma++)
+    {
+      t_rank += plasmamain[n_plasma].wu_time[WU_PHASE_ION_ABUNDANCES];
+      if (plasmamain[n_plasma].wu_time[WU_PHASE_ION_ABUNDANCES] > plasmamain[n_slowest].wu_time[WU_PHASE_ION_ABUNDANCES])
+      {
+        n_slowest = n_plasma;
+      }
+      for (i = 0; i < WU_PHASE_NTYPES; i++)
+      {
+        t_phase[i] += plasmamain[n_plasma].wu_time[i];
+      }
+    }
+    if (t_rank > t_rank_max)
+    {
+      t_rank_max = t_rank;
+    }
+    t_total += t_rank;
+  }
+
+  Log ("wind_update: profile: ion_abundances %.3f s, spectral_estimators %.3f s, calc_te %.3f s, macro_pops %.3f s, "
+       "matrix_solve %.3f s, convergence %.3f s summed over all cells\n",
+       t_phase[WU_PHASE_ION_ABUNDANCES], t_phase[WU_PHASE_SPECTRAL_ESTIMATORS], t_phase[WU_PHASE_CALC_TE],
+       t_phase[WU_PHASE_MACRO_POPS], t_phase[WU_PHASE_MATRIX_SOLVE], t_phase[WU_PHASE_CONVERGENCE]);
+  Log ("wind_update: profile: the slowest rank took %.3f s against a mean of %.3f s, the slowest cell was %d at %.3f s\n",
+       t_rank_max, t_total / np_mpi_global, n_slowest, plasmamain[n_slowest].wu_time[WU_PHASE_ION_ABUNDANCES]);
+}
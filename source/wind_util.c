@@ -26,6 +26,8 @@
 #include "sirocco.h"
 
 int ierr_coord_fraction = 0;
+static int stencil_generation = 0;
+static int stencil_vertices_fixed = FALSE;
 
 
 /**********************************************************/
@@ -204,6 +206,209 @@ coord_fraction (ndom, ichoice, x, ii, frac, nelem)
 
 
 
+/**********************************************************/
+/**
+ * @brief      check whether a value lies in the same interval of an array
+ * as a previous value, and if so find its fractional position in it
+ *
+ * @param [in] double  value   The value to be located
+ * @param [in] double  array[]   The array, in increasing order
+ * @param [in] int  npts   The number of elements in the array
+ * @param [in] int  i   The lower end of the interval which held the previous value
+ * @param [out] double *  f   The fractional position of value in the interval
+ * @return     TRUE if value is in the interval, FALSE otherwise
+ *
+ * @details
+ * The interval matches the one bisection in fraction would find, so
+ * the fractional position is the same as fraction would return.
+ *
+ **********************************************************/
+
+static int
+bracket_hint (value, array, npts, i, f)
+     double value;
+     double array[];
+     int npts, i;
+     double *f;
+{
+  if (i < 0 || i > npts - 2 || value > array[i + 1])
+    return (FALSE);
+  if (i == 0 ? value < array[0] : value <= array[i])
+    return (FALSE);
+
+  *f = (value - array[i]) / (array[i + 1] - array[i]);
+  return (TRUE);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      find the vertices and weights needed to interpolate
+ * quantities defined on the vertices of the grid, such as the velocity,
+ * at a position
+ *
+ * @param [in] int  ndom   The domain in where the interpolation will take place
+ * @param [in] double  x[]   the 3-vector position
+ * @param [in,out] StencilPtr  st   The stencil, which on input holds the
+ * vertices of the last position it was used for, and on output those of x
+ *
+ * @return     The same as coord_fraction
+ *
+ * @details
+ * This gives the same vertices and weights as coord_fraction with
+ * ichoice = 0, but photons usually take many steps within a cell, so the
+ * search of the grid starts by checking whether x is bracketed by the
+ * same vertices as the last position.  When the vertices change, the
+ * values gathered for them by stencil_vwind are marked as stale.
+ *
+ * Stencils belong to their callers, so this can be called by several
+ * threads at once, as long as each uses its own stencil.
+ *
+ * ### Notes ###
+ * For cylvar coordinates, the vertices are always found with
+ * coord_fraction.
+ *
+ **********************************************************/
+
+int
+coord_stencil (ndom, x, st)
+     int ndom;
+     double x[];
+     StencilPtr st;
+{
+  double r, z;
+  double *xx, *zz;
+  double dr, dz;
+  int ix, iz, nelem, n, istat;
+  int nnn[4];
+
+  for (n = 0; n < 4; n++)
+    nnn[n] = st->nnn[n];
+  nelem = st->nelem;
+
+  if (zdom[ndom].coord_type == CYLVAR)
+  {
+    istat = coord_fraction (ndom, 0, x, st->nnn, st->frac, &st->nelem);
+    st->ix = st->iz = -1;
+  }
+  else
+  {
+    xx = zdom[ndom].wind_x;
+    zz = zdom[ndom].wind_z;
+
+    r = z = 0.0;
+    if (zdom[ndom].coord_type == CYLIND)
+    {
+      r = sqrt (x[0] * x[0] + x[1] * x[1]);
+      z = fabs (x[2]);
+    }
+    else if (zdom[ndom].coord_type == RTHETA)
+    {
+      r = length (x);
+      z = acos (fabs (x[2]) / r) * RADIAN;
+    }
+    else if (zdom[ndom].coord_type == SPHERICAL)
+    {
+      r = length (x);
+    }
+    else
+    {
+      Error ("coord_stencil: Unknown coordinate type %d for domain %d\n", zdom[ndom].coord_type, ndom);
+      Exit (0);
+    }
+
+    ix = st->ix;
+    iz = st->iz;
+    if (st->ndom != ndom || bracket_hint (r, xx, zdom[ndom].ndim, ix, &dr) == FALSE)
+      fraction (r, xx, zdom[ndom].ndim, &ix, &dr, 0);
+
+    if (zdom[ndom].coord_type == SPHERICAL)
+    {
+      st->nnn[0] = ix;
+      st->frac[0] = (1. - dr);
+      st->nnn[1] = ix + 1;
+      st->frac[1] = dr;
+      st->nelem = 2;
+    }
+    else
+    {
+      if (st->ndom != ndom || bracket_hint (z, zz, zdom[ndom].mdim, iz, &dz) == FALSE)
+        fraction (z, zz, zdom[ndom].mdim, &iz, &dz, 0);
+
+      st->nnn[0] = ix * zdom[ndom].mdim + iz;
+      st->frac[0] = (1. - dz) * (1. - dr);
+
+      st->nnn[1] = (ix + 1) * zdom[ndom].mdim + iz;
+      st->frac[1] = (1. - dz) * dr;
+
+      st->nnn[2] = ix * zdom[ndom].mdim + iz + 1;
+      st->frac[2] = (dz) * (1. - dr);
+
+      st->nnn[3] = (ix + 1) * zdom[ndom].mdim + iz + 1;
+      st->frac[3] = (dz) * (dr);
+      st->nelem = 4;
+    }
+    st->ix = ix;
+    st->iz = iz;
+
+    if (r > xx[zdom[ndom].ndim - 1])
+      istat = -2;
+    else if (r < xx[0])
+      istat = -1;
+    else
+      istat = 1;
+  }
+
+  if (st->ndom != ndom || st->nelem != nelem || st->generation != stencil_generation || stencil_vertices_fixed == FALSE)
+  {
+    st->have_v = st->have_grad = FALSE;
+  }
+  else
+  {
+    for (n = 0; n < nelem; n++)
+    {
+      if (st->nnn[n] != nnn[n])
+        st->have_v = st->have_grad = FALSE;
+    }
+  }
+  st->ndom = ndom;
+  st->generation = stencil_generation;
+
+  return (istat);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      allow or stop stencils keeping the values of quantities
+ * at the vertices of the grid from one call to the next
+ *
+ * @param [in] int  fixed   TRUE if the wind will not change until this is
+ * called again, FALSE otherwise
+ * @return     Always returns 0
+ *
+ * @details
+ * The velocities in wmain are changed by many routines which set up or
+ * import winds, but not while photons are being transported, so
+ * trans_phot calls this with TRUE before transporting photons and with
+ * FALSE afterwards.  Either way, values gathered before the call are not
+ * used again.
+ *
+ **********************************************************/
+
+int
+stencil_cache_vertices (fixed)
+     int fixed;
+{
+  stencil_vertices_fixed = fixed;
+  stencil_generation++;
+  return (0);
+}
+
+
+
 int ierr_where_in_2dcell = 0;
 
 /**********************************************************/
@@ -59,6 +59,8 @@ wind_save (filename)
   int ndom;
   int m;
   int n;
+  int i;
+  int spec_mask[NCELL_SPEC_BLOCKS];
 
   if ((fptr = fopen (filename, "w")) == NULL)
   {
@@ -110,6 +112,21 @@ in the plasma structure */
     n += fwrite (plasmamain[m].recomb_simple, sizeof (double), nphot_total, fptr);
     n += fwrite (plasmamain[m].recomb_simple_upweight, sizeof (double), nphot_total, fptr);
     n += fwrite (plasmamain[m].kbf_use, sizeof (double), nphot_total, fptr);
+
+    /* Only the allocated blocks of the cell spectrum are written, following a mask of which are present */
+
+    for (i = 0; i < NCELL_SPEC_BLOCKS; i++)
+    {
+      spec_mask[i] = (plasmamain[m].cell_spec_block[i] != NULL);
+    }
+    n += fwrite (spec_mask, sizeof (int), NCELL_SPEC_BLOCKS, fptr);
+    for (i = 0; i < NCELL_SPEC_BLOCKS; i++)
+    {
+      if (spec_mask[i])
+      {
+        n += fwrite (plasmamain[m].cell_spec_block[i], sizeof (double), CELL_SPEC_BLOCK_SIZE, fptr);
+      }
+    }
   }
 
 /* Now write out the macro atom info */
@@ -190,7 +207,8 @@ wind_read (filename)
 {
   FILE *fptr;
   int ndom;
-  int n, m;
+  int n, m, i;
+  int spec_mask[NCELL_SPEC_BLOCKS];
   char header[LINELENGTH];
   char version[LINELENGTH];
   struct stat file_stat;        // Used to check the atomic data exists
@@ -285,6 +303,15 @@ wind_read (filename)
     n += fread (plasmamain[m].recomb_simple, sizeof (double), nphot_total, fptr);
     n += fread (plasmamain[m].recomb_simple_upweight, sizeof (double), nphot_total, fptr);
     n += fread (plasmamain[m].kbf_use, sizeof (double), nphot_total, fptr);
+
+    n += fread (spec_mask, sizeof (int), NCELL_SPEC_BLOCKS, fptr);
+    for (i = 0; i < NCELL_SPEC_BLOCKS; i++)
+    {
+      if (spec_mask[i])
+      {
+        n += fread (cell_spec_alloc_block (&plasmamain[m], i), sizeof (double), CELL_SPEC_BLOCK_SIZE, fptr);
+      }
+    }
   }
 
 
@@ -441,7 +441,7 @@ make_spec (inroot)
     for (int j = 0; j < spectra.num_wavelengths; j++)
     {
       // spectra.data[i][j] = (float) (i + j);
-      spectra.data[i][j] = (float) plasmamain[i].cell_spec_flux[j];
+      spectra.data[i][j] = (float) cell_spec_get (&plasmamain[i], j);
     }
   }
 
@@ -2016,7 +2016,7 @@ create_detailed_cell_spec_table (ncell, rootname)
 
   for (i = 0; i < NBINS_IN_CELL_SPEC; i++)
   {
-    flux[i] = plasmamain[nplasma].cell_spec_flux[i];
+    flux[i] = cell_spec_get (&plasmamain[nplasma], i);
   }
 
 
@@ -2049,8 +2049,8 @@ create_detailed_cell_spec_table (ncell, rootname)
  *
  * @details
  *
- * The routine simply reads data in stored in the cell_spec_flux
- * array of the Plasma structure
+ * The routine simply reads data in stored in the cell_spec_block
+ * arrays of the Plasma structure
  *
  * Notes:
  *
@@ -2159,7 +2159,7 @@ create_big_detailed_spec_table (ndom, rootname)
 
       for (n = nstart; n < nstop; n++)
       {
-        fprintf (fptr, "%10.3e ", plasmamain[nplasma[n]].cell_spec_flux[i]);
+        fprintf (fptr, "%10.3e ", cell_spec_get (&plasmamain[nplasma[n]], i));
       }
 
       fprintf (fptr, "\n");